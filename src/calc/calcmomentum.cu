@@ -15,10 +15,10 @@
 
 /* Compute the pressure gradient forcing for
    the W momentum equation */
-__host__ __device__ void calc_pgrad_u(float *pipert, float *thrhopert, float *qv0, float *th0, float *pgradu, \
+__host__ __device__ inline void calc_pgrad_u(field_t *pipert, field_t *thrhopert, float *qv0, float *th0, field_t *pgradu, \
 		                              float dx, int i, int j, int k, int NX, int NY) {
     // get dpi/dz
-    float *buf0 = pipert;
+    field_t *buf0 = pipert;
     float dpidx = (BUF(i, j, k) - BUF(i-1, j, k)) / dx;
 
     // get theta_rho on U points by averaging them
@@ -37,10 +37,10 @@ __host__ __device__ void calc_pgrad_u(float *pipert, float *thrhopert, float *qv
 
 /* Compute the pressure gradient forcing for
    the V momentum equation */
-__host__ __device__ void calc_pgrad_v(float *pipert, float *thrhopert, float *qv0, float *th0, float *pgradv, \
+__host__ __device__ inline void calc_pgrad_v(field_t *pipert, field_t *thrhopert, float *qv0, float *th0, field_t *pgradv, \
 		                              float dy, int i, int j, int k, int NX, int NY) {
     // get dpi/dz
-    float *buf0 = pipert;
+    field_t *buf0 = pipert;
     float dpidy = (BUF(i, j, k) - BUF(i, j-1, k)) / dy;
 
     // get theta_rho on V points by averaging them
@@ -58,10 +58,10 @@ __host__ __device__ void calc_pgrad_v(float *pipert, float *thrhopert, float *qv
 
 /* Compute the pressure gradient forcing for
    the W momentum equation */
-__host__ __device__ void calc_pgrad_w(float *pipert, float *thrhopert, float *qv0, float *th0, float *pgradw, \
+__host__ __device__ inline void calc_pgrad_w(field_t *pipert, field_t *thrhopert, float *qv0, float *th0, field_t *pgradw, \
 		                              float dz, int i, int j, int k, int NX, int NY) {
     // get dpi/dz
-    float *buf0 = pipert;
+    field_t *buf0 = pipert;
     float dpidz = (BUF(i, j, k) - BUF(i, j, k-1)) / dz;
 
     // get theta_rho on W points by averaging them
@@ -83,8 +83,8 @@ __host__ __device__ void calc_pgrad_w(float *pipert, float *thrhopert, float *qv
 
 /* Compute the buoyancy forcing
    the W momentum equation */
-__device__ void calc_buoyancy(float *thrhopert, float *th0, float *buoy, int i, int j, int k, int NX, int NY) {
-    float *buf0 = thrhopert;
+__host__ __device__ inline void calc_buoyancy(field_t *thrhopert, float *th0, field_t *buoy, int i, int j, int k, int NX, int NY) {
+    field_t *buf0 = thrhopert;
     // we need to get this all on staggered W grid
     // in CM1, geroge uses base state theta for buoyancy
     float buoy1 = g*(BUF(i, j, k)/th0[k]);
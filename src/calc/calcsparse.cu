@@ -0,0 +1,390 @@
+#include <iostream>
+#include <stdio.h>
+#include "../include/datastructs.h"
+#include "../include/constants.h"
+#include "../include/macros.h"
+#ifndef SPARSE_CALC
+#define SPARSE_CALC
+/*
+ * Copyright (C) 2017-2020 Kelton Halbert, Space Science and Engineering Center (SSEC), University of Wisconsin - Madison
+ * Written by Kelton Halbert at the University of Wisconsin - Madison,
+ * Cooperative Institute for Meteorological Satellite Studies (CIMSS),
+ * Space Science and Engineering Center (SSEC). Provided under the Apache 2.0 License.
+ * Email: kthalbert@wisc.edu
+*/
+
+/* Pointwise versions of the momentum budget stencils. Each of the pt_
+   functions returns the budget term at (i, j, k) of time tidx, or 0
+   outside of the range that term is defined on. The strain, stress, and
+   diffusion flux values get computed on the fly from the model fields, so
+   only pipert and rhof need to be on the grid already. The sparse budget
+   (see sparsebud.cpp) evaluates these at just the grid points the parcels
+   need, and the gridded budget in momentum.cu and momentum_cpu.cpp is
+   built out of the same pieces, so the two always agree. The buoyancy
+   and pressure gradient arithmetic is the same as in calcmomentum.cu, so
+   if that changes, this needs to change too. */
+
+// is (i, j, k) inside of [i0, i1) x [j0, j1) x [k0, k1)
+__host__ __device__ inline bool _in_range(int i, int j, int k, int i0, int i1, int j0, int j1, int k0, int k1) {
+    return (i >= i0) && (i < i1) && (j >= j0) && (j < j1) && (k >= k0) && (k < k1);
+}
+
+/* Buoyancy and pressure gradient forcing. Same as calc_buoyancy
+   and calc_pgrad_u/v/w along with the ranges in momentum_cpu.cpp */
+__host__ __device__ float pt_buoy(datagrid *grid, model_data *data, int tidx, int i, int j, int k) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    if (!_in_range(i, j, k, 0, NX+1, 0, NY+1, 1, NZ+1)) return 0.0;
+    float *th0 = grid->th0;
+    field_t *buf0 = &(data->thrhopert[P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1)]);
+    float buoy1 = g*(BUF(i, j, k)/th0[k]);
+    float buoy2 = g*(BUF(i, j, k-1)/th0[k-1]);
+    return 0.5*(buoy1 + buoy2);
+}
+
+__host__ __device__ float pt_pgradu(datagrid *grid, model_data *data, int tidx, int i, int j, int k) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    if (!_in_range(i, j, k, 1, NX, 0, NY+1, 0, NZ+1)) return 0.0;
+    long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+    float dx = xh(i) - xh(i-1);
+    field_t *buf0 = &(data->pipert[bufidx]);
+    float dpidx = (BUF(i, j, k) - BUF(i-1, j, k)) / dx;
+
+    buf0 = &(data->thrhopert[bufidx]);
+    float qvbar1 = grid->qv0[k];
+    float thbar1 = grid->th0[k]*(1.0+reps*qvbar1)/(1.0+qvbar1);
+    float thrhopert1 = BUF(i, j, k);
+    float thrhopert2 = BUF(i-1, j, k);
+    float thrhou = 0.5*( (thbar1 + thrhopert1) + (thbar1 + thrhopert2) );
+    return -cp*thrhou*dpidx;
+}
+
+__host__ __device__ float pt_pgradv(datagrid *grid, model_data *data, int tidx, int i, int j, int k) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    if (!_in_range(i, j, k, 0, NX+1, 1, NY, 0, NZ+1)) return 0.0;
+    long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+    float dy = yh(j) - yh(j-1);
+    field_t *buf0 = &(data->pipert[bufidx]);
+    float dpidy = (BUF(i, j, k) - BUF(i, j-1, k)) / dy;
+
+    buf0 = &(data->thrhopert[bufidx]);
+    float qvbar1 = grid->qv0[k];
+    float thbar1 = grid->th0[k]*(1.0+reps*qvbar1)/(1.0+qvbar1);
+    float thrhopert1 = BUF(i, j, k);
+    float thrhopert2 = BUF(i, j-1, k);
+    float thrhov = 0.5*( (thbar1 + thrhopert1) + (thbar1 + thrhopert2) );
+    return -cp*thrhov*dpidy;
+}
+
+__host__ __device__ float pt_pgradw(datagrid *grid, model_data *data, int tidx, int i, int j, int k) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    if (!_in_range(i, j, k, 0, NX+1, 0, NY+1, 1, NZ+1)) return 0.0;
+    long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+    float dz = zh(k) - zh(k-1);
+    field_t *buf0 = &(data->pipert[bufidx]);
+    float dpidz = (BUF(i, j, k) - BUF(i, j, k-1)) / dz;
+
+    buf0 = &(data->thrhopert[bufidx]);
+    float qvbar1 = grid->qv0[k];
+    float qvbar2 = grid->qv0[k-1];
+    float thbar1 = grid->th0[k]*(1.0+reps*qvbar1)/(1.0+qvbar1);
+    float thbar2 = grid->th0[k-1]*(1.0+reps*qvbar2)/(1.0+qvbar2);
+    float thrhopert1 = BUF(i, j, k);
+    float thrhopert2 = BUF(i, j, k-1);
+    float thrhow = 0.5*( (thbar1 + thrhopert1) + (thbar2 + thrhopert2) );
+    return -cp*thrhow*dpidz;
+}
+
+/* The stress tensor, tau_ij = 2 * km * rho * S_ij. KM is on the W
+   points, so it gets averaged to wherever each component lives. The _tau
+   functions do the arithmetic with the arrays already offset to the
+   time level, and the _pt_tau ones add the range checks on top. */
+__host__ __device__ inline float _tau11(datagrid *grid, field_t *ustag, field_t *kmstag, field_t *rhopert, int i, int j, int k, int NX, int NY) {
+    field_t *buf0 = rhopert;
+    float dx = xf(i+1) - xf(i);
+    float rho1 = BUF(i, j, k) + grid->rho0[k];
+    float s11 = rho1 * (UA(i+1, j, k) - UA(i, j, k)) * (1./dx);
+    float kmval = 0.5*(KM(i, j, k) + KM(i, j, k+1));
+    return 2.0 * kmval * s11;
+}
+
+__host__ __device__ inline float _tau22(datagrid *grid, field_t *vstag, field_t *kmstag, field_t *rhopert, int i, int j, int k, int NX, int NY) {
+    field_t *buf0 = rhopert;
+    float dy = yf(j+1) - yf(j);
+    float rho1 = BUF(i, j, k) + grid->rho0[k];
+    float s22 = rho1 * (VA(i, j+1, k) - VA(i, j, k)) * (1./dy);
+    float kmval = 0.5*(KM(i, j, k) + KM(i, j, k+1));
+    return 2.0 * kmval * s22;
+}
+
+__host__ __device__ inline float _tau33(datagrid *grid, field_t *wstag, field_t *kmstag, field_t *rhopert, int i, int j, int k, int NX, int NY) {
+    field_t *buf0 = rhopert;
+    float dz = zf(k+1) - zf(k);
+    float rho1 = BUF(i, j, k) + grid->rho0[k];
+    float s33 = rho1 * (WA(i, j, k+1) - WA(i, j, k)) * (1./dz);
+    float kmval = 0.5*(KM(i, j, k) + KM(i, j, k+1));
+    return 2.0 * kmval * s33;
+}
+
+__host__ __device__ inline float _tau12(datagrid *grid, field_t *ustag, field_t *vstag, field_t *kmstag, field_t *rhopert, int i, int j, int k, int NX, int NY) {
+    field_t *buf0 = rhopert;
+    float *rho0 = grid->rho0;
+    float dx = xf(i+1) - xf(i);
+    float dy = yf(j+1) - yf(j);
+	float rho1 = BUF(i, j, k) + rho0[k];
+	float rho2 = BUF(i-1, j-1, k) + rho0[k];
+	float rho3 = BUF(i-1, j, k) + rho0[k];
+	float rho4 = BUF(i, j-1, k) + rho0[k];
+	float s12 = 0.5*( (UA(i, j, k) - UA(i, j-1, k))*(1./dy) \
+			       +  (VA(i, j, k) - VA(i-1, j, k))*(1./dx) ) \
+			  *0.25*( (rho1+rho2+rho3+rho4) );
+	float kmval = 0.125 * ( ( (KM(i-1,j-1,k  )+KM(i,j,k  ))+(KM(i-1,j,k  )+KM(i,j-1,k  )) )   \
+                         +  ( (KM(i-1,j-1,k+1)+KM(i,j,k+1))+(KM(i-1,j,k+1)+KM(i,j-1,k+1)) ) );
+    return 2.0 * kmval * s12;
+}
+
+__host__ __device__ inline float _tau13(datagrid *grid, field_t *ustag, field_t *wstag, field_t *kmstag, field_t *rhof, int i, int j, int k, int NX, int NY) {
+    field_t *buf0 = rhof;
+    float dx = xf(i) - xf(i-1);
+    float dz = zf(k) - zf(k-1);
+	float rf1 = BUF(i, j, k);
+	float rf2 = BUF(i-1, j, k);
+	float s13 = 0.5*( (WA(i, j, k) - WA(i-1, j, k))*(1./dx) \
+				    + (UA(i, j, k) - UA(i, j, k-1))*(1./dz) ) \
+			  *0.5*(rf1 + rf2);
+	float kmval = 0.5 * (KM(i, j, k) + KM(i-1, j, k));
+    return 2.0 * kmval * s13;
+}
+
+__host__ __device__ inline float _tau23(datagrid *grid, field_t *vstag, field_t *wstag, field_t *kmstag, field_t *rhof, int i, int j, int k, int NX, int NY) {
+    field_t *buf0 = rhof;
+    float dy = yf(j) - yf(j-1);
+    float dz = zf(k) - zf(k-1);
+	float rf1 = BUF(i, j, k);
+	float rf3 = BUF(i, j-1, k);
+	float s23 = 0.5*( (WA(i, j, k) - WA(i, j-1, k))*(1./dy) \
+				    + (VA(i, j, k) - VA(i, j, k-1))*(1./dz) ) \
+			  *0.5*(rf1 + rf3);
+	float kmval = 0.5 * (KM(i, j, k) + KM(i, j-1, k));
+    return 2.0 * kmval * s23;
+}
+
+__host__ __device__ float _pt_tau11(datagrid *grid, model_data *data, int tidx, int i, int j, int k) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    if (!_in_range(i, j, k, 0, NX, 0, NY, 0, NZ)) return 0.0;
+    long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+    return _tau11(grid, &(data->ustag[bufidx]), &(data->kmh[bufidx]), &(data->rhopert[bufidx]), i, j, k, NX, NY);
+}
+
+__host__ __device__ float _pt_tau22(datagrid *grid, model_data *data, int tidx, int i, int j, int k) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    if (!_in_range(i, j, k, 0, NX, 0, NY, 0, NZ)) return 0.0;
+    long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+    return _tau22(grid, &(data->vstag[bufidx]), &(data->kmh[bufidx]), &(data->rhopert[bufidx]), i, j, k, NX, NY);
+}
+
+__host__ __device__ float _pt_tau33(datagrid *grid, model_data *data, int tidx, int i, int j, int k) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    if (!_in_range(i, j, k, 0, NX, 0, NY, 0, NZ)) return 0.0;
+    long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+    return _tau33(grid, &(data->wstag[bufidx]), &(data->kmh[bufidx]), &(data->rhopert[bufidx]), i, j, k, NX, NY);
+}
+
+__host__ __device__ float _pt_tau12(datagrid *grid, model_data *data, int tidx, int i, int j, int k) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    if (!_in_range(i, j, k, 0, NX, 0, NY, 0, NZ)) return 0.0;
+    long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+    return _tau12(grid, &(data->ustag[bufidx]), &(data->vstag[bufidx]), &(data->kmh[bufidx]), &(data->rhopert[bufidx]), i, j, k, NX, NY);
+}
+
+__host__ __device__ float _pt_tau13(datagrid *grid, model_data *data, int tidx, int i, int j, int k) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    if (!_in_range(i, j, k, 2, NX+1, 2, NY+1, 2, NZ)) return 0.0;
+    long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+    return _tau13(grid, &(data->ustag[bufidx]), &(data->wstag[bufidx]), &(data->kmh[bufidx]), &(data->rhof[bufidx]), i, j, k, NX, NY);
+}
+
+__host__ __device__ float _pt_tau23(datagrid *grid, model_data *data, int tidx, int i, int j, int k) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    if (!_in_range(i, j, k, 2, NX+1, 2, NY+1, 2, NZ)) return 0.0;
+    long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+    return _tau23(grid, &(data->vstag[bufidx]), &(data->wstag[bufidx]), &(data->kmh[bufidx]), &(data->rhof[bufidx]), i, j, k, NX, NY);
+}
+
+/* Momentum tendency from turbulence closure, which is
+   the divergence of the stress tensor divided by rho */
+__host__ __device__ float pt_turbu(datagrid *grid, model_data *data, int tidx, int i, int j, int k) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    if (!_in_range(i, j, k, 0, NX+1, 0, NY, 0, NZ)) return 0.0;
+    float dx = xf(i) - xf(i-1);
+    float dy = yf(j+1) - yf(j);
+    float dz = zf(k+1) - zf(k);
+    float turbx = ((_pt_tau11(grid, data, tidx, i, j, k) - _pt_tau11(grid, data, tidx, i-1, j, k)) / dx);
+    float turby = ((_pt_tau12(grid, data, tidx, i, j+1, k) - _pt_tau12(grid, data, tidx, i, j, k)) / dy);
+    float turbz = ((_pt_tau13(grid, data, tidx, i, j, k+1) - _pt_tau13(grid, data, tidx, i, j, k)) / dz);
+
+    float *rho0 = grid->rho0;
+    field_t *buf0 = &(data->rhopert[P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1)]);
+    float rru0 = 1.0 / (0.5 * ((BUF(i-1, j, k) + rho0[k]) + (BUF(i, j, k) + rho0[k])));
+    return ( turbx + turby + turbz ) * rru0;
+}
+
+__host__ __device__ float pt_turbv(datagrid *grid, model_data *data, int tidx, int i, int j, int k) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    if (!_in_range(i, j, k, 0, NX, 0, NY+1, 0, NZ)) return 0.0;
+    float dx = xf(i+1) - xf(i);
+    float dy = yf(j) - yf(j-1);
+    float dz = zf(k+1) - zf(k);
+    float turbx = ((_pt_tau12(grid, data, tidx, i+1, j, k) - _pt_tau12(grid, data, tidx, i, j, k)) / dx);
+    float turby = ((_pt_tau22(grid, data, tidx, i, j, k) - _pt_tau22(grid, data, tidx, i, j-1, k)) / dy);
+    float turbz = ((_pt_tau23(grid, data, tidx, i, j, k+1) - _pt_tau23(grid, data, tidx, i, j, k)) / dz);
+
+    float *rho0 = grid->rho0;
+    field_t *buf0 = &(data->rhopert[P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1)]);
+    float rrv0 = 1.0 / (0.5 * ((BUF(i, j-1, k) + rho0[k]) + (BUF(i, j, k) + rho0[k])));
+    return ( turbx + turby + turbz ) * rrv0;
+}
+
+__host__ __device__ float pt_turbw(datagrid *grid, model_data *data, int tidx, int i, int j, int k) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    if (!_in_range(i, j, k, 0, NX, 0, NY, 1, NZ)) return 0.0;
+    float dx = xf(i+1) - xf(i);
+    float dy = yf(j+1) - yf(j);
+    float dz = zf(k) - zf(k-1);
+    float turbx = ((_pt_tau13(grid, data, tidx, i+1, j, k) - _pt_tau13(grid, data, tidx, i, j, k)) / dx);
+    float turby = ((_pt_tau23(grid, data, tidx, i, j+1, k) - _pt_tau23(grid, data, tidx, i, j, k)) / dy);
+    float turbz = ((_pt_tau33(grid, data, tidx, i, j, k) - _pt_tau33(grid, data, tidx, i, j, k-1)) / dz);
+
+    field_t *buf0 = &(data->rhof[P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1)]);
+    float rrf = 1.0 / BUF(i, j, k);
+    return ( turbx + turby + turbz ) * rrf;
+}
+
+/* The 6th order diffusion fluxes, with the flux set to 0 wherever
+   it would go up the gradient. buf0 is the U, V, or W field at this time,
+   and base is the base state to subtract off in the vertical, or
+   NULL if there isn't one. Like the stresses, the _diff6 functions
+   are the arithmetic and the _pt_diff ones add the range checks. */
+__host__ __device__ inline float _diff6x(field_t *buf0, int i, int j, int k, int NX, int NY) {
+    float pval = ( 10.0*( BUF(i  , j, k) - BUF(i-1, j, k) ) \
+                   -5.0*( BUF(i+1, j, k) - BUF(i-2, j, k) ) \
+                       +( BUF(i+2, j, k) - BUF(i-3, j, k) ) );
+    if ( pval*(BUF(i,j,k)-BUF(i-1,j,k)) <= 0.0 ) {
+        pval = 0.0;
+    }
+    return pval;
+}
+
+__host__ __device__ inline float _diff6y(field_t *buf0, int i, int j, int k, int NX, int NY) {
+    float pval = ( 10.0*( BUF(i, j  , k) - BUF(i, j-1, k) ) \
+                   -5.0*( BUF(i, j+1, k) - BUF(i, j-2, k) ) \
+                       +( BUF(i, j+2, k) - BUF(i, j-3, k) ) );
+    if ( pval*(BUF(i,j,k)-BUF(i,j-1,k)) <= 0.0 ) {
+        pval = 0.0;
+    }
+    return pval;
+}
+
+__host__ __device__ inline float _diff6z(field_t *buf0, float *base, int i, int j, int k, int NX, int NY) {
+    float b1 = 0.0; float b2 = 0.0; float b3 = 0.0;
+    float b4 = 0.0; float b5 = 0.0; float b6 = 0.0;
+    if (base != NULL) {
+        b1 = base[k-0]; b2 = base[k-1]; b3 = base[k+1];
+        b4 = base[k-2]; b5 = base[k+2]; b6 = base[k-3];
+    }
+    float pval = ( 10.0*( (BUF(i, j, k  ) - b1) - (BUF(i, j, k-1) - b2) ) \
+                   -5.0*( (BUF(i, j, k+1) - b3) - (BUF(i, j, k-2) - b4) ) \
+                       +( (BUF(i, j, k+2) - b5) - (BUF(i, j, k-3) - b6) ) );
+    if ( pval*( (BUF(i,j,k)-b1)-(BUF(i,j,k-1)-b2) ) <= 0.0 ) {
+        pval = 0.0;
+    }
+    return pval;
+}
+
+__host__ __device__ float _pt_diffx(field_t *buf0, int i, int j, int k, int NX, int NY, int NZ) {
+    if (!_in_range(i, j, k, 3, NX-3, 3, NY-3, 3, NZ-4)) return 0.0;
+    return _diff6x(buf0, i, j, k, NX, NY);
+}
+
+__host__ __device__ float _pt_diffy(field_t *buf0, int i, int j, int k, int NX, int NY, int NZ) {
+    if (!_in_range(i, j, k, 3, NX-3, 3, NY-3, 3, NZ-4)) return 0.0;
+    return _diff6y(buf0, i, j, k, NX, NY);
+}
+
+__host__ __device__ float _pt_diffz(datagrid *grid, field_t *buf0, float *base, int i, int j, int k, int NX, int NY, int NZ) {
+    // the lower boundary condition when the bottom of the grid is
+    // the surface. This has always been applied one point over in i
+    // and j from the stencil (it used to index the flux array without
+    // the ghost point offset), and is kept that way so that the
+    // results don't change.
+    if ((zf(0) == 0.0) && (k <= 2) && _in_range(i, j, 0, 2, NX-4, 2, NY-4, 0, 1)) {
+        if (k == 2) return -1.0*_pt_diffz(grid, buf0, base, i, j, 4, NX, NY, NZ);
+        if (k == 1) return _pt_diffz(grid, buf0, base, i, j, 3, NX, NY, NZ);
+        return 0.0;
+    }
+    if (!_in_range(i, j, k, 3, NX-3, 3, NY-3, 3, NZ-4)) return 0.0;
+    return _diff6z(buf0, base, i, j, k, NX, NY);
+}
+
+/* Momentum tendency from 6th order diffusion of the U, V, or W
+   field in arr, which is the difference of the fluxes */
+__host__ __device__ float pt_diff(datagrid *grid, field_t *arr, float *base, int tidx, int i, int j, int k) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    if (!_in_range(i, j, k, 0, NX+1, 0, NY+1, 0, NZ)) return 0.0;
+    field_t *buf0 = &(arr[P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1)]);
+    const float coeff = (kdiff6/64.0/grid->dt);
+    float xten = coeff*(_pt_diffx(buf0, i+1, j, k, NX, NY, NZ) - _pt_diffx(buf0, i, j, k, NX, NY, NZ));
+    float yten = coeff*(_pt_diffy(buf0, i, j+1, k, NX, NY, NZ) - _pt_diffy(buf0, i, j, k, NX, NY, NZ));
+    float zten = coeff*(_pt_diffz(grid, buf0, base, i, j, k+1, NX, NY, NZ) - _pt_diffz(grid, buf0, base, i, j, k, NX, NY, NZ));
+    return xten + yten + zten;
+}
+
+/* Every term of the momentum budget at (i, j, k) of time tidx, written
+   straight into the output arrays. This is the whole gridded budget in a
+   single pass, with no strain, stress, or flux arrays in between. Points
+   outside of the range a term is defined on get 0. */
+__host__ __device__ inline void calc_momentum_bud(datagrid *grid, model_data *data, int tidx, int i, int j, int k) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    long idx = P4(i+1, j+1, k, tidx, NX+2, NY+2, NZ+1);
+    data->buoy[idx] = pt_buoy(grid, data, tidx, i, j, k);
+    data->pgradu[idx] = pt_pgradu(grid, data, tidx, i, j, k);
+    data->pgradv[idx] = pt_pgradv(grid, data, tidx, i, j, k);
+    data->pgradw[idx] = pt_pgradw(grid, data, tidx, i, j, k);
+    data->diffu[idx] = pt_diff(grid, data->ustag, grid->u0, tidx, i, j, k);
+    data->diffv[idx] = pt_diff(grid, data->vstag, grid->v0, tidx, i, j, k);
+    data->diffw[idx] = pt_diff(grid, data->wstag, NULL, tidx, i, j, k);
+    data->turbu[idx] = pt_turbu(grid, data, tidx, i, j, k);
+    data->turbv[idx] = pt_turbv(grid, data, tidx, i, j, k);
+    data->turbw[idx] = pt_turbw(grid, data, tidx, i, j, k);
+}
+
+#endif
@@ -1,5 +1,6 @@
 #include <iostream>
 #include <stdio.h>
+#include <math.h>
 #include "../include/datastructs.h"
 #include "../include/constants.h"
 #include "../include/macros.h"
@@ -30,38 +31,37 @@
    RETURNS
    pipert: unitless
  */
-__device__ void calc_pipert(float *prespert, float *p0, float *pipert, int i, int j, int k, int NX, int NY) {
-    float *buf0 = prespert; 
+__host__ __device__ void calc_pipert(field_t *prespert, float *p0, field_t *pipert, int i, int j, int k, int NX, int NY) {
+    field_t *buf0 = prespert; 
     float p = BUF(i, j, k)*100 + p0[k]; ; // convert from hPa to Pa 
     buf0 = pipert;
     BUF(i, j, k) = pow( p * rp00, rovcp) - pow( p0[k] * rp00, rovcp); 
 }
 
-/*  Compute the component of vorticity along the x-axis.
-    This stencil does not handle averaging the values
-    to the scalar grid, and dx and dy are passed as
-    arguments to the stencil. 
+/*  Compute the component of vorticity along the x-axis
+    on its staggered mesh at (i, j, k). This stencil does
+    not handle averaging the values to the scalar grid,
+    and dy and dz are passed as arguments to the stencil.
    
     INPUT
     vstag: meters/second
     wstag: meters/second
-    dx: meters
     dy: meters
+    dz: meters
 
-    OUTPUT:
+    RETURNS:
     xvort: 1/second
  */
-__device__ void calc_xvort(float *vstag, float *wstag, float *xvort, float dy, float dz, int i, int j, int k, int NX, int NY) {
-    float *dum0 = xvort;
+__host__ __device__ inline float _xvort_stag(field_t *vstag, field_t *wstag, float dy, float dz, int i, int j, int k, int NX, int NY) {
     float dwdy = ( ( WA(i, j, k) - WA(i, j-1, k) )/dy );
     float dvdz = ( ( VA(i, j, k) - VA(i, j, k-1) )/dz );
-    TEM(i, j, k) = dwdy - dvdz; 
+    return dwdy - dvdz; 
 }
 
-/*  Compute the component of vorticity along the y-axis.
-    This stencil does not handle averaging the values
-    to the scalar grid, and dx and dy are passed as
-    arguments to the stencil. 
+/*  Compute the component of vorticity along the y-axis
+    on its staggered mesh at (i, j, k). This stencil does
+    not handle averaging the values to the scalar grid,
+    and dx and dz are passed as arguments to the stencil.
    
     INPUT
     ustag: meters/second
@@ -69,20 +69,19 @@ __device__ void calc_xvort(float *vstag, float *wstag, float *xvort, float dy, f
     dx: meters
     dz: meters
 
-    OUTPUT:
+    RETURNS:
     yvort: 1/second
  */
-__device__ void calc_yvort(float *ustag, float *wstag, float *yvort, float dx, float dz, int i, int j, int k, int NX, int NY) {
-    float *dum0 = yvort;
+__host__ __device__ inline float _yvort_stag(field_t *ustag, field_t *wstag, float dx, float dz, int i, int j, int k, int NX, int NY) {
     float dwdx = ( ( WA(i, j, k) - WA(i-1, j, k) )/dx );
     float dudz = ( ( UA(i, j, k) - UA(i, j, k-1) )/dz );
-    TEM(i, j, k) = dudz - dwdx;
+    return dudz - dwdx;
 }
 
-/*  Compute the component of vorticity along the z-axis.
-    This stencil does not handle averaging the values
-    to the scalar grid, and dx and dy are passed as
-    arguments to the stencil. 
+/*  Compute the component of vorticity along the z-axis
+    on its staggered mesh at (i, j, k). This stencil does
+    not handle averaging the values to the scalar grid,
+    and dx and dy are passed as arguments to the stencil.
    
     INPUT
     ustag: meters/second
@@ -90,51 +89,117 @@ __device__ void calc_yvort(float *ustag, float *wstag, float *yvort, float dx, f
     dx: meters
     dy: meters
 
-    OUTPUT:
+    RETURNS:
     zvort: 1/second
  */
-__device__ void calc_zvort(float *ustag, float *vstag, float *zvort, float dx, float dy, int i, int j, int k, int NX, int NY) {
-    float *dum0 = zvort;
+__host__ __device__ inline float _zvort_stag(field_t *ustag, field_t *vstag, float dx, float dy, int i, int j, int k, int NX, int NY) {
     float dvdx = ( ( VA(i, j, k) - VA(i-1, j, k) )/dx);
     float dudy = ( ( UA(i, j, k) - UA(i, j-1, k) )/dy);
-    TEM(i, j, k) = dvdx - dudy;
+    return dvdx - dudy;
+}
+
+/*  The staggered vorticity components with the bounds and lower
+    boundary condition handled. The result is zero outside of where
+    the stencil is defined, and when the bottom of the grid is the
+    surface the lowest level of x and y vorticity is a copy of the
+    one above it. These are the values calc_vort_avg averages. */
+__host__ __device__ inline float calc_xvort(datagrid *grid, field_t *vstag, field_t *wstag, int i, int j, int k) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    // lower boundary condition of stencil
+    if ((k == 0) && (zf(0) == 0)) k = 1;
+    if ((i >= NX) || (j >= NY+1) || (k < 1) || (k >= NZ)) return 0.0;
+    return _xvort_stag(vstag, wstag, yf(j) - yf(j-1), zf(k) - zf(k-1), i, j, k, NX, NY);
+}
+
+__host__ __device__ inline float calc_yvort(datagrid *grid, field_t *ustag, field_t *wstag, int i, int j, int k) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    // lower boundary condition of stencil
+    if ((k == 0) && (zf(0) == 0)) k = 1;
+    if ((i >= NX+1) || (j >= NY) || (k < 1) || (k >= NZ+1)) return 0.0;
+    return _yvort_stag(ustag, wstag, xf(i) - xf(i-1), zf(k) - zf(k-1), i, j, k, NX, NY);
+}
+
+__host__ __device__ inline float calc_zvort(datagrid *grid, field_t *ustag, field_t *vstag, int i, int j, int k) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    if ((i >= NX+1) || (j >= NY+1) || (k >= NZ+1)) return 0.0;
+    return _zvort_stag(ustag, vstag, xf(i) - xf(i-1), yf(j) - yf(j-1), i, j, k, NX, NY);
+}
+
+/*  Compute all 3 components of vorticity on the scalar grid at
+    (i, j, k). Each one is the average of the 4 points on its own
+    staggered mesh that surround the scalar point, computed right
+    here instead of being stored in a temporary array first. This
+    works for the curl of any vector on the U/V/W meshes, like the
+    momentum diffusion and turbulence tendencies, not just the wind.
+
+    INPUT
+    ustag: meters/second
+    vstag: meters/second
+    wstag: meters/second
+
+    OUTPUT:
+    xvort: 1/second
+    yvort: 1/second
+    zvort: 1/second
+ */
+__host__ __device__ void calc_vort_avg(datagrid *grid, field_t *ustag, field_t *vstag, field_t *wstag, \
+                                       field_t *xvort, field_t *yvort, field_t *zvort, int i, int j, int k) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    field_t *buf0 = xvort;
+    BUF(i, j, k) = 0.25 * ( calc_xvort(grid, vstag, wstag, i, j, k) + calc_xvort(grid, vstag, wstag, i, j+1, k) + \
+                            calc_xvort(grid, vstag, wstag, i, j, k+1) + calc_xvort(grid, vstag, wstag, i, j+1, k+1) );
+
+    buf0 = yvort;
+    BUF(i, j, k) = 0.25 * ( calc_yvort(grid, ustag, wstag, i, j, k) + calc_yvort(grid, ustag, wstag, i+1, j, k) + \
+                            calc_yvort(grid, ustag, wstag, i, j, k+1) + calc_yvort(grid, ustag, wstag, i+1, j, k+1) );
+
+    buf0 = zvort;
+    BUF(i, j, k) = 0.25 * ( calc_zvort(grid, ustag, vstag, i, j, k) + calc_zvort(grid, ustag, vstag, i+1, j, k) + \
+                            calc_zvort(grid, ustag, vstag, i, j+1, k) + calc_zvort(grid, ustag, vstag, i+1, j+1, k) );
 }
 
-__device__ void calc_dudy(float *ustag, float *dudy, float dy, int i, int j, int k, int NX, int NY) {
-	float *dum0 = dudy;
+__host__ __device__ void calc_dudy(field_t *ustag, field_t *dudy, float dy, int i, int j, int k, int NX, int NY) {
+	field_t *dum0 = dudy;
 	TEM(i, j, k) = ( UA(i, j, k) - UA(i, j-1, k) ) / dy;
 }
 
-__device__ void calc_dudz(float *ustag, float *dudz, float dz, int i, int j, int k, int NX, int NY) {
-	float *dum0 = dudz;
+__host__ __device__ void calc_dudz(field_t *ustag, field_t *dudz, float dz, int i, int j, int k, int NX, int NY) {
+	field_t *dum0 = dudz;
 	TEM(i, j, k) = ( UA(i, j, k) - UA(i, j, k-1) ) / dz;
 }
 
-__device__ void calc_dvdx(float *vstag, float *dvdx, float dx, int i, int j, int k, int NX, int NY) {
-	float *dum0 = dvdx;
+__host__ __device__ void calc_dvdx(field_t *vstag, field_t *dvdx, float dx, int i, int j, int k, int NX, int NY) {
+	field_t *dum0 = dvdx;
 	TEM(i, j, k) = ( VA(i, j, k) - VA(i-1, j, k) ) / dx;
 }
 
-__device__ void calc_dvdz(float *vstag, float *dvdz, float dz, int i, int j, int k, int NX, int NY) {
-	float *dum0 = dvdz;
+__host__ __device__ void calc_dvdz(field_t *vstag, field_t *dvdz, float dz, int i, int j, int k, int NX, int NY) {
+	field_t *dum0 = dvdz;
 	TEM(i, j, k) = ( VA(i, j, k) - VA(i, j, k-1) ) / dz;
 }
 
-__device__ void calc_dwdx(float *wstag, float *dwdx, float dx, int i, int j, int k, int NX, int NY) {
-	float *dum0 = dwdx;
+__host__ __device__ void calc_dwdx(field_t *wstag, field_t *dwdx, float dx, int i, int j, int k, int NX, int NY) {
+	field_t *dum0 = dwdx;
 	TEM(i, j, k) = ( WA(i, j, k) - WA(i-1, j, k) ) / dx;
 }
 
-__device__ void calc_dwdy(float *wstag, float *dwdy, float dy, int i, int j, int k, int NX, int NY) {
-	float *dum0 = dwdy;
+__host__ __device__ void calc_dwdy(field_t *wstag, field_t *dwdy, float dy, int i, int j, int k, int NX, int NY) {
+	field_t *dum0 = dwdy;
 	TEM(i, j, k) = ( WA(i, j, k) - WA(i, j-1, k) ) / dy;
 }
 
 /* Compute the X component of vorticity tendency due
    to tilting Y and Z components into the X direction */
-__device__ void calc_xvort_tilt(float *yvort, float *zvort, float *dudy, float *dudz, float *xvtilt, int i, int j, int k, int NX, int NY) {
+__host__ __device__ void calc_xvort_tilt(field_t *yvort, field_t *zvort, field_t *dudy, field_t *dudz, field_t *xvtilt, int i, int j, int k, int NX, int NY) {
 
-	float *buf0, *dum0;
+	field_t *buf0, *dum0;
 	
 	buf0 = zvort; float zv = BUF(i, j, k);	
 	buf0 = yvort; float yv = BUF(i, j, k);
@@ -146,9 +211,9 @@ __device__ void calc_xvort_tilt(float *yvort, float *zvort, float *dudy, float *
 	TEM(i, j, k) = (zv * tem2) + (yv * tem1);
 }
 
-__device__ void calc_yvort_tilt(float *xvort, float *zvort, float *dvdx, float *dvdz, float *yvtilt, int i, int j, int k, int NX, int NY) {
+__host__ __device__ void calc_yvort_tilt(field_t *xvort, field_t *zvort, field_t *dvdx, field_t *dvdz, field_t *yvtilt, int i, int j, int k, int NX, int NY) {
 
-	float *buf0, *dum0;
+	field_t *buf0, *dum0;
 	
 	buf0 = zvort; float zv = BUF(i, j, k);	
 	buf0 = xvort; float xv = BUF(i, j, k);
@@ -160,9 +225,9 @@ __device__ void calc_yvort_tilt(float *xvort, float *zvort, float *dvdx, float *
 	TEM(i, j, k) = (zv * tem2) + (xv * tem1);
 }
 
-__device__ void calc_zvort_tilt(float *xvort, float *yvort, float *dwdx, float *dwdy, float *zvtilt, int i, int j, int k, int NX, int NY) {
+__host__ __device__ void calc_zvort_tilt(field_t *xvort, field_t *yvort, field_t *dwdx, field_t *dwdy, field_t *zvtilt, int i, int j, int k, int NX, int NY) {
 
-	float *buf0, *dum0;
+	field_t *buf0, *dum0;
 	
 	buf0 = xvort; float xv = BUF(i, j, k);	
 	buf0 = yvort; float yv = BUF(i, j, k);
@@ -176,12 +241,12 @@ __device__ void calc_zvort_tilt(float *xvort, float *yvort, float *dwdx, float *
 
 /* Compute the X component of vorticity tendency due
    to stretching of the vorticity along the X axis. */
-__device__ void calc_xvort_stretch(float *vstag, float *wstag, float *xvort, float *xvort_stretch, \
+__host__ __device__ void calc_xvort_stretch(field_t *vstag, field_t *wstag, field_t *xvort, field_t *xvort_stretch, \
                                    float dy, float dz, int i, int j, int k, int NX, int NY) {
 
     // this stencil conveniently lands itself on the scalar grid,
     // so we won't have to worry about doing any averaging. I think.
-    float *buf0 = xvort;
+    field_t *buf0 = xvort;
     float xv = BUF(i, j, k);
     float dvdy, dwdz;
     dvdy = ( VA(i, j+1, k) - VA(i, j, k) )/dy;
@@ -193,11 +258,11 @@ __device__ void calc_xvort_stretch(float *vstag, float *wstag, float *xvort, flo
 
 /* Compute the Y component of vorticity tendency due
    to stretching of the vorticity along the Y axis. */
-__device__ void calc_yvort_stretch(float *ustag, float *wstag, float *yvort, float *yvort_stretch, \
+__host__ __device__ void calc_yvort_stretch(field_t *ustag, field_t *wstag, field_t *yvort, field_t *yvort_stretch, \
                                    float dx, float dz, int i, int j, int k, int NX, int NY) {
     // this stencil conveniently lands itself on the scalar grid,
     // so we won't have to worry about doing any averaging. I think.
-    float *buf0 = yvort;
+    field_t *buf0 = yvort;
     float yv = BUF(i, j, k);
     float dudx, dwdz;
     dudx = ( UA(i+1, j, k) - UA(i, j, k) )/dx;
@@ -209,11 +274,11 @@ __device__ void calc_yvort_stretch(float *ustag, float *wstag, float *yvort, flo
 
 /* Compute the Z component of vorticity tendency due
    to stretching of the vorticity along the Z axis. */
-__device__ void calc_zvort_stretch(float *ustag, float *vstag, float *zvort, float *zvort_stretch, \
+__host__ __device__ void calc_zvort_stretch(field_t *ustag, field_t *vstag, field_t *zvort, field_t *zvort_stretch, \
                                    float dx, float dy, int i, int j, int k, int NX, int NY) {
     // this stencil conveniently lands itself on the scalar grid,
     // so we won't have to worry about doing any averaging. I think.
-    float *buf0 = zvort;
+    field_t *buf0 = zvort;
     float zv = BUF(i, j, k);
     float dudx = ( UA(i+1, j, k) - UA(i, j, k) )/dx;
     float dvdy = ( VA(i, j+1, k) - VA(i, j, k) )/dy;
@@ -222,9 +287,9 @@ __device__ void calc_zvort_stretch(float *ustag, float *vstag, float *zvort, flo
     BUF(i, j, k) = -zv*( dudx + dvdy);
 }
 
-__device__ void calc_xvort_baro(float *thrhopert, float *th0, float *qv0, float *xvort_baro, \
+__host__ __device__ void calc_xvort_baro(field_t *thrhopert, float *th0, float *qv0, field_t *xvort_baro, \
                                 float dy, int i, int j, int k, int NX, int NY) {
-    float *buf0 = thrhopert;
+    field_t *buf0 = thrhopert;
     float qvbar1 = qv0[k];
     float thbar1 = th0[k]*(1.0+reps*qvbar1)/(1.0+qvbar1); 
     // dthrho/dy
@@ -235,9 +300,9 @@ __device__ void calc_xvort_baro(float *thrhopert, float *th0, float *qv0, float
     BUF(i, j, k) = (g/thbar1)*dthdy; 
 }
 
-__device__ void calc_yvort_baro(float *thrhopert, float *th0, float *qv0, float *yvort_baro, \
+__host__ __device__ void calc_yvort_baro(field_t *thrhopert, float *th0, float *qv0, field_t *yvort_baro, \
                                 float dx, int i, int j, int k, int NX, int NY) {
-    float *buf0 = thrhopert;
+    field_t *buf0 = thrhopert;
     float qvbar1 = qv0[k];
     float thbar1 = th0[k]*(1.0+reps*qvbar1)/(1.0+qvbar1); 
     // dthrho/dy
@@ -247,9 +312,9 @@ __device__ void calc_yvort_baro(float *thrhopert, float *th0, float *qv0, float
     buf0 = yvort_baro; 
     BUF(i, j, k) = -1.0*(g/thbar1)*dthdx; 
 }
-__device__ void calc_xvort_solenoid(float *pipert, float *thrhopert, float *th0, float *qv0, float *xvort_solenoid, \
+__host__ __device__ void calc_xvort_solenoid(field_t *pipert, field_t *thrhopert, float *th0, float *qv0, field_t *xvort_solenoid, \
                                     float dy, float dz, int i, int j, int k, int NX, int NY) {
-    float *buf0 = pipert;
+    field_t *buf0 = pipert;
     float dpidz = ( (BUF(i, j, k+1) - BUF(i, j, k-1)) / ( dz ) );
     float dpidy = ( (BUF(i, j+1, k) - BUF(i, j-1, k)) / ( dy ) );
 
@@ -266,9 +331,9 @@ __device__ void calc_xvort_solenoid(float *pipert, float *thrhopert, float *th0,
     BUF(i, j, k) = -cp*(dthdy*dpidz - dthdz*dpidy); 
 }
 
-__device__ void calc_yvort_solenoid(float *pipert, float *thrhopert, float *th0, float *qv0, float *yvort_solenoid, \
+__host__ __device__ void calc_yvort_solenoid(field_t *pipert, field_t *thrhopert, float *th0, float *qv0, field_t *yvort_solenoid, \
                                     float dx, float dz, int i, int j, int k, int NX, int NY) {
-    float *buf0 = pipert;
+    field_t *buf0 = pipert;
     float dpidz = ( (BUF(i, j, k+1) - BUF(i, j, k-1)) / ( dz ) );
     float dpidx = ( (BUF(i+1, j, k) - BUF(i-1, j, k)) / ( dx ) );
 
@@ -285,9 +350,9 @@ __device__ void calc_yvort_solenoid(float *pipert, float *thrhopert, float *th0,
     BUF(i, j, k) = -cp*(dthdz*dpidx - dthdx*dpidz); 
 }
 
-__device__ void calc_zvort_solenoid(float *pipert, float *thrhopert, float *zvort_solenoid, \
+__host__ __device__ void calc_zvort_solenoid(field_t *pipert, field_t *thrhopert, field_t *zvort_solenoid, \
                                     float dx, float dy, int i, int j, int k, int NX, int NY) {
-    float *buf0 = pipert;
+    field_t *buf0 = pipert;
     float dpidx = ( (BUF(i+1, j, k) - BUF(i-1, j, k)) / ( 2*dx ) );
     float dpidy = ( (BUF(i, j+1, k) - BUF(i, j-1, k)) / ( 2*dy ) );
 
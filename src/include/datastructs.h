@@ -1,5 +1,6 @@
 // header file for reading CUDA compiled
 // stuffs
+#include "fieldtype.h"
 #ifndef DATASTRUCTS_H
 #define DATASTRUCTS_H
 /*
@@ -10,6 +11,11 @@
  * Email: kthalbert@wisc.edu
 */
 
+// the available trajectory integration schemes
+#define INTEG_RK2 0
+#define INTEG_RK4 1
+#define INTEG_RK45 2
+
 // This data structure stores the I/O
 // settings for which variables to read/write
 // based on the desired calculations and output
@@ -40,6 +46,81 @@ struct iocfg {
 
     int output_vorticity_budget = 0;
     int output_momentum_budget = 0;
+
+    // integration settings. nsubsteps is the number of
+    // integration steps to take between history times,
+    // and time_interp turns on linear interpolation of
+    // the wind in time between history times.
+    int nsubsteps = 1;
+    int time_interp = 0;
+
+    // which integration scheme to use, and the error
+    // tolerance in meters per step for the adaptive one
+    int integrator = INTEG_RK2;
+    float rk_tol = 1.0;
+
+    // how many time chunks to go between sorting the
+    // parcels in memory by location. 0 means never.
+    int reorder_interval = 0;
+
+    // evaluate the momentum budget only at the grid points
+    // around the parcels instead of on the whole grid
+    int sparse_budget = 0;
+
+    // only compute the gridded fields in the tiles of
+    // the domain the parcels can reach this time chunk
+    int tile_mask = 0;
+
+    // how many history intervals each time chunk integrates
+    // over. 0 means one per MPI rank.
+    int window_times = 0;
+
+    // how many grid points of padding the grid subset gets
+    // around the parcels when it has to be requested again
+    int subset_halo = 10;
+
+    // read the next time chunk in on the other MPI
+    // ranks while rank 0 integrates the current one
+    int read_ahead = 0;
+
+    // read the time levels on rank 0's node straight into its
+    // model arrays through an MPI shared memory window
+    int shared_window = 0;
+
+    // split the parcels up between the MPI ranks, and have each
+    // one read in and integrate its own
+    int parcel_shards = 0;
+
+    // split the horizontal domain into one tile per MPI rank,
+    // and have each one integrate the parcels in its tile
+    int domain_tiles = 0;
+
+    // the most separate subsets the parcels on a rank get
+    // split up into, one around each cluster of them
+    int subset_boxes = 0;
+
+    // size the room around the parcels on each face of the
+    // subset from the winds, instead of a fixed halo
+    int adaptive_halo = 0;
+};
+
+// size in grid points of the tiles in a tile_mask
+#define MASK_TILE_I 16
+#define MASK_TILE_J 16
+#define MASK_TILE_K 8
+
+/* Marks which tiles of a grid subset the parcels can get to during
+   the time chunk being integrated. The stencil kernels skip the tiles
+   that aren't active, so the gridded fields are only good inside of
+   them. See build_tile_mask in tilemask.cu. */
+struct tile_mask {
+    // number of tiles in each dimension
+    int nI;
+    int nJ;
+    int nK;
+    // 1 if the tile is active, indexed with P3
+    unsigned char *active;
+    long nActive;
 };
 
 // this struct helps manage all the different
@@ -89,12 +170,27 @@ struct datagrid {
     float dz;
     float dt;
 
+    // used for fast grid cell lookups. If an axis
+    // is evenly spaced, the cell can be computed
+    // directly from the inverse grid spacing rather
+    // than searched for. See set_grid_lookup.
+    int xuniform;
+    int yuniform;
+    int zuniform;
+    float rdx;
+    float rdy;
+    float rdz;
+
     // the subset points of the grid
     // that this grid is a part of
     long X0; long Y0;
     long X1; long Y1;
     long Z0; long Z1;
 
+    // the tiles that the gridded fields need to be
+    // computed in, or NULL for the whole grid
+    tile_mask *mask;
+
 };
 
 struct parcel_pos {
@@ -154,8 +250,26 @@ struct parcel_pos {
     float *pclqs;
     float *pclqg;
 
+    // the original (seed order) parcel id of
+    // each slot in the arrays above, since the
+    // parcels can get reordered in memory
+    int *pclid;
+
+    // the array slots of the parcels that are still
+    // being integrated, and how many of them there are.
+    // Parcels that leave the domain get dropped from
+    // this list by compact_parcels.
+    int *active;
+    int nActive;
+
     int nParcels;
     int nTimes;
+
+    // With the parcels split up between the MPI ranks, these are
+    // parcels pclOffset and up of the nTotParcels in the output.
+    // Otherwise they're 0 and nParcels.
+    int pclOffset;
+    int nTotParcels;
     iocfg *io;
 };
 
@@ -170,79 +284,150 @@ struct parcel_pos {
  * only code for this one. */
 struct model_data {
 
-    float *ustag;
-    float *vstag;
-    float *wstag;
-    float *pipert;
-    float *prespert;
-    float *thetapert;
-    float *thrhopert;
-    float *rhopert;
-    float *rhof;
-    float *kmh;
-    float *qvpert;
-    float *qc;
-    float *qi;
-    float *qs;
-    float *qg;
-
-    float *pgradu;
-    float *pgradv;
-    float *pgradw;
-    float *buoy;
-    float *turbu;
-    float *turbv;
-    float *turbw;
-    float *diffu;
-    float *diffv;
-    float *diffw;
-
-    float *tem1;
-    float *tem2;
-    float *tem3;
-    float *tem4;
-    float *tem5;
-    float *tem6;
-
-    float *xvort;
-    float *yvort;
-    float *zvort;
-
-    float *xvtilt;
-    float *yvtilt;
-    float *zvtilt;
-
-    float *xvstretch;
-    float *yvstretch;
-    float *zvstretch;
-    float *turbxvort;
-    float *turbyvort;
-    float *turbzvort;
-    float *diffxvort;
-    float *diffyvort;
-    float *diffzvort;
+    field_t *ustag;
+    field_t *vstag;
+    field_t *wstag;
+    field_t *pipert;
+    field_t *prespert;
+    field_t *thetapert;
+    field_t *thrhopert;
+    field_t *rhopert;
+    field_t *rhof;
+    field_t *kmh;
+    field_t *qvpert;
+    field_t *qc;
+    field_t *qi;
+    field_t *qs;
+    field_t *qg;
+
+    field_t *pgradu;
+    field_t *pgradv;
+    field_t *pgradw;
+    field_t *buoy;
+    field_t *turbu;
+    field_t *turbv;
+    field_t *turbw;
+    field_t *diffu;
+    field_t *diffv;
+    field_t *diffw;
+
+    field_t *tem1;
+    field_t *tem2;
+    field_t *tem3;
+    field_t *tem4;
+    field_t *tem5;
+    field_t *tem6;
+
+    field_t *xvort;
+    field_t *yvort;
+    field_t *zvort;
+
+    field_t *xvtilt;
+    field_t *yvtilt;
+    field_t *zvtilt;
+
+    field_t *xvstretch;
+    field_t *yvstretch;
+    field_t *zvstretch;
+    field_t *turbxvort;
+    field_t *turbyvort;
+    field_t *turbzvort;
+    field_t *diffxvort;
+    field_t *diffyvort;
+    field_t *diffzvort;
  
-    float *xvort_baro;
-    float *yvort_baro;
-    float *xvort_solenoid; 
-    float *yvort_solenoid; 
-    float *zvort_solenoid; 
+    field_t *xvort_baro;
+    field_t *yvort_baro;
+    field_t *xvort_solenoid; 
+    field_t *yvort_solenoid; 
+    field_t *zvort_solenoid; 
     iocfg *io;
+
+    // The time levels in the 4D arrays are a window into the
+    // history times that slides forward from one chunk to the
+    // next. tFirst is how many history steps past the start
+    // time level 0 is, nLevels is how many levels the arrays
+    // have room for, nValid is how many of them have been
+    // read in, and nDerived is how many of them have had the
+    // derived fields computed already.
+    int tFirst;
+    int nLevels;
+    int nValid;
+    int nDerived;
+};
+
+// how many of the model_data arrays get read in from the history files
+#define N_READ_FIELDS 13
+
+// How far inside of the edge of a grid subset a parcel has to stay for
+// everything it samples to come out the same as in a bigger subset. The
+// diffusion fluxes are zeroed within 3 points of the edge, the vorticity
+// budget takes one more derivative of them, and then the interpolation
+// reaches 2 points past that.
+#define SUBSET_STENCIL 7
+
+// the most room adaptive_halo will give a face of a subset
+#define ADAPT_HALO_MAX 64
+
+// the most subsets a rank's parcels can be split up into
+#define MAX_SUBSET_BOXES 16
+
+// the most buffers a buffer_pool will keep track of, which
+// has to be enough for the model data of every subset box
+#define POOL_MAXBUFS (64*MAX_SUBSET_BOXES)
+
+/* A pool of the big per-chunk arrays (the LOFS read buffers and
+   the model_data fields), so that they can be reused from one time
+   chunk to the next instead of being freed and allocated (and page
+   faulted in) all over again. Buffers are rounded up to a size class
+   so that small changes in the size of the subdomain don't need new
+   ones, and the pool only allocates when it has nothing free that is
+   big enough. managed pools use CUDA unified memory. */
+struct buffer_pool {
+    int managed;
+    int nBufs;
+    void *bufs[POOL_MAXBUFS];
+    size_t sizes[POOL_MAXBUFS];
+    int inuse[POOL_MAXBUFS];
+
+    // bytes currently allocated by the pool, and
+    // the most it has ever had allocated at once
+    size_t held;
+    size_t high_water;
+    // how many requests needed a new allocation,
+    // and how many got a buffer that was reused
+    long nAllocs;
+    long nReuses;
 };
 
 // These functions should only be compiled if 
 // we're actually using a GPU... otherwise
 // only expose the CPU functions
+#ifndef CPU_ONLY
 datagrid* allocate_grid_managed( int X0, int X1, int Y0, int Y1, int Z0, int Z1 );
 void deallocate_grid_managed(datagrid *grid);
 parcel_pos* allocate_parcels_managed(iocfg *io, int NX, int NY, int NZ, int nTotTimes);
 void deallocate_parcels_managed(iocfg* io, parcel_pos *parcels);
-model_data* allocate_model_managed(iocfg* io, long bufsize);
-void deallocate_model_managed(iocfg* io, model_data *data);
+model_data* allocate_model_managed(iocfg* io, long bufsize, buffer_pool *pool = NULL);
+void deallocate_model_managed(iocfg* io, model_data *data, buffer_pool *pool = NULL);
+#endif
 
 datagrid* allocate_grid_cpu( int X0, int X1, int Y0, int Y1, int Z0, int Z1 );
 void deallocate_grid_cpu(datagrid *grid);
 parcel_pos* allocate_parcels_cpu(iocfg *io, int NX, int NY, int NZ, int nTotTimes);
 void deallocate_parcels_cpu(iocfg *io, parcel_pos *parcels);
+model_data* allocate_model_cpu(iocfg* io, long bufsize, buffer_pool *pool = NULL, field_t *arena = NULL);
+void deallocate_model_cpu(iocfg* io, model_data *data, buffer_pool *pool = NULL, field_t *arena = NULL);
+void read_field_flags(iocfg *io, int *want);
+int read_fields(iocfg *io, field_t *arena, long bufsize, field_t **flds);
+void model_read_fields(iocfg *io, model_data *data, field_t **flds);
+void slide_model_window(iocfg *io, model_data *data, long N, int shift);
+void hold_model_level(iocfg *io, model_data *data, long N, int lvl);
+
+buffer_pool* allocate_pool(int managed);
+void deallocate_pool(buffer_pool *pool);
+void* pool_alloc(buffer_pool *pool, size_t nbytes);
+void pool_free(buffer_pool *pool, void *buf);
+void pool_report(buffer_pool *pool, const char *name);
 
 #endif
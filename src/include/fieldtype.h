@@ -0,0 +1,168 @@
+#include <string.h>
+#if defined(FIELD_FP16) && defined(__CUDACC__)
+#include <cuda_fp16.h>
+#endif
+#if defined(FIELD_FP16) && defined(__F16C__) && !defined(__CUDACC__)
+#include <immintrin.h>
+#endif
+#ifndef FIELDTYPE_H
+#define FIELDTYPE_H
+/*
+ * Copyright (C) 2017-2020 Kelton Halbert, Space Science and Engineering Center (SSEC), University of Wisconsin - Madison
+ * Written by Kelton Halbert at the University of Wisconsin - Madison,
+ * Cooperative Institute for Meteorological Satellite Studies (CIMSS),
+ * Space Science and Engineering Center (SSEC). Provided under the Apache 2.0 License.
+ * Email: kthalbert@wisc.edu
+*/
+
+// Same as in macros.h, so that this can
+// be used without the rest of the macros
+#ifndef __CUDACC__
+#ifndef __host__
+#define __host__
+#endif
+#ifndef __device__
+#define __device__
+#endif
+#endif
+
+/* The 4D arrays in model_data are stored as field_t. Normally that's just
+   a float, but building with -DFIELD_FP16 or -DFIELD_BF16 stores them as
+   16 bit IEEE half precision or bfloat16 instead, which halves the memory
+   they take up and the bandwidth of reading them. A field_t widens to a
+   float whenever it gets read, so all of the stencil and interpolation
+   math still happens in single precision, and only the values that get
+   stored are rounded.
+
+   fp16 has 11 bits of mantissa, but only holds values between about 6e-5
+   and 65504 at full precision. bf16 has the range of a float, but only 8
+   bits of mantissa. Either way, the budget terms lose a lot more to this
+   than the winds do, since they are differences of rounded values. */
+#if defined(FIELD_FP16) && defined(FIELD_BF16)
+#error "Only one of FIELD_FP16 and FIELD_BF16 can be defined"
+#endif
+
+#if defined(FIELD_FP16)
+#define FIELD_TYPE_NAME "fp16"
+#elif defined(FIELD_BF16)
+#define FIELD_TYPE_NAME "bf16"
+#else
+#define FIELD_TYPE_NAME "fp32"
+#endif
+
+#if defined(FIELD_FP16) || defined(FIELD_BF16)
+
+__host__ __device__ inline unsigned int _float_bits(float f) {
+#ifdef __CUDA_ARCH__
+    return __float_as_uint(f);
+#else
+    unsigned int u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+#endif
+}
+
+__host__ __device__ inline float _bits_float(unsigned int u) {
+#ifdef __CUDA_ARCH__
+    return __uint_as_float(u);
+#else
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+#endif
+}
+
+#ifdef FIELD_BF16
+// bfloat16 is just the top half of a float, rounded to nearest even
+__host__ __device__ inline unsigned short _float_to_field(float f) {
+    unsigned int u = _float_bits(f);
+    // keep NaNs as NaNs instead of rounding them to inf
+    if ((u & 0x7fffffff) > 0x7f800000) return (u >> 16) | 0x40;
+    u += 0x7fff + ((u >> 16) & 1);
+    return u >> 16;
+}
+
+__host__ __device__ inline float _field_to_float(unsigned short h) {
+    return _bits_float(((unsigned int) h) << 16);
+}
+
+#else
+// IEEE half precision, rounded to nearest even. The GPU and CPUs
+// with F16C have instructions for this, otherwise do it by hand.
+__host__ __device__ inline unsigned short _float_to_field(float f) {
+#if defined(__CUDA_ARCH__)
+    return __half_as_ushort(__float2half_rn(f));
+#elif defined(__F16C__)
+    return _cvtss_sh(f, 0);
+#else
+    unsigned int u = _float_bits(f);
+    unsigned int sign = (u >> 16) & 0x8000;
+    unsigned int a = u & 0x7fffffff;
+    // inf and NaN
+    if (a >= 0x7f800000) return sign | 0x7c00 | ((a > 0x7f800000) ? 0x200 : 0);
+    // too big, which includes everything that rounds up past 65504
+    if (a >= 0x477ff000) return sign | 0x7c00;
+    // subnormal halfs, and things that round to zero
+    if (a < 0x38800000) {
+        if (a < 0x33000000) return sign;
+        unsigned int m = (a & 0x7fffff) | 0x800000;
+        unsigned int shift = 126 - (a >> 23);
+        unsigned int h = m >> shift;
+        unsigned int rem = m & ((1u << shift) - 1);
+        unsigned int halfway = 1u << (shift - 1);
+        if ((rem > halfway) || ((rem == halfway) && (h & 1))) h += 1;
+        return sign | h;
+    }
+    unsigned int h = (a - 0x38000000) >> 13;
+    unsigned int rem = a & 0x1fff;
+    if ((rem > 0x1000) || ((rem == 0x1000) && (h & 1))) h += 1;
+    return sign | h;
+#endif
+}
+
+__host__ __device__ inline float _field_to_float(unsigned short h) {
+#if defined(__CUDA_ARCH__)
+    return __half2float(__ushort_as_half(h));
+#elif defined(__F16C__)
+    return _cvtsh_ss(h);
+#else
+    unsigned int sign = ((unsigned int) (h & 0x8000)) << 16;
+    unsigned int e = (h >> 10) & 0x1f;
+    unsigned int m = h & 0x3ff;
+    if (e == 0x1f) return _bits_float(sign | 0x7f800000 | (m << 13));
+    if (e == 0) {
+        float sub = m * 5.9604644775390625e-8f;
+        return sign ? -sub : sub;
+    }
+    return _bits_float(sign | ((e + 112) << 23) | (m << 13));
+#endif
+}
+#endif
+
+struct field_t {
+    unsigned short bits;
+
+    field_t() = default;
+    __host__ __device__ field_t(float f) : bits(_float_to_field(f)) {}
+    __host__ __device__ operator float() const { return _field_to_float(bits); }
+};
+
+#else
+typedef float field_t;
+#endif
+
+/* Convert a buffer of n floats into fields in place, and return it as
+   an array of fields. The fields are never bigger than the floats, so
+   this is safe to do front to back. The buffer still has to be freed
+   as the float array it was allocated as. */
+inline field_t* floats_to_fields(float *buf, long n) {
+    char *out = (char *) buf;
+    if ((buf == NULL) || (sizeof(field_t) == sizeof(float))) return (field_t *) buf;
+    for (long idx = 0; idx < n; ++idx) {
+        field_t val = buf[idx];
+        memcpy(out + idx*sizeof(field_t), &val, sizeof(field_t));
+    }
+    return (field_t *) buf;
+}
+
+#endif
@@ -12,5 +12,14 @@
 
 
 void _nearest_grid_idx(float *point, datagrid *grid, int *idx_4D);
+void _nearest_grid_idx(float *point, datagrid *grid, int *idx_4D, int *hint_4D);
+#ifndef CPU_ONLY
 void cudaIntegrateParcels(datagrid *grid, model_data *data, parcel_pos *parcels, int nT, int totTime, int direct);
+void cudaDeriveFields(datagrid *grid, model_data *data, int tEnd);
+#endif
+void cpuIntegrateParcels(datagrid *grid, model_data *data, parcel_pos *parcels, int nT, int totTime, int direct);
+void cpuDeriveFields(datagrid *grid, model_data *data, int tEnd);
+void parcel_reach(datagrid *grid, model_data *data, int tStart, int tEnd, int *reach);
+void parcel_reach_faces(datagrid *grid, model_data *data, int *box, int tStart, int tEnd, int *faces);
+void adaptive_halo(datagrid *grid, model_data *data, parcel_pos *parcels, int tStart, int tEnd, int direct, int *pad);
 #endif
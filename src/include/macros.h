@@ -8,6 +8,16 @@
  * Email: kthalbert@wisc.edu
 */
 
+// When we aren't being compiled by nvcc (i.e. the CPU_ONLY
+// build), the CUDA function qualifiers don't mean anything,
+// so make them go away. This lets the __host__ __device__
+// routines get compiled as regular C++ functions.
+#ifndef __CUDACC__
+#define __host__
+#define __device__
+#define __global__
+#endif
+
 // these macros help us stay consistent
 // with how indexing happens in CM1 for
 // the stretched, staggered grids
@@ -42,8 +52,47 @@
 #define  KM(x,y,z) kmstag[P3(x+1,y+1,z,NX+2,NY+2)]
 
 #define PCL(t,p,mt) (((p)*(mt))+(t))
+// missing value for parcel positions. This is the same
+// as NC_FILL_FLOAT, so they show up as missing in the output
+// file, but doesn't need the netcdf header on the GPU.
+#define PCL_MISSING 9.9692099683868690e+36f
 // stole this define from LOFS
 #define P3(x,y,z,mx,my) (((z)*(mx)*(my))+((y)*(mx))+(x))
 // I made this myself by stealing from LOFS
 #define P4(x, y, z, t, mx, my, mz) (((t)*(mx)*(my)*(mz))+((z)*(mx)*(my))+((y)*(mx))+(x))
+
+// Tile sizes for the CPU stencil loops. The default tile, plus
+// the 3 point halo of the 6th order diffusion stencil, keeps the
+// inputs and outputs of a pass at a few hundred KB so a tile stays
+// resident in L2. The i tile is kept long so it vectorizes well.
+#ifndef TILE_I
+#define TILE_I 128
+#endif
+#ifndef TILE_J
+#define TILE_J 16
+#endif
+#ifndef TILE_K
+#define TILE_K 8
+#endif
+#define TILE_END(t, tile, n) ( ((t)+(tile) < (n)) ? (t)+(tile) : (n) )
+
+// More fun with macros. This is the CPU version of a kernel launch:
+// loop over [i0,i1) x [j0,j1) x [k0,k1) for every time level in
+// [tStart,tEnd), handing out (time, k tile, j tile) chunks to OpenMP
+// threads and vectorizing along i. The loop body sees tidx, i, j, k.
+// If the grid has a tile mask, each tile only loops over the part of
+// it that's active (see tile_bounds in tilemask.cu), so grid has to be
+// in scope and tilemask.cu has to be included.
+#define FOR_TILES(tStart, tEnd, i0, i1, j0, j1, k0, k1) \
+    _Pragma("omp parallel for collapse(3) schedule(static)") \
+    for (int tidx = (tStart); tidx < (tEnd); ++tidx) \
+    for (int kt = (k0); kt < (k1); kt += TILE_K) \
+    for (int jt = (j0); jt < (j1); jt += TILE_J) \
+    for (int it = (i0); it < (i1); it += TILE_I) \
+    for (int ia = it, ib = TILE_END(it, TILE_I, (i1)), ja = jt, jb = TILE_END(jt, TILE_J, (j1)), \
+             ka = kt, kb = TILE_END(kt, TILE_K, (k1)), go = tile_bounds(grid, &ia, &ib, &ja, &jb, &ka, &kb); go; go = 0) \
+    for (int k = ka; k < kb; ++k) \
+    for (int j = ja; j < jb; ++j) \
+    _Pragma("omp simd") \
+    for (int i = ia; i < ib; ++i)
 #endif
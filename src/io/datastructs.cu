@@ -1,6 +1,9 @@
 #include "../include/macros.h"
 #include "../include/datastructs.h"
 #include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #ifndef DATASTRUCTS
 #define DATASTRUCTS
 /*
@@ -12,6 +15,159 @@
 */
 using namespace std;
 
+/* Allocate an empty pool of buffers. If managed is set,
+   the buffers are allocated in CUDA unified memory. */
+buffer_pool* allocate_pool(int managed) {
+    buffer_pool *pool = new buffer_pool();
+    pool->managed = managed;
+    return pool;
+}
+
+/* Round a request up to the size class it gets allocated as. The
+   classes are eighths of a power of two, so a buffer is never more
+   than 12.5% bigger than what was asked for, but a subdomain that
+   grows by a few grid points still fits in the one it had before. */
+size_t _pool_size_class(size_t nbytes) {
+    size_t pow2 = 4096;
+    while (pow2 < nbytes) pow2 *= 2;
+    size_t step = pow2 / 8;
+    return ((nbytes + step - 1) / step) * step;
+}
+
+void _pool_release(buffer_pool *pool, int b) {
+#ifndef CPU_ONLY
+    if (pool->managed) cudaFree(pool->bufs[b]);
+    else free(pool->bufs[b]);
+#else
+    free(pool->bufs[b]);
+#endif
+    pool->held -= pool->sizes[b];
+    // move the last buffer into this slot
+    pool->nBufs -= 1;
+    pool->bufs[b] = pool->bufs[pool->nBufs];
+    pool->sizes[b] = pool->sizes[pool->nBufs];
+    pool->inuse[b] = pool->inuse[pool->nBufs];
+}
+
+/* Get a buffer of at least nbytes from the pool. This hands back the
+   smallest free buffer that is big enough, and only allocates a new one
+   if there isn't one. When that happens because the subdomain grew, the
+   biggest free buffer that was too small gets freed, so the pool grows
+   instead of hanging on to both. The contents are whatever was left
+   in it, so callers that need zeros have to do that themselves. */
+void* pool_alloc(buffer_pool *pool, size_t nbytes) {
+    int best = -1;
+    int small = -1;
+    for (int b = 0; b < pool->nBufs; ++b) {
+        if (pool->inuse[b]) continue;
+        if (pool->sizes[b] >= nbytes) {
+            if ((best == -1) || (pool->sizes[b] < pool->sizes[best])) best = b;
+        }
+        else if ((small == -1) || (pool->sizes[b] > pool->sizes[small])) small = b;
+    }
+    if (best != -1) {
+        pool->inuse[best] = 1;
+        pool->nReuses += 1;
+        return pool->bufs[best];
+    }
+
+    if (small != -1) _pool_release(pool, small);
+    if (pool->nBufs == POOL_MAXBUFS) {
+        cout << "Buffer pool is out of slots (" << POOL_MAXBUFS << "). Abort." << endl;
+        exit(-1);
+    }
+    size_t size = _pool_size_class(nbytes);
+    void *buf = NULL;
+#ifndef CPU_ONLY
+    if (pool->managed) cudaMallocManaged(&buf, size);
+    else buf = malloc(size);
+#else
+    buf = malloc(size);
+#endif
+    if (buf == NULL) {
+        cout << "Failed to allocate " << size << " bytes for the buffer pool. Abort." << endl;
+        exit(-1);
+    }
+    int b = pool->nBufs;
+    pool->nBufs += 1;
+    pool->bufs[b] = buf;
+    pool->sizes[b] = size;
+    pool->inuse[b] = 1;
+    pool->held += size;
+    if (pool->held > pool->high_water) pool->high_water = pool->held;
+    pool->nAllocs += 1;
+    return buf;
+}
+
+/* Give a buffer back to the pool so it can be reused. The
+   memory stays allocated until the pool is deallocated. */
+void pool_free(buffer_pool *pool, void *buf) {
+    if (buf == NULL) return;
+    for (int b = 0; b < pool->nBufs; ++b) {
+        if (pool->bufs[b] == buf) {
+            pool->inuse[b] = 0;
+            return;
+        }
+    }
+    cout << "Tried to return a buffer that isn't from this pool" << endl;
+}
+
+/* Print how much memory the pool is holding, the most it ever held,
+   and how many of the requests it got were able to reuse a buffer */
+void pool_report(buffer_pool *pool, const char *name) {
+    printf("%s buffer pool: %d buffers, %.2f MB held, %.2f MB high water mark, %ld allocations, %ld reuses\n", \
+           name, pool->nBufs, pool->held / 1048576.0, pool->high_water / 1048576.0, pool->nAllocs, pool->nReuses);
+}
+
+/* Free all of the buffers in the pool, whether
+   or not they were given back, and the pool itself */
+void deallocate_pool(buffer_pool *pool) {
+    while (pool->nBufs > 0) _pool_release(pool, pool->nBufs-1);
+    delete pool;
+}
+
+/* The 4D arrays in model_data come out of the pool if there is one,
+   or get allocated on their own like always if there isn't. The CPU
+   ones are zeroed either way. */
+field_t* _cpu_field(buffer_pool *pool, long bufsize) {
+    if (pool == NULL) return new field_t[bufsize]();
+    field_t *fld = (field_t *) pool_alloc(pool, bufsize*sizeof(field_t));
+    memset(fld, 0, bufsize*sizeof(field_t));
+    return fld;
+}
+
+void _free_cpu_field(buffer_pool *pool, field_t *fld) {
+    if (pool == NULL) delete[] fld;
+    else pool_free(pool, fld);
+}
+
+/* The fields that get read in from the history files can live in an
+   arena the caller owns instead, so they're only allocated here if
+   there isn't one. Nothing in the arena gets zeroed or freed. */
+field_t* _read_field(buffer_pool *pool, long bufsize, field_t *in_arena) {
+    if (in_arena != NULL) return in_arena;
+    return _cpu_field(pool, bufsize);
+}
+
+void _free_read_field(buffer_pool *pool, field_t *fld, field_t *arena) {
+    if (arena == NULL) _free_cpu_field(pool, fld);
+}
+
+#ifndef CPU_ONLY
+field_t* _managed_field(buffer_pool *pool, long bufsize) {
+    field_t *fld;
+    if (pool == NULL) cudaMallocManaged(&fld, bufsize*sizeof(field_t));
+    else fld = (field_t *) pool_alloc(pool, bufsize*sizeof(field_t));
+    return fld;
+}
+
+void _free_managed_field(buffer_pool *pool, field_t *fld) {
+    if (pool == NULL) cudaFree(fld);
+    else pool_free(pool, fld);
+}
+#endif
+
+#ifndef CPU_ONLY
 /* Allocate memory on the CPU and GPU for a grid. There are times,
     like for various MPI ranks, that you don't want to do this on both.
     See the similar function for doing this on just the CPU */
@@ -32,6 +188,13 @@ datagrid* allocate_grid_managed( int X0, int X1, int Y0, int Y1, int Z0, int Z1
     grid->NX = NX;
     grid->NY = NY;
     grid->NZ = NZ;
+    // until set_grid_lookup is called, assume
+    // the axes are stretched
+    grid->xuniform = 0;
+    grid->yuniform = 0;
+    grid->zuniform = 0;
+    // and that there's no tile mask
+    grid->mask = NULL;
 
     // allocage grid arrays
     cudaMallocManaged(&(grid->xf), (NX+2)*sizeof(float));
@@ -64,6 +227,7 @@ datagrid* allocate_grid_managed( int X0, int X1, int Y0, int Y1, int Z0, int Z1
 
     return grid;
 }
+#endif
 
 /* Allocate arrays only on the CPU for the grid. This is important
    for using with MPI, as only 1 rank should be allocating memory
@@ -84,6 +248,13 @@ datagrid* allocate_grid_cpu( int X0, int X1, int Y0, int Y1, int Z0, int Z1 ) {
     grid->NX = NX;
     grid->NY = NY;
     grid->NZ = NZ;
+    // until set_grid_lookup is called, assume
+    // the axes are stretched
+    grid->xuniform = 0;
+    grid->yuniform = 0;
+    grid->zuniform = 0;
+    // and that there's no tile mask
+    grid->mask = NULL;
 
     // allocage grid arrays
     grid->xf = new float[NX+2];
@@ -115,6 +286,7 @@ datagrid* allocate_grid_cpu( int X0, int X1, int Y0, int Y1, int Z0, int Z1 ) {
     return grid;
 }
 
+#ifndef CPU_ONLY
 /* Deallocate all of the arrays in the 
    struct for both the GPU and CPU */
 void deallocate_grid_managed(datagrid *grid) {
@@ -138,6 +310,7 @@ void deallocate_grid_managed(datagrid *grid) {
     cudaFree(grid->p0);
     cudaDeviceSynchronize();
 }
+#endif
 
 /* Deallocate all of the arrays in the
    struct only for the CPU */
@@ -162,6 +335,7 @@ void deallocate_grid_cpu(datagrid *grid) {
     delete[] grid->p0;
 }
 
+#ifndef CPU_ONLY
 /* Allocate arrays for parcel info on both the CPU and GPU.
    This function should only be called by MPI Rank 0, so
    be sure to use the CPU function for Rank >= 1. */
@@ -197,6 +371,22 @@ parcel_pos* allocate_parcels_managed(iocfg *io, int NX, int NY, int NZ, int nTot
 
     parcels->io->output_vorticity_budget = io->output_vorticity_budget;
     parcels->io->output_momentum_budget = io->output_momentum_budget;
+
+    parcels->io->nsubsteps = io->nsubsteps;
+    parcels->io->time_interp = io->time_interp;
+    parcels->io->integrator = io->integrator;
+    parcels->io->rk_tol = io->rk_tol;
+    parcels->io->reorder_interval = io->reorder_interval;
+    parcels->io->sparse_budget = io->sparse_budget;
+    parcels->io->tile_mask = io->tile_mask;
+    parcels->io->window_times = io->window_times;
+    parcels->io->subset_halo = io->subset_halo;
+    parcels->io->read_ahead = io->read_ahead;
+    parcels->io->shared_window = io->shared_window;
+    parcels->io->parcel_shards = io->parcel_shards;
+    parcels->io->domain_tiles = io->domain_tiles;
+    parcels->io->subset_boxes = io->subset_boxes;
+    parcels->io->adaptive_halo = io->adaptive_halo;
     
     // allocate memory for the parcels
     // we are integrating for the entirety 
@@ -207,6 +397,8 @@ parcel_pos* allocate_parcels_managed(iocfg *io, int NX, int NY, int NZ, int nTot
     cudaMallocManaged(&(parcels->pclu), nParcels*nTotTimes*sizeof(float)); 
     cudaMallocManaged(&(parcels->pclv), nParcels*nTotTimes*sizeof(float)); 
     cudaMallocManaged(&(parcels->pclw), nParcels*nTotTimes*sizeof(float)); 
+    cudaMallocManaged(&(parcels->pclid), nParcels*sizeof(int)); 
+    cudaMallocManaged(&(parcels->active), nParcels*sizeof(int)); 
     if (io->output_kmh ) cudaMallocManaged(&(parcels->pclkmh), nParcels*nTotTimes*sizeof(float)); 
     if (io->output_momentum_budget) {
         cudaMallocManaged(&(parcels->pclbuoy), nParcels*nTotTimes*sizeof(float));
@@ -263,10 +455,18 @@ parcel_pos* allocate_parcels_managed(iocfg *io, int NX, int NY, int NZ, int nTot
     // set the static variables
     parcels->nParcels = nParcels;
     parcels->nTimes = nTotTimes;
+    parcels->pclOffset = 0;
+    parcels->nTotParcels = nParcels;
+    // parcels start out in seed order
+    for (int pcl = 0; pcl < nParcels; ++pcl) parcels->pclid[pcl] = pcl;
+    // every parcel starts out active
+    for (int pcl = 0; pcl < nParcels; ++pcl) parcels->active[pcl] = pcl;
+    parcels->nActive = nParcels;
     cudaDeviceSynchronize();
 
     return parcels;
 }
+#endif
 
 /* Allocate arrays only on the CPU for the grid. This is important
    for using with MPI, as only 1 rank should be allocating memory
@@ -285,6 +485,8 @@ parcel_pos* allocate_parcels_cpu(iocfg* io, int NX, int NY, int NZ, int nTotTime
     parcels->pclu = new float[nParcels*nTotTimes]; 
     parcels->pclv = new float[nParcels*nTotTimes]; 
     parcels->pclw = new float[nParcels*nTotTimes]; 
+    parcels->pclid = new int[nParcels]; 
+    parcels->active = new int[nParcels]; 
     if (io->output_kmh) parcels->pclkmh = new float[nParcels*nTotTimes]; 
     if (io->output_momentum_budget) {
         parcels->pclbuoy = new float[nParcels*nTotTimes];
@@ -340,10 +542,18 @@ parcel_pos* allocate_parcels_cpu(iocfg* io, int NX, int NY, int NZ, int nTotTime
     // set the static variables
     parcels->nParcels = nParcels;
     parcels->nTimes = nTotTimes;
+    parcels->pclOffset = 0;
+    parcels->nTotParcels = nParcels;
+    // parcels start out in seed order
+    for (int pcl = 0; pcl < nParcels; ++pcl) parcels->pclid[pcl] = pcl;
+    // every parcel starts out active
+    for (int pcl = 0; pcl < nParcels; ++pcl) parcels->active[pcl] = pcl;
+    parcels->nActive = nParcels;
 
     return parcels;
 }
 
+#ifndef CPU_ONLY
 /* Deallocate parcel arrays on both the CPU and the
    GPU */
 void deallocate_parcels_managed(iocfg* io, parcel_pos *parcels) {
@@ -353,6 +563,8 @@ void deallocate_parcels_managed(iocfg* io, parcel_pos *parcels) {
     cudaFree(parcels->pclu);
     cudaFree(parcels->pclv);
     cudaFree(parcels->pclw);
+    cudaFree(parcels->pclid);
+    cudaFree(parcels->active);
     if (io->output_kmh) cudaFree(parcels->pclkmh);
     if (io->output_momentum_budget) {
         cudaFree(parcels->pclbuoy);
@@ -409,6 +621,7 @@ void deallocate_parcels_managed(iocfg* io, parcel_pos *parcels) {
     cudaFree(parcels);
     cudaDeviceSynchronize();
 }
+#endif
 
 /* Deallocate parcel arrays only on the CPU */
 void deallocate_parcels_cpu(iocfg *io, parcel_pos *parcels) {
@@ -418,6 +631,8 @@ void deallocate_parcels_cpu(iocfg *io, parcel_pos *parcels) {
     delete[] parcels->pclu;
     delete[] parcels->pclv;
     delete[] parcels->pclw;
+    delete[] parcels->pclid;
+    delete[] parcels->active;
     if (io->output_kmh) delete[] parcels->pclkmh;
     if (io->output_momentum_budget) {
         delete[] parcels->pclbuoy;
@@ -471,14 +686,16 @@ void deallocate_parcels_cpu(iocfg *io, parcel_pos *parcels) {
     if (io->output_qs) delete[] parcels->pclqs;
     if (io->output_qg) delete[] parcels->pclqg;
 
-    delete[] parcels;
+    delete parcels;
 }
 
+#ifndef CPU_ONLY
 /* Allocate the struct of 4D arrays that store
    fields for integration and calculation. This
    only ever gets called by Rank 0, so there 
-   should be no need for a CPU counterpart. */
-model_data* allocate_model_managed(iocfg *io, long bufsize) {
+   should be no need for a CPU counterpart. If
+   a pool is given, the arrays come from it. */
+model_data* allocate_model_managed(iocfg *io, long bufsize, buffer_pool *pool) {
     model_data *data;
     // create the struct on both the GPU and the CPU.
     cudaMallocManaged(&data, sizeof(model_data));
@@ -510,74 +727,92 @@ model_data* allocate_model_managed(iocfg *io, long bufsize) {
     data->io->output_vorticity_budget = io->output_vorticity_budget;
     data->io->output_momentum_budget = io->output_momentum_budget;
 
+    data->io->nsubsteps = io->nsubsteps;
+    data->io->time_interp = io->time_interp;
+    data->io->integrator = io->integrator;
+    data->io->rk_tol = io->rk_tol;
+    data->io->reorder_interval = io->reorder_interval;
+    data->io->sparse_budget = io->sparse_budget;
+    data->io->tile_mask = io->tile_mask;
+    data->io->window_times = io->window_times;
+    data->io->subset_halo = io->subset_halo;
+    data->io->read_ahead = io->read_ahead;
+    data->io->shared_window = io->shared_window;
+    data->io->parcel_shards = io->parcel_shards;
+    data->io->domain_tiles = io->domain_tiles;
+    data->io->subset_boxes = io->subset_boxes;
+    data->io->adaptive_halo = io->adaptive_halo;
+
     // Now, here we only allocate the arrays that we need based on the
     // user supplied namelist configuration. This should help with a)
     // not having to manually comment out the microphysics variables
     // every time, and b) save on memory load when possible. 
 
     // These are arrays that are 100% necessary for parcel integration.
-    // The temporary arrays are included in this because pretty much any
-    // secondary calculation requires at least one or more of these
-    // arrays. So, better to just have them up front. 
-    cudaMallocManaged(&(data->ustag), bufsize*sizeof(float));
-    cudaMallocManaged(&(data->vstag), bufsize*sizeof(float));
-    cudaMallocManaged(&(data->wstag), bufsize*sizeof(float));
-    cudaMallocManaged(&(data->tem1), bufsize*sizeof(float));
-    cudaMallocManaged(&(data->tem2), bufsize*sizeof(float));
-    cudaMallocManaged(&(data->tem3), bufsize*sizeof(float));
-    cudaMallocManaged(&(data->tem4), bufsize*sizeof(float));
-    cudaMallocManaged(&(data->tem5), bufsize*sizeof(float));
-    cudaMallocManaged(&(data->tem6), bufsize*sizeof(float));
+    data->ustag = _managed_field(pool, bufsize);
+    data->vstag = _managed_field(pool, bufsize);
+    data->wstag = _managed_field(pool, bufsize);
+    // the vorticity budget is the only thing left that
+    // needs the temporary arrays
+    if (io->output_vorticity_budget) {
+        data->tem1 = _managed_field(pool, bufsize);
+        data->tem2 = _managed_field(pool, bufsize);
+        data->tem3 = _managed_field(pool, bufsize);
+        data->tem4 = _managed_field(pool, bufsize);
+        data->tem5 = _managed_field(pool, bufsize);
+        data->tem6 = _managed_field(pool, bufsize);
+    }
     
     // Arrays that are optional depending on if they need to be tracked along
     // a parcel, or are part of a calculation/budget. 
-    if (io->output_qc) cudaMallocManaged(&(data->qc), bufsize*sizeof(float));
-    if (io->output_qi) cudaMallocManaged(&(data->qi), bufsize*sizeof(float));
-    if (io->output_qs) cudaMallocManaged(&(data->qs), bufsize*sizeof(float));
-    if (io->output_qg) cudaMallocManaged(&(data->qg), bufsize*sizeof(float));
-
-    if (io->output_vorticity_budget || io->output_xvort) cudaMallocManaged(&(data->xvort), bufsize*sizeof(float));
-    if (io->output_vorticity_budget || io->output_yvort) cudaMallocManaged(&(data->yvort), bufsize*sizeof(float));
-    if (io->output_vorticity_budget || io->output_zvort) cudaMallocManaged(&(data->zvort), bufsize*sizeof(float));
-
-    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_ppert) cudaMallocManaged(&(data->pipert), bufsize*sizeof(float));
-    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_ppert) cudaMallocManaged(&(data->prespert), bufsize*sizeof(float));
-    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_thrhopert) cudaMallocManaged(&(data->thrhopert),  bufsize*sizeof(float));
-    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_thetapert) cudaMallocManaged(&(data->thetapert),  bufsize*sizeof(float));
-    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_rhopert) cudaMallocManaged(&(data->rhopert), bufsize*sizeof(float));
-    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_kmh) cudaMallocManaged(&(data->kmh), bufsize*sizeof(float));
-    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_qvpert) cudaMallocManaged(&(data->qvpert), bufsize*sizeof(float));
-    if (io->output_vorticity_budget || io->output_momentum_budget) {
-        cudaMallocManaged(&(data->rhof), bufsize*sizeof(float));
-        cudaMallocManaged(&(data->buoy), bufsize*sizeof(float));
-        cudaMallocManaged(&(data->pgradu), bufsize*sizeof(float));
-        cudaMallocManaged(&(data->pgradv), bufsize*sizeof(float));
-        cudaMallocManaged(&(data->pgradw), bufsize*sizeof(float));
-        cudaMallocManaged(&(data->turbu), bufsize*sizeof(float));
-        cudaMallocManaged(&(data->turbv), bufsize*sizeof(float));
-        cudaMallocManaged(&(data->turbw), bufsize*sizeof(float));
-        cudaMallocManaged(&(data->diffu), bufsize*sizeof(float));
-        cudaMallocManaged(&(data->diffv), bufsize*sizeof(float));
-        cudaMallocManaged(&(data->diffw), bufsize*sizeof(float));
+    if (io->output_qc) data->qc = _managed_field(pool, bufsize);
+    if (io->output_qi) data->qi = _managed_field(pool, bufsize);
+    if (io->output_qs) data->qs = _managed_field(pool, bufsize);
+    if (io->output_qg) data->qg = _managed_field(pool, bufsize);
+
+    if (io->output_vorticity_budget || io->output_xvort) data->xvort = _managed_field(pool, bufsize);
+    if (io->output_vorticity_budget || io->output_yvort) data->yvort = _managed_field(pool, bufsize);
+    if (io->output_vorticity_budget || io->output_zvort) data->zvort = _managed_field(pool, bufsize);
+
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_ppert) data->pipert = _managed_field(pool, bufsize);
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_ppert) data->prespert = _managed_field(pool, bufsize);
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_thrhopert) data->thrhopert = _managed_field(pool, bufsize);
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_thetapert) data->thetapert = _managed_field(pool, bufsize);
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_rhopert) data->rhopert = _managed_field(pool, bufsize);
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_kmh) data->kmh = _managed_field(pool, bufsize);
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_qvpert) data->qvpert = _managed_field(pool, bufsize);
+    if (io->output_vorticity_budget || io->output_momentum_budget) data->rhof = _managed_field(pool, bufsize);
+    // the sparse momentum budget doesn't need the gridded terms
+    if (io->output_vorticity_budget || (io->output_momentum_budget && !io->sparse_budget)) {
+        data->buoy = _managed_field(pool, bufsize);
+        data->pgradu = _managed_field(pool, bufsize);
+        data->pgradv = _managed_field(pool, bufsize);
+        data->pgradw = _managed_field(pool, bufsize);
+        data->turbu = _managed_field(pool, bufsize);
+        data->turbv = _managed_field(pool, bufsize);
+        data->turbw = _managed_field(pool, bufsize);
+        data->diffu = _managed_field(pool, bufsize);
+        data->diffv = _managed_field(pool, bufsize);
+        data->diffw = _managed_field(pool, bufsize);
     }
     if (io->output_vorticity_budget) {
-        cudaMallocManaged(&(data->xvtilt), bufsize*sizeof(float));
-        cudaMallocManaged(&(data->yvtilt), bufsize*sizeof(float));
-        cudaMallocManaged(&(data->zvtilt), bufsize*sizeof(float));
-        cudaMallocManaged(&(data->xvstretch), bufsize*sizeof(float));
-        cudaMallocManaged(&(data->yvstretch), bufsize*sizeof(float));
-        cudaMallocManaged(&(data->zvstretch), bufsize*sizeof(float));
-        cudaMallocManaged(&(data->turbxvort), bufsize*sizeof(float));
-        cudaMallocManaged(&(data->turbyvort), bufsize*sizeof(float));
-        cudaMallocManaged(&(data->turbzvort), bufsize*sizeof(float));
-        cudaMallocManaged(&(data->diffxvort), bufsize*sizeof(float));
-        cudaMallocManaged(&(data->diffyvort), bufsize*sizeof(float));
-        cudaMallocManaged(&(data->diffzvort), bufsize*sizeof(float));
-        cudaMallocManaged(&(data->xvort_baro), bufsize*sizeof(float)); 
-        cudaMallocManaged(&(data->yvort_baro), bufsize*sizeof(float)); 
-        cudaMallocManaged(&(data->xvort_solenoid), bufsize*sizeof(float)); 
-        cudaMallocManaged(&(data->yvort_solenoid), bufsize*sizeof(float)); 
-        cudaMallocManaged(&(data->zvort_solenoid), bufsize*sizeof(float)); 
+        data->xvtilt = _managed_field(pool, bufsize);
+        data->yvtilt = _managed_field(pool, bufsize);
+        data->zvtilt = _managed_field(pool, bufsize);
+        data->xvstretch = _managed_field(pool, bufsize);
+        data->yvstretch = _managed_field(pool, bufsize);
+        data->zvstretch = _managed_field(pool, bufsize);
+        data->turbxvort = _managed_field(pool, bufsize);
+        data->turbyvort = _managed_field(pool, bufsize);
+        data->turbzvort = _managed_field(pool, bufsize);
+        data->diffxvort = _managed_field(pool, bufsize);
+        data->diffyvort = _managed_field(pool, bufsize);
+        data->diffzvort = _managed_field(pool, bufsize);
+        data->xvort_baro = _managed_field(pool, bufsize); 
+        data->yvort_baro = _managed_field(pool, bufsize); 
+        data->xvort_solenoid = _managed_field(pool, bufsize); 
+        data->yvort_solenoid = _managed_field(pool, bufsize); 
+        data->zvort_solenoid = _managed_field(pool, bufsize); 
     }
 
     return data;
@@ -587,65 +822,375 @@ model_data* allocate_model_managed(iocfg *io, long bufsize) {
 /* Deallocate the struct of 4D arrays that store
    fields for integration and calculation. This 
    only ever gets called by Rank 0, so there
-   should be no need for a CPU counterpart. */
-void deallocate_model_managed(iocfg *io, model_data *data) {
-    cudaFree(data->ustag);
-    cudaFree(data->vstag);
-    cudaFree(data->wstag);
-    cudaFree(data->tem1);
-    cudaFree(data->tem2);
-    cudaFree(data->tem3);
-    cudaFree(data->tem4);
-    cudaFree(data->tem5);
-    cudaFree(data->tem6);
-
-    if (io->output_qc) cudaFree(data->qc);
-    if (io->output_qi) cudaFree(data->qi);
-    if (io->output_qs) cudaFree(data->qs);
-    if (io->output_qg) cudaFree(data->qg);
-
-    if (io->output_vorticity_budget || io->output_xvort) cudaFree(data->xvort);
-    if (io->output_vorticity_budget || io->output_yvort) cudaFree(data->yvort);
-    if (io->output_vorticity_budget || io->output_zvort) cudaFree(data->zvort);
-
-    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_ppert) cudaFree(data->pipert);
-    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_ppert) cudaFree(data->prespert);
-    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_thrhopert) cudaFree(data->thrhopert);
-    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_thetapert) cudaFree(data->thetapert);
-    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_rhopert) cudaFree(data->rhopert);
-    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_kmh) cudaFree(data->kmh);
-    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_qvpert) cudaFree(data->qvpert);
-    if (io->output_vorticity_budget || io->output_momentum_budget) {
-        cudaFree(data->rhof);
-        cudaFree(data->buoy);
-        cudaFree(data->pgradu);
-        cudaFree(data->pgradv);
-        cudaFree(data->pgradw);
-        cudaFree(data->turbu);
-        cudaFree(data->turbv);
-        cudaFree(data->turbw);
-        cudaFree(data->diffu);
-        cudaFree(data->diffv);
-        cudaFree(data->diffw);
+   should be no need for a CPU counterpart. Arrays
+   that came from a pool go back to it instead. */
+void deallocate_model_managed(iocfg *io, model_data *data, buffer_pool *pool) {
+    _free_managed_field(pool, data->ustag);
+    _free_managed_field(pool, data->vstag);
+    _free_managed_field(pool, data->wstag);
+    if (io->output_vorticity_budget) {
+        _free_managed_field(pool, data->tem1);
+        _free_managed_field(pool, data->tem2);
+        _free_managed_field(pool, data->tem3);
+        _free_managed_field(pool, data->tem4);
+        _free_managed_field(pool, data->tem5);
+        _free_managed_field(pool, data->tem6);
+    }
+
+    if (io->output_qc) _free_managed_field(pool, data->qc);
+    if (io->output_qi) _free_managed_field(pool, data->qi);
+    if (io->output_qs) _free_managed_field(pool, data->qs);
+    if (io->output_qg) _free_managed_field(pool, data->qg);
+
+    if (io->output_vorticity_budget || io->output_xvort) _free_managed_field(pool, data->xvort);
+    if (io->output_vorticity_budget || io->output_yvort) _free_managed_field(pool, data->yvort);
+    if (io->output_vorticity_budget || io->output_zvort) _free_managed_field(pool, data->zvort);
+
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_ppert) _free_managed_field(pool, data->pipert);
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_ppert) _free_managed_field(pool, data->prespert);
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_thrhopert) _free_managed_field(pool, data->thrhopert);
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_thetapert) _free_managed_field(pool, data->thetapert);
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_rhopert) _free_managed_field(pool, data->rhopert);
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_kmh) _free_managed_field(pool, data->kmh);
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_qvpert) _free_managed_field(pool, data->qvpert);
+    if (io->output_vorticity_budget || io->output_momentum_budget) _free_managed_field(pool, data->rhof);
+    // the sparse momentum budget doesn't need the gridded terms
+    if (io->output_vorticity_budget || (io->output_momentum_budget && !io->sparse_budget)) {
+        _free_managed_field(pool, data->buoy);
+        _free_managed_field(pool, data->pgradu);
+        _free_managed_field(pool, data->pgradv);
+        _free_managed_field(pool, data->pgradw);
+        _free_managed_field(pool, data->turbu);
+        _free_managed_field(pool, data->turbv);
+        _free_managed_field(pool, data->turbw);
+        _free_managed_field(pool, data->diffu);
+        _free_managed_field(pool, data->diffv);
+        _free_managed_field(pool, data->diffw);
     }
     if (io->output_vorticity_budget) {
-        cudaFree(data->xvtilt);
-        cudaFree(data->yvtilt);
-        cudaFree(data->zvtilt);
-        cudaFree(data->xvstretch);
-        cudaFree(data->yvstretch);
-        cudaFree(data->zvstretch);
-        cudaFree(data->turbxvort);
-        cudaFree(data->turbyvort);
-        cudaFree(data->turbzvort);
-        cudaFree(data->diffxvort);
-        cudaFree(data->diffyvort);
-        cudaFree(data->diffzvort);
-        cudaFree(data->xvort_baro);
-        cudaFree(data->yvort_baro);
-        cudaFree(data->xvort_solenoid); 
-        cudaFree(data->yvort_solenoid); 
-        cudaFree(data->zvort_solenoid); 
+        _free_managed_field(pool, data->xvtilt);
+        _free_managed_field(pool, data->yvtilt);
+        _free_managed_field(pool, data->zvtilt);
+        _free_managed_field(pool, data->xvstretch);
+        _free_managed_field(pool, data->yvstretch);
+        _free_managed_field(pool, data->zvstretch);
+        _free_managed_field(pool, data->turbxvort);
+        _free_managed_field(pool, data->turbyvort);
+        _free_managed_field(pool, data->turbzvort);
+        _free_managed_field(pool, data->diffxvort);
+        _free_managed_field(pool, data->diffyvort);
+        _free_managed_field(pool, data->diffzvort);
+        _free_managed_field(pool, data->xvort_baro);
+        _free_managed_field(pool, data->yvort_baro);
+        _free_managed_field(pool, data->xvort_solenoid); 
+        _free_managed_field(pool, data->yvort_solenoid); 
+        _free_managed_field(pool, data->zvort_solenoid); 
+    }
+}
+#endif
+
+/* Allocate the struct of 4D arrays that store
+   fields for integration and calculation in
+   regular CPU memory. This is what Rank 0 uses
+   when built without a GPU (CPU_ONLY). The arrays
+   are zero initialized so that the halo/boundary
+   points of calculated fields are well defined,
+   including ones that come from a pool. If an
+   arena is given, the fields that get read in
+   are laid out in it the way read_fields says. */
+model_data* allocate_model_cpu(iocfg *io, long bufsize, buffer_pool *pool, field_t *arena) {
+    model_data *data = new model_data();
+    // there's only one copy of the io config
+    // in CPU memory, so just point to it
+    data->io = io;
+    // where the fields that get read in go, if there's an arena
+    field_t *rd[N_READ_FIELDS];
+    read_fields(io, arena, bufsize, rd);
+
+    // Now, here we only allocate the arrays that we need based on the
+    // user supplied namelist configuration. This should help with a)
+    // not having to manually comment out the microphysics variables
+    // every time, and b) save on memory load when possible. 
+
+    // These are arrays that are 100% necessary for parcel integration.
+    data->ustag = _read_field(pool, bufsize, rd[0]);
+    data->vstag = _read_field(pool, bufsize, rd[1]);
+    data->wstag = _read_field(pool, bufsize, rd[2]);
+    // the vorticity budget is the only thing left that
+    // needs the temporary arrays
+    if (io->output_vorticity_budget) {
+        data->tem1 = _cpu_field(pool, bufsize);
+        data->tem2 = _cpu_field(pool, bufsize);
+        data->tem3 = _cpu_field(pool, bufsize);
+        data->tem4 = _cpu_field(pool, bufsize);
+        data->tem5 = _cpu_field(pool, bufsize);
+        data->tem6 = _cpu_field(pool, bufsize);
+    }
+    
+    // Arrays that are optional depending on if they need to be tracked along
+    // a parcel, or are part of a calculation/budget. 
+    if (io->output_qc) data->qc = _read_field(pool, bufsize, rd[9]);
+    if (io->output_qi) data->qi = _read_field(pool, bufsize, rd[10]);
+    if (io->output_qs) data->qs = _read_field(pool, bufsize, rd[11]);
+    if (io->output_qg) data->qg = _read_field(pool, bufsize, rd[12]);
+
+    if (io->output_vorticity_budget || io->output_xvort) data->xvort = _cpu_field(pool, bufsize);
+    if (io->output_vorticity_budget || io->output_yvort) data->yvort = _cpu_field(pool, bufsize);
+    if (io->output_vorticity_budget || io->output_zvort) data->zvort = _cpu_field(pool, bufsize);
+
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_ppert) data->pipert = _cpu_field(pool, bufsize);
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_ppert) data->prespert = _read_field(pool, bufsize, rd[4]);
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_thrhopert) data->thrhopert = _read_field(pool, bufsize, rd[6]);
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_thetapert) data->thetapert = _read_field(pool, bufsize, rd[5]);
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_rhopert) data->rhopert = _read_field(pool, bufsize, rd[7]);
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_kmh) data->kmh = _read_field(pool, bufsize, rd[3]);
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_qvpert) data->qvpert = _read_field(pool, bufsize, rd[8]);
+    if (io->output_vorticity_budget || io->output_momentum_budget) data->rhof = _cpu_field(pool, bufsize);
+    // the sparse momentum budget doesn't need the gridded terms
+    if (io->output_vorticity_budget || (io->output_momentum_budget && !io->sparse_budget)) {
+        data->buoy = _cpu_field(pool, bufsize);
+        data->pgradu = _cpu_field(pool, bufsize);
+        data->pgradv = _cpu_field(pool, bufsize);
+        data->pgradw = _cpu_field(pool, bufsize);
+        data->turbu = _cpu_field(pool, bufsize);
+        data->turbv = _cpu_field(pool, bufsize);
+        data->turbw = _cpu_field(pool, bufsize);
+        data->diffu = _cpu_field(pool, bufsize);
+        data->diffv = _cpu_field(pool, bufsize);
+        data->diffw = _cpu_field(pool, bufsize);
+    }
+    if (io->output_vorticity_budget) {
+        data->xvtilt = _cpu_field(pool, bufsize);
+        data->yvtilt = _cpu_field(pool, bufsize);
+        data->zvtilt = _cpu_field(pool, bufsize);
+        data->xvstretch = _cpu_field(pool, bufsize);
+        data->yvstretch = _cpu_field(pool, bufsize);
+        data->zvstretch = _cpu_field(pool, bufsize);
+        data->turbxvort = _cpu_field(pool, bufsize);
+        data->turbyvort = _cpu_field(pool, bufsize);
+        data->turbzvort = _cpu_field(pool, bufsize);
+        data->diffxvort = _cpu_field(pool, bufsize);
+        data->diffyvort = _cpu_field(pool, bufsize);
+        data->diffzvort = _cpu_field(pool, bufsize);
+        data->xvort_baro = _cpu_field(pool, bufsize); 
+        data->yvort_baro = _cpu_field(pool, bufsize); 
+        data->xvort_solenoid = _cpu_field(pool, bufsize); 
+        data->yvort_solenoid = _cpu_field(pool, bufsize); 
+        data->zvort_solenoid = _cpu_field(pool, bufsize); 
+    }
+
+    return data;
+}
+
+/* Deallocate the struct of 4D arrays that
+   were allocated on the CPU, or give them
+   back to the pool they came from. The ones
+   in the arena belong to whoever passed it. */
+void deallocate_model_cpu(iocfg *io, model_data *data, buffer_pool *pool, field_t *arena) {
+    _free_read_field(pool, data->ustag, arena);
+    _free_read_field(pool, data->vstag, arena);
+    _free_read_field(pool, data->wstag, arena);
+    if (io->output_vorticity_budget) {
+        _free_cpu_field(pool, data->tem1);
+        _free_cpu_field(pool, data->tem2);
+        _free_cpu_field(pool, data->tem3);
+        _free_cpu_field(pool, data->tem4);
+        _free_cpu_field(pool, data->tem5);
+        _free_cpu_field(pool, data->tem6);
+    }
+
+    if (io->output_qc) _free_read_field(pool, data->qc, arena);
+    if (io->output_qi) _free_read_field(pool, data->qi, arena);
+    if (io->output_qs) _free_read_field(pool, data->qs, arena);
+    if (io->output_qg) _free_read_field(pool, data->qg, arena);
+
+    if (io->output_vorticity_budget || io->output_xvort) _free_cpu_field(pool, data->xvort);
+    if (io->output_vorticity_budget || io->output_yvort) _free_cpu_field(pool, data->yvort);
+    if (io->output_vorticity_budget || io->output_zvort) _free_cpu_field(pool, data->zvort);
+
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_ppert) _free_cpu_field(pool, data->pipert);
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_ppert) _free_read_field(pool, data->prespert, arena);
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_thrhopert) _free_read_field(pool, data->thrhopert, arena);
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_thetapert) _free_read_field(pool, data->thetapert, arena);
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_rhopert) _free_read_field(pool, data->rhopert, arena);
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_kmh) _free_read_field(pool, data->kmh, arena);
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_qvpert) _free_read_field(pool, data->qvpert, arena);
+    if (io->output_vorticity_budget || io->output_momentum_budget) _free_cpu_field(pool, data->rhof);
+    // the sparse momentum budget doesn't need the gridded terms
+    if (io->output_vorticity_budget || (io->output_momentum_budget && !io->sparse_budget)) {
+        _free_cpu_field(pool, data->buoy);
+        _free_cpu_field(pool, data->pgradu);
+        _free_cpu_field(pool, data->pgradv);
+        _free_cpu_field(pool, data->pgradw);
+        _free_cpu_field(pool, data->turbu);
+        _free_cpu_field(pool, data->turbv);
+        _free_cpu_field(pool, data->turbw);
+        _free_cpu_field(pool, data->diffu);
+        _free_cpu_field(pool, data->diffv);
+        _free_cpu_field(pool, data->diffw);
+    }
+    if (io->output_vorticity_budget) {
+        _free_cpu_field(pool, data->xvtilt);
+        _free_cpu_field(pool, data->yvtilt);
+        _free_cpu_field(pool, data->zvtilt);
+        _free_cpu_field(pool, data->xvstretch);
+        _free_cpu_field(pool, data->yvstretch);
+        _free_cpu_field(pool, data->zvstretch);
+        _free_cpu_field(pool, data->turbxvort);
+        _free_cpu_field(pool, data->turbyvort);
+        _free_cpu_field(pool, data->turbzvort);
+        _free_cpu_field(pool, data->diffxvort);
+        _free_cpu_field(pool, data->diffyvort);
+        _free_cpu_field(pool, data->diffzvort);
+        _free_cpu_field(pool, data->xvort_baro);
+        _free_cpu_field(pool, data->yvort_baro);
+        _free_cpu_field(pool, data->xvort_solenoid); 
+        _free_cpu_field(pool, data->yvort_solenoid); 
+        _free_cpu_field(pool, data->zvort_solenoid); 
+    }
+    delete data;
+}
+
+/* Which of the fields that get read in from the history files this io
+   config needs, in the order u, v, w, kmh, prespert, thpert, thrhopert,
+   rhopert, qvpert, qc, qi, qs, qg. */
+void read_field_flags(iocfg *io, int *want) {
+    int budget = io->output_momentum_budget || io->output_vorticity_budget;
+    want[0] = 1; want[1] = 1; want[2] = 1;
+    want[3] = budget || io->output_kmh;
+    want[4] = budget || io->output_ppert;
+    want[5] = budget || io->output_thetapert;
+    want[6] = budget || io->output_thrhopert;
+    want[7] = budget || io->output_rhopert;
+    want[8] = budget || io->output_qvpert;
+    want[9] = io->output_qc;
+    want[10] = io->output_qi;
+    want[11] = io->output_qs;
+    want[12] = io->output_qg;
+}
+
+/* Lay the fields that get read in out one after another in arena,
+   bufsize apiece, in the same order as read_field_flags. The ones
+   that don't get read are NULL, and so is everything if there's no
+   arena. Returns how many fields the arena needs room for, so it can
+   be sized with this too. */
+int read_fields(iocfg *io, field_t *arena, long bufsize, field_t **flds) {
+    int want[N_READ_FIELDS];
+    read_field_flags(io, want);
+    int n = 0;
+    for (int f = 0; f < N_READ_FIELDS; ++f) {
+        flds[f] = NULL;
+        if (!want[f]) continue;
+        if (arena != NULL) flds[f] = arena + n*bufsize;
+        n += 1;
+    }
+    return n;
+}
+
+/* The arrays of model_data that the fields that get read in go in,
+   in the same order as read_field_flags, or NULL if they don't */
+void model_read_fields(iocfg *io, model_data *data, field_t **flds) {
+    int want[N_READ_FIELDS];
+    read_field_flags(io, want);
+    field_t *arrs[N_READ_FIELDS] = {data->ustag, data->vstag, data->wstag, data->kmh, data->prespert, \
+                                    data->thetapert, data->thrhopert, data->rhopert, data->qvpert, \
+                                    data->qc, data->qi, data->qs, data->qg};
+    for (int f = 0; f < N_READ_FIELDS; ++f) flds[f] = (want[f]) ? arrs[f] : NULL;
+}
+
+/* Collect the 4D arrays of model_data that were allocated for
+   this io config into flds, and return how many there are. The
+   temporary arrays are left out, since they don't hold on to
+   anything from one chunk to the next. */
+int _model_fields(iocfg *io, model_data *data, field_t **flds) {
+    int n = 0;
+    // the other MPI ranks don't have any arrays
+    if (data->ustag == NULL) return 0;
+    flds[n++] = data->ustag;
+    flds[n++] = data->vstag;
+    flds[n++] = data->wstag;
+
+    if (io->output_qc) flds[n++] = data->qc;
+    if (io->output_qi) flds[n++] = data->qi;
+    if (io->output_qs) flds[n++] = data->qs;
+    if (io->output_qg) flds[n++] = data->qg;
+
+    if (io->output_vorticity_budget || io->output_xvort) flds[n++] = data->xvort;
+    if (io->output_vorticity_budget || io->output_yvort) flds[n++] = data->yvort;
+    if (io->output_vorticity_budget || io->output_zvort) flds[n++] = data->zvort;
+
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_ppert) flds[n++] = data->pipert;
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_ppert) flds[n++] = data->prespert;
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_thrhopert) flds[n++] = data->thrhopert;
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_thetapert) flds[n++] = data->thetapert;
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_rhopert) flds[n++] = data->rhopert;
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_kmh) flds[n++] = data->kmh;
+    if (io->output_vorticity_budget || io->output_momentum_budget || io->output_qvpert) flds[n++] = data->qvpert;
+    if (io->output_vorticity_budget || io->output_momentum_budget) flds[n++] = data->rhof;
+    if (io->output_vorticity_budget || (io->output_momentum_budget && !io->sparse_budget)) {
+        flds[n++] = data->buoy;
+        flds[n++] = data->pgradu;
+        flds[n++] = data->pgradv;
+        flds[n++] = data->pgradw;
+        flds[n++] = data->turbu;
+        flds[n++] = data->turbv;
+        flds[n++] = data->turbw;
+        flds[n++] = data->diffu;
+        flds[n++] = data->diffv;
+        flds[n++] = data->diffw;
+    }
+    if (io->output_vorticity_budget) {
+        flds[n++] = data->xvtilt;
+        flds[n++] = data->yvtilt;
+        flds[n++] = data->zvtilt;
+        flds[n++] = data->xvstretch;
+        flds[n++] = data->yvstretch;
+        flds[n++] = data->zvstretch;
+        flds[n++] = data->turbxvort;
+        flds[n++] = data->turbyvort;
+        flds[n++] = data->turbzvort;
+        flds[n++] = data->diffxvort;
+        flds[n++] = data->diffyvort;
+        flds[n++] = data->diffzvort;
+        flds[n++] = data->xvort_baro;
+        flds[n++] = data->yvort_baro;
+        flds[n++] = data->xvort_solenoid;
+        flds[n++] = data->yvort_solenoid;
+        flds[n++] = data->zvort_solenoid;
+    }
+    return n;
+}
+
+/* Slide the time window of the model arrays forward by shift levels.
+   The levels that are still in the window get moved down to the start
+   of the arrays, derived fields and all, so the next chunk only has to
+   read in the levels after them. The kernels all index the time levels
+   directly, so moving the few levels that get kept is a lot simpler
+   than teaching every one of them to wrap around, and it's nothing
+   next to reading them again. N is the size of one time level. */
+void slide_model_window(iocfg *io, model_data *data, long N, int shift) {
+    int nKeep = data->nValid - shift;
+    if (nKeep < 0) nKeep = 0;
+    field_t *flds[64];
+    int nFlds = _model_fields(io, data, flds);
+    if (nKeep > 0) {
+        for (int f = 0; f < nFlds; ++f) {
+            memmove(flds[f], flds[f] + shift*N, nKeep*N*sizeof(field_t));
+        }
+    }
+    data->tFirst += shift;
+    data->nValid = nKeep;
+    data->nDerived = (data->nDerived > shift) ? data->nDerived - shift : 0;
+}
+
+/* Fill time level lvl with a copy of the level before it. This
+   is for levels past the end of the history files, where we just
+   hold everything constant. */
+void hold_model_level(iocfg *io, model_data *data, long N, int lvl) {
+    field_t *flds[64];
+    int nFlds = _model_fields(io, data, flds);
+    for (int f = 0; f < nFlds; ++f) {
+        memcpy(flds[f] + lvl*N, flds[f] + (lvl-1)*N, N*sizeof(field_t));
     }
 }
 #endif
@@ -5,8 +5,13 @@
 #include "mpi.h"
 #include <stdio.h>
 #include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include "../include/macros.h"
 #include "../include/datastructs.h"
+#include "../parcel/gridlookup.cu"
 
 extern "C" {
 #include <lofs-read.h>
@@ -53,6 +58,34 @@ int filetype = NC_NETCDF4;
 int saved_staggered_mesh_params = 1;
 int nthreads = 1;
 
+// size in grid points of the tiles the field
+// cache keeps each variable in at every time
+#define CACHE_TILE_I 64
+#define CACHE_TILE_J 64
+#define CACHE_TILE_K 32
+
+/* With a cache directory set, the 3D fields get read in from LOFS a
+   whole tile at a time and saved there already decompressed, so that
+   later runs over the same part of the same dataset can map the tiles
+   straight into memory instead of decompressing them all over again.
+   Each file is one variable at one history time in one tile, and is
+   named after all three. It's a small header and then the raw floats,
+   in the same order LOFS hands them back (i fastest, then j, then k).
+   The tiles of each dataset get a directory of their own in the cache,
+   so more than one dataset can share it. */
+struct cache_header {
+    char magic[8];
+    int i0, j0, k0;
+    int ni, nj, nk;
+};
+const char CACHE_MAGIC[8] = {'L', 'O', 'F', 'T', 'C', 'A', 'C', '1'};
+
+// the dataset's directory in the cache, or empty if there's no cache
+char cachedir[PATH_MAX+1] = "";
+// tiles that were already in the cache, and tiles that had to be read
+long cache_hits = 0;
+long cache_misses = 0;
+
 
 // just a simple 1D array print 
 // used for some sanity checking
@@ -64,114 +97,195 @@ void print_arr(float *arr, int N) {
     std::cout << std::endl;
 }
 
+// The full mesh and base state arrays out of the first file. They
+// get read in once along with the dataset structure, and every grid
+// (or grid subset) after that is just a slice of them.
+struct lofs_mesh {
+    float *xhfull;
+    float *yhfull;
+    float *xffull;
+    float *yffull;
+    float *zh;
+    float *zf;
+    float *qv0;
+    float *th0;
+    float *rho0;
+    float *p0;
+    float *u0;
+    float *v0;
+};
+lofs_mesh full_mesh;
+// the whole saved domain, see lofs_full_grid
+datagrid *full_grid = NULL;
+
+// Send n strings of len chars each from rank 0 to everyone
+// else, all in one go since there can be thousands of them
+void _bcast_strings(char **strs, int n, int len, int rank) {
+    char *buf = new char[(long)n*len];
+    if (rank == 0) {
+        for (int i = 0; i < n; ++i) memcpy(&(buf[(long)i*len]), strs[i], len);
+    }
+    MPI_Bcast(buf, n*len, MPI_CHAR, 0, MPI_COMM_WORLD);
+    if (rank != 0) {
+        for (int i = 0; i < n; ++i) memcpy(strs[i], &(buf[(long)i*len]), len);
+    }
+    delete[] buf;
+}
+
+// Read the mesh and base state out of the first file on rank 0,
+// and hand them out to all of the other ranks
+void _lofs_get_mesh(int rank) {
+    full_mesh.xhfull = new float[nx];
+    full_mesh.yhfull = new float[ny];
+    // staggered arrays have +1 to their
+    // respective dimension
+    full_mesh.xffull = new float[nx+1];
+    full_mesh.yffull = new float[ny+1];
+    full_mesh.zh = new float[nz];
+    full_mesh.zf = new float[nz+1];
+    full_mesh.qv0 = new float[nz];
+    full_mesh.th0 = new float[nz];
+    full_mesh.rho0 = new float[nz];
+    full_mesh.p0 = new float[nz];
+    full_mesh.u0 = new float[nz];
+    full_mesh.v0 = new float[nz];
+
+    if (rank == 0) {
+        // open the first found HDF5 files and use it to
+        // construct our grid in memory. Since it's a self-describing
+        // file system, only 1 file is needed to construct the whole
+        // grid in order to then subset it. Yay for not having to
+        // reconstruct the whole thing!!!
+        hid_t f_id = H5Fopen(firstfilename, H5F_ACC_RDONLY,H5P_DEFAULT);
+
+        // how much vertical data is actually written?
+        printf("Attemtping to determine vertical write size...\n");
+        //get0dint (f_id,(char *)"namelist/orf_io/nkwrite_val",&nkwrite_val);
+        get0dint (f_id,(char *)"grid/nkwrite_val",&nkwrite_val);
+        printf("NKWRITE: %d\n", nkwrite_val);
+
+        // fill the arrays with the goods
+        get1dfloat( f_id, (char *)"mesh/xhfull", full_mesh.xhfull, 0, nx );
+        get1dfloat( f_id, (char *)"mesh/yhfull", full_mesh.yhfull, 0, ny );
+        get1dfloat( f_id, (char *)"mesh/xffull", full_mesh.xffull, 0, nx+1 );
+        get1dfloat( f_id, (char *)"mesh/yffull", full_mesh.yffull, 0, ny+1 );
+        get1dfloat( f_id, (char *)"mesh/zh", full_mesh.zh, 0, nz );
+        get1dfloat( f_id, (char *)"mesh/zf", full_mesh.zf, 0, nz+1 );
+        get1dfloat(f_id, (char *)"basestate/qv0", full_mesh.qv0, 0, nz);
+        get1dfloat(f_id, (char *)"basestate/th0", full_mesh.th0, 0, nz);
+        get1dfloat(f_id, (char *)"basestate/rh0", full_mesh.rho0, 0, nz);
+        get1dfloat(f_id, (char *)"basestate/pres0", full_mesh.p0, 0, nz);
+        get1dfloat(f_id, (char *)"basestate/u0", full_mesh.u0, 0, nz);
+        get1dfloat(f_id, (char *)"basestate/v0", full_mesh.v0, 0, nz);
+        H5Fclose(f_id);
+    }
+
+    MPI_Bcast(&nkwrite_val, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(full_mesh.xhfull, nx, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(full_mesh.yhfull, ny, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(full_mesh.xffull, nx+1, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(full_mesh.yffull, ny+1, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(full_mesh.zh, nz, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(full_mesh.zf, nz+1, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(full_mesh.qv0, nz, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(full_mesh.th0, nz, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(full_mesh.rho0, nz, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(full_mesh.p0, nz, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(full_mesh.u0, nz, MPI_FLOAT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(full_mesh.v0, nz, MPI_FLOAT, 0, MPI_COMM_WORLD);
+}
+
 // This is all lifted from the grok function in hdf2.c of LOFS
 // but cleaned up a little bit to be more C++ esque with it's
-// memory allocation because C++ is prettier
-void lofs_get_dataset_structure(std::string base_dir) {
+// memory allocation because C++ is prettier. Walking all of the
+// time and node directories is a lot of metadata traffic on a
+// parallel filesystem, so only rank 0 does it, along with reading
+// the mesh, and then sends all of it out to the other ranks.
+void lofs_get_dataset_structure(std::string base_dir, int rank) {
 
     // get the c string representation
     // of the directory for use with LOFS functions
     strcpy(topdir, base_dir.c_str());
 
-    // query the number of directories corresponding to 
-    // times in the dataset
-    ntimedirs = get_num_time_dirs(topdir, debug, 0);
-    cout << "MY TIME DIRS = " << ntimedirs << endl;
-
-    // allocate an array containing
-    // all of the directories for all times
-    timedir = new char*[ntimedirs];
-    for (int i = 0; i < ntimedirs; ++i) {
-        timedir[i] = new char[MAXSTR];
-    }
-    
-    // get the double representation of time times
-    // from the filestructure
-    dirtimes = new double[ntimedirs];
-    get_sorted_time_dirs(topdir,timedir,dirtimes,ntimedirs,debug, 0);
-
-    // query the number of directories corresponding to compute nodes
-    nnodedirs =  get_num_node_dirs(topdir,timedir[0],debug, 0);
-    // allocate and get the array of strings for the nodedirs
-    nodedir = new char*[nnodedirs];
-    // ORF 8 == 7 zero padded node number directory name plus 1 end of string char
-    for (int i = 0; i < nnodedirs; ++i) {
-        nodedir[i] = new char[8];
+    if (rank == 0) {
+        // query the number of directories corresponding to 
+        // times in the dataset
+        ntimedirs = get_num_time_dirs(topdir, debug, 0);
+        cout << "MY TIME DIRS = " << ntimedirs << endl;
+
+        // allocate an array containing
+        // all of the directories for all times
+        timedir = new char*[ntimedirs];
+        for (int i = 0; i < ntimedirs; ++i) {
+            timedir[i] = new char[MAXSTR];
+        }
+        
+        // get the double representation of time times
+        // from the filestructure
+        dirtimes = new double[ntimedirs];
+        get_sorted_time_dirs(topdir,timedir,dirtimes,ntimedirs,debug, 0);
+
+        // query the number of directories corresponding to compute nodes
+        nnodedirs =  get_num_node_dirs(topdir,timedir[0],debug, 0);
+        // allocate and get the array of strings for the nodedirs
+        nodedir = new char*[nnodedirs];
+        // ORF 8 == 7 zero padded node number directory name plus 1 end of string char
+        for (int i = 0; i < nnodedirs; ++i) {
+            nodedir[i] = new char[8];
+        }
+        // sort the node directories
+        get_sorted_node_dirs(topdir,timedir[0],nodedir,&dn,nnodedirs,debug, 0);
+
+        // get all of the available times
+        // from the dataset
+        alltimes = get_all_available_times(topdir,timedir,ntimedirs,nodedir,nnodedirs,
+                                            &ntottimes,firstfilename,&firsttimedirindex, 
+                                            &saved_X0,&saved_Y0,&saved_X1,&saved_Y1,debug, 0);
+
+        // the dimensions of the whole domain
+        get_hdf_metadata(firstfilename,&nx,&ny,&nz,&nodex,&nodey);
     }
-    // sort the node directories
-    get_sorted_node_dirs(topdir,timedir[0],nodedir,&dn,nnodedirs,debug, 0);
 
-    // get all of the available times
-    // from the dataset
-    alltimes = get_all_available_times(topdir,timedir,ntimedirs,nodedir,nnodedirs,
-                                        &ntottimes,firstfilename,&firsttimedirindex, 
-                                        &saved_X0,&saved_Y0,&saved_X1,&saved_Y1,debug, 0);
+    // everyone else gets the sizes first so they have somewhere
+    // to put the directory names and times
+    int sizes[14] = {ntimedirs, nnodedirs, dn, ntottimes, firsttimedirindex, \
+                     saved_X0, saved_Y0, saved_X1, saved_Y1, nx, ny, nz, nodex, nodey};
+    MPI_Bcast(sizes, 14, MPI_INT, 0, MPI_COMM_WORLD);
+    if (rank != 0) {
+        ntimedirs = sizes[0]; nnodedirs = sizes[1]; dn = sizes[2];
+        ntottimes = sizes[3]; firsttimedirindex = sizes[4];
+        saved_X0 = sizes[5]; saved_Y0 = sizes[6]; saved_X1 = sizes[7]; saved_Y1 = sizes[8];
+        nx = sizes[9]; ny = sizes[10]; nz = sizes[11]; nodex = sizes[12]; nodey = sizes[13];
+
+        timedir = new char*[ntimedirs];
+        for (int i = 0; i < ntimedirs; ++i) timedir[i] = new char[MAXSTR];
+        nodedir = new char*[nnodedirs];
+        for (int i = 0; i < nnodedirs; ++i) nodedir[i] = new char[8];
+        dirtimes = new double[ntimedirs];
+        alltimes = new double[ntottimes];
+    }
+    _bcast_strings(timedir, ntimedirs, MAXSTR, rank);
+    _bcast_strings(nodedir, nnodedirs, 8, rank);
+    MPI_Bcast(dirtimes, ntimedirs, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(alltimes, ntottimes, MPI_DOUBLE, 0, MPI_COMM_WORLD);
+    MPI_Bcast(firstfilename, MAXSTR, MPI_CHAR, 0, MPI_COMM_WORLD);
 
+    _lofs_get_mesh(rank);
 }
 
 
 // get the grid info and return the volume subset of the
-// grid we are interested in
+// grid we are interested in. The mesh got read in along with
+// the dataset structure, so this doesn't touch the disk.
 void lofs_get_grid( datagrid *grid ) {
 	
-	hid_t f_id;
-	int NX,NY,NZ;
-    int nk, nj, ni;
-    int ngz = 1;
-    // open the first found HDF5 files and use it to
-    // construct our grid in memory. Since it's a self-describing
-    // file system, only 1 file is needed to construct the whole
-    // grid in order to then subset it. Yay for not having to
-    // reconstruct the whole thing!!!
-    f_id = H5Fopen(firstfilename, H5F_ACC_RDONLY,H5P_DEFAULT);
-
-    // how much vertical data is actually written?
-    printf("Attemtping to determine vertical write size...\n");
-    //get0dint (f_id,(char *)"namelist/orf_io/nkwrite_val",&nkwrite_val);
-    get0dint (f_id,(char *)"grid/nkwrite_val",&nkwrite_val);
-    printf("NKWRITE: %d\n", nkwrite_val);
-    // how many points are in our 
-    // subset?
-	NX = grid->NX;
-	NY = grid->NY;
-	NZ = grid->NZ;
-    nk = NZ; nj = NY; ni = NX;
-
-
-    // allocate memory for the grid arrays
-    float *xhfull = new float[nx];
-    float *yhfull = new float[ny];
-    // staggered arrays have +1 to their
-    // respective dimension
-    float *xffull = new float[nx+1];
-    float *yffull = new float[ny+1];
-
-    float *zh_save = new float[nz];
-    float *zf_save = new float[nz+1]; 
     float *zh = new float[nz+1];
     float *zf = new float[nz+2];
+    float *xhfull = full_mesh.xhfull;
+    float *yhfull = full_mesh.yhfull;
+    float *xffull = full_mesh.xffull;
+    float *yffull = full_mesh.yffull;
     float dx, dy, dz;
-    float rdx, rdy, rdz;
-
-    // fill the arrays with the goods
-    get1dfloat( f_id, (char *)"mesh/xhfull", xhfull, 0, nx );
-    get1dfloat( f_id, (char *)"mesh/yhfull", yhfull, 0, ny );
-    get1dfloat( f_id, (char *)"mesh/xffull", xffull, 0, nx+1 );
-    get1dfloat( f_id, (char *)"mesh/yffull", yffull, 0, ny+1 );
-    get1dfloat( f_id, (char *)"mesh/zh", zh_save, 0, nz );
-    get1dfloat( f_id, (char *)"mesh/zf", zf_save, 0, nz+1 );
-    float *qv0 = new float[nz];
-    float *th0 = new float[nz];
-    float *rho0 = new float[nz];
-    float *p0 = new float[nz];
-    float *u0 = new float[nz];
-    float *v0 = new float[nz];
-    get1dfloat(f_id, (char *)"basestate/qv0", qv0, 0, nz);
-    get1dfloat(f_id, (char *)"basestate/th0", th0, 0, nz);
-    get1dfloat(f_id, (char *)"basestate/rh0", rho0, 0, nz);
-    get1dfloat(f_id, (char *)"basestate/pres0", p0, 0, nz);
-    get1dfloat(f_id, (char *)"basestate/u0", u0, 0, nz);
-    get1dfloat(f_id, (char *)"basestate/v0", v0, 0, nz);
 
 
     // We want to include the lower ghost zone in the vertical
@@ -180,26 +294,23 @@ void lofs_get_grid( datagrid *grid ) {
     // going below the surface, the ghost zones are used as a 
     // reflective boundary. This attempts to recreate that. 
 
-    for (int iz = 0; iz < grid->Z1; iz++)   zh[iz+1] = zh_save[iz];
-    for (int iz = 0; iz < grid->Z1+1; iz++) zf[iz+1] = zf_save[iz];
+    for (int iz = 0; iz < grid->Z1; iz++)   zh[iz+1] = full_mesh.zh[iz];
+    for (int iz = 0; iz < grid->Z1+1; iz++) zf[iz+1] = full_mesh.zf[iz];
     // set the reflective ghost zone boundary here
     zf[0] = -zf[2]; //param.F
     zh[0] = -zh[1]; //param.F
-    delete[] zf_save;
-    delete[] zh_save;
 
     // fill the z arrays with the subset portion
     // of the vertical dimension
 	for (int iz = grid->Z0; iz <= grid->Z1; iz++) {
-        grid->qv0[iz-grid->Z0] = qv0[iz];
-        grid->th0[iz-grid->Z0] = th0[iz];
-        grid->rho0[iz-grid->Z0] = rho0[iz];
-        grid->p0[iz-grid->Z0] = p0[iz];
-        grid->u0[iz-grid->Z0] = u0[iz];
-        grid->v0[iz-grid->Z0] = v0[iz];
+        grid->qv0[iz-grid->Z0] = full_mesh.qv0[iz];
+        grid->th0[iz-grid->Z0] = full_mesh.th0[iz];
+        grid->rho0[iz-grid->Z0] = full_mesh.rho0[iz];
+        grid->p0[iz-grid->Z0] = full_mesh.p0[iz];
+        grid->u0[iz-grid->Z0] = full_mesh.u0[iz];
+        grid->v0[iz-grid->Z0] = full_mesh.v0[iz];
     }
 
-
     // We recreate George's mesh/derivative calculation paradigm even though
     // // we are usually isotropic. We need to have our code here match what
     // // CM1 does internally for stretched and isotropic meshes.
@@ -225,6 +336,9 @@ void lofs_get_grid( datagrid *grid ) {
     grid->dx = dx;
     grid->dy = dy;
     grid->dz = dz;
+    // precompute what we need for the fast
+    // grid cell lookups
+    set_grid_lookup(grid);
 
     // fill the x and y arrays with the subset
     // portion of the horizontal dimensions
@@ -238,18 +352,164 @@ void lofs_get_grid( datagrid *grid ) {
     MF(0) = MF(1);
 
 
-    delete[] xffull;
-    delete[] yffull;
-    delete[] xhfull;
-    delete[] yhfull;
     delete[] zh;
     delete[] zf;
-    delete[] rho0;
-    delete[] qv0;
-    delete[] th0;
-    delete[] p0;
-    delete[] u0;
-    delete[] v0;
+}
+
+// The whole saved domain as a grid, for finding which grid cells the
+// parcels are in before a subset gets requested. It only gets built
+// the first time it's asked for.
+datagrid* lofs_full_grid() {
+    if (full_grid == NULL) {
+        full_grid = allocate_grid_cpu( saved_X0, saved_X1, saved_Y0, saved_Y1, 0, nz-1);
+        lofs_get_grid(full_grid);
+    }
+    return full_grid;
+}
+
+/* Turn on the field cache in dir. The dataset gets its own directory in
+   there, named after a hash of its path and shape. If the directories
+   can't be made, the cache just stays off. Every rank calls this after
+   lofs_get_dataset_structure. */
+void lofs_open_cache(std::string dir, int rank) {
+    if (dir.empty()) return;
+    char path[PATH_MAX+1];
+    if (realpath(topdir, path) == NULL) strcpy(path, topdir);
+    string key = string(path) + " " + to_string(nx) + " " + to_string(ny) + " " + to_string(nz) + " " + \
+                 to_string(saved_X0) + " " + to_string(saved_Y0) + " " + to_string(saved_X1) + " " + \
+                 to_string(saved_Y1) + " " + to_string(nkwrite_val);
+    // FNV-1a
+    unsigned long long h = 14695981039346656037ULL;
+    for (size_t c = 0; c < key.size(); ++c) {
+        h ^= (unsigned char) key[c];
+        h *= 1099511628211ULL;
+    }
+    char name[17];
+    snprintf(name, sizeof(name), "%016llx", h);
+    string sub = dir + "/" + name;
+    // the other ranks might be making them at the same time
+    mkdir(dir.c_str(), 0755);
+    mkdir(sub.c_str(), 0755);
+    struct stat st;
+    if ((sub.size() > PATH_MAX) || (stat(sub.c_str(), &st) != 0) || !S_ISDIR(st.st_mode)) {
+        if (rank == 0) cerr << "Couldn't make the cache directory " << sub << ", not caching fields." << endl;
+        return;
+    }
+    strcpy(cachedir, sub.c_str());
+    if (rank == 0) cout << "Caching fields in " << cachedir << endl;
+}
+
+void _cache_tile_name(char *name, char *varname, double t0, int ti, int tj, int tk) {
+    snprintf(name, PATH_MAX+1, "%s/%s_%.6f_%d_%d_%d", cachedir, varname, t0, ti, tj, tk);
+}
+
+/* Map a tile in from the cache, or return NULL if it isn't there
+   (or isn't the tile it should be). It gets unmapped with munmap
+   and the size that comes back in nbytes. */
+float* _map_cache_tile(char *name, int i0, int j0, int k0, int ni, int nj, int nk, size_t *nbytes) {
+    int fd = open(name, O_RDONLY);
+    if (fd < 0) return NULL;
+    *nbytes = sizeof(cache_header) + (size_t)ni*nj*nk*sizeof(float);
+    struct stat st;
+    void *map = MAP_FAILED;
+    if ((fstat(fd, &st) == 0) && ((size_t)st.st_size == *nbytes)) {
+        map = mmap(NULL, *nbytes, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd);
+    if (map == MAP_FAILED) return NULL;
+    cache_header *hdr = (cache_header *) map;
+    if ((memcmp(hdr->magic, CACHE_MAGIC, 8) != 0) || (hdr->i0 != i0) || (hdr->j0 != j0) || (hdr->k0 != k0) || \
+        (hdr->ni != ni) || (hdr->nj != nj) || (hdr->nk != nk)) {
+        munmap(map, *nbytes);
+        return NULL;
+    }
+    return (float *)(hdr + 1);
+}
+
+/* Save a tile that just got read in to the cache. It gets written
+   under a name of its own and then renamed into place, so nobody
+   else ever maps half of one. */
+void _save_cache_tile(char *name, float *tile, int i0, int j0, int k0, int ni, int nj, int nk) {
+    static bool warned = false;
+    cache_header hdr;
+    memcpy(hdr.magic, CACHE_MAGIC, 8);
+    hdr.i0 = i0; hdr.j0 = j0; hdr.k0 = k0;
+    hdr.ni = ni; hdr.nj = nj; hdr.nk = nk;
+    string tmp = string(name) + ".tmp" + to_string((long)getpid());
+    FILE *f = fopen(tmp.c_str(), "wb");
+    size_t n = (size_t)ni*nj*nk;
+    bool ok = (f != NULL);
+    if (ok) ok = (fwrite(&hdr, sizeof(hdr), 1, f) == 1) && (fwrite(tile, sizeof(float), n, f) == n);
+    if (f != NULL) ok = (fclose(f) == 0) && ok;
+    if (ok) ok = (rename(tmp.c_str(), name) == 0);
+    if (!ok) {
+        remove(tmp.c_str());
+        if (!warned) cerr << "Couldn't write " << name << " to the field cache." << endl;
+        warned = true;
+    }
+}
+
+/* Fill buffer with points X0 to X1, Y0 to Y1, and Z0 to Z1 (all inclusive)
+   of a variable out of the tiles of the cache, reading and saving any
+   tiles that aren't in it yet. Returns false if there's no cache, or the
+   request goes outside of what the tiles cover, in which case it has to
+   get read the usual way. */
+bool _read_cached(float *buffer, char *varname, double t0, int X0, int Y0, int X1, int Y1, int Z0, int Z1) {
+    if (cachedir[0] == '\0') return false;
+    if ((X0 < saved_X0) || (X1 > saved_X1) || (Y0 < saved_Y0) || (Y1 > saved_Y1) || \
+        (Z0 < 0) || (Z1 > nkwrite_val-1)) return false;
+    long nir = X1-X0+1;
+    long njr = Y1-Y0+1;
+    char name[PATH_MAX+1];
+    for (int tk = Z0 / CACHE_TILE_K; tk <= Z1 / CACHE_TILE_K; ++tk) {
+    for (int tj = (Y0-saved_Y0) / CACHE_TILE_J; tj <= (Y1-saved_Y0) / CACHE_TILE_J; ++tj) {
+    for (int ti = (X0-saved_X0) / CACHE_TILE_I; ti <= (X1-saved_X0) / CACHE_TILE_I; ++ti) {
+        // the points this tile covers
+        int i0 = saved_X0 + ti*CACHE_TILE_I;
+        int j0 = saved_Y0 + tj*CACHE_TILE_J;
+        int k0 = tk*CACHE_TILE_K;
+        int ni = min(CACHE_TILE_I, saved_X1 - i0 + 1);
+        int nj = min(CACHE_TILE_J, saved_Y1 - j0 + 1);
+        int nk = min(CACHE_TILE_K, nkwrite_val - k0);
+
+        _cache_tile_name(name, varname, t0, ti, tj, tk);
+        size_t nbytes = 0;
+        float *tile = _map_cache_tile(name, i0, j0, k0, ni, nj, nk, &nbytes);
+        bool mapped = (tile != NULL);
+        if (mapped) cache_hits += 1;
+        else {
+            cache_misses += 1;
+            tile = new float[(size_t)ni*nj*nk];
+            read_hdf_mult_md(tile,topdir,timedir,nodedir,ntimedirs,dn,dirtimes,alltimes,ntottimes,t0,varname, \
+                    i0,j0,i0+ni-1,j0+nj-1,k0,k0+nk-1,nx,ny,nz,nodex,nodey);
+            _save_cache_tile(name, tile, i0, j0, k0, ni, nj, nk);
+        }
+
+        // and copy over the part of it that got asked for
+        int ilo = max(X0, i0), ihi = min(X1, i0+ni-1);
+        int jlo = max(Y0, j0), jhi = min(Y1, j0+nj-1);
+        int klo = max(Z0, k0), khi = min(Z1, k0+nk-1);
+        for (int k = klo; k <= khi; ++k) {
+            for (int j = jlo; j <= jhi; ++j) {
+                memcpy(&(buffer[(k-Z0)*nir*njr + (j-Y0)*nir + (ilo-X0)]), \
+                       &(tile[((long)(k-k0)*nj + (j-j0))*ni + (ilo-i0)]), (ihi-ilo+1)*sizeof(float));
+            }
+        }
+        if (mapped) munmap(((cache_header *) tile) - 1, nbytes);
+        else delete[] tile;
+    }
+    }
+    }
+    return true;
+}
+
+// how much the field cache got used, summed over all of the ranks
+void lofs_cache_report(int rank) {
+    if (cachedir[0] == '\0') return;
+    long counts[2] = {cache_hits, cache_misses};
+    long tot[2];
+    MPI_Reduce(counts, tot, 2, MPI_LONG, MPI_SUM, 0, MPI_COMM_WORLD);
+    if (rank == 0) cout << "Field cache: " << tot[0] << " tiles mapped in, " << tot[1] << " read and saved" << endl;
 }
 
 void lofs_read_3dvar(datagrid *grid, float *buffer, char *varname, bool istag, double t0) {
@@ -260,6 +520,7 @@ void lofs_read_3dvar(datagrid *grid, float *buffer, char *varname, bool istag, d
     //
     // X0, Y0, X1, Y1, Z0, Y1, nx, ny, nz all from lofs_get_grid
         //X0-1,Y0-1,X1+1,Y1+1,Z0,Z1,
+    if (_read_cached(buffer, varname, t0, grid->X0-1, grid->Y0-1, grid->X1+1, grid->Y1+1, grid->Z0, grid->Z1+1)) return;
     read_hdf_mult_md(buffer,topdir,timedir,nodedir,ntimedirs,dn,dirtimes,alltimes,ntottimes,t0,varname, \
             grid->X0-1,grid->Y0-1,grid->X1+1,grid->Y1+1,grid->Z0,grid->Z1+1,nx,ny,nz,nodex,nodey);
 }
@@ -11,6 +11,7 @@
 #include "../include/datastructs.h"
 #include <iostream>
 #include <string>
+#include <string.h>
 #include <netcdf>
 
 using namespace std;
@@ -23,7 +24,7 @@ void init_nc(string filename, parcel_pos *parcels) {
     // Create the file.
     NcFile output(filename, NcFile::replace);
 
-    NcDim pclDim = output.addDim("nParcels", parcels->nParcels);
+    NcDim pclDim = output.addDim("nParcels", parcels->nTotParcels);
     NcDim timeDim = output.addDim("nTimes");
 
     // define the coordinate variables
@@ -183,13 +184,37 @@ void init_nc(string filename, parcel_pos *parcels) {
     }
 }
  
+/* The parcels may have been reordered in memory for locality (see
+   reorder.cpp), so put a parcel array back into parcel id order before
+   writing it out. If buf is NULL the parcels are already in order, and
+   the array is returned as is. */
+float* _in_pclid_order(parcel_pos *parcels, float *arr, float *buf) {
+    if (buf == NULL) return arr;
+    int nTimes = parcels->nTimes;
+    for (int pcl = 0; pcl < parcels->nParcels; ++pcl) {
+        memcpy(&(buf[(long)parcels->pclid[pcl]*nTimes]), &(arr[(long)pcl*nTimes]), nTimes*sizeof(float));
+    }
+    return buf;
+}
+
 void write_parcels(string filename, parcel_pos *parcels, int writeIters ) { 
     // get the io configurations from the user
     iocfg *io = parcels->io;
+
+    // only need a buffer for reordering the
+    // output if the parcels are out of order
+    float *outbuf = NULL;
+    for (int pcl = 0; pcl < parcels->nParcels; ++pcl) {
+        if (parcels->pclid[pcl] != pcl) {
+            outbuf = new float[(long)parcels->nParcels*parcels->nTimes];
+            break;
+        }
+    }
     // These vectors define the starting write positions
-    // and the number of bits to write
+    // and the number of bits to write. The parcels go
+    // wherever this rank's share of them starts.
     vector<size_t> startp,countp;
-    startp.push_back(0);
+    startp.push_back(parcels->pclOffset);
     if (writeIters == 0) startp.push_back(0);
     else startp.push_back(parcels->nTimes * writeIters - writeIters);
     countp.push_back(parcels->nParcels);
@@ -201,16 +226,16 @@ void write_parcels(string filename, parcel_pos *parcels, int writeIters ) {
     NcVar xVar = output.getVar("xpos");
     NcVar yVar = output.getVar("ypos");
     NcVar zVar = output.getVar("zpos");
-    xVar.putVar(startp,countp,parcels->xpos);
-    yVar.putVar(startp,countp,parcels->ypos);
-    zVar.putVar(startp,countp,parcels->zpos);
+    xVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->xpos, outbuf));
+    yVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->ypos, outbuf));
+    zVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->zpos, outbuf));
 
     NcVar uVar = output.getVar("u");
     NcVar vVar = output.getVar("v");
     NcVar wVar = output.getVar("w");
-    uVar.putVar(startp,countp,parcels->pclu);
-    vVar.putVar(startp,countp,parcels->pclv);
-    wVar.putVar(startp,countp,parcels->pclw);
+    uVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclu, outbuf));
+    vVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclv, outbuf));
+    wVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclw, outbuf));
 
     if (io->output_momentum_budget) {
         NcVar wbuoyVar = output.getVar("wbuoy");
@@ -224,34 +249,34 @@ void write_parcels(string filename, parcel_pos *parcels, int writeIters ) {
         NcVar vdiffVar = output.getVar("vdiff");
         NcVar wdiffVar = output.getVar("wdiff");
 
-        wbuoyVar.putVar(startp,countp,parcels->pclbuoy);
-        upgradVar.putVar(startp,countp,parcels->pclupgrad);
-        vpgradVar.putVar(startp,countp,parcels->pclvpgrad);
-        wpgradVar.putVar(startp,countp,parcels->pclwpgrad);
-        uturbVar.putVar(startp,countp,parcels->pcluturb);
-        vturbVar.putVar(startp,countp,parcels->pclvturb);
-        wturbVar.putVar(startp,countp,parcels->pclwturb);
-        udiffVar.putVar(startp,countp,parcels->pcludiff);
-        vdiffVar.putVar(startp,countp,parcels->pclvdiff);
-        wdiffVar.putVar(startp,countp,parcels->pclwdiff);
+        wbuoyVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclbuoy, outbuf));
+        upgradVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclupgrad, outbuf));
+        vpgradVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclvpgrad, outbuf));
+        wpgradVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclwpgrad, outbuf));
+        uturbVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pcluturb, outbuf));
+        vturbVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclvturb, outbuf));
+        wturbVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclwturb, outbuf));
+        udiffVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pcludiff, outbuf));
+        vdiffVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclvdiff, outbuf));
+        wdiffVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclwdiff, outbuf));
     }
     if (io->output_kmh) {
         NcVar kmhVar = output.getVar("kmh");
-        kmhVar.putVar(startp,countp,parcels->pclkmh);
+        kmhVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclkmh, outbuf));
     }
 
 
     if (io->output_vorticity_budget || io->output_xvort) {
         NcVar xvortVar = output.getVar("xvort");
-        xvortVar.putVar(startp,countp,parcels->pclxvort);
+        xvortVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclxvort, outbuf));
     }
     if (io->output_vorticity_budget || io->output_yvort) {
         NcVar yvortVar = output.getVar("yvort");
-        yvortVar.putVar(startp,countp,parcels->pclyvort);
+        yvortVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclyvort, outbuf));
     }
     if (io->output_vorticity_budget || io->output_zvort) {
         NcVar zvortVar = output.getVar("zvort");
-        zvortVar.putVar(startp,countp,parcels->pclzvort);
+        zvortVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclzvort, outbuf));
     }
     if (io->output_vorticity_budget) {
         NcVar xvorttiltVar = output.getVar("xvorttilt");
@@ -272,84 +297,85 @@ void write_parcels(string filename, parcel_pos *parcels, int writeIters ) {
         NcVar xvortbaroVar = output.getVar("xvortbaro");
         NcVar yvortbaroVar = output.getVar("yvortbaro");
 
-        xvorttiltVar.putVar(startp,countp,parcels->pclxvorttilt);
-        yvorttiltVar.putVar(startp,countp,parcels->pclyvorttilt);
-        zvorttiltVar.putVar(startp,countp,parcels->pclzvorttilt);
-        xvortstretchVar.putVar(startp,countp,parcels->pclxvortstretch);
-        yvortstretchVar.putVar(startp,countp,parcels->pclyvortstretch);
-        zvortstretchVar.putVar(startp,countp,parcels->pclzvortstretch);
-        xvortsolenoidVar.putVar(startp,countp,parcels->pclxvortsolenoid);
-        yvortsolenoidVar.putVar(startp,countp,parcels->pclyvortsolenoid);
-        zvortsolenoidVar.putVar(startp,countp,parcels->pclzvortsolenoid);
-        xvortturbVar.putVar(startp,countp,parcels->pclxvortturb);
-        yvortturbVar.putVar(startp,countp,parcels->pclyvortturb);
-        zvortturbVar.putVar(startp,countp,parcels->pclzvortturb);
-        xvortdiffVar.putVar(startp,countp,parcels->pclxvortdiff);
-        yvortdiffVar.putVar(startp,countp,parcels->pclyvortdiff);
-        zvortdiffVar.putVar(startp,countp,parcels->pclzvortdiff);
-        xvortbaroVar.putVar(startp,countp,parcels->pclxvortbaro);
-        yvortbaroVar.putVar(startp,countp,parcels->pclyvortbaro);
+        xvorttiltVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclxvorttilt, outbuf));
+        yvorttiltVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclyvorttilt, outbuf));
+        zvorttiltVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclzvorttilt, outbuf));
+        xvortstretchVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclxvortstretch, outbuf));
+        yvortstretchVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclyvortstretch, outbuf));
+        zvortstretchVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclzvortstretch, outbuf));
+        xvortsolenoidVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclxvortsolenoid, outbuf));
+        yvortsolenoidVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclyvortsolenoid, outbuf));
+        zvortsolenoidVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclzvortsolenoid, outbuf));
+        xvortturbVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclxvortturb, outbuf));
+        yvortturbVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclyvortturb, outbuf));
+        zvortturbVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclzvortturb, outbuf));
+        xvortdiffVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclxvortdiff, outbuf));
+        yvortdiffVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclyvortdiff, outbuf));
+        zvortdiffVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclzvortdiff, outbuf));
+        xvortbaroVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclxvortbaro, outbuf));
+        yvortbaroVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclyvortbaro, outbuf));
     }
 
     if (io->output_ppert) {
         NcVar ppertVar = output.getVar("prespert");
-        ppertVar.putVar(startp,countp,parcels->pclppert);
+        ppertVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclppert, outbuf));
     }
     if (io->output_qvpert) {
         NcVar qvpertVar = output.getVar("qvpert");
-        qvpertVar.putVar(startp,countp,parcels->pclqvpert);
+        qvpertVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclqvpert, outbuf));
     }
     if (io->output_rhopert) {
         NcVar rhopertVar = output.getVar("rhopert");
-        rhopertVar.putVar(startp,countp,parcels->pclrhopert);
+        rhopertVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclrhopert, outbuf));
     }
     if (io->output_thetapert) {
         NcVar thetapertVar = output.getVar("thetapert");
-        thetapertVar.putVar(startp,countp,parcels->pclthetapert);
+        thetapertVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclthetapert, outbuf));
     }
     if (io->output_thrhopert) {
         NcVar thrhopertVar = output.getVar("thrhopert");
-        thrhopertVar.putVar(startp,countp,parcels->pclthrhopert);
+        thrhopertVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclthrhopert, outbuf));
     }
 
     if (io->output_pbar) {
         NcVar pbarVar = output.getVar("presbar");
-        pbarVar.putVar(startp,countp,parcels->pclpbar);
+        pbarVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclpbar, outbuf));
     }
     if (io->output_qvbar) {
         NcVar qvbarVar = output.getVar("qvbar");
-        qvbarVar.putVar(startp,countp,parcels->pclqvbar);
+        qvbarVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclqvbar, outbuf));
     }
     if (io->output_rhobar) {
         NcVar rhobarVar = output.getVar("rhobar");
-        rhobarVar.putVar(startp,countp,parcels->pclrhobar);
+        rhobarVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclrhobar, outbuf));
     }
     if (io->output_thetabar) {
         NcVar thetabarVar = output.getVar("thetabar");
-        thetabarVar.putVar(startp,countp,parcels->pclthetabar);
+        thetabarVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclthetabar, outbuf));
     }
     if (io->output_thrhobar) {
         NcVar thrhobarVar = output.getVar("thrhobar");
-        thrhobarVar.putVar(startp,countp,parcels->pclthrhobar);
+        thrhobarVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclthrhobar, outbuf));
     }
 
     if (io->output_qc) {
         NcVar qcVar = output.getVar("qc");
-        qcVar.putVar(startp,countp,parcels->pclqc);
+        qcVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclqc, outbuf));
     }
     if (io->output_qi) {
         NcVar qiVar = output.getVar("qi");
-        qiVar.putVar(startp,countp,parcels->pclqi);
+        qiVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclqi, outbuf));
     }
     if (io->output_qs) {
         NcVar qsVar = output.getVar("qs");
-        qsVar.putVar(startp,countp,parcels->pclqs);
+        qsVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclqs, outbuf));
     }
     if (io->output_qg) {
         NcVar qgVar = output.getVar("qg");
-        qgVar.putVar(startp,countp,parcels->pclqg);
+        qgVar.putVar(startp,countp,_in_pclid_order(parcels, parcels->pclqg, outbuf));
     }
 
+    if (outbuf != NULL) delete[] outbuf;
     cout << "*** SUCCESS writing file " << filename << "!" << endl;
     return;
 }
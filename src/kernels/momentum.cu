@@ -3,6 +3,8 @@
 #include "../include/datastructs.h"
 #include "../include/macros.h"
 #include "../calc/calcmomentum.cu"
+#include "../calc/calcsparse.cu"
+#include "../parcel/tilemask.cu"
 #ifndef MOMENTUM_CU
 #define MOMENTUM_CU
 /*
@@ -13,7 +15,7 @@
  * Email: kthalbert@wisc.edu
 */
 
-__global__ void cuCalcBuoy(datagrid *grid, float *thrhopert, float *buoy) {
+__global__ void cuCalcBuoy(datagrid *grid, field_t *thrhopert, field_t *buoy) {
     // get our 3D index based on our blocks/threads
     int i = (blockIdx.x*blockDim.x) + threadIdx.x;
     int j = (blockIdx.y*blockDim.y) + threadIdx.y;
@@ -21,12 +23,12 @@ __global__ void cuCalcBuoy(datagrid *grid, float *thrhopert, float *buoy) {
     int NX = grid->NX;
     int NY = grid->NY;
     int NZ = grid->NZ;
-    if ((i < NX+1) && (j < NY+1) && (k > 0) && (k < NZ+1)) {
+    if ((i < NX+1) && (j < NY+1) && (k > 0) && (k < NZ+1) && tile_active(grid, i, j, k)) {
 		    calc_buoyancy(thrhopert, grid->th0, buoy, i, j, k, NX, NY);
     }
 }
 
-__global__ void cuCalcPgradU(datagrid *grid, float *pipert, float *thrhopert, float *pgradu) {
+__global__ void cuCalcPgradU(datagrid *grid, field_t *pipert, field_t *thrhopert, field_t *pgradu) {
     // get our 3D index based on our blocks/threads
     int i = (blockIdx.x*blockDim.x) + threadIdx.x;
     int j = (blockIdx.y*blockDim.y) + threadIdx.y;
@@ -36,13 +38,13 @@ __global__ void cuCalcPgradU(datagrid *grid, float *pipert, float *thrhopert, fl
     int NZ = grid->NZ;
 
 	  float dx;
-    if ((i < NX) && (j < NY+1) && (i > 0) && (k < NZ+1)) {
+    if ((i < NX) && (j < NY+1) && (i > 0) && (k < NZ+1) && tile_active(grid, i, j, k)) {
 		    dx = xh(i) - xh(i-1);
 		    calc_pgrad_u(pipert, thrhopert, grid->qv0, grid->th0, pgradu, dx, i, j, k, NX, NY);
     }
 }
 
-__global__ void cuCalcPgradV(datagrid *grid, float *pipert, float *thrhopert, float *pgradv) {
+__global__ void cuCalcPgradV(datagrid *grid, field_t *pipert, field_t *thrhopert, field_t *pgradv) {
     // get our 3D index based on our blocks/threads
     int i = (blockIdx.x*blockDim.x) + threadIdx.x;
     int j = (blockIdx.y*blockDim.y) + threadIdx.y;
@@ -52,13 +54,13 @@ __global__ void cuCalcPgradV(datagrid *grid, float *pipert, float *thrhopert, fl
     int NZ = grid->NZ;
 	float dy;
 
-    if ((i < NX+1) && (j < NY) && (j > 0) && (k < NZ+1)) {
+    if ((i < NX+1) && (j < NY) && (j > 0) && (k < NZ+1) && tile_active(grid, i, j, k)) {
 		dy = yh(j) - yh(j-1);
 		calc_pgrad_v(pipert, thrhopert, grid->qv0, grid->th0, pgradv, dy, i, j, k, NX, NY);
     }
 }
 
-__global__ void cuCalcPgradW(datagrid *grid, float *pipert, float *thrhopert, float *pgradw) {
+__global__ void cuCalcPgradW(datagrid *grid, field_t *pipert, field_t *thrhopert, field_t *pgradw) {
     // get our 3D index based on our blocks/threads
     int i = (blockIdx.x*blockDim.x) + threadIdx.x;
     int j = (blockIdx.y*blockDim.y) + threadIdx.y;
@@ -68,10 +70,30 @@ __global__ void cuCalcPgradW(datagrid *grid, float *pipert, float *thrhopert, fl
     int NZ = grid->NZ;
 	float dz;
 
-    if ((i < NX+1) && (j < NY+1) && (k > 0) && (k < NZ+1)) {
+    if ((i < NX+1) && (j < NY+1) && (k > 0) && (k < NZ+1) && tile_active(grid, i, j, k)) {
 		dz = zh(k) - zh(k-1);
 		calc_pgrad_w(pipert, thrhopert, grid->qv0, grid->th0, pgradw, dz, i, j, k, NX, NY);
     }
 }
 
+/* The whole momentum budget in one pass. Each thread does every term
+   at its own point and recomputes the stresses and diffusion fluxes it
+   needs from its neighbors rather than reading them back out of the tem
+   arrays, which trades a little arithmetic for not streaming a dozen
+   intermediate arrays through global memory. pipert and rhof have to
+   be computed first. */
+__global__ void cuCalcMomentumBud(datagrid *grid, model_data *data, int tidx) {
+    // get our 3D index based on our blocks/threads
+    int i = (blockIdx.x*blockDim.x) + threadIdx.x;
+    int j = (blockIdx.y*blockDim.y) + threadIdx.y;
+    int k = (blockIdx.z*blockDim.z) + threadIdx.z;
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+
+    if ((i < NX+1) && (j < NY+1) && (k < NZ+1) && tile_active(grid, i, j, k)) {
+        calc_momentum_bud(grid, data, tidx, i, j, k);
+    }
+}
+
 #endif
@@ -0,0 +1,368 @@
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "../include/datastructs.h"
+#include "../include/macros.h"
+#include "../calc/calcmomentum.cu"
+#include "../calc/calcsparse.cu"
+#include "../parcel/tilemask.cu"
+#ifndef MOMENTUM_CPU
+#define MOMENTUM_CPU
+/*
+ * Copyright (C) 2017-2020 Kelton Halbert, Space Science and Engineering Center (SSEC), University of Wisconsin - Madison
+ * Written by Kelton Halbert at the University of Wisconsin - Madison,
+ * Cooperative Institute for Meteorological Satellite Studies (CIMSS),
+ * Space Science and Engineering Center (SSEC). Provided under the Apache 2.0 License.
+ * Email: kthalbert@wisc.edu
+*/
+
+/* CPU counterparts to the kernels in momentum.cu. These loop
+   over all of the time levels from tStart to tEnd themselves. */
+
+void cpuCalcBuoy(datagrid *grid, field_t *thrhopert, field_t *buoy, int tStart, int tEnd) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+
+    FOR_TILES(tStart, tEnd, 0, NX+1, 0, NY+1, 1, NZ+1) {
+        long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+        calc_buoyancy(&(thrhopert[bufidx]), grid->th0, &(buoy[bufidx]), i, j, k, NX, NY);
+    }
+}
+
+void cpuCalcPgradU(datagrid *grid, field_t *pipert, field_t *thrhopert, field_t *pgradu, int tStart, int tEnd) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+
+    FOR_TILES(tStart, tEnd, 1, NX, 0, NY+1, 0, NZ+1) {
+        long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+        float dx = xh(i) - xh(i-1);
+        calc_pgrad_u(&(pipert[bufidx]), &(thrhopert[bufidx]), grid->qv0, grid->th0, &(pgradu[bufidx]), dx, i, j, k, NX, NY);
+    }
+}
+
+void cpuCalcPgradV(datagrid *grid, field_t *pipert, field_t *thrhopert, field_t *pgradv, int tStart, int tEnd) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+
+    FOR_TILES(tStart, tEnd, 0, NX+1, 1, NY, 0, NZ+1) {
+        long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+        float dy = yh(j) - yh(j-1);
+        calc_pgrad_v(&(pipert[bufidx]), &(thrhopert[bufidx]), grid->qv0, grid->th0, &(pgradv[bufidx]), dy, i, j, k, NX, NY);
+    }
+}
+
+void cpuCalcPgradW(datagrid *grid, field_t *pipert, field_t *thrhopert, field_t *pgradw, int tStart, int tEnd) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+
+    FOR_TILES(tStart, tEnd, 0, NX+1, 0, NY+1, 1, NZ+1) {
+        long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+        float dz = zh(k) - zh(k-1);
+        calc_pgrad_w(&(pipert[bufidx]), &(thrhopert[bufidx]), grid->qv0, grid->th0, &(pgradw[bufidx]), dz, i, j, k, NX, NY);
+    }
+}
+
+/* The whole momentum budget in one pass, with no tem arrays in between.
+   calc_momentum_bud would do it one point at a time like the GPU does,
+   but then every stress and diffusion flux gets computed 2 to 4 times
+   over by the neighboring points, which the CPU can't hide. Instead,
+   each thread takes a strip of TILE_J rows and walks it up through all
+   of the levels, keeping the stresses and fluxes for the level it's on
+   in a few small planes along with the ones for the level above (or
+   below, for tau 33) that get differenced in the vertical. The planes
+   are small enough to stay in cache, and the model fields only get
+   read about once. Each plane and output row loops over just the range
+   its term is defined on, and everything else is 0, the same as what
+   the pt_ functions give. pipert and rhof have to be on the grid already.
+   With a tile mask, each strip only does the box around its active tiles,
+   and the planes go one point past it on each side for the stencils. */
+void cpuCalcMomentumBud(datagrid *grid, model_data *data, int tStart, int tEnd) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    // the planes go from -1 to NX+1 in i, and
+    // from one row before to one row after the strip
+    long PW = NX+3;
+    long NP = PW*(TILE_J+3);
+    int nStrips = (NY + TILE_J) / TILE_J;
+    const float coeff = (kdiff6/64.0/grid->dt);
+    float *bases[3] = {grid->u0, grid->v0, NULL};
+    float *rho0 = grid->rho0;
+
+    #pragma omp parallel
+    {
+        // the stresses on this level, plus the ones
+        // that get differenced in the vertical with the
+        // level above (below for tau 33) in the other half
+        float *t11 = new float[NP];
+        float *t12 = new float[NP];
+        float *t22 = new float[NP];
+        float *t13 = new float[2*NP];
+        float *t23 = new float[2*NP];
+        float *t33 = new float[2*NP];
+        // diffusion fluxes in x and y for one of the
+        // winds at a time, and in z for all of them
+        float *fx = new float[NP];
+        float *fy = new float[NP];
+        float *fz = new float[6*NP];
+
+        #pragma omp for collapse(2) schedule(static)
+        for (int tidx = tStart; tidx < tEnd; ++tidx) {
+            for (int js = 0; js < nStrips; ++js) {
+                int j0 = js*TILE_J;
+                int j1 = TILE_END(j0, TILE_J, NY+1);
+                int ia = 0, ib = NX+1, ja = j0, jb = j1, ka = 0, kb = NZ+1;
+                if (!tile_bounds(grid, &ia, &ib, &ja, &jb, &ka, &kb)) continue;
+                long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+                field_t *ustag = &(data->ustag[bufidx]);
+                field_t *vstag = &(data->vstag[bufidx]);
+                field_t *wstag = &(data->wstag[bufidx]);
+                field_t *kmstag = &(data->kmh[bufidx]);
+                field_t *rhopert = &(data->rhopert[bufidx]);
+                field_t *rhof = &(data->rhof[bufidx]);
+                field_t *pipert = &(data->pipert[bufidx]);
+                field_t *thrhopert = &(data->thrhopert[bufidx]);
+                field_t *winds[3] = {ustag, vstag, wstag};
+                field_t *diffs[3] = {&(data->diffu[bufidx]), &(data->diffv[bufidx]), &(data->diffw[bufidx])};
+
+                // Only the part of a plane that its term is defined on
+                // gets written to when the level is in range, so the rest
+                // stays 0 for the whole strip. Out of range levels clear
+                // the whole plane.
+                memset(t11, 0, NP*sizeof(float)); memset(t12, 0, NP*sizeof(float));
+                memset(t22, 0, NP*sizeof(float)); memset(t13, 0, 2*NP*sizeof(float));
+                memset(t23, 0, 2*NP*sizeof(float)); memset(t33, 0, 2*NP*sizeof(float));
+                memset(fx, 0, NP*sizeof(float)); memset(fy, 0, NP*sizeof(float));
+
+                // the rows and columns of the box and its
+                // neighbors that a term is defined on
+                #define STRIP_ROWS(lo, hi) (int j = std::max(ja-1, (lo)); j < std::min(jb+1, (hi)); ++j)
+                #define STRIP_COLS(lo, hi) (int i = std::max(ia-1, (lo)); i < std::min(ib+1, (hi)); ++i)
+                #define PL(i, j) (((j)-j0+1)*PW + (i)+1)
+
+                for (int k = ka; k < kb; ++k) {
+                    if (k >= NZ) {
+                        memset(t11, 0, NP*sizeof(float));
+                        memset(t12, 0, NP*sizeof(float));
+                        memset(t22, 0, NP*sizeof(float));
+                    }
+                    else {
+                        for STRIP_ROWS(0, NY) {
+                            #pragma omp simd
+                            for STRIP_COLS(0, NX) {
+                                t11[PL(i, j)] = _tau11(grid, ustag, kmstag, rhopert, i, j, k, NX, NY);
+                                t12[PL(i, j)] = _tau12(grid, ustag, vstag, kmstag, rhopert, i, j, k, NX, NY);
+                                t22[PL(i, j)] = _tau22(grid, vstag, kmstag, rhopert, i, j, k, NX, NY);
+                            }
+                        }
+                    }
+
+                    // the level above was done on the last
+                    // pass, unless this is the first level
+                    for (int kk = (k == ka) ? ka : k+1; kk < k+2; ++kk) {
+                        float *t13k = &(t13[(kk % 2)*NP]);
+                        float *t23k = &(t23[(kk % 2)*NP]);
+                        if ((kk < 2) || (kk >= NZ)) {
+                            memset(t13k, 0, NP*sizeof(float));
+                            memset(t23k, 0, NP*sizeof(float));
+                        }
+                        else {
+                            for STRIP_ROWS(2, NY+1) {
+                                #pragma omp simd
+                                for STRIP_COLS(2, NX+1) {
+                                    t13k[PL(i, j)] = _tau13(grid, ustag, wstag, kmstag, rhof, i, j, kk, NX, NY);
+                                    t23k[PL(i, j)] = _tau23(grid, vstag, wstag, kmstag, rhof, i, j, kk, NX, NY);
+                                }
+                            }
+                        }
+                        for (int n = 0; n < 3; ++n) {
+                            float *fzk = &(fz[(2*n + (kk % 2))*NP]);
+                            // the boundary condition reaches outside of
+                            // the stencil's range, so this one always
+                            // gets cleared
+                            memset(fzk, 0, NP*sizeof(float));
+                            if ((zf(0) == 0.0) && (kk <= 2)) {
+                                // it's only a couple of levels,
+                                // so let it check its own range
+                                for STRIP_ROWS(0, NY+1) {
+                                    for STRIP_COLS(0, NX+1) {
+                                        fzk[PL(i, j)] = _pt_diffz(grid, winds[n], bases[n], i, j, kk, NX, NY, NZ);
+                                    }
+                                }
+                            }
+                            else if ((kk >= 3) && (kk < NZ-4)) {
+                                // split on the base state so that
+                                // the check is out of the loop
+                                field_t *arr = winds[n];
+                                float *base = bases[n];
+                                for STRIP_ROWS(3, NY-3) {
+                                    if (base != NULL) {
+                                        #pragma omp simd
+                                        for STRIP_COLS(3, NX-3) {
+                                            fzk[PL(i, j)] = _diff6z(arr, base, i, j, kk, NX, NY);
+                                        }
+                                    }
+                                    else {
+                                        #pragma omp simd
+                                        for STRIP_COLS(3, NX-3) {
+                                            fzk[PL(i, j)] = _diff6z(arr, NULL, i, j, kk, NX, NY);
+                                        }
+                                    }
+                                }
+                            }
+                        }
+                    }
+                    // and the same for the level below
+                    for (int kk = (k == ka) ? ka-1 : k; kk < k+1; ++kk) {
+                        float *t33k = &(t33[((kk+2) % 2)*NP]);
+                        if ((kk < 0) || (kk >= NZ)) {
+                            memset(t33k, 0, NP*sizeof(float));
+                        }
+                        else {
+                            for STRIP_ROWS(0, NY) {
+                                #pragma omp simd
+                                for STRIP_COLS(0, NX) {
+                                    t33k[PL(i, j)] = _tau33(grid, wstag, kmstag, rhopert, i, j, kk, NX, NY);
+                                }
+                            }
+                        }
+                    }
+
+                    float *t13lo = &(t13[(k % 2)*NP]); float *t13hi = &(t13[((k+1) % 2)*NP]);
+                    float *t23lo = &(t23[(k % 2)*NP]); float *t23hi = &(t23[((k+1) % 2)*NP]);
+                    float *t33lo = &(t33[((k+1) % 2)*NP]); float *t33hi = &(t33[(k % 2)*NP]);
+                    for (int j = ja; j < jb; ++j) {
+                        long row = P3(1, j+1, k, NX+2, NY+2);
+                        field_t *buoy = &(data->buoy[bufidx]);
+                        field_t *pgradu = &(data->pgradu[bufidx]);
+                        field_t *pgradv = &(data->pgradv[bufidx]);
+                        field_t *pgradw = &(data->pgradw[bufidx]);
+                        field_t *turbu = &(data->turbu[bufidx + row]);
+                        field_t *turbv = &(data->turbv[bufidx + row]);
+                        field_t *turbw = &(data->turbw[bufidx + row]);
+                        field_t *buf0;
+
+                        // buoyancy and pressure gradient, over the same
+                        // ranges as cpuCalcBuoy and cpuCalcPgradU/V/W
+                        for (int i = ia; i < ib; ++i) {
+                            buoy[row + i] = 0.0; pgradu[row + i] = 0.0;
+                            pgradv[row + i] = 0.0; pgradw[row + i] = 0.0;
+                            turbu[i] = 0.0; turbv[i] = 0.0; turbw[i] = 0.0;
+                        }
+                        if (k >= 1) {
+                            float dz = zh(k) - zh(k-1);
+                            #pragma omp simd
+                            for (int i = ia; i < ib; ++i) {
+                                calc_buoyancy(thrhopert, grid->th0, buoy, i, j, k, NX, NY);
+                                calc_pgrad_w(pipert, thrhopert, grid->qv0, grid->th0, pgradw, dz, i, j, k, NX, NY);
+                            }
+                        }
+                        if ((j >= 1) && (j < NY)) {
+                            float dy = yh(j) - yh(j-1);
+                            #pragma omp simd
+                            for (int i = ia; i < ib; ++i) {
+                                calc_pgrad_v(pipert, thrhopert, grid->qv0, grid->th0, pgradv, dy, i, j, k, NX, NY);
+                            }
+                        }
+                        #pragma omp simd
+                        for (int i = std::max(ia, 1); i < std::min(ib, NX); ++i) {
+                            calc_pgrad_u(pipert, thrhopert, grid->qv0, grid->th0, pgradu, xh(i) - xh(i-1), i, j, k, NX, NY);
+                        }
+
+                        // turbulence, the same as pt_turbu/v/w
+                        // with the stresses out of the planes
+                        float *t11j = &(t11[PL(0, j)]);
+                        float *t12j = &(t12[PL(0, j)]);
+                        float *t22j = &(t22[PL(0, j)]);
+                        float *t13j = &(t13lo[PL(0, j)]); float *t13u = &(t13hi[PL(0, j)]);
+                        float *t23j = &(t23lo[PL(0, j)]); float *t23u = &(t23hi[PL(0, j)]);
+                        float *t33j = &(t33hi[PL(0, j)]); float *t33d = &(t33lo[PL(0, j)]);
+                        buf0 = rhopert;
+                        if ((j < NY) && (k < NZ)) {
+                            float dy = yf(j+1) - yf(j);
+                            float dz = zf(k+1) - zf(k);
+                            #pragma omp simd
+                            for (int i = ia; i < ib; ++i) {
+                                float turbx = ((t11j[i] - t11j[i-1]) / (xf(i) - xf(i-1)));
+                                float turby = ((t12j[i+PW] - t12j[i]) / dy);
+                                float turbz = ((t13u[i] - t13j[i]) / dz);
+                                float rru0 = 1.0 / (0.5 * ((BUF(i-1, j, k) + rho0[k]) + (BUF(i, j, k) + rho0[k])));
+                                turbu[i] = ( turbx + turby + turbz ) * rru0;
+                            }
+                        }
+                        if (k < NZ) {
+                            float dy = yf(j) - yf(j-1);
+                            float dz = zf(k+1) - zf(k);
+                            #pragma omp simd
+                            for (int i = ia; i < std::min(ib, NX); ++i) {
+                                float turbx = ((t12j[i+1] - t12j[i]) / (xf(i+1) - xf(i)));
+                                float turby = ((t22j[i] - t22j[i-PW]) / dy);
+                                float turbz = ((t23u[i] - t23j[i]) / dz);
+                                float rrv0 = 1.0 / (0.5 * ((BUF(i, j-1, k) + rho0[k]) + (BUF(i, j, k) + rho0[k])));
+                                turbv[i] = ( turbx + turby + turbz ) * rrv0;
+                            }
+                        }
+                        if ((j < NY) && (k >= 1) && (k < NZ)) {
+                            float dy = yf(j+1) - yf(j);
+                            float dz = zf(k) - zf(k-1);
+                            buf0 = rhof;
+                            #pragma omp simd
+                            for (int i = ia; i < std::min(ib, NX); ++i) {
+                                float turbx = ((t13j[i+1] - t13j[i]) / (xf(i+1) - xf(i)));
+                                float turby = ((t23j[i+PW] - t23j[i]) / dy);
+                                float turbz = ((t33j[i] - t33d[i]) / dz);
+                                float rrf = 1.0 / BUF(i, j, k);
+                                turbw[i] = ( turbx + turby + turbz ) * rrf;
+                            }
+                        }
+                    }
+
+                    // the diffusion of each wind, one at a time
+                    // so that the x and y flux planes get reused
+                    for (int n = 0; n < 3; ++n) {
+                        if ((k < 3) || (k >= NZ-4)) {
+                            memset(fx, 0, NP*sizeof(float));
+                            memset(fy, 0, NP*sizeof(float));
+                        }
+                        else {
+                            for STRIP_ROWS(3, NY-3) {
+                                #pragma omp simd
+                                for STRIP_COLS(3, NX-3) {
+                                    fx[PL(i, j)] = _diff6x(winds[n], i, j, k, NX, NY);
+                                    fy[PL(i, j)] = _diff6y(winds[n], i, j, k, NX, NY);
+                                }
+                            }
+                        }
+                        float *fzlo = &(fz[(2*n + (k % 2))*NP]);
+                        float *fzhi = &(fz[(2*n + ((k+1) % 2))*NP]);
+                        for (int j = ja; j < jb; ++j) {
+                            field_t *diff = &(diffs[n][P3(1, j+1, k, NX+2, NY+2)]);
+                            long p0 = PL(0, j);
+                            #pragma omp simd
+                            for (int i = ia; i < ib; ++i) {
+                                long p = p0 + i;
+                                float xten = coeff*(fx[p+1] - fx[p]);
+                                float yten = coeff*(fy[p+PW] - fy[p]);
+                                float zten = coeff*(fzhi[p] - fzlo[p]);
+                                diff[i] = (k < NZ) ? xten + yten + zten : 0.0;
+                            }
+                        }
+                    }
+                }
+                #undef STRIP_ROWS
+                #undef STRIP_COLS
+                #undef PL
+            }
+        }
+        delete[] t11; delete[] t12; delete[] t22;
+        delete[] t13; delete[] t23; delete[] t33;
+        delete[] fx; delete[] fy; delete[] fz;
+    }
+}
+
+#endif
\ No newline at end of file
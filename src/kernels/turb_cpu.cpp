@@ -0,0 +1,31 @@
+#include <iostream>
+#include <stdio.h>
+#include "../include/datastructs.h"
+#include "../include/macros.h"
+#include "../calc/calcturb.cu"
+#include "../parcel/tilemask.cu"
+#ifndef TURB_CPU
+#define TURB_CPU
+/*
+ * Copyright (C) 2017-2020 Kelton Halbert, Space Science and Engineering Center (SSEC), University of Wisconsin - Madison
+ * Written by Kelton Halbert at the University of Wisconsin - Madison,
+ * Cooperative Institute for Meteorological Satellite Studies (CIMSS),
+ * Space Science and Engineering Center (SSEC). Provided under the Apache 2.0 License.
+ * Email: kthalbert@wisc.edu
+*/
+
+/* CPU counterparts to the kernels in turb.cu. The turbulence terms
+   themselves are part of the fused budget in momentum_cpu.cpp. */
+
+void cpuCalcRf(datagrid *grid, field_t *rhopert, field_t *rhof, int tStart, int tEnd) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+
+    FOR_TILES(tStart, tEnd, 0, NX, 0, NY, 0, NZ+1) {
+        long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+        calcrf(&(rhopert[bufidx]), grid->rho0, &(rhof[bufidx]), i, j, k, NX, NY);
+    }
+}
+
+#endif
@@ -3,6 +3,7 @@
 #include "../include/datastructs.h"
 #include "../include/macros.h"
 #include "../calc/calcvort.cu"
+#include "../parcel/tilemask.cu"
 #ifndef VORT_CU
 #define VORT_CU
 
@@ -13,7 +14,7 @@
  * Space Science and Engineering Center (SSEC). Provided under the Apache 2.0 License.
  * Email: kthalbert@wisc.edu
 */
-__global__ void cuCalcPipert(datagrid *grid, float *prespert, float *pipert) {
+__global__ void cuCalcPipert(datagrid *grid, field_t *prespert, field_t *pipert) {
     // get our 3D index based on our blocks/threads
     int i = (blockIdx.x*blockDim.x) + threadIdx.x;
     int j = (blockIdx.y*blockDim.y) + threadIdx.y;
@@ -22,12 +23,14 @@ __global__ void cuCalcPipert(datagrid *grid, float *prespert, float *pipert) {
     int NY = grid->NY;
     int NZ = grid->NZ;
 
-    if ((i < NX+1) && (j < NY+1) && (k < NZ)) {
+    if ((i < NX+1) && (j < NY+1) && (k < NZ) && tile_active(grid, i, j, k)) {
 		calc_pipert(prespert, grid->p0, pipert, i, j, k, NX, NY);
     }
 }
 
-__global__ void cuCalcXvort(datagrid *grid, float *vstag, float *wstag, float *xvort) {
+/* Compute the 3 components of vorticity and average them to the
+   scalar grid in one pass, without going through the tem arrays */
+__global__ void cuCalcVort(datagrid *grid, field_t *ustag, field_t *vstag, field_t *wstag, field_t *xvort, field_t *yvort, field_t *zvort) {
     // get our 3D index based on our blocks/threads
     int i = (blockIdx.x*blockDim.x) + threadIdx.x;
     int j = (blockIdx.y*blockDim.y) + threadIdx.y;
@@ -35,62 +38,13 @@ __global__ void cuCalcXvort(datagrid *grid, float *vstag, float *wstag, float *x
     int NX = grid->NX;
     int NY = grid->NY;
     int NZ = grid->NZ;
-    float dy, dz;
-	float *buf0 = xvort;
-
-    if ((i < NX) && (j < NY+1) && (k > 0) && (k < NZ)) {
-        dy = yf(j) - yf(j-1);
-        dz = zf(k) - zf(k-1);
 
-		calc_xvort(vstag, wstag, xvort, dy, dz, i, j, k, NX, NY);
-		// lower boundary condition of stencil
-		if ((k == 1) && (zf(k-1) == 0)) {
-			BUF(i, j, 0) = BUF(i, j, 1);
-		}
+    if ((i < NX) && (j < NY) && (k < NZ) && tile_active(grid, i, j, k)) {
+		calc_vort_avg(grid, ustag, vstag, wstag, xvort, yvort, zvort, i, j, k);
     }
 }
 
-__global__ void cuCalcYvort(datagrid *grid, float *ustag, float *wstag, float *yvort) {
-    // get our 3D index based on our blocks/threads
-    int i = (blockIdx.x*blockDim.x) + threadIdx.x;
-    int j = (blockIdx.y*blockDim.y) + threadIdx.y;
-    int k = (blockIdx.z*blockDim.z) + threadIdx.z;
-    int NX = grid->NX;
-    int NY = grid->NY;
-    int NZ = grid->NZ;
-    float dx, dz;
-	float *buf0 = yvort;
-
-    if ((i < NX+1) && (j < NY) && (k > 0) && (k < NZ+1)) {
-        dx = xf(i) - xf(i-1);
-        dz = zf(k) - zf(k-1);
-
-		calc_yvort(ustag, wstag, yvort, dx, dz, i, j, k, NX, NY);
-		// lower boundary condition of stencil
-		if ((k == 1) && (zf(k-1) == 0)) {
-			BUF(i, j, 0) = BUF(i, j, 1);
-		}
-    }
-}
-__global__ void cuCalcZvort(datagrid *grid, float *ustag, float *vstag, float *zvort) {
-    // get our 3D index based on our blocks/threads
-    int i = (blockIdx.x*blockDim.x) + threadIdx.x;
-    int j = (blockIdx.y*blockDim.y) + threadIdx.y;
-    int k = (blockIdx.z*blockDim.z) + threadIdx.z;
-    int NX = grid->NX;
-    int NY = grid->NY;
-    int NZ = grid->NZ;
-    float dx, dy;
-
-    if ((i < NX+1) && (j < NY+1) && (k < NZ+1)) {
-        dx = xf(i) - xf(i-1);
-        dy = yf(j) - yf(j-1);
-
-		calc_zvort(ustag, vstag, zvort, dx, dy, i, j, k, NX, NY);
-    }
-}
-
-__global__ void cuCalcXvortStretch(datagrid *grid, float *vstag, float *wstag, float *xvort, float *xvstretch) {
+__global__ void cuCalcXvortStretch(datagrid *grid, field_t *vstag, field_t *wstag, field_t *xvort, field_t *xvstretch) {
     // get our 3D index based on our blocks/threads
     int i = (blockIdx.x*blockDim.x) + threadIdx.x;
     int j = (blockIdx.y*blockDim.y) + threadIdx.y;
@@ -101,14 +55,14 @@ __global__ void cuCalcXvortStretch(datagrid *grid, float *vstag, float *wstag, f
     float dy, dz;
 
 
-    if ((i < NX) && (j < NY) && (k < NZ)) {
+    if ((i < NX) && (j < NY) && (k < NZ) && tile_active(grid, i, j, k)) {
         dy = yf(j+1) - yf(j);
         dz = zf(k+1) - zf(k);
 		    calc_xvort_stretch(vstag, wstag, xvort, xvstretch, dy, dz, i, j, k, NX, NY);
     }
 }
 
-__global__ void cuCalcYvortStretch(datagrid *grid, float *ustag, float *wstag, float *yvort, float *yvstretch) {
+__global__ void cuCalcYvortStretch(datagrid *grid, field_t *ustag, field_t *wstag, field_t *yvort, field_t *yvstretch) {
     // get our 3D index based on our blocks/threads
     int i = (blockIdx.x*blockDim.x) + threadIdx.x;
     int j = (blockIdx.y*blockDim.y) + threadIdx.y;
@@ -118,7 +72,7 @@ __global__ void cuCalcYvortStretch(datagrid *grid, float *ustag, float *wstag, f
     int NZ = grid->NZ;
     float dx, dz;
 
-    if ((i < NX) && (j < NY) && (k < NZ)) {
+    if ((i < NX) && (j < NY) && (k < NZ) && tile_active(grid, i, j, k)) {
         dx = xf(i+1) - xf(i);
         dz = zf(k+1) - zf(k);
 		calc_yvort_stretch(ustag, wstag, yvort, yvstretch, dx, dz, i, j, k, NX, NY);
@@ -126,7 +80,7 @@ __global__ void cuCalcYvortStretch(datagrid *grid, float *ustag, float *wstag, f
 
 }
 /* Compute the forcing tendencies from the Vorticity Equation */
-__global__ void cuCalcZvortStretch(datagrid *grid, float *ustag, float *vstag, float *zvort, float *zvstretch) {
+__global__ void cuCalcZvortStretch(datagrid *grid, field_t *ustag, field_t *vstag, field_t *zvort, field_t *zvstretch) {
     // get our 3D index based on our blocks/threads
     int i = (blockIdx.x*blockDim.x) + threadIdx.x;
     int j = (blockIdx.y*blockDim.y) + threadIdx.y;
@@ -136,14 +90,14 @@ __global__ void cuCalcZvortStretch(datagrid *grid, float *ustag, float *vstag, f
     int NZ = grid->NZ;
     float dx, dy;
 
-    if ((i < NX) && (j < NY) && (k < NZ)) {
+    if ((i < NX) && (j < NY) && (k < NZ) && tile_active(grid, i, j, k)) {
         dx = xf(i+1) - xf(i);
         dy = yf(j+1) - yf(j);
 		calc_zvort_stretch(ustag, vstag, zvort, zvstretch, dx, dy, i, j, k, NX, NY);
     }
 }
 
-__global__ void cuPreXvortTilt(datagrid *grid, float *ustag, float *dudy, float *dudz) {
+__global__ void cuPreXvortTilt(datagrid *grid, field_t *ustag, field_t *dudy, field_t *dudz) {
     // get our 3D index based on our blocks/threads
     int i = (blockIdx.x*blockDim.x) + threadIdx.x;
     int j = (blockIdx.y*blockDim.y) + threadIdx.y;
@@ -153,19 +107,19 @@ __global__ void cuPreXvortTilt(datagrid *grid, float *ustag, float *dudy, float
     int NZ = grid->NZ;
 	float dy, dz;
 
-    if ((i < NX) && (j < NY) && (k < NZ)) {
+    if ((i < NX) && (j < NY) && (k < NZ) && tile_active(grid, i, j, k)) {
 		dy = yf(j) - yf(j-1);
         // loop over the number of time steps we have in memory
 		calc_dudy(ustag, dudy, dy, i, j, k, NX, NY);
     }
 
-	if ((i < NX) && (j < NY) && (k < NZ) && (k > 0)) {
+	if ((i < NX) && (j < NY) && (k < NZ) && (k > 0) && tile_active(grid, i, j, k)) {
 		dz = zf(k) - zf(k-1);
 		calc_dudz(ustag, dudz, dz, i, j, k, NX, NY);
 	}
 }
 
-__global__ void cuPreYvortTilt(datagrid *grid, float *vstag, float *dvdx, float *dvdz) {
+__global__ void cuPreYvortTilt(datagrid *grid, field_t *vstag, field_t *dvdx, field_t *dvdz) {
     // get our 3D index based on our blocks/threads
     int i = (blockIdx.x*blockDim.x) + threadIdx.x;
     int j = (blockIdx.y*blockDim.y) + threadIdx.y;
@@ -175,19 +129,19 @@ __global__ void cuPreYvortTilt(datagrid *grid, float *vstag, float *dvdx, float
     int NZ = grid->NZ;
 	float dx, dz;
 
-    if ((i < NX) && (j < NY) && (k < NZ)) {
+    if ((i < NX) && (j < NY) && (k < NZ) && tile_active(grid, i, j, k)) {
 		dx = xf(i) - xf(i-1);
         // loop over the number of time steps we have in memory
 		calc_dvdx(vstag, dvdx, dx, i, j, k, NX, NY);
     }
 
-	if ((i < NX) && (j < NY) && (k < NZ) && (k > 0)) {
+	if ((i < NX) && (j < NY) && (k < NZ) && (k > 0) && tile_active(grid, i, j, k)) {
 		dz = zf(k) - zf(k-1);
 		calc_dvdz(vstag, dvdz, dz, i, j, k, NX, NY);
 	}
 }
 
-__global__ void cuPreZvortTilt(datagrid *grid, float *wstag, float *dwdx, float *dwdy) {
+__global__ void cuPreZvortTilt(datagrid *grid, field_t *wstag, field_t *dwdx, field_t *dwdy) {
     // get our 3D index based on our blocks/threads
     int i = (blockIdx.x*blockDim.x) + threadIdx.x;
     int j = (blockIdx.y*blockDim.y) + threadIdx.y;
@@ -197,7 +151,7 @@ __global__ void cuPreZvortTilt(datagrid *grid, float *wstag, float *dwdx, float
     int NZ = grid->NZ;
 	float dx, dy;
 
-    if ((i < NX) && (j < NY) && (k < NZ)) {
+    if ((i < NX) && (j < NY) && (k < NZ) && tile_active(grid, i, j, k)) {
 		dx = xf(i) - xf(i-1);
 		dy = yf(j) - yf(j-1);
         // loop over the number of time steps we have in memory
@@ -207,7 +161,7 @@ __global__ void cuPreZvortTilt(datagrid *grid, float *wstag, float *dwdx, float
 }
 
 /* Compute the forcing tendencies from the Vorticity Equation */
-__global__ void cuCalcXvortTilt(datagrid *grid, float *yvort, float *zvort, float *dudy, float *dudz, float *xvtilt) {
+__global__ void cuCalcXvortTilt(datagrid *grid, field_t *yvort, field_t *zvort, field_t *dudy, field_t *dudz, field_t *xvtilt) {
     // get our 3D index based on our blocks/threads
     int i = (blockIdx.x*blockDim.x) + threadIdx.x;
     int j = (blockIdx.y*blockDim.y) + threadIdx.y;
@@ -216,14 +170,14 @@ __global__ void cuCalcXvortTilt(datagrid *grid, float *yvort, float *zvort, floa
     int NY = grid->NY;
     int NZ = grid->NZ;
 
-    if ((i < NX) && (j < NY) && (k < NZ)) {
+    if ((i < NX) && (j < NY) && (k < NZ) && tile_active(grid, i, j, k)) {
         // loop over the number of time steps we have in memory
 		calc_xvort_tilt(yvort, zvort, dudy, dudz, xvtilt, i, j, k, NX, NY);
     }
 }
 
 /* Compute the forcing tendencies from the Vorticity Equation */
-__global__ void cuCalcYvortTilt(datagrid *grid, float *xvort, float *zvort, float *dvdx, float *dvdz, float *yvtilt) {
+__global__ void cuCalcYvortTilt(datagrid *grid, field_t *xvort, field_t *zvort, field_t *dvdx, field_t *dvdz, field_t *yvtilt) {
     // get our 3D index based on our blocks/threads
     int i = (blockIdx.x*blockDim.x) + threadIdx.x;
     int j = (blockIdx.y*blockDim.y) + threadIdx.y;
@@ -232,14 +186,14 @@ __global__ void cuCalcYvortTilt(datagrid *grid, float *xvort, float *zvort, floa
     int NY = grid->NY;
     int NZ = grid->NZ;
 
-    if ((i < NX) && (j < NY) && (k < NZ)) {
+    if ((i < NX) && (j < NY) && (k < NZ) && tile_active(grid, i, j, k)) {
         // loop over the number of time steps we have in memory
 		calc_yvort_tilt(xvort, zvort, dvdx, dvdz, yvtilt, i, j, k, NX, NY);
     }
 }
 
 /* Compute the forcing tendencies from the Vorticity Equation */
-__global__ void cuCalcZvortTilt(datagrid *grid, float *xvort, float *yvort, float *dwdx, float *dwdy, float *zvtilt) {
+__global__ void cuCalcZvortTilt(datagrid *grid, field_t *xvort, field_t *yvort, field_t *dwdx, field_t *dwdy, field_t *zvtilt) {
     // get our 3D index based on our blocks/threads
     int i = (blockIdx.x*blockDim.x) + threadIdx.x;
     int j = (blockIdx.y*blockDim.y) + threadIdx.y;
@@ -248,13 +202,13 @@ __global__ void cuCalcZvortTilt(datagrid *grid, float *xvort, float *yvort, floa
     int NY = grid->NY;
     int NZ = grid->NZ;
 
-    if ((i < NX) && (j < NY) && (k < NZ)) {
+    if ((i < NX) && (j < NY) && (k < NZ) && tile_active(grid, i, j, k)) {
         // loop over the number of time steps we have in memory
 		calc_zvort_tilt(xvort, yvort, dwdx, dwdy, zvtilt, i, j, k, NX, NY);
     }
 }
 
-__global__ void cuCalcXvortBaro(datagrid *grid, float *thrhopert, float *xvort_baro) {
+__global__ void cuCalcXvortBaro(datagrid *grid, field_t *thrhopert, field_t *xvort_baro) {
     // get our 3D index based on our blocks/threads
     int i = (blockIdx.x*blockDim.x) + threadIdx.x;
     int j = (blockIdx.y*blockDim.y) + threadIdx.y;
@@ -264,14 +218,14 @@ __global__ void cuCalcXvortBaro(datagrid *grid, float *thrhopert, float *xvort_b
     int NZ = grid->NZ;
     float dx;
 
-    if ((i < NX-1) && (j < NY-1) && (k < NZ) && ( i > 0 ) && (j > 0) && (k > 0)) {
+    if ((i < NX-1) && (j < NY-1) && (k < NZ) && ( i > 0 ) && (j > 0) && (k > 0) && tile_active(grid, i, j, k)) {
         // loop over the number of time steps we have in memory
         dx = xh(i+1) - xh(i-1);
 		calc_xvort_baro(thrhopert, grid->th0, grid->qv0, xvort_baro, dx, i, j, k, NX, NY);
     }
 }
 
-__global__ void cuCalcYvortBaro(datagrid *grid, float *thrhopert, float *yvort_baro) {
+__global__ void cuCalcYvortBaro(datagrid *grid, field_t *thrhopert, field_t *yvort_baro) {
     // get our 3D index based on our blocks/threads
     int i = (blockIdx.x*blockDim.x) + threadIdx.x;
     int j = (blockIdx.y*blockDim.y) + threadIdx.y;
@@ -281,7 +235,7 @@ __global__ void cuCalcYvortBaro(datagrid *grid, float *thrhopert, float *yvort_b
     int NZ = grid->NZ;
     float dy;
 
-    if ((i < NX-1) && (j < NY-1) && (k < NZ) && ( i > 0 ) && (j > 0) && (k > 0)) {
+    if ((i < NX-1) && (j < NY-1) && (k < NZ) && ( i > 0 ) && (j > 0) && (k > 0) && tile_active(grid, i, j, k)) {
         // loop over the number of time steps we have in memory
         dy = yh(j+1) - yh(j-1);
 		calc_yvort_baro(thrhopert, grid->th0, grid->qv0, yvort_baro, dy, i, j, k, NX, NY);
@@ -289,7 +243,7 @@ __global__ void cuCalcYvortBaro(datagrid *grid, float *thrhopert, float *yvort_b
 }
 
 /* Compute the forcing tendencies from the pressure-volume solenoid term */
-__global__ void cuCalcXvortSolenoid(datagrid *grid, float *pipert, float *thrhopert, float *xvort_solenoid) {
+__global__ void cuCalcXvortSolenoid(datagrid *grid, field_t *pipert, field_t *thrhopert, field_t *xvort_solenoid) {
     // get our 3D index based on our blocks/threads
     int i = (blockIdx.x*blockDim.x) + threadIdx.x;
     int j = (blockIdx.y*blockDim.y) + threadIdx.y;
@@ -299,7 +253,7 @@ __global__ void cuCalcXvortSolenoid(datagrid *grid, float *pipert, float *thrhop
     int NZ = grid->NZ;
     float dy, dz;
 
-    if ((i < NX-1) && (j < NY-1) && (k < NZ) && ( i > 0 ) && (j > 0) && (k > 0)) {
+    if ((i < NX-1) && (j < NY-1) && (k < NZ) && ( i > 0 ) && (j > 0) && (k > 0) && tile_active(grid, i, j, k)) {
         dy = yh(j+1)-yh(j-1);
         dz = zh(k+1)-zh(k-1);
 
@@ -311,7 +265,7 @@ __global__ void cuCalcXvortSolenoid(datagrid *grid, float *pipert, float *thrhop
 }
 
 /* Compute the forcing tendencies from the pressure-volume solenoid term */
-__global__ void cuCalcYvortSolenoid(datagrid *grid, float *pipert, float *thrhopert, float *yvort_solenoid) {
+__global__ void cuCalcYvortSolenoid(datagrid *grid, field_t *pipert, field_t *thrhopert, field_t *yvort_solenoid) {
     // get our 3D index based on our blocks/threads
     int i = (blockIdx.x*blockDim.x) + threadIdx.x;
     int j = (blockIdx.y*blockDim.y) + threadIdx.y;
@@ -321,7 +275,7 @@ __global__ void cuCalcYvortSolenoid(datagrid *grid, float *pipert, float *thrhop
     int NZ = grid->NZ;
     float dx, dz;
 
-    if ((i < NX-1) && (j < NY-1) && (k < NZ) && ( i > 0 ) && (j > 0) && (k > 0)) {
+    if ((i < NX-1) && (j < NY-1) && (k < NZ) && ( i > 0 ) && (j > 0) && (k > 0) && tile_active(grid, i, j, k)) {
         dx = xh(i+1)-xh(i-1);
         dz = zh(k+1)-zh(k-1);
 
@@ -333,7 +287,7 @@ __global__ void cuCalcYvortSolenoid(datagrid *grid, float *pipert, float *thrhop
 }
 
 /* Compute the forcing tendencies from the pressure-volume solenoid term */
-__global__ void cuCalcZvortSolenoid(datagrid *grid, float *pipert, float *thrhopert, float *zvort_solenoid) {
+__global__ void cuCalcZvortSolenoid(datagrid *grid, field_t *pipert, field_t *thrhopert, field_t *zvort_solenoid) {
     // get our 3D index based on our blocks/threads
     int i = (blockIdx.x*blockDim.x) + threadIdx.x;
     int j = (blockIdx.y*blockDim.y) + threadIdx.y;
@@ -345,7 +299,7 @@ __global__ void cuCalcZvortSolenoid(datagrid *grid, float *pipert, float *thrhop
 
     // Even though there are NZ points, it's a center difference
     // and we reach out NZ+1 points to get the derivatives
-    if ((i < NX-1) && (j < NY-1) && (k < NZ) && ( i > 0 ) && (j > 0)) {
+    if ((i < NX-1) && (j < NY-1) && (k < NZ) && ( i > 0 ) && (j > 0) && tile_active(grid, i, j, k)) {
         dx = xh(i+1)-xh(i-1);
         dy = yh(j+1)-yh(j-1);
 
@@ -362,7 +316,7 @@ __global__ void zeroTemArrays(datagrid *grid, model_data *data, int tStart, int
     int NX = grid->NX;
     int NY = grid->NY;
     int NZ = grid->NZ;
-    float *dum0;
+    field_t *dum0;
     if (( i < NX+1) && ( j < NY+1) && ( k < NZ+1)) {
         dum0 = data->tem1;
         for (int tidx = tStart; tidx < tEnd; ++tidx) {
@@ -392,43 +346,4 @@ __global__ void zeroTemArrays(datagrid *grid, model_data *data, int tStart, int
 }
 
 
-/* Average our vorticity values back to the scalar grid for interpolation
-   to the parcel paths. We're able to do this in parallel by making use of
-   the three temporary arrays allocated on our grid, which means that the
-   xvort/yvort/zvort arrays will be averaged into tem1/tem2/tem3. */ 
-__global__ void doVortAvg(datagrid *grid, float *tem1, float *tem2, float *tem3, float *xvort, float *yvort, float *zvort, int tStart, int tEnd) {
-
-    // get our grid indices based on our block and thread info
-    int i = blockIdx.x*blockDim.x + threadIdx.x;
-    int j = blockIdx.y*blockDim.y + threadIdx.y;
-    int k = blockIdx.z*blockDim.z + threadIdx.z;
-
-    int NX = grid->NX;
-    int NY = grid->NY;
-    int NZ = grid->NZ;
-    float *buf0, *dum0;
-
-    if ((i < NX) && (j < NY) && (k < NZ)) {
-        // loop over the number of time steps we have in memory
-        for (int tidx = tStart; tidx < tEnd; ++tidx) {
-            // average the temporary arrays into the result arrays
-            dum0 = tem1;
-            buf0 = xvort;
-            BUF4D(i, j, k, tidx) = 0.25 * ( TEM4D(i, j, k, tidx) + TEM4D(i, j+1, k, tidx) +\
-                                            TEM4D(i, j, k+1, tidx) + TEM4D(i, j+1, k+1, tidx) );
-
-            dum0 = tem2;
-            buf0 = yvort;
-            BUF4D(i, j, k, tidx) = 0.25 * ( TEM4D(i, j, k, tidx) + TEM4D(i+1, j, k, tidx) +\
-                                            TEM4D(i, j, k+1, tidx) + TEM4D(i+1, j, k+1, tidx) );
-
-            dum0 = tem3;
-            buf0 = zvort;
-            BUF4D(i, j, k, tidx) = 0.25 * ( TEM4D(i, j, k, tidx) + TEM4D(i+1, j, k, tidx) +\
-                                            TEM4D(i, j+1, k, tidx) + TEM4D(i+1, j+1, k, tidx) );
-        }
-    }
-}
-
-
 #endif
@@ -0,0 +1,368 @@
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "../include/datastructs.h"
+#include "../include/macros.h"
+#include "../calc/calcvort.cu"
+#include "../parcel/tilemask.cu"
+#ifndef VORT_CPU
+#define VORT_CPU
+
+/*
+ * Copyright (C) 2017-2020 Kelton Halbert, Space Science and Engineering Center (SSEC), University of Wisconsin - Madison
+ * Written by Kelton Halbert at the University of Wisconsin - Madison,
+ * Cooperative Institute for Meteorological Satellite Studies (CIMSS),
+ * Space Science and Engineering Center (SSEC). Provided under the Apache 2.0 License.
+ * Email: kthalbert@wisc.edu
+*/
+
+/* These are the CPU counterparts to the kernels in vort.cu. Rather than
+   being called once per time level like the GPU kernels, each of these
+   takes the full 4D arrays and loops over tStart to tEnd itself so that
+   independent time levels can run in parallel. The index ranges are the
+   same as the bounds checks in the GPU kernels. Boundary conditions get
+   applied in a separate pass after the stencil so that no thread reads
+   a point another thread is writing. */
+
+void cpuCalcPipert(datagrid *grid, field_t *prespert, field_t *pipert, int tStart, int tEnd) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+
+    FOR_TILES(tStart, tEnd, 0, NX+1, 0, NY+1, 0, NZ) {
+        long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+        calc_pipert(&(prespert[bufidx]), grid->p0, &(pipert[bufidx]), i, j, k, NX, NY);
+    }
+}
+
+/* Compute the 3 components of vorticity and average them to the scalar
+   grid without the tem arrays. On the GPU every scalar point computes the
+   staggered values around it on its own, but on the CPU computing each one
+   4 times costs more than it saves. Instead, each thread works up through a
+   block of levels, and keeps the staggered values for the levels just below
+   and above the one it's on in a couple of small buffers to average out of.
+   With a tile mask, a block only does the box around its active tiles. */
+void cpuCalcVort(datagrid *grid, field_t *ustag, field_t *vstag, field_t *wstag, field_t *xvort, field_t *yvort, field_t *zvort, int tStart, int tEnd) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    // one level of a staggered mesh, big
+    // enough for any of the three of them
+    long NP = (long)(NX+1)*(NY+1);
+    int nKBlocks = (NZ + TILE_K - 1) / TILE_K;
+
+    #pragma omp parallel
+    {
+        float *xv = new float[2*NP];
+        float *yv = new float[2*NP];
+        float *zv = new float[NP];
+
+        #pragma omp for collapse(2) schedule(static)
+        for (int tidx = tStart; tidx < tEnd; ++tidx) {
+            for (int kb = 0; kb < nKBlocks; ++kb) {
+                long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+                field_t *u = &(ustag[bufidx]);
+                field_t *v = &(vstag[bufidx]);
+                field_t *w = &(wstag[bufidx]);
+                int k0 = kb*TILE_K;
+                int k1 = TILE_END(k0, TILE_K, NZ);
+                int ia = 0, ib = NX, ja = 0, jb = NY;
+                if (!tile_bounds(grid, &ia, &ib, &ja, &jb, &k0, &k1)) continue;
+                // the staggered values one past the end of
+                // the box get averaged in, and are all that
+                // gets cleared out of the buffers
+                long r0 = ja*(NX+1);
+                long nr = (std::min(jb+1, NY+1) - ja)*(NX+1);
+
+                for (int k = k0; k < k1; ++k) {
+                    // the staggered x and y vorticity at k and k+1. The
+                    // level below was the level above on the last pass.
+                    float *xlo = &(xv[(k % 2)*NP]); float *xhi = &(xv[((k+1) % 2)*NP]);
+                    float *ylo = &(yv[(k % 2)*NP]); float *yhi = &(yv[((k+1) % 2)*NP]);
+                    for (int kk = (k == k0) ? k : k+1; kk < k+2; ++kk) {
+                        float *xs = &(xv[(kk % 2)*NP]);
+                        float *ys = &(yv[(kk % 2)*NP]);
+                        // the same bounds and lower boundary
+                        // condition as calc_xvort and calc_yvort
+                        int ks = kk;
+                        if ((ks == 0) && (zf(0) == 0)) ks = 1;
+                        memset(&(xs[r0]), 0, nr*sizeof(float));
+                        memset(&(ys[r0]), 0, nr*sizeof(float));
+                        float dz = zf(ks) - zf(ks-1);
+                        if ((ks >= 1) && (ks < NZ)) {
+                            for (int j = ja; j < std::min(jb+1, NY+1); ++j) {
+                                float dy = yf(j) - yf(j-1);
+                                #pragma omp simd
+                                for (int i = ia; i < std::min(ib+1, NX); ++i) {
+                                    xs[j*(NX+1) + i] = _xvort_stag(v, w, dy, dz, i, j, ks, NX, NY);
+                                }
+                            }
+                        }
+                        if ((ks >= 1) && (ks < NZ+1)) {
+                            for (int j = ja; j < std::min(jb+1, NY); ++j) {
+                                #pragma omp simd
+                                for (int i = ia; i < std::min(ib+1, NX+1); ++i) {
+                                    ys[j*(NX+1) + i] = _yvort_stag(u, w, xf(i) - xf(i-1), dz, i, j, ks, NX, NY);
+                                }
+                            }
+                        }
+                    }
+                    for (int j = ja; j < std::min(jb+1, NY+1); ++j) {
+                        float dy = yf(j) - yf(j-1);
+                        #pragma omp simd
+                        for (int i = ia; i < std::min(ib+1, NX+1); ++i) {
+                            zv[j*(NX+1) + i] = _zvort_stag(u, v, xf(i) - xf(i-1), dy, i, j, k, NX, NY);
+                        }
+                    }
+
+                    // and average them the same way calc_vort_avg does
+                    for (int j = ja; j < jb; ++j) {
+                        float *x0 = &(xlo[j*(NX+1)]); float *x1 = &(xhi[j*(NX+1)]);
+                        float *y0 = &(ylo[j*(NX+1)]); float *y1 = &(yhi[j*(NX+1)]);
+                        float *z0 = &(zv[j*(NX+1)]);
+                        field_t *buf0;
+                        #pragma omp simd private(buf0)
+                        for (int i = ia; i < ib; ++i) {
+                            buf0 = &(xvort[bufidx]);
+                            BUF(i, j, k) = 0.25 * ( x0[i] + x0[i+NX+1] + x1[i] + x1[i+NX+1] );
+                            buf0 = &(yvort[bufidx]);
+                            BUF(i, j, k) = 0.25 * ( y0[i] + y0[i+1] + y1[i] + y1[i+1] );
+                            buf0 = &(zvort[bufidx]);
+                            BUF(i, j, k) = 0.25 * ( z0[i] + z0[i+1] + z0[i+NX+1] + z0[i+NX+2] );
+                        }
+                    }
+                }
+            }
+        }
+
+        delete[] xv;
+        delete[] yv;
+        delete[] zv;
+    }
+}
+
+void cpuCalcXvortStretch(datagrid *grid, field_t *vstag, field_t *wstag, field_t *xvort, field_t *xvstretch, int tStart, int tEnd) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+
+    FOR_TILES(tStart, tEnd, 0, NX, 0, NY, 0, NZ) {
+        long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+        float dy = yf(j+1) - yf(j);
+        float dz = zf(k+1) - zf(k);
+        calc_xvort_stretch(&(vstag[bufidx]), &(wstag[bufidx]), &(xvort[bufidx]), &(xvstretch[bufidx]), dy, dz, i, j, k, NX, NY);
+    }
+}
+
+void cpuCalcYvortStretch(datagrid *grid, field_t *ustag, field_t *wstag, field_t *yvort, field_t *yvstretch, int tStart, int tEnd) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+
+    FOR_TILES(tStart, tEnd, 0, NX, 0, NY, 0, NZ) {
+        long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+        float dx = xf(i+1) - xf(i);
+        float dz = zf(k+1) - zf(k);
+        calc_yvort_stretch(&(ustag[bufidx]), &(wstag[bufidx]), &(yvort[bufidx]), &(yvstretch[bufidx]), dx, dz, i, j, k, NX, NY);
+    }
+}
+
+void cpuCalcZvortStretch(datagrid *grid, field_t *ustag, field_t *vstag, field_t *zvort, field_t *zvstretch, int tStart, int tEnd) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+
+    FOR_TILES(tStart, tEnd, 0, NX, 0, NY, 0, NZ) {
+        long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+        float dx = xf(i+1) - xf(i);
+        float dy = yf(j+1) - yf(j);
+        calc_zvort_stretch(&(ustag[bufidx]), &(vstag[bufidx]), &(zvort[bufidx]), &(zvstretch[bufidx]), dx, dy, i, j, k, NX, NY);
+    }
+}
+
+void cpuPreXvortTilt(datagrid *grid, field_t *ustag, field_t *dudy, field_t *dudz, int tStart, int tEnd) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+
+    FOR_TILES(tStart, tEnd, 0, NX, 0, NY, 0, NZ) {
+        long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+        float dy = yf(j) - yf(j-1);
+        calc_dudy(&(ustag[bufidx]), &(dudy[bufidx]), dy, i, j, k, NX, NY);
+    }
+    FOR_TILES(tStart, tEnd, 0, NX, 0, NY, 1, NZ) {
+        long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+        float dz = zf(k) - zf(k-1);
+        calc_dudz(&(ustag[bufidx]), &(dudz[bufidx]), dz, i, j, k, NX, NY);
+    }
+}
+
+void cpuPreYvortTilt(datagrid *grid, field_t *vstag, field_t *dvdx, field_t *dvdz, int tStart, int tEnd) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+
+    FOR_TILES(tStart, tEnd, 0, NX, 0, NY, 0, NZ) {
+        long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+        float dx = xf(i) - xf(i-1);
+        calc_dvdx(&(vstag[bufidx]), &(dvdx[bufidx]), dx, i, j, k, NX, NY);
+    }
+    FOR_TILES(tStart, tEnd, 0, NX, 0, NY, 1, NZ) {
+        long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+        float dz = zf(k) - zf(k-1);
+        calc_dvdz(&(vstag[bufidx]), &(dvdz[bufidx]), dz, i, j, k, NX, NY);
+    }
+}
+
+void cpuPreZvortTilt(datagrid *grid, field_t *wstag, field_t *dwdx, field_t *dwdy, int tStart, int tEnd) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+
+    FOR_TILES(tStart, tEnd, 0, NX, 0, NY, 0, NZ) {
+        long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+        float dx = xf(i) - xf(i-1);
+        float dy = yf(j) - yf(j-1);
+        calc_dwdx(&(wstag[bufidx]), &(dwdx[bufidx]), dx, i, j, k, NX, NY);
+        calc_dwdy(&(wstag[bufidx]), &(dwdy[bufidx]), dy, i, j, k, NX, NY);
+    }
+}
+
+void cpuCalcXvortTilt(datagrid *grid, field_t *yvort, field_t *zvort, field_t *dudy, field_t *dudz, field_t *xvtilt, int tStart, int tEnd) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+
+    FOR_TILES(tStart, tEnd, 0, NX, 0, NY, 0, NZ) {
+        long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+        calc_xvort_tilt(&(yvort[bufidx]), &(zvort[bufidx]), &(dudy[bufidx]), &(dudz[bufidx]), &(xvtilt[bufidx]), i, j, k, NX, NY);
+    }
+}
+
+void cpuCalcYvortTilt(datagrid *grid, field_t *xvort, field_t *zvort, field_t *dvdx, field_t *dvdz, field_t *yvtilt, int tStart, int tEnd) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+
+    FOR_TILES(tStart, tEnd, 0, NX, 0, NY, 0, NZ) {
+        long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+        calc_yvort_tilt(&(xvort[bufidx]), &(zvort[bufidx]), &(dvdx[bufidx]), &(dvdz[bufidx]), &(yvtilt[bufidx]), i, j, k, NX, NY);
+    }
+}
+
+void cpuCalcZvortTilt(datagrid *grid, field_t *xvort, field_t *yvort, field_t *dwdx, field_t *dwdy, field_t *zvtilt, int tStart, int tEnd) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+
+    FOR_TILES(tStart, tEnd, 0, NX, 0, NY, 0, NZ) {
+        long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+        calc_zvort_tilt(&(xvort[bufidx]), &(yvort[bufidx]), &(dwdx[bufidx]), &(dwdy[bufidx]), &(zvtilt[bufidx]), i, j, k, NX, NY);
+    }
+}
+
+void cpuCalcXvortBaro(datagrid *grid, field_t *thrhopert, field_t *xvort_baro, int tStart, int tEnd) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+
+    FOR_TILES(tStart, tEnd, 1, NX-1, 1, NY-1, 1, NZ) {
+        long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+        float dx = xh(i+1) - xh(i-1);
+        calc_xvort_baro(&(thrhopert[bufidx]), grid->th0, grid->qv0, &(xvort_baro[bufidx]), dx, i, j, k, NX, NY);
+    }
+}
+
+void cpuCalcYvortBaro(datagrid *grid, field_t *thrhopert, field_t *yvort_baro, int tStart, int tEnd) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+
+    FOR_TILES(tStart, tEnd, 1, NX-1, 1, NY-1, 1, NZ) {
+        long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+        float dy = yh(j+1) - yh(j-1);
+        calc_yvort_baro(&(thrhopert[bufidx]), grid->th0, grid->qv0, &(yvort_baro[bufidx]), dy, i, j, k, NX, NY);
+    }
+}
+
+void cpuCalcXvortSolenoid(datagrid *grid, field_t *pipert, field_t *thrhopert, field_t *xvort_solenoid, int tStart, int tEnd) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+
+    FOR_TILES(tStart, tEnd, 1, NX-1, 1, NY-1, 1, NZ) {
+        long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+        float dy = yh(j+1)-yh(j-1);
+        float dz = zh(k+1)-zh(k-1);
+        calc_xvort_solenoid(&(pipert[bufidx]), &(thrhopert[bufidx]), grid->th0, grid->qv0, &(xvort_solenoid[bufidx]), dy, dz, i, j, k, NX, NY);
+    }
+
+    // lower boundary condition of stencil
+    if (zf(0) == 0) {
+        #pragma omp parallel for collapse(2)
+        for (int tidx = tStart; tidx < tEnd; ++tidx) {
+            for (int j = 1; j < NY-1; ++j) {
+                field_t *sol = &(xvort_solenoid[P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1)]);
+                for (int i = 1; i < NX-1; ++i) sol[P3(i, j, 0, NX+2, NY+2)] = sol[P3(i, j, 1, NX+2, NY+2)];
+            }
+        }
+    }
+}
+
+void cpuCalcYvortSolenoid(datagrid *grid, field_t *pipert, field_t *thrhopert, field_t *yvort_solenoid, int tStart, int tEnd) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+
+    FOR_TILES(tStart, tEnd, 1, NX-1, 1, NY-1, 1, NZ) {
+        long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+        float dx = xh(i+1)-xh(i-1);
+        float dz = zh(k+1)-zh(k-1);
+        calc_yvort_solenoid(&(pipert[bufidx]), &(thrhopert[bufidx]), grid->th0, grid->qv0, &(yvort_solenoid[bufidx]), dx, dz, i, j, k, NX, NY);
+    }
+
+    // lower boundary condition of stencil
+    if (zf(0) == 0) {
+        #pragma omp parallel for collapse(2)
+        for (int tidx = tStart; tidx < tEnd; ++tidx) {
+            for (int j = 1; j < NY-1; ++j) {
+                field_t *sol = &(yvort_solenoid[P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1)]);
+                for (int i = 1; i < NX-1; ++i) sol[P3(i, j, 0, NX+2, NY+2)] = sol[P3(i, j, 1, NX+2, NY+2)];
+            }
+        }
+    }
+}
+
+void cpuCalcZvortSolenoid(datagrid *grid, field_t *pipert, field_t *thrhopert, field_t *zvort_solenoid, int tStart, int tEnd) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+
+    // Even though there are NZ points, it's a center difference
+    // and we reach out NZ+1 points to get the derivatives
+    FOR_TILES(tStart, tEnd, 1, NX-1, 1, NY-1, 0, NZ) {
+        long bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
+        float dx = xh(i+1)-xh(i-1);
+        float dy = yh(j+1)-yh(j-1);
+        calc_zvort_solenoid(&(pipert[bufidx]), &(thrhopert[bufidx]), &(zvort_solenoid[bufidx]), dx, dy, i, j, k, NX, NY);
+    }
+}
+
+/* Zero out the temporary arrays. On the CPU these are contiguous
+   in memory for each time level so just memset the whole chunk. */
+void zeroTemArraysCPU(datagrid *grid, model_data *data, int tStart, int tEnd) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    long bufidx = P4(0, 0, 0, tStart, NX+2, NY+2, NZ+1);
+    long nbytes = (long)(tEnd - tStart)*(NX+2)*(NY+2)*(NZ+1)*sizeof(field_t);
+
+    field_t *tems[6] = {data->tem1, data->tem2, data->tem3, data->tem4, data->tem5, data->tem6};
+    #pragma omp parallel for
+    for (int n = 0; n < 6; ++n) {
+        memset(&(tems[n][bufidx]), 0, nbytes);
+    }
+}
+
+#endif
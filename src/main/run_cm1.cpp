@@ -1,15 +1,18 @@
 #include <algorithm>
+#include <climits>
 #include <iostream>
 #include <fstream>
 #include <string>
 #include "mpi.h"
 #include <map>
+#include <vector>
 
 #include "../include/datastructs.h"
 #include "../include/integrate.h"
 #include "../include/macros.h"
 #include "../io/readlofs.cpp"
 #include "../io/writenc.cpp"
+#include "../parcel/reorder.cpp"
 /*
  * Copyright (C) 2017-2020 Kelton Halbert, Space Science and Engineering Center (SSEC), University of Wisconsin - Madison
  * Written by Kelton Halbert at the University of Wisconsin - Madison,
@@ -38,46 +41,6 @@ int find_nearest_index(double *arr, double val, int N) {
     return nearest;
 }
 
-void nearest_grid_idx(float *point, datagrid *grid, int *idx_4D) {
-
-	int near_i = -1;
-	int near_j = -1;
-	int near_k = -1;
-
-    float pt_x = point[0];
-    float pt_y = point[1];
-    float pt_z = point[2];
-
-
-	// loop over the X grid
-	for ( int i = 0; i < grid->NX; i++ ) {
-		// find the nearest grid point index at X
-		if ( ( pt_x >= grid->xf[i] ) && ( pt_x <= grid->xf[i+1] ) ) { near_i = i; } 
-	}
-
-	// loop over the Y grid
-	for ( int j = 0; j < grid->NY; j++ ) {
-		// find the nearest grid point index in the Y
-		if ( ( pt_y >= grid->yf[j] ) && ( pt_y <= grid->yf[j+1] ) ) { near_j = j; } 
-	}
-
-	// loop over the Z grid
-    int k = 1;
-    while (pt_z >= grid->zf[k+1]) {
-        k = k + 1;
-    }
-    near_k = k;
-
-	// if a nearest index was not found, set all indices to -1 to flag
-	// that the point is not in the domain
-	if ((near_i == -1) || (near_j == -1) || (near_k == -1)) {
-		near_i = -1; near_j = -1; near_k = -1;
-	}
-
-	idx_4D[0] = near_i; idx_4D[1] = near_j; idx_4D[2] = near_k;
-	return;
-}
-
 /* Read a user supplied config/namelist file
  * used for specifying details about the parcel
  * seeds, data location, and variables to write. */
@@ -101,6 +64,20 @@ map<string, string> readCfg(string filename) {
     return usrCfg;
 }
 
+/* Get an integer option from the namelist that isn't
+ * required to be there, returning the default value
+ * if the user didn't set it. */
+int get_cfg_int(map<string, string> *usrCfg, string name, int default_val) {
+    if (usrCfg->find(name) == usrCfg->end()) return default_val;
+    return stoi((*usrCfg)[name]);
+}
+
+// the same, for options that are strings
+string get_cfg_str(map<string, string> *usrCfg, string name, string default_val) {
+    if (usrCfg->find(name) == usrCfg->end()) return default_val;
+    return (*usrCfg)[name];
+}
+
 /* Parse the user configuration and fill the variables with the necessary values */
 void parse_cfg(map<string, string> *usrCfg, iocfg *io, string *histpath, string *base, double *time, int *nTimes, \
             int *direction, float *X0, float *Y0, float *Z0, int *NX, int *NY, int *NZ, float *DX, float *DY, float *DZ) {
@@ -147,60 +124,172 @@ void parse_cfg(map<string, string> *usrCfg, iocfg *io, string *histpath, string
 
     io->output_vorticity_budget = stoi((*usrCfg)["output_vorticity_budget"]);
     io->output_momentum_budget = stoi((*usrCfg)["output_momentum_budget"]);
+
+    // Optional integration settings. These default
+    // to one step per history time with no time 
+    // interpolation, same as older namelists.
+    io->nsubsteps = get_cfg_int(usrCfg, "nsubsteps", 1);
+    io->time_interp = get_cfg_int(usrCfg, "time_interp", 0);
+    if (io->nsubsteps < 1) io->nsubsteps = 1;
+
+    // The integration scheme can be rk2, rk4, or rk45, with rk2 being
+    // the default. The adaptive rk45 scheme also takes an error tolerance.
+    string scheme = "rk2";
+    if (usrCfg->find("integrator") != usrCfg->end()) scheme = (*usrCfg)["integrator"];
+    transform(scheme.begin(), scheme.end(), scheme.begin(), ::tolower);
+    if (scheme == "rk2") io->integrator = INTEG_RK2;
+    else if (scheme == "rk4") io->integrator = INTEG_RK4;
+    else if (scheme == "rk45") io->integrator = INTEG_RK45;
+    else {
+        cerr << "Unknown integrator " << scheme << ", using rk2." << endl;
+        io->integrator = INTEG_RK2;
+    }
+    if (usrCfg->find("rk_tol") != usrCfg->end()) io->rk_tol = stof((*usrCfg)["rk_tol"]);
+
+    io->reorder_interval = get_cfg_int(usrCfg, "reorder_interval", 0);
+
+    // The sparse momentum budget is only done at the parcels, but the
+    // vorticity budget needs the momentum budget on the whole grid.
+    io->sparse_budget = get_cfg_int(usrCfg, "sparse_budget", 0);
+    if (io->sparse_budget && io->output_vorticity_budget) {
+        cerr << "sparse_budget doesn't work with output_vorticity_budget, turning it off." << endl;
+        io->sparse_budget = 0;
+    }
+
+    io->tile_mask = get_cfg_int(usrCfg, "tile_mask", 0);
+
+    // How many history times each chunk integrates through, and
+    // how much room the parcels get when the subset is requested.
+    io->window_times = get_cfg_int(usrCfg, "window_times", 0);
+    io->subset_halo = get_cfg_int(usrCfg, "subset_halo", 10);
+    if (io->subset_halo < 10) io->subset_halo = 10;
+    // or size the room on each side from how fast the wind blows that way
+    io->adaptive_halo = get_cfg_int(usrCfg, "adaptive_halo", 0);
+
+    // read the next chunk in on the other ranks while
+    // rank 0 integrates the current one
+    io->read_ahead = get_cfg_int(usrCfg, "read_ahead", 0);
+
+    // The 4D arrays live in managed memory when there's a GPU,
+    // and the other ranks can't map that into their address space.
+    io->shared_window = get_cfg_int(usrCfg, "shared_window", 0);
+#ifndef CPU_ONLY
+    if (io->shared_window) {
+        cerr << "shared_window only works in CPU_ONLY builds, turning it off." << endl;
+        io->shared_window = 0;
+    }
+#endif
+
+    // every rank integrates its own share of the parcels. The GPU
+    // code only runs on rank 0, so this is a CPU_ONLY thing too, and
+    // the ranks don't send each other time levels when it's on.
+    io->parcel_shards = get_cfg_int(usrCfg, "parcel_shards", 0);
+
+    // each rank integrates the parcels in its own part of the domain,
+    // on top of the parcels being sharded for the output. The parcels
+    // get regrouped by tile every chunk, so sorting them is no help.
+    io->domain_tiles = get_cfg_int(usrCfg, "domain_tiles", 0);
+    if (io->domain_tiles) {
+        io->parcel_shards = 1;
+        io->reorder_interval = 0;
+    }
+
+    // split the parcels up into this many clusters with a subset around
+    // each, which goes along with every rank integrating its own parcels
+    io->subset_boxes = get_cfg_int(usrCfg, "subset_boxes", 0);
+    if (io->subset_boxes > MAX_SUBSET_BOXES) io->subset_boxes = MAX_SUBSET_BOXES;
+    if (io->subset_boxes > 1) io->parcel_shards = 1;
+#ifndef CPU_ONLY
+    if (io->parcel_shards) {
+        cerr << "parcel_shards, domain_tiles, and subset_boxes only work in CPU_ONLY builds, turning them off." << endl;
+        io->parcel_shards = 0;
+        io->domain_tiles = 0;
+        io->subset_boxes = 0;
+    }
+#endif
+    if (io->parcel_shards) {
+        io->read_ahead = 0;
+        io->shared_window = 0;
+    }
 }
 
 
+// how many grid points inside of a subset the parcels
+// have to stay for it to get kept for the next chunk
+#define KEEP_HALO 10
+
+/* Pad the parcel index bounds (relative to the saved grid) by halo
+ * points on every side, plus however far the parcels might move in each
+ * direction, and keep the result in our saved bounds. The padding on
+ * each face (west, east, south, north, bottom, top) starts from pad if
+ * it isn't NULL, or KEEP_HALO otherwise, and halo gets added to that. */
+void subsetBounds(int halo, int *pad, int *reach, int *min_i, int *max_i, int *min_j, int *max_j, int *min_k, int *max_k) {
+    int ri = 0, rj = 0, rk = 0;
+    if (reach != NULL) { ri = reach[0]; rj = reach[1]; rk = reach[2]; }
+    int h[6];
+    for (int f = 0; f < 6; ++f) h[f] = halo + ((pad != NULL) ? pad[f] : KEEP_HALO);
+    *min_i = saved_X0 + *min_i - h[0] - ri;
+    *max_i = saved_X0 + *max_i + h[1] + ri;
+    *min_j = saved_Y0 + *min_j - h[2] - rj;
+    *max_j = saved_Y0 + *max_j + h[3] + rj;
+    *min_k = *min_k - h[4] - rk;
+    *max_k = *max_k + h[5] + rk;
+
+    if (*min_i < saved_X0) *min_i = saved_X0+1;
+    if (*max_i > saved_X1) *max_i = saved_X1-1;
+    if (*min_j < saved_Y0) *min_j = saved_Y0+1;
+    if (*max_j > saved_Y1) *max_j = saved_Y1-1;
+    if (*min_k < 0) *min_k = 0;
+    if (*max_k > nkwrite_val-2) *max_k = nkwrite_val-2;
+}
+
 /* Load the grid metadata and request a domain subset based on the 
  * current parcel positioning for the current time step. The idea is that 
  * for the first chunk of times read in (from 0 to N MPI ranks for time)
  * only the subset of the domain that matters for that period of time. 
  * When the next chunk of time is read in, check and see where the parcels
  * are currently and request a subset that is relevent to those parcels.   
+ * If the parcels are all still well inside of the current subset, that
+ * gets handed back instead, so that the time levels already read in
+ * for it can be kept. If reach isn't NULL, the subset is for where the
+ * parcels could be after moving up to that many grid points, which is
+ * how the next chunk gets predicted for reading ahead. With
+ * adaptive_halo, pad is how much room each face of the subset needs
+ * (see adaptive_halo in tilemask.cu), otherwise it's NULL.
  */
-datagrid* loadMetadataAndGrid(string base_dir, parcel_pos *parcels, int rank) {
-    // get the HDF metadata from LOFS - return the first filename
-    cout << "Retrieving HDF Metadata" << endl;
-    get_hdf_metadata(firstfilename,&nx,&ny,&nz,&nodex,&nodey);
-
-    // Create a temporary full grid that we will then subset. We will
-    // only do this in CPU memory because this will get deleted
-    datagrid *temp_grid;
+datagrid* loadMetadataAndGrid(parcel_pos *parcels, int rank, datagrid *current, int *reach, int *pad) {
+    // The full grid that we will then subset, so that we can find
+    // the indices of where our parcels are. The metadata and mesh
+    // were read in once up front, so this is all in memory.
+    datagrid *temp_grid = lofs_full_grid();
     // this is the grid we will return
     datagrid *requested_grid;
-        
-
-    // load the saved grid dimmensions into 
-    // the temporary grid, then we will find
-    // a smaller subset to load into memory.
-    //  nz comes from readlofs
-    cout << "Allocating temporary grid" << endl;
-    temp_grid = allocate_grid_cpu( saved_X0, saved_X1, saved_Y0, saved_Y1, 0, nz-1);
-
-    // request the full grid so that we can find the indices
-    // of where our parcels are, and then request a smaller
-    // subset from there.
-    cout << "Calling LOFS on temporary grid" << endl;
-    lofs_get_grid(temp_grid);
 
     // find the min/max index bounds of 
     // our parcels
     float point[3];
     int idx_4D[4];
-    int min_i = temp_grid->NX+1;
-    int min_j = temp_grid->NY+1;
-    int min_k = temp_grid->NZ+1;
-    int max_i = -1;
-    int max_j = -1;
-    int max_k = -1;
+    int hint_4D[4] = {-1, -1, -1, -1};
+    int pmin_i = temp_grid->NX+1;
+    int pmin_j = temp_grid->NY+1;
+    int pmin_k = temp_grid->NZ+1;
+    int pmax_i = -1;
+    int pmax_j = -1;
+    int pmax_k = -1;
     int invalidCount = 0;
+    // only the parcels that are still active matter here
     cout << "Searching the parcel bounds" << endl;
-    for (int pcl = 0; pcl < parcels->nParcels; ++pcl) {
+    for (int a = 0; a < parcels->nActive; ++a) {
+        int pcl = parcels->active[a];
         point[0] = parcels->xpos[PCL(0, pcl, parcels->nTimes)];
         point[1] = parcels->ypos[PCL(0, pcl, parcels->nTimes)];
         point[2] = parcels->zpos[PCL(0, pcl, parcels->nTimes)];
         // find the nearest grid point!
         if ((point[0] == NC_FILL_FLOAT) || (point[1] == NC_FILL_FLOAT) || (point[2] == NC_FILL_FLOAT)) continue;
-        nearest_grid_idx(point, temp_grid, idx_4D);
+        // parcels are seeded in order, so the last
+        // parcel's cell makes a good starting guess
+        _nearest_grid_idx(point, temp_grid, idx_4D, hint_4D);
+        if (idx_4D[0] != -1) { hint_4D[0] = idx_4D[0]; hint_4D[1] = idx_4D[1]; hint_4D[2] = idx_4D[2]; }
         if ( (idx_4D[0] == -1) || (idx_4D[1] == -1) || (idx_4D[2] == -1) ) {
             cout << "INVALID POINT X " << point[0] << " Y " << point[1] << " Z " << point[2] << endl;
             cout << "Parcel X " << parcels->xpos[PCL(0, pcl, parcels->nTimes)];
@@ -211,42 +300,38 @@ datagrid* loadMetadataAndGrid(string base_dir, parcel_pos *parcels, int rank) {
 
         // check to see if we've found the min/max
         // for the dimension
-        if (idx_4D[0] < min_i) min_i = idx_4D[0]; 
-        if (idx_4D[0] > max_i) max_i = idx_4D[0]; 
-        if (idx_4D[1] < min_j) min_j = idx_4D[1]; 
-        if (idx_4D[1] > max_j) max_j = idx_4D[1]; 
-        if (idx_4D[2] < min_k) min_k = idx_4D[2]; 
-        if (idx_4D[2] > max_k) max_k = idx_4D[2]; 
+        if (idx_4D[0] < pmin_i) pmin_i = idx_4D[0]; 
+        if (idx_4D[0] > pmax_i) pmax_i = idx_4D[0]; 
+        if (idx_4D[1] < pmin_j) pmin_j = idx_4D[1]; 
+        if (idx_4D[1] > pmax_j) pmax_j = idx_4D[1]; 
+        if (idx_4D[2] < pmin_k) pmin_k = idx_4D[2]; 
+        if (idx_4D[2] > pmax_k) pmax_k = idx_4D[2]; 
     }
     cout << "Finished searching parcel bounds" << endl;
-    // clear the memory from the temp grid
-    cout << "Deallocating temporary grid" << endl;
-    deallocate_grid_cpu(temp_grid);
+
+    // If every parcel is still at least KEEP_HALO (or pad) points inside
+    // of the subset we already have, there's no need for a new one. The
+    // parcel positions are the same on every rank, so they all
+    // make the same call here.
+    int min_i = pmin_i, max_i = pmax_i, min_j = pmin_j, max_j = pmax_j, min_k = pmin_k, max_k = pmax_k;
+    subsetBounds(0, pad, reach, &min_i, &max_i, &min_j, &max_j, &min_k, &max_k);
+    if ((current != NULL) && (invalidCount < parcels->nActive) && \
+        (min_i >= current->X0) && (max_i <= current->X1) && \
+        (min_j >= current->Y0) && (max_j <= current->Y1) && \
+        (min_k >= current->Z0) && (max_k <= current->Z1)) {
+        cout << "Parcels are still inside of the current subset, keeping it" << endl;
+        return current;
+    }
 
     // we want to add a buffer to our dimensions so that
     // the parcels don't accidentally move outside of our
     // requested data. If the buffer goes outside the 
     // saved dimensions, set it to the saved dimensions.
-    // We also do this for our staggered grid calculations
-    min_i = saved_X0 + min_i - 10;
-    max_i = saved_X0 + max_i + 10;
-    min_j = saved_Y0 + min_j - 10;
-    max_j = saved_Y0 + max_j + 10;
-    min_k = min_k - 10;
-    max_k = max_k + 10;
-    cout << "Attempted Parcel Bounds In Grid" << endl;
-    cout << "X0: " << min_i << " X1: " << max_i << endl;
-    cout << "Y0: " << min_j << " Y1: " << max_j << endl;
-    cout << "Z0: " << min_k << " Z1: " << max_k << endl;
-
-    // keep the data in our saved bounds
-    if (min_i < saved_X0) min_i = saved_X0+1;
-    if (max_i > saved_X1) max_i = saved_X1-1;
-    if (min_j < saved_Y0) min_j = saved_Y0+1;
-    if (max_j > saved_Y1) max_j = saved_Y1-1;
-    if (min_k < 0) min_k = 0;
-    if (max_k > nkwrite_val-2) max_k = nkwrite_val-2;
-
+    // We also do this for our staggered grid calculations.
+    // A bigger buffer means the subset can be kept for more
+    // chunks before the parcels get too close to its edge.
+    min_i = pmin_i; max_i = pmax_i; min_j = pmin_j; max_j = pmax_j; min_k = pmin_k; max_k = pmax_k;
+    subsetBounds(parcels->io->subset_halo - KEEP_HALO, pad, reach, &min_i, &max_i, &min_j, &max_j, &min_k, &max_k);
 
     cout << "Parcel Bounds In Grid" << endl;
     cout << "X0: " << min_i << " X1: " << max_i << endl;
@@ -259,8 +344,13 @@ datagrid* loadMetadataAndGrid(string base_dir, parcel_pos *parcels, int rank) {
     // on rank zero, allocate our grid on both the
     // CPU and GPU so that the GPU knows something
     // about our data for future integration.
+    // (or just the CPU, if this is a CPU_ONLY build)
     if (rank == 0) {
+#ifdef CPU_ONLY
+        requested_grid = allocate_grid_cpu( min_i, max_i, min_j, max_j, min_k, max_k);
+#else
         requested_grid = allocate_grid_managed( min_i, max_i, min_j, max_j, min_k, max_k);
+#endif
     }
     // For the other MPI ranks, we only need to
     // allocate the grids on the CPU for copying
@@ -273,7 +363,7 @@ datagrid* loadMetadataAndGrid(string base_dir, parcel_pos *parcels, int rank) {
     // if literally all of our parcels aren't
     // in the domain then something has gone
     // horribly wrong
-    if (invalidCount == parcels->nParcels) {
+    if (invalidCount == parcels->nActive) {
         requested_grid->isValid = 0;
         return requested_grid;
     }
@@ -335,22 +425,421 @@ void loadDataFromDisk(iocfg *io, datagrid *requested_grid, float *ustag, float *
 
 }
 
+/* The buffers one rank read a time level of the model data into,
+ * already packed down to field_t, waiting to get sent to rank 0.
+ * hidx is the history time index that got read, or -1 if the rank
+ * didn't have a level to read.
+ */
+struct level_read {
+    int hidx;
+    field_t *u, *v, *w, *kmh, *p, *t, *th, *rho, *qv, *qc, *qi, *qs, *qg;
+};
+
+/* Work out which history time each rank reads for the batch of window
+ * levels starting at level l0, with ranks r0 and up reading one level
+ * each. Ranks below r0, past the end of the window, or past the end of
+ * the history files get -1. Returns how many levels are in the batch.
+ */
+int batchTimes(int *hidx, int tFirst, int l0, int nLevels, int r0, int size, int nearest_tidx, int direct) {
+    int nRead = min(size - r0, nLevels - l0);
+    for (int r = 0; r < size; ++r) {
+        int h = nearest_tidx + direct*(tFirst + l0 + r - r0);
+        hidx[r] = ((r >= r0) && (r - r0 < nRead) && (h >= 0) && (h < ntottimes)) ? h : -1;
+    }
+    if ((l0 == 0) && (nRead > 0) && (hidx[r0] < 0)) {
+        cout << "Ran out of history times to integrate through. Abort." << endl;
+        exit(-1);
+    }
+    return nRead;
+}
+
+/* Read the time level at history index hidx into buffers from the
+ * read pool, and pack them down to however the 4D arrays store their
+ * fields, so that's all that has to get sent around. With 16 bit
+ * fields this halves the size of the gathers. Nothing gets read if
+ * hidx is -1.
+ */
+void readTimeLevel(iocfg *io, datagrid *requested_grid, buffer_pool *readpool, level_read *lvl, int hidx, int rank, int size) {
+    // The number of grid points requested...
+    // There's some awkwardness here I have to figure out a better way around,
+    // but MPI Scatter/Gather behaves weird if I use the generic large buffer,
+    // so I use N_scalar for the MPI calls to non staggered/scalar fields. 
+    long N_stag = (requested_grid->NX+2)*(requested_grid->NY+2)*(requested_grid->NZ+1);
+    long N_scal = (requested_grid->NX+2)*(requested_grid->NY+2)*(requested_grid->NZ+1);
+    *lvl = level_read();
+    lvl->hidx = hidx;
+    if (hidx < 0) return;
+
+    // allocate space for U, V, and W arrays
+    // for all ranks, because this is what
+    // LOFS will return it's data subset to
+    float *ubuf = NULL, *vbuf = NULL, *wbuf = NULL, *pbuf = NULL, *tbuf = NULL, *thbuf = NULL, *rhobuf = NULL;
+    float *qvbuf = NULL, *qcbuf = NULL, *qibuf = NULL, *qsbuf = NULL, *qgbuf = NULL, *kmhbuf = NULL;
+
+    ubuf = (float *) pool_alloc(readpool, N_stag*sizeof(float));
+    vbuf = (float *) pool_alloc(readpool, N_stag*sizeof(float));
+    wbuf = (float *) pool_alloc(readpool, N_stag*sizeof(float));
+    // khh and kmh are on the staggered W mesh
+    if (io->output_momentum_budget || io->output_vorticity_budget || io->output_kmh) kmhbuf = (float *) pool_alloc(readpool, N_stag*sizeof(float));
+    if (io->output_momentum_budget || io->output_vorticity_budget || io->output_ppert) pbuf = (float *) pool_alloc(readpool, N_scal*sizeof(float));
+    if (io->output_momentum_budget || io->output_vorticity_budget || io->output_thetapert) tbuf = (float *) pool_alloc(readpool, N_scal*sizeof(float));
+    if (io->output_momentum_budget || io->output_vorticity_budget || io->output_thrhopert) thbuf = (float *) pool_alloc(readpool, N_scal*sizeof(float));
+    if (io->output_momentum_budget || io->output_vorticity_budget || io->output_rhopert) rhobuf = (float *) pool_alloc(readpool, N_scal*sizeof(float));
+    if (io->output_momentum_budget || io->output_vorticity_budget || io->output_qvpert) qvbuf = (float *) pool_alloc(readpool, N_scal*sizeof(float));
+    if (io->output_qc) qcbuf = (float *) pool_alloc(readpool, N_scal*sizeof(float));
+    if (io->output_qi) qibuf = (float *) pool_alloc(readpool, N_scal*sizeof(float));
+    if (io->output_qs) qsbuf = (float *) pool_alloc(readpool, N_scal*sizeof(float));
+    if (io->output_qg) qgbuf = (float *) pool_alloc(readpool, N_scal*sizeof(float));
+
+    // load u, v, and w into memory
+    printf("TIMESTEP %d/%d %d %f dt= %f\n", rank, size, hidx, alltimes[hidx], requested_grid->dt);
+    loadDataFromDisk(io, requested_grid, ubuf, vbuf, wbuf, pbuf, tbuf, thbuf, \
+                     rhobuf, qvbuf, qcbuf, qibuf, qsbuf, qgbuf, kmhbuf, \
+                     alltimes[hidx]);
+
+    lvl->u = floats_to_fields(ubuf, N_stag);
+    lvl->v = floats_to_fields(vbuf, N_stag);
+    lvl->w = floats_to_fields(wbuf, N_stag);
+    lvl->kmh = floats_to_fields(kmhbuf, N_stag);
+    lvl->p = floats_to_fields(pbuf, N_scal);
+    lvl->t = floats_to_fields(tbuf, N_scal);
+    lvl->th = floats_to_fields(thbuf, N_scal);
+    lvl->rho = floats_to_fields(rhobuf, N_scal);
+    lvl->qv = floats_to_fields(qvbuf, N_scal);
+    lvl->qc = floats_to_fields(qcbuf, N_scal);
+    lvl->qi = floats_to_fields(qibuf, N_scal);
+    lvl->qs = floats_to_fields(qsbuf, N_scal);
+    lvl->qg = floats_to_fields(qgbuf, N_scal);
+}
+
+/* Give the buffers of a level that was read back to the read pool */
+void releaseTimeLevel(buffer_pool *readpool, level_read *lvl) {
+    field_t *bufs[13] = {lvl->u, lvl->v, lvl->w, lvl->kmh, lvl->p, lvl->t, lvl->th, \
+                         lvl->rho, lvl->qv, lvl->qc, lvl->qi, lvl->qs, lvl->qg};
+    for (int b = 0; b < 13; ++b) {
+        if (bufs[b] != NULL) pool_free(readpool, bufs[b]);
+    }
+    *lvl = level_read();
+}
+
+/* With shared_window on, the ranks on the same node as rank 0 read their
+ * time levels right into rank 0's model arrays, which live in an MPI-3
+ * shared memory window, instead of into read buffers that then get
+ * gathered. That's one less copy of every level, and those ranks don't
+ * need read buffers at all. Ranks on the other nodes still send theirs.
+ * comm is the ranks on rank 0's node (MPI_COMM_NULL on the others),
+ * onNode says which world ranks those are, and arena is the start of
+ * rank 0's segment, laid out like read_fields says. onNode is NULL when
+ * the option is off.
+ */
+struct node_window {
+    MPI_Comm comm;
+    MPI_Win win;
+    int *onNode;
+    field_t *arena;
+    long nElems;
+};
+
+void openNodeWindow(node_window *nw, int enable, int rank, int size) {
+    nw->comm = MPI_COMM_NULL;
+    nw->win = MPI_WIN_NULL;
+    nw->onNode = NULL;
+    nw->arena = NULL;
+    nw->nElems = 0;
+    if (!enable) return;
+
+    // the lowest world rank on each node is rank 0 of its node
+    MPI_Comm node;
+    MPI_Comm_split_type(MPI_COMM_WORLD, MPI_COMM_TYPE_SHARED, rank, MPI_INFO_NULL, &node);
+    int nodeRoot = rank;
+    MPI_Bcast(&nodeRoot, 1, MPI_INT, 0, node);
+    int mine = (nodeRoot == 0);
+    if (mine) nw->comm = node;
+    else MPI_Comm_free(&node);
+    nw->onNode = new int[size];
+    MPI_Allgather(&mine, 1, MPI_INT, nw->onNode, 1, MPI_INT, MPI_COMM_WORLD);
+}
+
+/* Make sure the window has room for nElems fields, all of them on rank 0.
+ * It only ever grows, so a subset that shrinks keeps the one it has. This
+ * is collective over rank 0's node, and rank 0 can't have anything in the
+ * old window anymore when it has to grow.
+ */
+void sizeNodeWindow(node_window *nw, long nElems, int rank) {
+    if ((nw->comm == MPI_COMM_NULL) || (nElems <= nw->nElems)) return;
+    if (nw->win != MPI_WIN_NULL) {
+        MPI_Win_unlock_all(nw->win);
+        MPI_Win_free(&(nw->win));
+    }
+    MPI_Aint nbytes = (rank == 0) ? nElems*sizeof(field_t) : 0;
+    void *base;
+    MPI_Win_allocate_shared(nbytes, sizeof(field_t), MPI_INFO_NULL, nw->comm, &base, &(nw->win));
+    MPI_Aint segsize;
+    int disp;
+    MPI_Win_shared_query(nw->win, 0, &segsize, &disp, &base);
+    if (rank == 0) memset(base, 0, nbytes);
+    nw->arena = (field_t *) base;
+    nw->nElems = nElems;
+    // everyone keeps an access epoch open on it the whole time, and
+    // syncNodeWindow is what keeps the ranks from stepping on each other
+    MPI_Win_lock_all(MPI_MODE_NOCHECK, nw->win);
+}
+
+/* Everything the ranks on rank 0's node wrote to the window before this
+ * is visible to all of them after it. Does nothing anywhere else. */
+void syncNodeWindow(node_window *nw) {
+    if (nw->comm == MPI_COMM_NULL) return;
+    MPI_Win_sync(nw->win);
+    MPI_Barrier(nw->comm);
+    MPI_Win_sync(nw->win);
+}
+
+void closeNodeWindow(node_window *nw) {
+    if (nw->win != MPI_WIN_NULL) {
+        MPI_Win_unlock_all(nw->win);
+        MPI_Win_free(&(nw->win));
+    }
+    if (nw->comm != MPI_COMM_NULL) MPI_Comm_free(&(nw->comm));
+    delete[] nw->onNode;
+    nw->onNode = NULL;
+}
+
+/* With domain_tiles on, the horizontal domain gets split up into one
+ * tile per rank, and each rank integrates whichever parcels are in its
+ * tile at the start of a time chunk. The tiles are laid out nI by nJ,
+ * rank r has tile (r % nI, r / nI), and the edges are the x and y
+ * coordinates the tiles start at, with the last ones being the far
+ * side of the domain. xEdge is NULL when the option is off.
+ */
+struct domain_tiles {
+    int nI;
+    int nJ;
+    float *xEdge;
+    float *yEdge;
+};
+
+void openDomainTiles(domain_tiles *tiles, int enable, int size) {
+    tiles->nI = 1;
+    tiles->nJ = 1;
+    tiles->xEdge = NULL;
+    tiles->yEdge = NULL;
+    if (!enable) return;
+
+    datagrid *grid = lofs_full_grid();
+
+    // the longer side of the domain gets cut into more tiles
+    int dims[2] = {0, 0};
+    MPI_Dims_create(size, 2, dims);
+    tiles->nI = (grid->NX >= grid->NY) ? dims[0] : dims[1];
+    tiles->nJ = size / tiles->nI;
+    tiles->xEdge = new float[tiles->nI+1];
+    tiles->yEdge = new float[tiles->nJ+1];
+    for (int t = 0; t <= tiles->nI; ++t) tiles->xEdge[t] = xf(t*grid->NX/tiles->nI);
+    for (int t = 0; t <= tiles->nJ; ++t) tiles->yEdge[t] = yf(t*grid->NY/tiles->nJ);
+    cout << "Splitting the domain into " << tiles->nI << " by " << tiles->nJ << " tiles" << endl;
+}
+
+// the rank whose tile the point is in. Anything
+// off the edge of the domain goes to the closest one.
+int tileOwner(domain_tiles *tiles, float x, float y) {
+    int ti = 0, tj = 0;
+    while ((ti < tiles->nI-1) && (x >= tiles->xEdge[ti+1])) ti += 1;
+    while ((tj < tiles->nJ-1) && (y >= tiles->yEdge[tj+1])) tj += 1;
+    return tj*tiles->nI + ti;
+}
+
+void closeDomainTiles(domain_tiles *tiles) {
+    delete[] tiles->xEdge;
+    delete[] tiles->yEdge;
+    tiles->xEdge = NULL;
+    tiles->yEdge = NULL;
+}
+
+/* Read the time level at history index hidx right into level lvl of the
+ * 4D arrays in dst (in the order read_field_flags uses), instead of into
+ * read buffers of its own. LOFS hands back floats, so if the fields are
+ * stored as something smaller they still go through the read buffers to
+ * get packed down first.
+ */
+void readLevelInto(iocfg *io, datagrid *requested_grid, buffer_pool *readpool, field_t **dst, \
+                   int hidx, int lvl, int rank, int size) {
+    long N = (requested_grid->NX+2)*(requested_grid->NY+2)*(requested_grid->NZ+1);
+    if (hidx < 0) return;
+
+    if (sizeof(field_t) == sizeof(float)) {
+        float *bufs[N_READ_FIELDS];
+        for (int f = 0; f < N_READ_FIELDS; ++f) bufs[f] = (dst[f] == NULL) ? NULL : (float *) (dst[f] + lvl*N);
+        printf("TIMESTEP %d/%d %d %f dt= %f\n", rank, size, hidx, alltimes[hidx], requested_grid->dt);
+        loadDataFromDisk(io, requested_grid, bufs[0], bufs[1], bufs[2], bufs[4], bufs[5], bufs[6], bufs[7], \
+                         bufs[8], bufs[9], bufs[10], bufs[11], bufs[12], bufs[3], alltimes[hidx]);
+        return;
+    }
+
+    level_read buf;
+    readTimeLevel(io, requested_grid, readpool, &buf, hidx, rank, size);
+    field_t *src[N_READ_FIELDS] = {buf.u, buf.v, buf.w, buf.kmh, buf.p, buf.t, buf.th, \
+                                   buf.rho, buf.qv, buf.qc, buf.qi, buf.qs, buf.qg};
+    for (int f = 0; f < N_READ_FIELDS; ++f) {
+        if (src[f] != NULL) memcpy(dst[f] + lvl*N, src[f], N*sizeof(field_t));
+    }
+    releaseTimeLevel(readpool, &buf);
+}
+
+// The most elements of a field that go in one message. A time level of
+// a big subset can have more points than fit in the int count MPI wants,
+// so the levels get sent in pieces no bigger than this, which also lets
+// the pieces of all of the fields be in flight at once.
+#define MAX_MSG_ELEMS (1L << 26)
+
+/* Post the sends and receives that move one field of the level each rank
+ * read into consecutive levels of dst on rank 0, starting at level l0 for
+ * rank r0, in pieces of at most MAX_MSG_ELEMS. send says which ranks have
+ * a level to send. Rank 0 just copies its own level over. The requests
+ * get added to reqs, and nothing is done until they're waited on.
+ */
+void postField(field_t *fld, field_t *dst, long l0, long N, int *send, int r0, int tag, \
+               int rank, int size, MPI_Datatype type, vector<MPI_Request> &reqs) {
+    if (rank == 0) {
+        for (int r = 0; r < size; ++r) {
+            if (!send[r]) continue;
+            field_t *recv = dst + (l0 + r - r0)*N;
+            if (r == 0) {
+                memcpy(recv, fld, N*sizeof(field_t));
+                continue;
+            }
+            for (long off = 0; off < N; off += MAX_MSG_ELEMS) {
+                MPI_Request req;
+                MPI_Irecv(recv + off, (int) min(MAX_MSG_ELEMS, N - off), type, r, tag, MPI_COMM_WORLD, &req);
+                reqs.push_back(req);
+            }
+        }
+    }
+    else if (send[rank]) {
+        for (long off = 0; off < N; off += MAX_MSG_ELEMS) {
+            MPI_Request req;
+            MPI_Isend(fld + off, (int) min(MAX_MSG_ELEMS, N - off), type, 0, tag, MPI_COMM_WORLD, &req);
+            reqs.push_back(req);
+        }
+    }
+}
+
+/* Send one batch of time levels to rank 0, where they go in the 4D
+ * arrays starting at level l0 in the same order as batchTimes handed
+ * them out. The read buffers go back to the pool afterwards. Levels
+ * in the batch past the end of the history files hold the last time
+ * there is constant. Ranks with inPlace set already put their level
+ * where it goes through the shared window, so they don't send it.
+ */
+void sendTimeLevels(iocfg *io, datagrid *requested_grid, model_data *data, buffer_pool *readpool, \
+                    level_read *lvl, int *hidx, int l0, int nRead, int r0, int rank, int size, int *inPlace) {
+    long N = (requested_grid->NX+2)*(requested_grid->NY+2)*(requested_grid->NZ+1);
+    MPI_Datatype MPI_FIELD = (sizeof(field_t) == sizeof(float)) ? MPI_FLOAT : MPI_UNSIGNED_SHORT;
+
+    // which ranks have a level to send
+    int *send = new int[size];
+    for (int r = 0; r < size; ++r) {
+        send[r] = (hidx[r] >= 0) && !((inPlace != NULL) && inPlace[r]);
+    }
+
+    // The fields that get read in, where they come from on
+    // each rank, and where they go in the arrays on rank 0
+    static const char *names[N_READ_FIELDS] = {"U", "V", "W", "KMH", "P", "T", "TH", "RHO", "QV", "QC", "QI", "QS", "QG"};
+    int want[N_READ_FIELDS];
+    read_field_flags(io, want);
+    field_t *src[N_READ_FIELDS] = {lvl->u, lvl->v, lvl->w, lvl->kmh, lvl->p, lvl->t, lvl->th, \
+                                   lvl->rho, lvl->qv, lvl->qc, lvl->qi, lvl->qs, lvl->qg};
+    field_t *dst[N_READ_FIELDS] = {NULL};
+    if (rank == 0) model_read_fields(io, data, dst);
+
+    // for MPI runs that load multiple time steps into memory,
+    // communicate the data you've read into our 4D array. All
+    // of the fields get posted before waiting on any of them.
+    vector<MPI_Request> reqs;
+    int first[N_READ_FIELDS+1];
+    for (int f = 0; f < N_READ_FIELDS; ++f) {
+        first[f] = reqs.size();
+        if (want[f]) postField(src[f], dst[f], l0, N, send, r0, f, rank, size, MPI_FIELD, reqs);
+    }
+    first[N_READ_FIELDS] = reqs.size();
+    int senderr[N_READ_FIELDS];
+    for (int f = 0; f < N_READ_FIELDS; ++f) {
+        senderr[f] = MPI_Waitall(first[f+1] - first[f], reqs.data() + first[f], MPI_STATUSES_IGNORE);
+    }
+    delete[] send;
+
+    // clean up temporary buffers
+    releaseTimeLevel(readpool, lvl);
+
+    if (rank == 0) {
+        for (int f = 0; f < N_READ_FIELDS; ++f) {
+            if (want[f]) cout << "MPI Gather Error " << names[f] << ": " << senderr[f] << endl;
+        }
+
+        for (int n = 0; n < nRead; ++n) {
+            if (hidx[r0 + n] >= 0) continue;
+            cout << "No history time for level " << l0 + n << ", holding the last one constant" << endl;
+            hold_model_level(io, data, N, l0 + n);
+        }
+    }
+}
+
+/* Compute the derived fields for the levels of this chunk that have come
+ * in so far. When this happens between batches, the other ranks are busy
+ * reading the next one in the meantime. The tile mask needs the winds for
+ * the whole chunk first, so with it on this waits for the integration.
+ */
+void deriveLevels(iocfg *io, datagrid *requested_grid, model_data *data, int nChunkTimes, int rank) {
+    if ((rank != 0) || io->tile_mask) return;
+    int tEnd = min(data->nValid, nChunkTimes);
+#ifdef CPU_ONLY
+    cpuDeriveFields(requested_grid, data, tEnd);
+#else
+    cudaDeriveFields(requested_grid, data, tEnd);
+#endif
+}
+
+/* Free a grid subset, and the model data that goes with it if there is
+ * any. Rank 0's live in managed memory if there's a GPU, and the fields
+ * that get read in are in the shared window's arena if there is one.
+ * With parcel_shards, every rank has model data of its own.
+ */
+void releaseSubset(iocfg *io, datagrid *grid, model_data *data, buffer_pool *datapool, field_t *arena, int rank) {
+    if ((rank == 0) || io->parcel_shards) {
+#ifdef CPU_ONLY
+        deallocate_grid_cpu(grid);
+        if (data != NULL) deallocate_model_cpu(io, data, datapool, arena);
+#else
+        deallocate_grid_managed(grid);
+        if (data != NULL) deallocate_model_managed(io, data, datapool);
+#endif
+    }
+    else {
+        deallocate_grid_cpu(grid);
+        if (data != NULL) delete data;
+    }
+}
+
 /* Seed some parcels into the domain
  * in physical gridpoint space, and then
  * fill the remainder of the parcel traces
- * with missing values. 
+ * with missing values. If the parcels are
+ * split up between ranks, only this rank's
+ * share of them gets seeded.
  */
 void seed_parcels(parcel_pos *parcels, float X0, float Y0, float Z0, int NX, int NY, int NZ, \
                     float DX, float DY, float DZ, int nTotTimes) {
-    int nParcels = NX*NY*NZ;
+    int nParcels = parcels->nParcels;
+    int first = parcels->pclOffset;
 
     int pid = 0;
     for (int k = 0; k < NZ; ++k) {
         for (int j = 0; j < NY; ++j) {
             for (int i = 0; i < NX; ++i) {
-                parcels->xpos[PCL(0, pid, parcels->nTimes)] = X0 + i*DX;
-                parcels->ypos[PCL(0, pid, parcels->nTimes)] = Y0 + j*DY;
-                parcels->zpos[PCL(0, pid, parcels->nTimes)] = Z0 + k*DZ;
+                if ((pid >= first) && (pid < first + nParcels)) {
+                    parcels->xpos[PCL(0, pid - first, parcels->nTimes)] = X0 + i*DX;
+                    parcels->ypos[PCL(0, pid - first, parcels->nTimes)] = Y0 + j*DY;
+                    parcels->zpos[PCL(0, pid - first, parcels->nTimes)] = Z0 + k*DZ;
+                }
                 pid += 1;
             }
         }
@@ -366,16 +855,502 @@ void seed_parcels(parcel_pos *parcels, float X0, float Y0, float Z0, int NX, int
             parcels->zpos[PCL(t, p, parcels->nTimes)] = NC_FILL_FLOAT;
         }
     }
+    // Only the positions get filled in at the last time of a chunk,
+    // so give everything else something defined to write out there
+    float *arrs[MAX_PCL_ARRAYS];
+    int nArrs = _parcel_arrays(parcels, arrs);
+    for (int n = 3; n < nArrs; ++n) memset(arrs[n], 0, (long)nParcels*parcels->nTimes*sizeof(float));
     cout << "END PARCEL SEED" << endl;
     cout << NC_FILL_FLOAT << endl;
 }
 
 
+/* Now that we've integrated forward and written to disk, before we can go
+ * again we have to set the current end position of the parcel to the
+ * beginning for the next leg of integration. Do that, stop integrating the
+ * parcels that left the domain, and every so often sort the parcels in
+ * memory by where they are in the domain so that parcels next to each
+ * other in memory read from the same parts of the model data.
+ */
+void startNextChunk(iocfg *io, datagrid *requested_grid, parcel_pos *parcels, int tChunk, int nChunkTimes) {
+    cout << "Setting final parcel position to beginning of array for next integration cycle..." << endl;
+    for (int a = 0; a < parcels->nActive; ++a) {
+        int pcl = parcels->active[a];
+        parcels->xpos[PCL(0, pcl, parcels->nTimes)] = parcels->xpos[PCL(nChunkTimes, pcl, parcels->nTimes)];
+        parcels->ypos[PCL(0, pcl, parcels->nTimes)] = parcels->ypos[PCL(nChunkTimes, pcl, parcels->nTimes)];
+        parcels->zpos[PCL(0, pcl, parcels->nTimes)] = parcels->zpos[PCL(nChunkTimes, pcl, parcels->nTimes)];
+    }
+    cout << "Parcel position arrays reset." << endl;
+
+    compact_parcels(parcels);
+
+    if ((io->reorder_interval > 0) && ((tChunk+1) % io->reorder_interval == 0)) {
+        reorder_parcels(requested_grid, parcels);
+    }
+}
+
+// how many times a chunk gets read in again with more room
+// around the parcels before adaptive_halo gives up on it
+#define HALO_RETRIES 3
+
+/* With adaptive_halo, look for parcels that got out of the grid subset
+ * during the chunk. A parcel that went missing while it was within reach
+ * of a face of the subset that isn't also the edge of the domain got out
+ * through that face, rather than out of the domain. It can go missing as
+ * soon as its stencil gets to the edge, so within reach means within pad
+ * plus SUBSET_STENCIL points, which is generous on purpose. Those faces
+ * get twice the room, and this returns true if any of them could, so
+ * that the chunk can be read in again and integrated over.
+ */
+bool haloEscapes(datagrid *grid, parcel_pos *parcels, int nChunkTimes, int *pad) {
+    int nTimes = parcels->nTimes;
+    // which faces of the subset are inside of the domain
+    bool inner[6] = {grid->X0 > saved_X0+1, grid->X1 < saved_X1-1, \
+                     grid->Y0 > saved_Y0+1, grid->Y1 < saved_Y1-1, \
+                     grid->Z0 > 0, grid->Z1 < nkwrite_val-2};
+    int escaped[6] = {0, 0, 0, 0, 0, 0};
+    float point[3];
+    int idx_4D[4];
+    int hint_4D[4] = {-1, -1, -1, -1};
+    for (int a = 0; a < parcels->nActive; ++a) {
+        int pcl = parcels->active[a];
+        if (parcels->xpos[PCL(nChunkTimes, pcl, nTimes)] != PCL_MISSING) continue;
+        // the last place it was before it went missing
+        int t = nChunkTimes-1;
+        while ((t >= 0) && (parcels->xpos[PCL(t, pcl, nTimes)] == PCL_MISSING)) --t;
+        if (t < 0) continue;
+        point[0] = parcels->xpos[PCL(t, pcl, nTimes)];
+        point[1] = parcels->ypos[PCL(t, pcl, nTimes)];
+        point[2] = parcels->zpos[PCL(t, pcl, nTimes)];
+        _nearest_grid_idx(point, grid, idx_4D, hint_4D);
+        if (idx_4D[0] == -1) continue;
+        hint_4D[0] = idx_4D[0]; hint_4D[1] = idx_4D[1]; hint_4D[2] = idx_4D[2];
+        int dist[6] = {idx_4D[0], (int)grid->NX-1 - idx_4D[0], idx_4D[1], (int)grid->NY-1 - idx_4D[1], \
+                       idx_4D[2], (int)grid->NZ-1 - idx_4D[2]};
+        for (int f = 0; f < 6; ++f) {
+            if (inner[f] && (dist[f] < pad[f] + SUBSET_STENCIL)) escaped[f] += 1;
+        }
+    }
+
+    bool grew = false;
+    for (int f = 0; f < 6; ++f) {
+        if (escaped[f] == 0) continue;
+        cout << escaped[f] << " parcels got out of face " << f << " of the subset with " << pad[f] << " points of room";
+        if (pad[f] < ADAPT_HALO_MAX) {
+            pad[f] = std::min(2*pad[f], ADAPT_HALO_MAX);
+            grew = true;
+        }
+        cout << ", giving it " << pad[f] << endl;
+    }
+    return grew;
+}
+
+// Size the pad for the next chunk's subset from this one's winds around the parcels
+void nextHalo(datagrid *grid, model_data *data, parcel_pos *parcels, int nChunkTimes, int direct, int *pad) {
+    adaptive_halo(grid, data, parcels, 0, nChunkTimes, direct, pad);
+    cout << "Adaptive halo W " << pad[0] << " E " << pad[1] << " S " << pad[2];
+    cout << " N " << pad[3] << " B " << pad[4] << " T " << pad[5] << endl;
+}
+
+/* The grid subsets around each cluster of a rank's parcels. Box b has
+ * its own subset and model data, which get kept from one chunk to the
+ * next for as long as the parcels in box b stay inside of it. Without
+ * subset_boxes there's only ever the one box around all of them.
+ */
+struct box_set {
+    int nBoxes;
+    datagrid *grid[MAX_SUBSET_BOXES];
+    model_data *data[MAX_SUBSET_BOXES];
+    // the room each face of a box's subset gets with adaptive_halo
+    int pad[MAX_SUBSET_BOXES][6];
+};
+
+void openBoxes(box_set *boxes) {
+    boxes->nBoxes = 0;
+    for (int b = 0; b < MAX_SUBSET_BOXES; ++b) {
+        boxes->grid[b] = NULL;
+        boxes->data[b] = NULL;
+        for (int f = 0; f < 6; ++f) boxes->pad[b][f] = KEEP_HALO;
+    }
+}
+
+// free the subsets of boxes nKeep and up
+void closeBoxes(iocfg *io, box_set *boxes, int nKeep, buffer_pool *datapool, int rank) {
+    for (int b = nKeep; b < MAX_SUBSET_BOXES; ++b) {
+        if (boxes->grid[b] != NULL) releaseSubset(io, boxes->grid[b], boxes->data[b], datapool, NULL, rank);
+        boxes->grid[b] = NULL;
+        boxes->data[b] = NULL;
+        for (int f = 0; f < 6; ++f) boxes->pad[b][f] = KEEP_HALO;
+    }
+    if (boxes->nBoxes > nKeep) boxes->nBoxes = nKeep;
+}
+
+#ifdef CPU_ONLY
+/* Request the subset around this rank's own parcels, read every time
+ * level of it in, and integrate them. With parcel_shards on, every rank
+ * does this for itself, so nothing has to go through rank 0. The subset
+ * and levels stick around between chunks the same way they do otherwise.
+ * With adaptive_halo, pad is the room the subset gets on each face, and
+ * if any parcels get out of it the chunk is done over in a bigger one.
+ */
+void integrateShard(iocfg *io, parcel_pos *parcels, datagrid **grid, model_data **data, int *pad, \
+                    buffer_pool *readpool, buffer_pool *datapool, int tChunk, int nChunkTimes, int nDataTimes, \
+                    int nearest_tidx, int direct, double dt, int rank, int size) {
+    if (parcels->nActive == 0) return;
+    int *halo = io->adaptive_halo ? pad : NULL;
+    bool regrow = false;
+    for (int retry = 0; ; ++retry) {
+        // if a parcel got out last time, the subset has to be requested again
+        datagrid *chunk_grid = loadMetadataAndGrid(parcels, rank, regrow ? NULL : *grid, NULL, halo);
+        if (chunk_grid->isValid == 0) {
+            cout << "Something went horribly wrong when requesting a domain subset. Abort." << endl;
+            exit(-1);
+        }
+        long N = (chunk_grid->NX+2)*(chunk_grid->NY+2)*(chunk_grid->NZ+1);
+        if (chunk_grid != *grid) {
+            if (*grid != NULL) releaseSubset(io, *grid, *data, datapool, NULL, rank);
+            *grid = chunk_grid;
+            *data = allocate_model_cpu(io, N*nDataTimes, datapool);
+            (*data)->tFirst = tChunk*nChunkTimes;
+            (*data)->nLevels = nDataTimes;
+            (*data)->nValid = 0;
+            (*data)->nDerived = 0;
+        }
+        else {
+            slide_model_window(io, *data, N, tChunk*nChunkTimes - (*data)->tFirst);
+            cout << "Keeping " << (*data)->nValid << " time levels from the last chunk" << endl;
+        }
+        (*grid)->dt = dt;
+
+        // every level the window doesn't have yet goes straight into it
+        field_t *dst[N_READ_FIELDS];
+        model_read_fields(io, *data, dst);
+        for (int lvl = (*data)->nValid; lvl < nDataTimes; ++lvl) {
+            int hidx = nearest_tidx + direct*((*data)->tFirst + lvl);
+            if ((hidx >= 0) && (hidx < ntottimes)) readLevelInto(io, *grid, readpool, dst, hidx, lvl, rank, size);
+            else if (lvl == 0) {
+                cout << "Ran out of history times to integrate through. Abort." << endl;
+                exit(-1);
+            }
+            else {
+                cout << "No history time for level " << lvl << ", holding the last one constant" << endl;
+                hold_model_level(io, *data, N, lvl);
+            }
+            (*data)->nValid = lvl+1;
+        }
+
+        cout << "Beginning parcel integration! Using OpenMP on the CPU..." << endl;
+        cpuIntegrateParcels(*grid, *data, parcels, nChunkTimes, parcels->nTimes, direct);
+        cout << "Finished integrating parcels!" << endl;
+
+        if (!io->adaptive_halo) break;
+        regrow = (retry < HALO_RETRIES) && haloEscapes(*grid, parcels, nChunkTimes, pad);
+        if (!regrow) break;
+        cout << "Integrating the chunk over again" << endl;
+    }
+    if (io->adaptive_halo) nextHalo(*grid, *data, parcels, nChunkTimes, direct, pad);
+}
+
+/* Only the positions (the first three parcel arrays) get filled in
+ * through the end of a chunk. The rest stop a time short, since the
+ * next chunk starts there. This is how many values of a parcel's rows
+ * integrating it fills in, which is all that has to come back out of a
+ * working set of parcels that got integrated on their own.
+ */
+long parcelRowLen(parcel_pos *parcels, int nChunkTimes) {
+    float *arrs[MAX_PCL_ARRAYS];
+    int nArrs = _parcel_arrays(parcels, arrs);
+    return 3L*parcels->nTimes + (long)(nArrs-3)*nChunkTimes;
+}
+
+// copy those values for the parcel in slot pcl out into row,
+// or with unpack set, from row back into the parcel arrays
+void copyParcelRow(parcel_pos *parcels, int pcl, float *row, int nChunkTimes, bool unpack) {
+    float *arrs[MAX_PCL_ARRAYS];
+    int nArrs = _parcel_arrays(parcels, arrs);
+    int nTimes = parcels->nTimes;
+    for (int n = 0; n < nArrs; ++n) {
+        int len = (n < 3) ? nTimes : nChunkTimes;
+        float *arr = &(arrs[n][(long)pcl*nTimes]);
+        if (unpack) memcpy(arr, row, len*sizeof(float));
+        else memcpy(row, arr, len*sizeof(float));
+        row += len;
+    }
+}
+
+// a working set of n parcels starting out at pos (x, y, z for each)
+parcel_pos* workingParcels(iocfg *io, float *pos, int n, int nTimes) {
+    parcel_pos *work = allocate_parcels_cpu(io, n, 1, 1, nTimes);
+    for (int p = 0; p < n; ++p) {
+        work->xpos[PCL(0, p, nTimes)] = pos[3*p+0];
+        work->ypos[PCL(0, p, nTimes)] = pos[3*p+1];
+        work->zpos[PCL(0, p, nTimes)] = pos[3*p+2];
+    }
+    return work;
+}
+
+/* Split the active parcels up into at most maxBoxes clusters, and put
+ * which one each parcel is in into box (in active list order). Parcels
+ * go into bins of horizontal grid points, and bins that touch are in the
+ * same cluster. If that makes too many clusters, the bins get bigger
+ * until it doesn't. Clusters whose subsets would overlap once they get
+ * their halo are merged, so no part of the domain gets read twice.
+ * Returns how many clusters there are, numbered from the south west.
+ */
+int clusterParcels(iocfg *io, parcel_pos *parcels, int maxBoxes, int *box) {
+    datagrid *full = lofs_full_grid();
+    int nActive = parcels->nActive;
+    int nTimes = parcels->nTimes;
+    int halo = io->subset_halo;
+
+    // the horizontal grid cell each parcel is in
+    vector<int> ci(nActive), cj(nActive);
+    float point[3];
+    int idx_4D[4];
+    int hint_4D[4] = {-1, -1, -1, -1};
+    for (int a = 0; a < nActive; ++a) {
+        int pcl = parcels->active[a];
+        point[0] = parcels->xpos[PCL(0, pcl, nTimes)];
+        point[1] = parcels->ypos[PCL(0, pcl, nTimes)];
+        point[2] = parcels->zpos[PCL(0, pcl, nTimes)];
+        _nearest_grid_idx(point, full, idx_4D, hint_4D);
+        if (idx_4D[0] != -1) { hint_4D[0] = idx_4D[0]; hint_4D[1] = idx_4D[1]; hint_4D[2] = idx_4D[2]; }
+        ci[a] = max(idx_4D[0], 0);
+        cj[a] = max(idx_4D[1], 0);
+    }
+
+    // label the bins that have parcels in them by flood filling
+    // through the ones that touch, corners included
+    int bin = 2*halo;
+    int nBoxes = 0;
+    vector<int> binOf(nActive), label;
+    while (true) {
+        int nbi = full->NX/bin + 1;
+        int nbj = full->NY/bin + 1;
+        label.assign((long)nbi*nbj, -2);
+        for (int a = 0; a < nActive; ++a) {
+            binOf[a] = (cj[a]/bin)*nbi + ci[a]/bin;
+            label[binOf[a]] = -1;
+        }
+        nBoxes = 0;
+        vector<long> stack;
+        for (long b = 0; b < (long)label.size(); ++b) {
+            if (label[b] != -1) continue;
+            label[b] = nBoxes;
+            stack.push_back(b);
+            while (!stack.empty()) {
+                long c = stack.back();
+                stack.pop_back();
+                int bi = c % nbi, bj = c / nbi;
+                for (int nj = max(bj-1, 0); nj <= min(bj+1, nbj-1); ++nj) {
+                    for (int ni = max(bi-1, 0); ni <= min(bi+1, nbi-1); ++ni) {
+                        long n = (long)nj*nbi + ni;
+                        if (label[n] == -1) {
+                            label[n] = nBoxes;
+                            stack.push_back(n);
+                        }
+                    }
+                }
+            }
+            nBoxes += 1;
+        }
+        if (nBoxes <= maxBoxes) break;
+        bin *= 2;
+    }
+
+    // the bounds of each cluster
+    vector<int> lo_i(nBoxes, INT_MAX), hi_i(nBoxes, -1), lo_j(nBoxes, INT_MAX), hi_j(nBoxes, -1);
+    for (int a = 0; a < nActive; ++a) {
+        int b = label[binOf[a]];
+        lo_i[b] = min(lo_i[b], ci[a]); hi_i[b] = max(hi_i[b], ci[a]);
+        lo_j[b] = min(lo_j[b], cj[a]); hi_j[b] = max(hi_j[b], cj[a]);
+    }
+
+    // merge the ones whose padded bounds overlap into
+    // the first of them until none of them do
+    vector<int> into(nBoxes);
+    for (int b = 0; b < nBoxes; ++b) into[b] = b;
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (int b = 0; b < nBoxes; ++b) {
+            if (into[b] != b) continue;
+            for (int c = b+1; c < nBoxes; ++c) {
+                if (into[c] != c) continue;
+                if ((lo_i[b] - halo > hi_i[c] + halo) || (lo_i[c] - halo > hi_i[b] + halo)) continue;
+                if ((lo_j[b] - halo > hi_j[c] + halo) || (lo_j[c] - halo > hi_j[b] + halo)) continue;
+                for (int d = 0; d < nBoxes; ++d) if (into[d] == c) into[d] = b;
+                lo_i[b] = min(lo_i[b], lo_i[c]); hi_i[b] = max(hi_i[b], hi_i[c]);
+                lo_j[b] = min(lo_j[b], lo_j[c]); hi_j[b] = max(hi_j[b], hi_j[c]);
+                merged = true;
+            }
+        }
+    }
+
+    // and number what's left in order
+    vector<int> number(nBoxes, -1);
+    int nMerged = 0;
+    for (int b = 0; b < nBoxes; ++b) {
+        if (into[b] == b) number[b] = nMerged++;
+    }
+    for (int a = 0; a < nActive; ++a) box[a] = number[into[label[binOf[a]]]];
+    return nMerged;
+}
+
+/* Integrate a rank's parcels with a subset around each cluster of them
+ * instead of one around all of them, so that the parts of the domain in
+ * between the clusters don't get read in or have stencils run on them.
+ * The parcels in each box get integrated as a working set of their own
+ * and copied back afterwards. With only the one box, the parcels get
+ * integrated right where they are.
+ */
+void integrateBoxes(iocfg *io, parcel_pos *parcels, box_set *boxes, \
+                    buffer_pool *readpool, buffer_pool *datapool, int tChunk, int nChunkTimes, int nDataTimes, \
+                    int nearest_tidx, int direct, double dt, int rank, int size) {
+    int nActive = parcels->nActive;
+    vector<int> box(nActive, 0);
+    int nBoxes = 1;
+    if ((io->subset_boxes > 1) && (nActive > 0)) nBoxes = clusterParcels(io, parcels, io->subset_boxes, box.data());
+    closeBoxes(io, boxes, nBoxes, datapool, rank);
+    boxes->nBoxes = nBoxes;
+
+    if (nBoxes == 1) {
+        integrateShard(io, parcels, &(boxes->grid[0]), &(boxes->data[0]), boxes->pad[0], readpool, datapool, \
+                       tChunk, nChunkTimes, nDataTimes, nearest_tidx, direct, dt, rank, size);
+        return;
+    }
+
+    cout << "Splitting " << nActive << " parcels into " << nBoxes << " subsets" << endl;
+    int nTimes = parcels->nTimes;
+    float *row = new float[parcelRowLen(parcels, nChunkTimes)];
+    for (int b = 0; b < nBoxes; ++b) {
+        vector<int> slot;
+        vector<float> pos;
+        for (int a = 0; a < nActive; ++a) {
+            if (box[a] != b) continue;
+            int pcl = parcels->active[a];
+            slot.push_back(pcl);
+            pos.push_back(parcels->xpos[PCL(0, pcl, nTimes)]);
+            pos.push_back(parcels->ypos[PCL(0, pcl, nTimes)]);
+            pos.push_back(parcels->zpos[PCL(0, pcl, nTimes)]);
+        }
+        cout << "Subset " << b << " has " << slot.size() << " parcels" << endl;
+        parcel_pos *work = workingParcels(io, pos.data(), slot.size(), nTimes);
+        integrateShard(io, work, &(boxes->grid[b]), &(boxes->data[b]), boxes->pad[b], readpool, datapool, \
+                       tChunk, nChunkTimes, nDataTimes, nearest_tidx, direct, dt, rank, size);
+        for (int p = 0; p < (int)slot.size(); ++p) {
+            copyParcelRow(work, p, row, nChunkTimes, false);
+            copyParcelRow(parcels, slot[p], row, nChunkTimes, true);
+        }
+        deallocate_parcels_cpu(io, work);
+    }
+    delete[] row;
+}
+
+/* Write this rank's share of the parcels out and get them ready for the
+ * next chunk. NetCDF can't write in parallel, so the ranks take turns
+ * writing their rows of the output. Ranks that don't have any parcels
+ * left still take their turn, so everyone's rows get written. Returns
+ * how many parcels are left on all ranks.
+ */
+int finishShard(string outfilename, iocfg *io, parcel_pos *parcels, int tChunk, int nChunkTimes, int rank, int size) {
+    cout << "Beginning to write to disk..." << endl;
+    for (int r = 0; r < size; ++r) {
+        if (r == rank) write_parcels(outfilename, parcels, tChunk);
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+    // the parcels can be spread across more than one subset,
+    // so they get sorted by where they are in the whole domain
+    if (parcels->nActive > 0) startNextChunk(io, lofs_full_grid(), parcels, tChunk, nChunkTimes);
+
+    int nLeft;
+    MPI_Allreduce(&(parcels->nActive), &nLeft, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    return nLeft;
+}
+
+/* One time chunk with domain_tiles on. The parcels still belong to the
+ * shard they were seeded in for the output, but each one gets sent to
+ * the rank whose tile it's in to be integrated, and everything that got
+ * computed along its path gets sent back afterwards. A rank only ever
+ * needs the part of the domain around its own tile, plus however far the
+ * parcels in it get during the chunk. Returns how many parcels are left
+ * on all ranks.
+ */
+int tileChunk(string outfilename, iocfg *io, parcel_pos *parcels, domain_tiles *tiles, \
+              box_set *boxes, buffer_pool *readpool, buffer_pool *datapool, int tChunk, \
+              int nChunkTimes, int nDataTimes, int nearest_tidx, int direct, double dt, int rank, int size) {
+    int nTimes = parcels->nTimes;
+
+    // sort our parcels by whose tile they're in
+    vector<int> owner(parcels->nActive);
+    vector<int> sendCounts(size, 0), recvCounts(size, 0);
+    for (int a = 0; a < parcels->nActive; ++a) {
+        int pcl = parcels->active[a];
+        owner[a] = tileOwner(tiles, parcels->xpos[PCL(0, pcl, nTimes)], parcels->ypos[PCL(0, pcl, nTimes)]);
+        sendCounts[owner[a]] += 1;
+    }
+    MPI_Alltoall(sendCounts.data(), 1, MPI_INT, recvCounts.data(), 1, MPI_INT, MPI_COMM_WORLD);
+    vector<int> sendDispl(size, 0), recvDispl(size, 0);
+    for (int r = 1; r < size; ++r) {
+        sendDispl[r] = sendDispl[r-1] + sendCounts[r-1];
+        recvDispl[r] = recvDispl[r-1] + recvCounts[r-1];
+    }
+    int nSend = parcels->nActive;
+    int nRecv = recvDispl[size-1] + recvCounts[size-1];
+
+    // the slot each parcel we send came from, so the results go back there
+    vector<int> slot(nSend);
+    vector<int> next(sendDispl);
+    vector<float> sendPos(3*nSend), recvPos(3*nRecv);
+    for (int a = 0; a < nSend; ++a) {
+        int k = next[owner[a]]++;
+        int pcl = parcels->active[a];
+        slot[k] = pcl;
+        sendPos[3*k+0] = parcels->xpos[PCL(0, pcl, nTimes)];
+        sendPos[3*k+1] = parcels->ypos[PCL(0, pcl, nTimes)];
+        sendPos[3*k+2] = parcels->zpos[PCL(0, pcl, nTimes)];
+    }
+    MPI_Datatype posType;
+    MPI_Type_contiguous(3, MPI_FLOAT, &posType);
+    MPI_Type_commit(&posType);
+    MPI_Alltoallv(sendPos.data(), sendCounts.data(), sendDispl.data(), posType, \
+                  recvPos.data(), recvCounts.data(), recvDispl.data(), posType, MPI_COMM_WORLD);
+    MPI_Type_free(&posType);
+    cout << "Integrating " << nRecv << " parcels in this rank's tile" << endl;
+
+    parcel_pos *work = workingParcels(io, recvPos.data(), nRecv, nTimes);
+    integrateBoxes(io, work, boxes, readpool, datapool, tChunk, nChunkTimes, nDataTimes, \
+                   nearest_tidx, direct, dt, rank, size);
+
+    // Send what got computed for each parcel back to where it came
+    // from. The parcels are what gets counted, so the counts stay
+    // small no matter how many arrays there are.
+    long rowLen = parcelRowLen(work, nChunkTimes);
+    float *sendRows = new float[nRecv*rowLen];
+    for (int p = 0; p < nRecv; ++p) copyParcelRow(work, p, &(sendRows[p*rowLen]), nChunkTimes, false);
+    deallocate_parcels_cpu(io, work);
+    float *recvRows = new float[nSend*rowLen];
+    MPI_Datatype rowType;
+    MPI_Type_contiguous(rowLen, MPI_FLOAT, &rowType);
+    MPI_Type_commit(&rowType);
+    MPI_Alltoallv(sendRows, recvCounts.data(), recvDispl.data(), rowType, \
+                  recvRows, sendCounts.data(), sendDispl.data(), rowType, MPI_COMM_WORLD);
+    MPI_Type_free(&rowType);
+    delete[] sendRows;
+
+    for (int k = 0; k < nSend; ++k) copyParcelRow(parcels, slot[k], &(recvRows[k*rowLen]), nChunkTimes, true);
+    delete[] recvRows;
+
+    return finishShard(outfilename, io, parcels, tChunk, nChunkTimes, rank, size);
+}
+#endif
+
 /* This is the main program that does the parcel trajectory analysis.
  * It first sets up the parcel vectors and seeds the starting locations.
  * It then loads a chunk of times into memory by calling the LOFS api
- * wrappers, with the number of times read in being determined by the
- * number of MPI ranks launched. It then passes the vectors and the 4D u/v/w 
+ * wrappers, with the MPI ranks each reading in one time at a time, and
+ * the number of times in a chunk being the number of MPI ranks launched
+ * unless window_times is set. It then passes the vectors and the 4D u/v/w 
  * data chunks to the GPU, and then proceeds with another time chunk.
  */
 int main(int argc, char **argv ) {
@@ -408,7 +1383,7 @@ int main(int argc, char **argv ) {
     string outfilename = string(base) + ".nc";
 
     int rank, size;
-    long N_stag, N_scal, MX, MY, MZ;
+    long N_stag;
 
     // initialize a bunch of MPI stuff.
     // Rank tells you which process
@@ -420,8 +1395,12 @@ int main(int argc, char **argv ) {
     MPI_Comm_set_errhandler(MPI_COMM_WORLD, MPI_ERRORS_ARE_FATAL);
     MPI_Barrier(MPI_COMM_WORLD);
 
-    int nTimeChunks = (int) (nTimeSteps / size); // this is a temporary hack
-    if (nTimeSteps % size > 0) nTimeChunks += 1;
+    // Each time chunk integrates over nChunkTimes history intervals,
+    // which is one per MPI rank unless the namelist says otherwise.
+    int nChunkTimes = size;
+    if (io->window_times > 0) nChunkTimes = io->window_times;
+    int nTimeChunks = (int) (nTimeSteps / nChunkTimes); // this is a temporary hack
+    if (nTimeSteps % nChunkTimes > 0) nTimeChunks += 1;
     // to make the command line parser stuff work with the
     // existing code.
     // KELTON PLEASE REMEMBER TO CHANGE THIS SO THAT WE
@@ -430,27 +1409,105 @@ int main(int argc, char **argv ) {
 
 
     // the number of time steps we have is 
-    // the number of MPI ranks there are
+    // the number of times in a chunk
     // plus the very last integration end time
-    int nTotTimes = size+1;
+    int nTotTimes = nChunkTimes+1;
+    // and the number of time levels of model data each chunk needs.
+    // If we're interpolating in time, we need one extra time
+    // for the end of the last history interval, which is also
+    // the first time of the next chunk.
+    int nDataTimes = nChunkTimes;
+    if (io->time_interp) nDataTimes = nChunkTimes+1;
     
     // Query our dataset structure.
     // If this has been done before, it reads
     // the information from cache files in the 
     // runtime directory. If it hasn't been run,
     // this step can take fair amount of time.
-    lofs_get_dataset_structure(base_dir);
+    // Only rank 0 walks the dataset and reads the
+    // mesh, and the rest of the ranks get it from
+    // there, so all of the subsetting after this
+    // happens in memory.
+    lofs_get_dataset_structure(base_dir, rank);
+    // keep the fields that get read in around on disk for the next run
+    lofs_open_cache(get_cfg_str(&usrCfg, "cache_dir", ""), rank);
+
+    // we need to find the index of the nearest time to the user requested
+    // time. If the index isn't found, abort.
+    int nearest_tidx = find_nearest_index(alltimes, time, ntottimes);
+    if (nearest_tidx < 0) {
+        cout << "Invalid time index: " << nearest_tidx << " for time " << time << ". Abort." << endl;
+        return 0;
+    }
+    //double dt = fabs(alltimes[nearest_tidx + direct*(1+tChunk*size)] - alltimes[nearest_tidx + direct*(tChunk*size)]);
+    double dt = fabs(alltimes[1] - alltimes[0]);
+
+    // The read buffers and the 4D model arrays are the same size (or
+    // close to it) for every chunk, so hang onto them between chunks
+    // instead of allocating them all over again each time. Only rank 0
+    // has model arrays (unless the parcels are sharded), and they have
+    // to be on the GPU if there is one.
+    buffer_pool *readpool = allocate_pool(0);
+    buffer_pool *datapool = NULL;
+    if ((rank == 0) || io->parcel_shards) {
+#ifdef CPU_ONLY
+        datapool = allocate_pool(0);
+#else
+        datapool = allocate_pool(1);
+#endif
+    }
+    // With shared_window, the ranks on rank 0's node read straight
+    // into the model arrays, so the ones that get read in don't come
+    // from the pool. They live in a shared memory window instead.
+    node_window nw;
+    openNodeWindow(&nw, io->shared_window, rank, size);
+    domain_tiles tiles;
+    openDomainTiles(&tiles, io->domain_tiles, size);
+    // with parcel_shards, the subsets this rank's parcels are in
+    box_set boxes;
+    openBoxes(&boxes);
+
+    // The grid subset and the model data stick around from one chunk
+    // to the next for as long as the parcels stay inside of the subset,
+    // so that the time levels two chunks share only get read once.
+    requested_grid = NULL;
+    model_data *data = NULL;
+    // The subset the next chunk is being read ahead for, and
+    // the levels of it this rank has read but not sent yet
+    datagrid *next_grid = NULL;
+    level_read *held = NULL;
+    int nHeld = 0;
+    // With adaptive_halo, the room each face of the next subset gets,
+    // and how many times this chunk has been done over because some
+    // parcels got out of the subset
+    int halo[6] = {KEEP_HALO, KEEP_HALO, KEEP_HALO, KEEP_HALO, KEEP_HALO, KEEP_HALO};
+    int *pad = io->adaptive_halo ? halo : NULL;
+    int nRetries = 0;
 
     // This is the main loop that does the data reading and eventually
     // calls the CUDA code to integrate forward.
     for (int tChunk = 0; tChunk < nTimeChunks; ++tChunk) {
         // if this is the first chunk of time, seed the
         // parcel start locations
-        if (tChunk == 0) {
+        if ((tChunk == 0) && (nRetries == 0)) {
             cout << "SEEDING PARCELS" << endl;
-            if (rank == 0) {
+            if (io->parcel_shards) {
+                // contiguous runs of the parcels in seed order, with
+                // the leftovers going one apiece to the first ranks
+                int nTot = pNX*pNY*pNZ;
+                int first = rank*(nTot/size) + min(rank, nTot%size);
+                int nMine = nTot/size + (rank < nTot%size ? 1 : 0);
+                parcels = allocate_parcels_cpu(io, nMine, 1, 1, nTotTimes);
+                parcels->pclOffset = first;
+                parcels->nTotParcels = nTot;
+            }
+            else if (rank == 0) {
                 // allocate parcels on both CPU and GPU
+#ifdef CPU_ONLY
+                parcels = allocate_parcels_cpu(io, pNX, pNY, pNZ, nTotTimes);
+#else
                 parcels = allocate_parcels_managed(io, pNX, pNY, pNZ, nTotTimes);
+#endif
             }
             else {
                 // for all other ranks, only
@@ -465,216 +1522,268 @@ int main(int argc, char **argv ) {
             seed_parcels(parcels, pX0, pY0, pZ0, pNX, pNY, pNZ, pDX, pDY, pDZ, nTotTimes);
             // we also initialize the output netcdf file here
             if (rank == 0) init_nc(outfilename, parcels);
+            if (io->parcel_shards) MPI_Barrier(MPI_COMM_WORLD);
         }
 
+#ifdef CPU_ONLY
+        if (io->parcel_shards) {
+            int nLeft;
+            if (io->domain_tiles) {
+                nLeft = tileChunk(outfilename, io, parcels, &tiles, &boxes, readpool, datapool, \
+                                  tChunk, nChunkTimes, nDataTimes, nearest_tidx, direct, dt, rank, size);
+            }
+            else {
+                integrateBoxes(io, parcels, &boxes, readpool, datapool, \
+                               tChunk, nChunkTimes, nDataTimes, nearest_tidx, direct, dt, rank, size);
+                nLeft = finishShard(outfilename, io, parcels, tChunk, nChunkTimes, rank, size);
+            }
+            if (nLeft == 0) {
+                if (rank == 0) cout << "All parcels have left the domain, stopping early" << endl;
+                break;
+            }
+            continue;
+        }
+#endif
+
         // Read in the metadata and request a grid subset 
         // that is dynamically based on where our parcels
         // are in the simulation. This is done for all MPI
         // ranks so that they can request different time
         // steps, but only Rank 0 will allocate the grid
         // arrays on both the CPU and GPU.
-        
-        requested_grid = loadMetadataAndGrid(base_dir, parcels, rank); 
-        if (requested_grid->isValid == 0) {
+        // If the next chunk got read ahead, the subset it was read
+        // for is the one to check the parcels against. If the chunk
+        // is being done over, it needs a new subset no matter what.
+        datagrid *current = (next_grid != NULL) ? next_grid : requested_grid;
+        if (nRetries > 0) current = NULL;
+        datagrid *chunk_grid = loadMetadataAndGrid(parcels, rank, current, NULL, pad); 
+        if (chunk_grid->isValid == 0) {
             cout << "Something went horribly wrong when requesting a domain subset. Abort." << endl;
             exit(-1);
         }
-
-
-        // The number of grid points requested...
-        // There's some awkwardness here I have to figure out a better way around,
-        // but MPI Scatter/Gather behaves weird if I use the generic large buffer,
-        // so I use N_scalar for the MPI calls to non staggered/scalar fields. 
-        N_stag = (requested_grid->NX+2)*(requested_grid->NY+2)*(requested_grid->NZ+1);
-        N_scal = (requested_grid->NX+2)*(requested_grid->NY+2)*(requested_grid->NZ+1);
-
-
-        // allocate space for U, V, and W arrays
-        // for all ranks, because this is what
-        // LOFS will return it's data subset to
-        float *ubuf, *vbuf, *wbuf, *pbuf, *tbuf, *thbuf, *rhobuf, *qvbuf, *qcbuf, *qibuf, *qsbuf, *qgbuf, *kmhbuf;
-
-        ubuf = new float[N_stag];
-        vbuf = new float[N_stag];
-        wbuf = new float[N_stag];
-        // khh and kmh are on the staggered W mesh
-        if (io->output_momentum_budget || io->output_vorticity_budget || io->output_kmh) kmhbuf = new float[N_stag];
-        if (io->output_momentum_budget || io->output_vorticity_budget || io->output_ppert) pbuf = new float[N_scal];
-        if (io->output_momentum_budget || io->output_vorticity_budget || io->output_thetapert) tbuf = new float[N_scal];
-        if (io->output_momentum_budget || io->output_vorticity_budget || io->output_thrhopert) thbuf = new float[N_scal];
-        if (io->output_momentum_budget || io->output_vorticity_budget || io->output_rhopert) rhobuf = new float[N_scal];
-        if (io->output_momentum_budget || io->output_vorticity_budget || io->output_qvpert) qvbuf = new float[N_scal];
-        if (io->output_qc) qcbuf = new float[N_scal];
-        if (io->output_qi) qibuf = new float[N_scal];
-        if (io->output_qs) qsbuf = new float[N_scal];
-        if (io->output_qg) qgbuf = new float[N_scal];
-
-
-        // construct a 4D contiguous array to store stuff in.
-        // bufsize is the size of the 3D component and size is
-        // the number of MPI ranks (which is also the number of times)
-        // read in
-        //
-        // declare the struct on all ranks, but only
-        // allocate space for it on Rank 0
-        model_data *data;
-        if (rank == 0) {
-            data = allocate_model_managed(io, N_stag*size);
+        N_stag = (chunk_grid->NX+2)*(chunk_grid->NY+2)*(chunk_grid->NZ+1);
+
+        // The parcels can't get past the predicted subset unless the
+        // winds changed on us, but if they do, what got read ahead
+        // isn't any good and this chunk gets read in all over again.
+        bool readahead = (next_grid != NULL) && (chunk_grid == next_grid);
+        if ((next_grid != NULL) && !readahead) {
+            if (rank == 0) cout << "Parcels left the predicted subset, reading the chunk in again" << endl;
+            for (int b = 0; b < nHeld; ++b) releaseTimeLevel(readpool, &(held[b]));
+            if (next_grid != requested_grid) releaseSubset(io, next_grid, NULL, datapool, nw.arena, rank);
         }
-        else {
-            data = new model_data();
+        next_grid = NULL;
+
+        if (chunk_grid != requested_grid) {
+            // A new subset means none of the time levels
+            // we have are any good anymore, so start over.
+            if (requested_grid != NULL) releaseSubset(io, requested_grid, data, datapool, nw.arena, rank);
+            requested_grid = chunk_grid;
+
+            // construct a 4D contiguous array to store stuff in.
+            // bufsize is the size of the 3D component and 
+            // nDataTimes is the number of time levels in the window.
+            //
+            // declare the struct on all ranks, but only
+            // allocate space for it on Rank 0.
+            long bufsize = N_stag*nDataTimes;
+            if (nw.onNode != NULL) {
+                field_t *rd[N_READ_FIELDS];
+                sizeNodeWindow(&nw, read_fields(io, NULL, bufsize, rd)*bufsize, rank);
+            }
+            if (rank == 0) {
+#ifdef CPU_ONLY
+                data = allocate_model_cpu(io, bufsize, datapool, nw.arena);
+#else
+                data = allocate_model_managed(io, bufsize, datapool);
+#endif
+            }
+            else {
+                data = new model_data();
+            }
+            data->tFirst = tChunk*nChunkTimes;
+            data->nLevels = nDataTimes;
+            data->nValid = 0;
+            data->nDerived = 0;
         }
-
-
-        // we need to find the index of the nearest time to the user requested
-        // time. If the index isn't found, abort.
-        int nearest_tidx = find_nearest_index(alltimes, time, ntottimes);
-        if (nearest_tidx < 0) {
-            cout << "Invalid time index: " << nearest_tidx << " for time " << time << ". Abort." << endl;
-            return 0;
+        else {
+            // Same subset as last time, so slide the window up to the
+            // start of this chunk and keep the levels the two share
+            slide_model_window(io, data, N_stag, tChunk*nChunkTimes - data->tFirst);
+            if (rank == 0) cout << "Keeping " << data->nValid << " time levels from the last chunk" << endl;
         }
-        //double dt = fabs(alltimes[nearest_tidx + direct*(1+tChunk*size)] - alltimes[nearest_tidx + direct*(tChunk*size)]);
-        double dt = fabs(alltimes[1] - alltimes[0]);
-        printf("TIMESTEP %d/%d %d %f dt= %f\n", rank, size, rank + tChunk*size, alltimes[nearest_tidx + direct*( rank + tChunk*size)], dt);
         requested_grid->dt = dt;
-        // load u, v, and w into memory
-        loadDataFromDisk(io, requested_grid, ubuf, vbuf, wbuf, pbuf, tbuf, thbuf, \
-                         rhobuf, qvbuf, qcbuf, qibuf, qsbuf, qgbuf, kmhbuf, \
-                         alltimes[nearest_tidx + direct*(rank + tChunk*size)]);
-
-        // for MPI runs that load multiple time steps into memory,
-        // communicate the data you've read into our 4D array
-        
-        int senderr_u, senderr_v, senderr_w, senderr_kmh;
-        int senderr_p, senderr_t, senderr_th, senderr_rho;
-        int senderr_qv, senderr_qc, senderr_qi, senderr_qs, senderr_qg;
 
-        senderr_u = MPI_Gather(ubuf, N_stag, MPI_FLOAT, data->ustag, N_stag, MPI_FLOAT, 0, MPI_COMM_WORLD);
-        senderr_v = MPI_Gather(vbuf, N_stag, MPI_FLOAT, data->vstag, N_stag, MPI_FLOAT, 0, MPI_COMM_WORLD);
-        senderr_w = MPI_Gather(wbuf, N_stag, MPI_FLOAT, data->wstag, N_stag, MPI_FLOAT, 0, MPI_COMM_WORLD);
-        if (io->output_momentum_budget || io->output_vorticity_budget || io->output_kmh) {
-            senderr_kmh = MPI_Gather(kmhbuf, N_stag, MPI_FLOAT, data->kmh, N_stag, MPI_FLOAT, 0, MPI_COMM_WORLD);
-        }
-
-        // Use N_scalar here so that there aren't random zeroes throughout the middle of the array
-        if (io->output_momentum_budget || io->output_vorticity_budget || io->output_ppert) {
-            senderr_p = MPI_Gather(pbuf, N_scal, MPI_FLOAT, data->prespert, N_scal, MPI_FLOAT, 0, MPI_COMM_WORLD);
-        }
-        if (io->output_momentum_budget || io->output_vorticity_budget || io->output_thetapert) {
-            senderr_t = MPI_Gather(tbuf, N_scal, MPI_FLOAT, data->thetapert, N_scal, MPI_FLOAT, 0, MPI_COMM_WORLD);
-        }
-        if (io->output_momentum_budget || io->output_vorticity_budget || io->output_thrhopert) {
-            senderr_th = MPI_Gather(thbuf, N_scal, MPI_FLOAT, data->thrhopert, N_scal, MPI_FLOAT, 0, MPI_COMM_WORLD);
-        }
-        if (io->output_momentum_budget || io->output_vorticity_budget || io->output_rhopert) {
-            senderr_rho = MPI_Gather(rhobuf, N_scal, MPI_FLOAT, data->rhopert, N_scal, MPI_FLOAT, 0, MPI_COMM_WORLD);
+        // Send over whatever got read ahead during the last chunk,
+        // and then read in anything the window still doesn't have,
+        // one level per rank at a time. Rank 0 works on the derived
+        // fields of each batch while the next one is being read.
+        int *hidx = new int[size];
+        if (readahead) {
+            for (int b = 0; b < nHeld; ++b) {
+                int l0 = data->nValid;
+                int nRead = batchTimes(hidx, data->tFirst, l0, nDataTimes, 1, size, nearest_tidx, direct);
+                sendTimeLevels(io, requested_grid, data, readpool, &(held[b]), hidx, l0, nRead, 1, rank, size, NULL);
+                data->nValid += nRead;
+                deriveLevels(io, requested_grid, data, nChunkTimes, rank);
+            }
         }
-        if (io->output_momentum_budget || io->output_vorticity_budget || io->output_qvpert) {
-            senderr_qv = MPI_Gather(qvbuf, N_scal, MPI_FLOAT, data->qvpert, N_scal, MPI_FLOAT, 0, MPI_COMM_WORLD);
+        delete[] held;
+        held = NULL;
+        nHeld = 0;
+        // rank 0 might still be sliding the levels the ranks
+        // sharing the window are about to write over down
+        bool inPlace = (nw.onNode != NULL) && nw.onNode[rank];
+        if (inPlace && (data->nValid < nDataTimes)) syncNodeWindow(&nw);
+        while (data->nValid < nDataTimes) {
+            int l0 = data->nValid;
+            int nRead = batchTimes(hidx, data->tFirst, l0, nDataTimes, 0, size, nearest_tidx, direct);
+            level_read lvl;
+            if (inPlace) {
+                // and has to wait for all of them to be written
+                field_t *dst[N_READ_FIELDS];
+                read_fields(io, nw.arena, N_stag*nDataTimes, dst);
+                readLevelInto(io, requested_grid, readpool, dst, hidx[rank], l0 + rank, rank, size);
+                syncNodeWindow(&nw);
+                lvl = level_read();
+                lvl.hidx = hidx[rank];
+            }
+            else readTimeLevel(io, requested_grid, readpool, &lvl, hidx[rank], rank, size);
+            sendTimeLevels(io, requested_grid, data, readpool, &lvl, hidx, l0, nRead, 0, rank, size, nw.onNode);
+            data->nValid += nRead;
+            deriveLevels(io, requested_grid, data, nChunkTimes, rank);
         }
-        if (io->output_qc) senderr_qc = MPI_Gather(qcbuf, N_scal, MPI_FLOAT, data->qc, N_scal, MPI_FLOAT, 0, MPI_COMM_WORLD);
-        if (io->output_qi) senderr_qi = MPI_Gather(qibuf, N_scal, MPI_FLOAT, data->qi, N_scal, MPI_FLOAT, 0, MPI_COMM_WORLD);
-        if (io->output_qs) senderr_qs = MPI_Gather(qsbuf, N_scal, MPI_FLOAT, data->qs, N_scal, MPI_FLOAT, 0, MPI_COMM_WORLD);
-        if (io->output_qg) senderr_qg = MPI_Gather(qgbuf, N_scal, MPI_FLOAT, data->qg, N_scal, MPI_FLOAT, 0, MPI_COMM_WORLD);
 
-        // clean up temporary buffers
-        delete[] ubuf;
-        delete[] vbuf;
-        delete[] wbuf;
-        if (io->output_momentum_budget || io->output_vorticity_budget || io->output_ppert) {
-            delete[] pbuf;
-        }
-        if (io->output_momentum_budget || io->output_vorticity_budget || io->output_thetapert) {
-            delete[] tbuf;
-        }
-        if (io->output_momentum_budget || io->output_vorticity_budget || io->output_thrhopert) {
-            delete[] thbuf;
-        }
-        if (io->output_momentum_budget || io->output_vorticity_budget || io->output_rhopert) {
-            delete[] rhobuf;
-        }
-        if (io->output_momentum_budget || io->output_vorticity_budget || io->output_kmh) {
-            delete[] kmhbuf;
+        // With more than one rank, start reading the next chunk in on the
+        // other ranks while rank 0 integrates and writes this one. Where
+        // the parcels will be isn't known yet, so the subset to read is
+        // padded by as far as they could possibly get during this chunk.
+        // The levels get read in the order the parcels will integrate
+        // through them, so backwards runs read backwards in time.
+        if (io->read_ahead && (size > 1) && (tChunk+1 < nTimeChunks)) {
+            int reach[3];
+            if (rank == 0) parcel_reach(requested_grid, data, 0, nChunkTimes, reach);
+            MPI_Bcast(reach, 3, MPI_INT, 0, MPI_COMM_WORLD);
+            next_grid = loadMetadataAndGrid(parcels, rank, requested_grid, reach, pad);
+            if (next_grid->isValid == 0) {
+                releaseSubset(io, next_grid, NULL, datapool, nw.arena, rank);
+                next_grid = NULL;
+            }
         }
-        if (io->output_momentum_budget || io->output_vorticity_budget || io->output_qvpert) {
-            delete[] qvbuf;
+        if (next_grid != NULL) {
+            // the levels the next chunk will keep don't need reading
+            int tNext = (tChunk+1)*nChunkTimes;
+            int l0 = (next_grid == requested_grid) ? data->tFirst + data->nValid - tNext : 0;
+            nHeld = (nDataTimes - l0 + size-2) / (size-1);
+            held = new level_read[nHeld]();
+            next_grid->dt = dt;
+            for (int b = 0; b < nHeld; ++b) {
+                batchTimes(hidx, tNext, l0 + b*(size-1), nDataTimes, 1, size, nearest_tidx, direct);
+                if (rank != 0) readTimeLevel(io, next_grid, readpool, &(held[b]), hidx[rank], rank, size);
+            }
         }
-        if (io->output_qc) delete[] qcbuf;
-        if (io->output_qi) delete[] qibuf;
-        if (io->output_qs) delete[] qsbuf;
-        if (io->output_qg) delete[] qgbuf;
+        delete[] hidx;
 
         if (rank == 0) {
-            // send to the GPU!!
-            cout << "MPI Gather Error U: " << senderr_u << endl;
-            cout << "MPI Gather Error V: " << senderr_v << endl;
-            cout << "MPI Gather Error W: " << senderr_w << endl;
-            if (io->output_momentum_budget || io->output_vorticity_budget || io->output_ppert) {
-                cout << "MPI Gather Error P: " << senderr_p << endl;
-            }
-            if (io->output_momentum_budget || io->output_vorticity_budget || io->output_thetapert) {
-                cout << "MPI Gather Error T: " << senderr_t << endl;
-            }
-            if (io->output_momentum_budget || io->output_vorticity_budget || io->output_thrhopert) {
-                cout << "MPI Gather Error TH: " << senderr_th << endl;
-            }
-            if (io->output_momentum_budget || io->output_vorticity_budget || io->output_rhopert) {
-                cout << "MPI Gather Error RHO: " << senderr_rho << endl;
-            }
-            if (io->output_momentum_budget || io->output_vorticity_budget || io->output_kmh) {
-                cout << "MPI Gather Error KMH: " << senderr_kmh << endl;
-            }
-            if (io->output_momentum_budget || io->output_vorticity_budget || io->output_qvpert) {
-                cout << "MPI Gather Error QV: " << senderr_qv << endl;
-            }
-            if (io->output_qc) cout << "MPI Gather Error QC: " << senderr_qc << endl;
-            if (io->output_qi) cout << "MPI Gather Error QI: " << senderr_qi << endl;
-            if (io->output_qs) cout << "MPI Gather Error QS: " << senderr_qs << endl;
-            if (io->output_qs) cout << "MPI Gather Error QG: " << senderr_qg << endl;
-
             int nParcels = parcels->nParcels;
+#ifdef CPU_ONLY
+            cout << "Beginning parcel integration! Using OpenMP on the CPU..." << endl;
+            cpuIntegrateParcels(requested_grid, data, parcels, nChunkTimes, nTotTimes, direct); 
+#else
             cout << "Beginning parcel integration! Heading over to the GPU to do GPU things..." << endl;
-            cudaIntegrateParcels(requested_grid, data, parcels, size, nTotTimes, direct); 
+            cudaIntegrateParcels(requested_grid, data, parcels, nChunkTimes, nTotTimes, direct); 
+#endif
             cout << "Finished integrating parcels!" << endl;
-            // write out our information to disk
-            cout << "Beginning to write to disk..." << endl;
-            write_parcels(outfilename, parcels, tChunk);
+        }
 
-            // Now that we've integrated forward and written to disk, before we can go again
-            // we have to set the current end position of the parcel to the beginning for 
-            // the next leg of integration. Do that, and then reset all the other values
-            // to missing.
-            cout << "Setting final parcel position to beginning of array for next integration cycle..." << endl;
-            for (int pcl = 0; pcl < parcels->nParcels; ++pcl) {
-                parcels->xpos[P2(0, pcl, parcels->nTimes)] = parcels->xpos[P2(size, pcl, parcels->nTimes)];
-                parcels->ypos[P2(0, pcl, parcels->nTimes)] = parcels->ypos[P2(size, pcl, parcels->nTimes)];
-                parcels->zpos[P2(0, pcl, parcels->nTimes)] = parcels->zpos[P2(size, pcl, parcels->nTimes)];
+        // With adaptive_halo, check that none of the parcels got out of
+        // the subset before anything gets written. If some did, the faces
+        // they got out of get more room, and the chunk gets read in and
+        // integrated all over again. Its starting positions haven't gone
+        // anywhere, and whatever got read ahead for the next chunk was
+        // for the wrong subset.
+        if (io->adaptive_halo) {
+            int redo = 0;
+            if (rank == 0) {
+                redo = (nRetries < HALO_RETRIES) && haloEscapes(requested_grid, parcels, nChunkTimes, halo);
+                if (!redo) nextHalo(requested_grid, data, parcels, nChunkTimes, direct, halo);
             }
-            cout << "Parcel position arrays reset." << endl;
-
-            // memory management for root rank
-            deallocate_grid_managed(requested_grid);
-            deallocate_model_managed(io, data);
+            MPI_Bcast(&redo, 1, MPI_INT, 0, MPI_COMM_WORLD);
+            MPI_Bcast(halo, 6, MPI_INT, 0, MPI_COMM_WORLD);
+            if (redo) {
+                if (rank == 0) cout << "Integrating the chunk over again" << endl;
+                for (int b = 0; b < nHeld; ++b) releaseTimeLevel(readpool, &(held[b]));
+                delete[] held;
+                held = NULL;
+                nHeld = 0;
+                if ((next_grid != NULL) && (next_grid != requested_grid)) releaseSubset(io, next_grid, NULL, datapool, nw.arena, rank);
+                next_grid = NULL;
+                nRetries += 1;
+                --tChunk;
+                continue;
+            }
+            nRetries = 0;
         }
 
-        // house keeping for the non-master
-        // MPI ranks
-        else {
-            // memory management
-            deallocate_grid_cpu(requested_grid);
+        if (rank == 0) {
+            // write out our information to disk
+            cout << "Beginning to write to disk..." << endl;
+            write_parcels(outfilename, parcels, tChunk);
+
+            startNextChunk(io, requested_grid, parcels, tChunk, nChunkTimes);
         }
         // receive the updated parcel arrays
         // so that we can do proper subseting. This happens
-        // after integration is complete from CUDA.
-        MPI_Status status;
-        MPI_Bcast(parcels->xpos, parcels->nParcels*nTotTimes, MPI_FLOAT, 0, MPI_COMM_WORLD);
-        MPI_Bcast(parcels->ypos, parcels->nParcels*nTotTimes, MPI_FLOAT, 0, MPI_COMM_WORLD);
-        MPI_Bcast(parcels->zpos, parcels->nParcels*nTotTimes, MPI_FLOAT, 0, MPI_COMM_WORLD);
+        // after integration is complete from CUDA. The other
+        // ranks only need the starting positions of the active
+        // parcels, so pack those up instead of sending everything.
+        MPI_Bcast(&(parcels->nActive), 1, MPI_INT, 0, MPI_COMM_WORLD);
+        if (parcels->nActive == 0) {
+            if (rank == 0) cout << "All parcels have left the domain, stopping early" << endl;
+            break;
+        }
+        MPI_Bcast(parcels->active, parcels->nActive, MPI_INT, 0, MPI_COMM_WORLD);
+        float *pos0 = new float[3*parcels->nActive];
+        if (rank == 0) {
+            for (int a = 0; a < parcels->nActive; ++a) {
+                int pcl = parcels->active[a];
+                pos0[3*a+0] = parcels->xpos[PCL(0, pcl, nTotTimes)];
+                pos0[3*a+1] = parcels->ypos[PCL(0, pcl, nTotTimes)];
+                pos0[3*a+2] = parcels->zpos[PCL(0, pcl, nTotTimes)];
+            }
+        }
+        MPI_Bcast(pos0, 3*parcels->nActive, MPI_FLOAT, 0, MPI_COMM_WORLD);
+        if (rank != 0) {
+            for (int a = 0; a < parcels->nActive; ++a) {
+                int pcl = parcels->active[a];
+                parcels->xpos[PCL(0, pcl, nTotTimes)] = pos0[3*a+0];
+                parcels->ypos[PCL(0, pcl, nTotTimes)] = pos0[3*a+1];
+                parcels->zpos[PCL(0, pcl, nTotTimes)] = pos0[3*a+2];
+            }
+        }
+        delete[] pos0;
 
     }
 
+    // memory management for the last subset, and anything that
+    // got read ahead for a chunk that never happened
+    for (int b = 0; b < nHeld; ++b) releaseTimeLevel(readpool, &(held[b]));
+    delete[] held;
+    if ((next_grid != NULL) && (next_grid != requested_grid)) releaseSubset(io, next_grid, NULL, datapool, nw.arena, rank);
+    if (requested_grid != NULL) releaseSubset(io, requested_grid, data, datapool, nw.arena, rank);
+    closeNodeWindow(&nw);
+    closeDomainTiles(&tiles);
+    closeBoxes(io, &boxes, 0, datapool, rank);
+
+    if (rank == 0) pool_report(readpool, "Read");
+    lofs_cache_report(rank);
+    if (datapool != NULL) {
+        pool_report(datapool, "Model data");
+        deallocate_pool(datapool);
+    }
     if (rank == 0) {
         cout << "Finished!" << endl << endl;
     }
+    deallocate_pool(readpool);
     MPI_Finalize();
 }
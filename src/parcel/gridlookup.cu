@@ -0,0 +1,90 @@
+#include <iostream>
+#include <stdio.h>
+#include "math.h"
+#include "../include/datastructs.h"
+#include "../include/macros.h"
+#ifndef GRIDLOOKUP_CU
+#define GRIDLOOKUP_CU
+/*
+ * Copyright (C) 2017-2020 Kelton Halbert, Space Science and Engineering Center (SSEC), University of Wisconsin - Madison
+ * Written by Kelton Halbert at the University of Wisconsin - Madison,
+ * Cooperative Institute for Meteorological Satellite Studies (CIMSS),
+ * Space Science and Engineering Center (SSEC). Provided under the Apache 2.0 License.
+ * Email: kthalbert@wisc.edu
+*/
+
+/* Finding which grid cell a point lives in used to be a linear scan
+   over every xf/yf point, which gets really expensive when it happens
+   for every field, every RK stage, every parcel. Most CM1 meshes are
+   isotropic in the horizontal, so for a uniform axis we can just do the
+   arithmetic, and for a stretched axis fall back to a binary search.
+   The cell returned for a point x is i such that f(i) <= x < f(i+1),
+   except a point sitting exactly on the last face goes in the last cell,
+   which is the same answer the old scans gave. */
+
+// relative tolerance for deciding if an axis is evenly spaced. The
+// face values are floats in meters, so roundoff alone is already
+// around 1e-4 of a 30 m grid spacing at 100 km from the origin.
+#define UNIFORM_TOL 1.0e-3
+
+// Check whether the N+1 face values in arr are evenly spaced, and if
+// so, return 1 and set the inverse of the grid spacing.
+inline int _is_uniform_axis(float *arr, int N, float *rd) {
+    *rd = 0.0;
+    if (N < 1) return 0;
+    float d = (arr[N] - arr[0]) / N;
+    if (d <= 0.0) return 0;
+    for (int i = 0; i < N; ++i) {
+        if (fabs((arr[i+1] - arr[i]) - d) > UNIFORM_TOL*d) return 0;
+    }
+    *rd = 1.0 / d;
+    return 1;
+}
+
+/* Precompute what we need for the fast lookups on the grid. This has to
+   be called any time the xf/yf/zf arrays of a grid are filled in. If it
+   never gets called, the lookups still work, they just always use the
+   binary search. These are all inline since this file gets included
+   by both the I/O and the integration code. */
+inline void set_grid_lookup(datagrid *grid) {
+    grid->xuniform = _is_uniform_axis(&(xf(0)), grid->NX, &(grid->rdx));
+    grid->yuniform = _is_uniform_axis(&(yf(0)), grid->NY, &(grid->rdy));
+    grid->zuniform = _is_uniform_axis(&(zf(0)), grid->NZ, &(grid->rdz));
+}
+
+// Find the cell index for x on an axis with N cells and N+1 face values
+// in arr. Returns -1 if x is outside of the axis. If hint is a valid
+// index, the cell it points to and its neighbors are checked first since
+// parcels don't move very far between lookups.
+__host__ __device__ inline int _find_cell(float *arr, int N, float x, int uniform, float rd, int hint) {
+    if ((x < arr[0]) || (x > arr[N])) return -1;
+
+    int i;
+    if ((hint >= 0) && (hint < N) && (x >= arr[hint]) && (x < arr[hint+1])) return hint;
+    if ((hint >= 1) && (hint < N+1) && (x >= arr[hint-1]) && (x < arr[hint])) return hint-1;
+    if ((hint >= -1) && (hint < N-1) && (x >= arr[hint+1]) && (x < arr[hint+2])) return hint+1;
+
+    if (uniform) {
+        // direct arithmetic, then walk a cell or so if
+        // floating point roundoff put us on the wrong side
+        i = (int) ((x - arr[0]) * rd);
+        if (i < 0) i = 0;
+        if (i > N-1) i = N-1;
+        while ((i > 0) && (x < arr[i])) i = i - 1;
+        while ((i < N-1) && (x >= arr[i+1])) i = i + 1;
+    }
+    else {
+        // binary search for the last face <= x
+        int lo = 0;
+        int hi = N-1;
+        while (lo < hi) {
+            int mid = (lo + hi + 1) / 2;
+            if (arr[mid] <= x) lo = mid;
+            else hi = mid - 1;
+        }
+        i = lo;
+    }
+    return i;
+}
+
+#endif
@@ -5,8 +5,10 @@
 #include "../kernels/momentum.cu"
 #include "../kernels/turb.cu"
 #include "../kernels/vort.cu"
-#include "../kernels/diff6.cu"
 #include "interp.cu"
+#include "trajectory.cu"
+#include "sparsebud.cpp"
+#include "tilemask.cu"
 #ifndef INTEGRATE_CU
 #define INTEGRATE_CU
 /*
@@ -33,10 +35,9 @@ inline void gpuAssert(cudaError_t code, const char *file, int line, bool abort=t
 
 /*  Execute all of the required kernels on the GPU that are necessary for computing the 3
     components of vorticity. The idea here is that we're building wrappers on wrappers to
-    simplify the process for the end user that just wants to calculate vorticity. This is
-    also a necessary adjustment because the tendency calculations will require multiple
-    steps, so transitioning this block of code as a proof of concept for how the programming
-    model should work. */
+    simplify the process for the end user that just wants to calculate vorticity. Each
+    component gets computed on its staggered mesh and averaged to the scalar grid in the
+    same kernel, so this doesn't need the temporary arrays. */
 void doCalcVort(datagrid *grid, model_data *data, int tStart, int tEnd, dim3 numBlocks, dim3 threadsPerBlock, cudaStream_t stream) {
     // calculate the three compionents of vorticity
 	long bufidx;
@@ -45,17 +46,9 @@ void doCalcVort(datagrid *grid, model_data *data, int tStart, int tEnd, dim3 num
 	int NZ = grid->NZ;
 	for ( int tidx = tStart; tidx < tEnd; ++tidx) {
     	bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
-		cuCalcXvort<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->vstag[bufidx]), &(data->wstag[bufidx]), &(data->tem1[bufidx]));
-		cuCalcYvort<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->ustag[bufidx]), &(data->wstag[bufidx]), &(data->tem2[bufidx]));
-		cuCalcZvort<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->ustag[bufidx]), &(data->vstag[bufidx]), &(data->tem3[bufidx]));
+		cuCalcVort<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->ustag[bufidx]), &(data->vstag[bufidx]), &(data->wstag[bufidx]), \
+		                                                     &(data->xvort[bufidx]), &(data->yvort[bufidx]), &(data->zvort[bufidx]));
 	}
-
-	gpuErrchk(cudaStreamSynchronize(stream) );
-	gpuErrchk( cudaPeekAtLastError() );
-	doVortAvg<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, data->tem1, data->tem2, data->tem3, data->xvort, data->yvort, data->zvort, tStart, tEnd);
-	gpuErrchk(cudaStreamSynchronize(stream) );
-	gpuErrchk( cudaPeekAtLastError() );
-	zeroTemArrays<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, data, tStart, tEnd);
 	gpuErrchk(cudaStreamSynchronize(stream) );
 	gpuErrchk( cudaPeekAtLastError() );
 } 
@@ -66,11 +59,6 @@ void doMomentumBud(datagrid *grid, model_data *data, int tStart, int tEnd, dim3
 	int NY = grid->NY;
 	int NZ = grid->NZ;
 
-	// Make sure we don't have any weird residual values
-	// in the temporary arrays
-    zeroTemArrays<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, data, tStart, tEnd);
-	gpuErrchk( cudaStreamSynchronize(stream) );
-
 	// The scalars need to be computed and synchronized first
 	for ( int tidx = tStart; tidx < tEnd; ++tidx) {
     	bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
@@ -79,86 +67,29 @@ void doMomentumBud(datagrid *grid, model_data *data, int tStart, int tEnd, dim3
 	}
 	gpuErrchk(cudaStreamSynchronize(stream));
 
+	// and then every term of the budget in one pass
 	for (int tidx = tStart; tidx < tEnd; ++tidx) {
-    	bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
-		cuCalcBuoy<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->thrhopert[bufidx]), &(data->buoy[bufidx]));
-		cuCalcPgradU<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->pipert[bufidx]), &(data->thrhopert[bufidx]), &(data->pgradu[bufidx]));
-		cuCalcPgradV<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->pipert[bufidx]), &(data->thrhopert[bufidx]), &(data->pgradv[bufidx]));
-		cuCalcPgradW<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->pipert[bufidx]), &(data->thrhopert[bufidx]), &(data->pgradw[bufidx]));
+		cuCalcMomentumBud<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, data, tidx);
 	}
 	gpuErrchk(cudaStreamSynchronize(stream));
+}
 
-	// These loops depend on temporary arrays so
-	// we have to be careful to not overwrite them
-
-	// compute momentum forcing on U from diffusion
-	for (int tidx = tStart; tidx < tEnd; ++tidx) { 
-    	bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
-
-    	cuCalcDiffUXYZ<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->ustag[bufidx]), &(data->tem1[bufidx]), \
-				                                                  &(data->tem2[bufidx]), &(data->tem3[bufidx]));
-    	cuCalcDiff<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->tem1[bufidx]), &(data->tem2[bufidx]), \
-				                                            &(data->tem3[bufidx]), &(data->diffu[bufidx]));
-	}
-	gpuErrchk(cudaStreamSynchronize(stream));
-    zeroTemArrays<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, data, tStart, tEnd);
-	gpuErrchk(cudaStreamSynchronize(stream));
-
-	// compute momentum forcing on V from diffusion
-	for (int tidx = tStart; tidx < tEnd; ++tidx) { 
-    	bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
-
-    	cuCalcDiffVXYZ<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->vstag[bufidx]), &(data->tem1[bufidx]), \
-				                                                  &(data->tem2[bufidx]), &(data->tem3[bufidx]));
-    	cuCalcDiff<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->tem1[bufidx]), &(data->tem2[bufidx]), \
-				                                            &(data->tem3[bufidx]), &(data->diffv[bufidx]));
-	}
-	gpuErrchk(cudaStreamSynchronize(stream));
-    zeroTemArrays<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, data, tStart, tEnd);
-	gpuErrchk(cudaStreamSynchronize(stream));
-
-	// compute momentum forcing on W from diffusion
-	for (int tidx = tStart; tidx < tEnd; ++tidx) { 
-    	bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
-
-    	cuCalcDiffWXYZ<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->wstag[bufidx]), &(data->tem1[bufidx]), \
-				                                                  &(data->tem2[bufidx]), &(data->tem3[bufidx]));
-    	cuCalcDiff<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->tem1[bufidx]), &(data->tem2[bufidx]), \
-				                                            &(data->tem3[bufidx]), &(data->diffw[bufidx]));
-	}
-	gpuErrchk(cudaStreamSynchronize(stream));
-    zeroTemArrays<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, data, tStart, tEnd);
-	gpuErrchk(cudaStreamSynchronize(stream));
-
+/* With the sparse momentum budget, the only things that still get done
+   on the whole grid are the scalars the pointwise stencils depend on. The
+   budget itself gets computed at the parcels after they are integrated. */
+void doSparseMomentumPrep(datagrid *grid, model_data *data, int tStart, int tEnd, dim3 numBlocks, dim3 threadsPerBlock, cudaStream_t stream) {
+	long bufidx;
+	int NX = grid->NX;
+	int NY = grid->NY;
+	int NZ = grid->NZ;
 
-	// Calculate the strain rate terms
-	for (int tidx = tStart; tidx < tEnd; ++tidx) { 
-    	bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
-		
-		cuCalcStrain<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->ustag[bufidx]), &(data->vstag[bufidx]), &(data->wstag[bufidx]), \
-				                                               &(data->rhopert[bufidx]), &(data->rhof[bufidx]), &(data->tem1[bufidx]),  \
-															   &(data->tem2[bufidx]), &(data->tem3[bufidx]), &(data->tem4[bufidx]), \
-															   &(data->tem5[bufidx]), &(data->tem6[bufidx]));
-	}
-	gpuErrchk(cudaStreamSynchronize(stream));
-	// Compute the stress terms from the strain rate
-	for (int tidx = tStart; tidx < tEnd; ++tidx) { 
-    	bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
-        cuGetTau<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->kmh[bufidx]), &(data->tem1[bufidx]), &(data->tem2[bufidx]), \
-				                                            &(data->tem3[bufidx]), &(data->tem4[bufidx]), &(data->tem5[bufidx]), &(data->tem6[bufidx]));
-	}
-	gpuErrchk(cudaStreamSynchronize(stream));
-	// compute the momentum tendency due to turbulence closure
-	for (int tidx = tStart; tidx < tEnd; ++tidx) { 
+	for ( int tidx = tStart; tidx < tEnd; ++tidx) {
     	bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
-		cuCalcTurb<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->tem1[bufidx]), &(data->tem2[bufidx]), &(data->tem3[bufidx]), \
-		                                                     &(data->tem4[bufidx]), &(data->tem5[bufidx]), &(data->tem6[bufidx]), \
-						                                     &(data->rhopert[bufidx]), &(data->rhof[bufidx]), &(data->turbu[bufidx]), \
-						                                     &(data->turbv[bufidx]), &(data->turbw[bufidx]));
+		cuCalcPipert<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->prespert[bufidx]), &(data->pipert[bufidx]));
+		cuCalcRf<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->rhopert[bufidx]), &(data->rhof[bufidx]));
 	}
 	gpuErrchk(cudaStreamSynchronize(stream));
-    zeroTemArrays<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, data, tStart, tEnd);
-	gpuErrchk(cudaStreamSynchronize(stream));
+	gpuErrchk( cudaPeekAtLastError() );
 }
 
 void doCalcVortTend(datagrid *grid, model_data *data, int tStart, int tEnd, dim3 numBlocks, dim3 threadsPerBlock, cudaStream_t stream) {
@@ -180,7 +111,10 @@ void doCalcVortTend(datagrid *grid, model_data *data, int tStart, int tEnd, dim3
 
 	// Compute the budget terms for tilting of vorticity. First, we have to
 	// preprocess some derivatives on the staggered mesh into the temporary 
-	// arrays we have available, and then compute the tilting rate.
+	// arrays we have available, and then compute the tilting rate. Nothing
+	// before this uses the temporary arrays, so clean them out first.
+	zeroTemArrays<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, data, tStart, tEnd);
+	gpuErrchk(cudaStreamSynchronize(stream));
 	for (int tidx = tStart; tidx < tEnd; ++tidx) {
     	bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
 		cuPreXvortTilt<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->ustag[bufidx]), &(data->tem1[bufidx]), &(data->tem2[bufidx]));
@@ -237,337 +171,75 @@ void doCalcVortTend(datagrid *grid, model_data *data, int tStart, int tEnd, dim3
 	// If not, calculate them for our diffusion and turbulence terms.
 	if (!io->output_momentum_budget) {
 		doMomentumBud(grid, data, tStart, tEnd, numBlocks, threadsPerBlock, stream);
-		zeroTemArrays<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, data, tStart, tEnd);
-		gpuErrchk(cudaStreamSynchronize(stream));
 		gpuErrchk( cudaPeekAtLastError() );
 	}
 
-	// compute vorticity due to momentum diffusion
+	// compute vorticity due to momentum diffusion and turbulence,
+	// which is the same stencil as the vorticity itself
 	for ( int tidx = tStart; tidx < tEnd; ++tidx) {
     	bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
-		cuCalcXvort<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->diffv[bufidx]), &(data->diffw[bufidx]), &(data->tem1[bufidx]));
-		cuCalcYvort<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->diffu[bufidx]), &(data->diffw[bufidx]), &(data->tem2[bufidx]));
-		cuCalcZvort<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->diffu[bufidx]), &(data->diffv[bufidx]), &(data->tem3[bufidx]));
+		cuCalcVort<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->diffu[bufidx]), &(data->diffv[bufidx]), &(data->diffw[bufidx]), \
+		                                                     &(data->diffxvort[bufidx]), &(data->diffyvort[bufidx]), &(data->diffzvort[bufidx]));
+		cuCalcVort<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->turbu[bufidx]), &(data->turbv[bufidx]), &(data->turbw[bufidx]), \
+		                                                     &(data->turbxvort[bufidx]), &(data->turbyvort[bufidx]), &(data->turbzvort[bufidx]));
 	}
 	gpuErrchk(cudaStreamSynchronize(stream) );
 	gpuErrchk( cudaPeekAtLastError() );
-	doVortAvg<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, data->tem1, data->tem2, data->tem3, data->diffxvort, data->diffyvort, data->diffzvort, tStart, tEnd);
-	gpuErrchk(cudaStreamSynchronize(stream) );
-	gpuErrchk( cudaPeekAtLastError() );
-	zeroTemArrays<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, data, tStart, tEnd);
-	gpuErrchk(cudaStreamSynchronize(stream) );
-	gpuErrchk( cudaPeekAtLastError() );
-
-	// compute vorticity due to momentum turbulence
-	for ( int tidx = tStart; tidx < tEnd; ++tidx) {
-    	bufidx = P4(0, 0, 0, tidx, NX+2, NY+2, NZ+1);
-		cuCalcXvort<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->turbv[bufidx]), &(data->turbw[bufidx]), &(data->tem1[bufidx]));
-		cuCalcYvort<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->turbu[bufidx]), &(data->turbw[bufidx]), &(data->tem2[bufidx]));
-		cuCalcZvort<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, &(data->turbu[bufidx]), &(data->turbv[bufidx]), &(data->tem3[bufidx]));
-	}
-	gpuErrchk(cudaStreamSynchronize(stream) );
-	gpuErrchk( cudaPeekAtLastError() );
-	doVortAvg<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, data->tem1, data->tem2, data->tem3, data->turbxvort, data->turbyvort, data->turbzvort, tStart, tEnd);
-	gpuErrchk(cudaStreamSynchronize(stream) );
-	gpuErrchk( cudaPeekAtLastError() );
-	zeroTemArrays<<<numBlocks, threadsPerBlock, 0, stream>>>(grid, data, tStart, tEnd);
-	gpuErrchk(cudaStreamSynchronize(stream) );
-	gpuErrchk( cudaPeekAtLastError() );
 
 }
 
 __global__ void integrate(datagrid *grid, parcel_pos *parcels, model_data *data, \
                           int tStart, int tEnd, int totTime, int direct) {
 
-	//int parcel_id = blockIdx.x;
-    int parcel_id = blockIdx.x * blockDim.x + threadIdx.x;
+    // each thread gets one of the parcels that
+    // are still active, not one of every parcel
+    int active_id = blockIdx.x * blockDim.x + threadIdx.x;
 
     // safety check to make sure our thread index doesn't
     // go out of our array bounds
-    if (parcel_id < parcels->nParcels) {
-        bool is_ugrd = false;
-        bool is_vgrd = false;
-        bool is_wgrd = false;
-
-        float pcl_x, pcl_y, pcl_z;
-        float pcl_u, pcl_v, pcl_w;
-        float uu1, vv1, ww1;
-        float point[3];
-
-        // loop over the number of time steps we are
-        // integrating over
-        float dt = grid->dt; 
-        float dt2 = dt / 2.;
-        for (int tidx = tStart; tidx < tEnd; ++tidx) {
-
-            // get the current values of various fields interpolated
-            // to the parcel before we integrate using the RK2 step
-            point[0] = parcels->xpos[PCL(tidx, parcel_id, totTime)];
-            point[1] = parcels->ypos[PCL(tidx, parcel_id, totTime)];
-            point[2] = parcels->zpos[PCL(tidx, parcel_id, totTime)];
-            pcl_x = point[0];
-            pcl_y = point[1];
-            pcl_z = point[2];
-            if (( pcl_x > xf(grid->NX-4) ) || ( pcl_y > yf(grid->NY-4) ) || ( pcl_z > zf(grid->NZ-4) ) \
-             || ( pcl_x < xf(0) )        || ( pcl_y < yf(0) )        || ( pcl_z < 0. ) ) {
-                break;
-            }
-
-
-            is_ugrd = true;
-            is_vgrd = false;
-            is_wgrd = false;
-            pcl_u = interp3D(grid, data->ustag, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-
-            is_ugrd = false;
-            is_vgrd = true;
-            is_wgrd = false;
-            pcl_v = interp3D(grid, data->vstag, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-
-            is_ugrd = false;
-            is_vgrd = false;
-            is_wgrd = true;
-            pcl_w = interp3D(grid, data->wstag, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-            parcels->pclu[PCL(tidx,   parcel_id, totTime)] = pcl_u;
-            parcels->pclv[PCL(tidx,   parcel_id, totTime)] = pcl_v;
-            parcels->pclw[PCL(tidx,   parcel_id, totTime)] = pcl_w;
-
-            // Now we use an RK2 scheme to integrate forward
-            // in time. Values are interpolated to the parcel 
-            // at the beginning of the next data time step. 
-            for (int nkrp = 1; nkrp <= 2; ++nkrp) {        
-                if (nkrp == 1) {
-                    // integrate X position forward by the U wind
-                    point[0] = pcl_x + pcl_u * dt * direct;
-                    // integrate Y position forward by the V wind
-                    point[1] = pcl_y + pcl_v * dt * direct;
-                    // integrate Z position forward by the W wind
-                    point[2] = pcl_z + pcl_w * dt * direct;
-                    if ((pcl_u == -999.0) || (pcl_v == -999.0) || (pcl_w == -999.0)) {
-                        printf("Warning: missing values detected at x: %f y:%f z:%f with ground bounds X0: %f Y0: %f Z0: %f X1: %f Y1: %f Z1: %f\n", \
-                            point[0], point[1], point[2], xh(0), yh(0), zh(0), xh(grid->NX-1), yh(grid->NY-1), zh(grid->NZ-1));
-                        return;
-                    }
-                    uu1 = pcl_u;
-                    vv1 = pcl_v;
-                    ww1 = pcl_w;
-                }
-                else {
-                    is_ugrd = true;
-                    is_vgrd = false;
-                    is_wgrd = false;
-                    pcl_u = interp3D(grid, data->ustag, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-
-                    is_ugrd = false;
-                    is_vgrd = true;
-                    is_wgrd = false;
-                    pcl_v = interp3D(grid, data->vstag, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-
-                    is_ugrd = false;
-                    is_vgrd = false;
-                    is_wgrd = true;
-                    pcl_w = interp3D(grid, data->wstag, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-
-                    // integrate X position forward by the U wind
-                    point[0] = pcl_x + (pcl_u + uu1) * dt2 * direct;
-                    // integrate Y position forward by the V wind
-                    point[1] = pcl_y + (pcl_v + vv1) * dt2 * direct;
-                    // integrate Z position forward by the W wind
-                    point[2] = pcl_z + (pcl_w + ww1) * dt2 * direct;
-                    if ((pcl_u == -999.0) || (pcl_v == -999.0) || (pcl_w == -999.0)) {
-                        printf("Warning: missing values detected at x: %f y:%f z:%f with ground bounds X0: %f Y0: %f Z0: %f X1: %f Y1: %f Z1: %f\n", \
-                            point[0], point[1], point[2], xh(0), yh(0), zh(0), xh(grid->NX-1), yh(grid->NY-1), zh(grid->NZ-1));
-                        return;
-                    }
-                }
-            } // end RK loop
-
-            parcels->xpos[PCL(tidx+1, parcel_id, totTime)] = point[0]; 
-            parcels->ypos[PCL(tidx+1, parcel_id, totTime)] = point[1];
-            parcels->zpos[PCL(tidx+1, parcel_id, totTime)] = point[2];
-        } // end time loop
+    if (active_id < parcels->nActive) {
+        integrate_parcel(grid, parcels, data, parcels->active[active_id], tStart, tEnd, totTime, direct);
     } // end index check
 }
 
-__global__ void parcel_interp(datagrid *grid, parcel_pos *parcels, model_data *data, \
-                          int tStart, int tEnd, int totTime, int direct) {
+/* Launch everything that computes the fields derived from the ones read
+in (the momentum budget, vorticity, and the vorticity budget) for time
+levels tStart to tEnd */
+void _cudaDeriveFields(datagrid *grid, model_data *data, int tStart, int tEnd, dim3 numBlocks, dim3 threadsPerBlock, cudaStream_t stream) {
+    iocfg *io = data->io;
+    if (io->output_momentum_budget) {
+        if (io->sparse_budget) doSparseMomentumPrep(grid, data, tStart, tEnd, numBlocks, threadsPerBlock, stream);
+        else doMomentumBud(grid, data, tStart, tEnd, numBlocks, threadsPerBlock, stream);
+    }
+    // Calculate the three compionents of vorticity
+    // and do the necessary averaging. This is a wrapper that
+    // calls the necessary kernels and assigns the pointers
+    // appropriately such that the "user" only has to call this method.
+    if (io->output_xvort || io->output_yvort || io->output_zvort || io->output_vorticity_budget) {
+        doCalcVort(grid, data, tStart, tEnd, numBlocks, threadsPerBlock, stream);
+    }
 
-	//int parcel_id = blockIdx.x;
-    int parcel_id = blockIdx.x * blockDim.x + threadIdx.x;
-    // get the io config from the user namelist
-    iocfg *io = parcels->io;
+    // Calculate the vorticity forcing terms for each of the 3 components.
+    // This is a wrapper that calls the necessary kernels to compute the
+    // derivatives and average them back to the scalar grid where necessary. 
+    if (io->output_vorticity_budget) doCalcVortTend(grid, data, tStart, tEnd, numBlocks, threadsPerBlock, stream);
+}
 
-    // safety check to make sure our thread index doesn't
-    // go out of our array bounds
-    if (parcel_id < parcels->nParcels) {
-        bool is_ugrd = false;
-        bool is_vgrd = false;
-        bool is_wgrd = false;
-
-        float point[3];
-
-        // loop over the number of time steps we are
-        // integrating over
-        for (int tidx = tStart; tidx < tEnd; ++tidx) {
-            point[0] = parcels->xpos[PCL(tidx, parcel_id, totTime)];
-            point[1] = parcels->ypos[PCL(tidx, parcel_id, totTime)];
-            point[2] = parcels->zpos[PCL(tidx, parcel_id, totTime)];
-            if (io->output_kmh) {
-                is_ugrd = false;
-                is_vgrd = false;
-                is_wgrd = true;
-                float pclkmh = interp3D(grid, data->kmh, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                parcels->pclkmh[PCL(tidx, parcel_id, totTime)] = pclkmh;
-            }
-
-            if (io->output_momentum_budget) {
-                is_ugrd = true;
-                is_vgrd = false;
-                is_wgrd = false;
-                float pclupgrad = interp3D(grid, data->pgradu, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                float pcluturb = interp3D(grid, data->turbu, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                float pcludiff = interp3D(grid, data->diffu, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                is_ugrd = false;
-                is_vgrd = true;
-                is_wgrd = false;
-                float pclvpgrad = interp3D(grid, data->pgradv, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                float pclvturb = interp3D(grid, data->turbv, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                float pclvdiff = interp3D(grid, data->diffv, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                is_ugrd = false;
-                is_vgrd = false;
-                is_wgrd = true;
-                float pclwpgrad = interp3D(grid, data->pgradw, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                float pclwturb = interp3D(grid, data->turbw, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                float pclwdiff = interp3D(grid, data->diffw, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                float pclbuoy = interp3D(grid, data->buoy, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                parcels->pclupgrad[PCL(tidx,   parcel_id, totTime)] = pclupgrad;
-                parcels->pclvpgrad[PCL(tidx,   parcel_id, totTime)] = pclvpgrad;
-                parcels->pclwpgrad[PCL(tidx,   parcel_id, totTime)] = pclwpgrad;
-                parcels->pcluturb[PCL(tidx,   parcel_id, totTime)] = pcluturb;
-                parcels->pclvturb[PCL(tidx,   parcel_id, totTime)] = pclvturb;
-                parcels->pclwturb[PCL(tidx,   parcel_id, totTime)] = pclwturb;
-                parcels->pcludiff[PCL(tidx,   parcel_id, totTime)] = pcludiff;
-                parcels->pclvdiff[PCL(tidx,   parcel_id, totTime)] = pclvdiff;
-                parcels->pclwdiff[PCL(tidx,   parcel_id, totTime)] = pclwdiff;
-                parcels->pclbuoy[PCL(tidx,   parcel_id, totTime)] = pclbuoy;
-            }
-
-
-            // interpolate scalar values to the parcel point
-            is_ugrd = false;
-            is_vgrd = false;
-            is_wgrd = false;
-            if (io->output_vorticity_budget || io->output_xvort) {
-                float pclxvort = interp3D(grid, data->xvort, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                parcels->pclxvort[PCL(tidx, parcel_id, totTime)] = pclxvort;
-            }
-            if (io->output_vorticity_budget || io->output_yvort) {
-                float pclyvort = interp3D(grid, data->yvort, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                parcels->pclyvort[PCL(tidx, parcel_id, totTime)] = pclyvort;
-            }
-            if (io->output_vorticity_budget || io->output_zvort) {
-                float pclzvort = interp3D(grid, data->zvort, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                parcels->pclzvort[PCL(tidx, parcel_id, totTime)] = pclzvort;
-            }
-            if (io->output_vorticity_budget) {
-                float pclxvorttilt = interp3D(grid, data->xvtilt, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                float pclyvorttilt = interp3D(grid, data->yvtilt, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                float pclzvorttilt = interp3D(grid, data->zvtilt, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                float pclxvortstretch = interp3D(grid, data->xvstretch, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                float pclyvortstretch = interp3D(grid, data->yvstretch, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                float pclzvortstretch = interp3D(grid, data->zvstretch, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                float pclxvortturb = interp3D(grid, data->turbxvort, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                float pclyvortturb = interp3D(grid, data->turbyvort, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                float pclzvortturb = interp3D(grid, data->turbzvort, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                float pclxvortdiff = interp3D(grid, data->diffxvort, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                float pclyvortdiff = interp3D(grid, data->diffyvort, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                float pclzvortdiff = interp3D(grid, data->diffzvort, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                float pclxvortbaro = interp3D(grid, data->xvort_baro, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                float pclyvortbaro = interp3D(grid, data->yvort_baro, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                float pclxvortsolenoid = interp3D(grid, data->xvort_solenoid, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                float pclyvortsolenoid = interp3D(grid, data->yvort_solenoid, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                float pclzvortsolenoid = interp3D(grid, data->zvort_solenoid, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                // Store the vorticity in the parcel
-                parcels->pclxvorttilt[PCL(tidx, parcel_id, totTime)] = pclxvorttilt;
-                parcels->pclyvorttilt[PCL(tidx, parcel_id, totTime)] = pclyvorttilt;
-                parcels->pclzvorttilt[PCL(tidx, parcel_id, totTime)] = pclzvorttilt;
-                parcels->pclxvortstretch[PCL(tidx, parcel_id, totTime)] = pclxvortstretch;
-                parcels->pclyvortstretch[PCL(tidx, parcel_id, totTime)] = pclyvortstretch;
-                parcels->pclzvortstretch[PCL(tidx, parcel_id, totTime)] = pclzvortstretch;
-                parcels->pclxvortturb[PCL(tidx, parcel_id, totTime)] = pclxvortturb;
-                parcels->pclyvortturb[PCL(tidx, parcel_id, totTime)] = pclyvortturb;
-                parcels->pclzvortturb[PCL(tidx, parcel_id, totTime)] = pclzvortturb;
-                parcels->pclxvortdiff[PCL(tidx, parcel_id, totTime)] = pclxvortdiff;
-                parcels->pclyvortdiff[PCL(tidx, parcel_id, totTime)] = pclyvortdiff;
-                parcels->pclzvortdiff[PCL(tidx, parcel_id, totTime)] = pclzvortdiff;
-                parcels->pclxvortbaro[PCL(tidx, parcel_id, totTime)] = pclxvortbaro;
-                parcels->pclyvortbaro[PCL(tidx, parcel_id, totTime)] = pclyvortbaro;
-                parcels->pclxvortsolenoid[PCL(tidx, parcel_id, totTime)] = pclxvortsolenoid;
-                parcels->pclyvortsolenoid[PCL(tidx, parcel_id, totTime)] = pclyvortsolenoid;
-                parcels->pclzvortsolenoid[PCL(tidx, parcel_id, totTime)] = pclzvortsolenoid;
-            }
-
-            // Now do the scalars
-            if (io->output_ppert) {
-                float pclppert = interp3D(grid, data->prespert, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                parcels->pclppert[PCL(tidx, parcel_id, totTime)] = pclppert;
-            }
-            if (io->output_qvpert) {
-                float pclqvpert = interp3D(grid, data->qvpert, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                parcels->pclqvpert[PCL(tidx, parcel_id, totTime)] = pclqvpert;
-            }
-            if (io->output_rhopert) {
-                float pclrhopert = interp3D(grid, data->rhopert, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                parcels->pclrhopert[PCL(tidx, parcel_id, totTime)] = pclrhopert;
-            }
-            if (io->output_thetapert) {
-                float pclthetapert = interp3D(grid, data->thetapert, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                parcels->pclthetapert[PCL(tidx, parcel_id, totTime)] = pclthetapert;
-            }
-            if (io->output_thrhopert) {
-                float pclthrhopert = interp3D(grid, data->thrhopert, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                parcels->pclthrhopert[PCL(tidx, parcel_id, totTime)] = pclthrhopert;
-            }
-
-            if (io->output_pbar) {
-                float pclpbar = interp1D(grid, grid->p0, point[2], is_wgrd, tidx);
-                parcels->pclpbar[PCL(tidx, parcel_id, totTime)] = pclpbar;
-            }
-            if (io->output_qvbar) {
-                float pclqvbar = interp1D(grid, grid->qv0, point[2], is_wgrd, tidx);
-                parcels->pclqvbar[PCL(tidx, parcel_id, totTime)] = pclqvbar;
-            }
-            if (io->output_rhobar) {
-                float pclrhobar = interp1D(grid, grid->rho0, point[2], is_wgrd, tidx);
-                parcels->pclrhobar[PCL(tidx, parcel_id, totTime)] = pclrhobar;
-            }
-            if (io->output_thetabar) {
-                float pclthetabar = interp1D(grid, grid->th0, point[2], is_wgrd, tidx);
-                parcels->pclthetabar[PCL(tidx, parcel_id, totTime)] = pclthetabar;
-            }
-            if (io->output_rhobar) {
-                float pclthrhobar = interp1D(grid, grid->th0, point[2], is_wgrd, tidx);
-                parcels->pclthrhobar[PCL(tidx, parcel_id, totTime)] = pclthrhobar;
-            }
-
-            if (io->output_qc) {
-                float pclqc = interp3D(grid, data->qc, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                parcels->pclqc[PCL(tidx, parcel_id, totTime)] = pclqc;
-            }
-            if (io->output_qi) {
-                float pclqi = interp3D(grid, data->qi, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                parcels->pclqi[PCL(tidx, parcel_id, totTime)] = pclqi;
-            }
-            if (io->output_qs) {
-                float pclqs = interp3D(grid, data->qs, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                parcels->pclqs[PCL(tidx, parcel_id, totTime)] = pclqs;
-            }
-            if (io->output_qg) {
-                float pclqg = interp3D(grid, data->qg, point, is_ugrd, is_vgrd, is_wgrd, tidx);
-                parcels->pclqg[PCL(tidx, parcel_id, totTime)] = pclqg;
-            }
-        }
-    }
+/* Bring the derived fields up to date through time level tEnd. Every
+level is done on its own, so the driver can call this on the levels
+that have come in so far while the rest are still being read. */
+void cudaDeriveFields(datagrid *grid, model_data *data, int tEnd) {
+    if (data->nDerived >= tEnd) return;
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    cudaStream_t calStream;
+    cudaStreamCreate(&calStream);
+    dim3 threadsPerBlock(256, 1, 1);
+    dim3 numBlocks((int)ceil(NX+2/threadsPerBlock.x)+1, (int)ceil(NY+2/threadsPerBlock.y)+1, (int)ceil(NZ+1/threadsPerBlock.z)+1); 
+    _cudaDeriveFields(grid, data, data->nDerived, tEnd, numBlocks, threadsPerBlock, calStream);
+    cudaStreamDestroy(calStream);
+    data->nDerived = tEnd;
 }
 
 /*This function handles allocating memory on the GPU, transferring the CPU
@@ -586,6 +258,10 @@ void cudaIntegrateParcels(datagrid *grid, model_data *data, parcel_pos *parcels,
     NZ = grid->NZ;
     iocfg *io = parcels->io;
 
+    // Only do the gridded fields where the parcels can get to. This
+    // reads the winds on the host, so do it before the kernels do.
+    if (io->tile_mask) grid->mask = build_tile_mask(grid, data, parcels, tStart, tEnd, totTime);
+
     cudaStream_t calStream;
     cudaStream_t intStream;
     cudaStreamCreate(&calStream);
@@ -596,20 +272,17 @@ void cudaIntegrateParcels(datagrid *grid, model_data *data, parcel_pos *parcels,
     dim3 threadsPerBlock(256, 1, 1);
     dim3 numBlocks((int)ceil(NX+2/threadsPerBlock.x)+1, (int)ceil(NY+2/threadsPerBlock.y)+1, (int)ceil(NZ+1/threadsPerBlock.z)+1); 
 
-    if (io->output_momentum_budget) doMomentumBud(grid, data, tStart, tEnd, numBlocks, threadsPerBlock, calStream);
-    // Calculate the three compionents of vorticity
-    // and do the necessary averaging. This is a wrapper that
-    // calls the necessary kernels and assigns the pointers
-    // appropriately such that the "user" only has to call this method.
-    if (io->output_xvort || io->output_yvort || io->output_zvort || io->output_vorticity_budget) {
-        doCalcVort(grid, data, tStart, tEnd, numBlocks, threadsPerBlock, calStream);
+    // Levels kept over from the last chunk or done while the rest were
+    // being read already have their derived fields, unless the tile mask
+    // might have skipped parts of them.
+    if (io->tile_mask) {
+        _cudaDeriveFields(grid, data, tStart, tEnd, numBlocks, threadsPerBlock, calStream);
+        data->nDerived = 0;
+    }
+    else if (data->nDerived < tEnd) {
+        _cudaDeriveFields(grid, data, data->nDerived, tEnd, numBlocks, threadsPerBlock, calStream);
+        data->nDerived = tEnd;
     }
-    
-
-    // Calculate the vorticity forcing terms for each of the 3 components.
-    // This is a wrapper that calls the necessary kernels to compute the
-    // derivatives and average them back to the scalar grid where necessary. 
-    if (io->output_vorticity_budget) doCalcVortTend(grid, data, tStart, tEnd, numBlocks, threadsPerBlock, calStream);
 
 
     // Before integrating the trajectories, George Bryan sets some below-grid/surface conditions 
@@ -619,16 +292,21 @@ void cudaIntegrateParcels(datagrid *grid, model_data *data, parcel_pos *parcels,
     //gpuErrchk( cudaPeekAtLastError() );
 
     // integrate the parcels forward in time and interpolate
-    // calculations to trajectories. 
+    // calculations to trajectories. This is a single pass,
+    // the output fields get sampled while integrating.
     int nThreads = 256;
-    int nPclBlocks = int(parcels->nParcels / nThreads) + 1;
+    int nPclBlocks = int(parcels->nActive / nThreads) + 1;
     integrate<<<nPclBlocks, nThreads, 0, intStream>>>(grid, parcels, data, tStart, tEnd, totTime, direct);
     gpuErrchk(cudaDeviceSynchronize());
     gpuErrchk( cudaPeekAtLastError() );
 
-    parcel_interp<<<nPclBlocks, nThreads, 0, intStream>>>(grid, parcels, data, tStart, tEnd, totTime, direct);
-    gpuErrchk(cudaDeviceSynchronize());
-    gpuErrchk( cudaPeekAtLastError() );
+    // The sparse budget needs to know where the parcels went first. This
+    // runs on the host, straight out of the managed memory.
+    if (io->output_momentum_budget && io->sparse_budget) {
+        sparse_momentum_budget(grid, data, parcels, tStart, tEnd, totTime);
+    }
+    deallocate_tile_mask(grid->mask);
+    grid->mask = NULL;
 }
 #endif
 
@@ -0,0 +1,161 @@
+#include <iostream>
+#include <stdio.h>
+#include <omp.h>
+#include "../include/datastructs.h"
+#include "../include/macros.h"
+#include "../kernels/momentum_cpu.cpp"
+#include "../kernels/turb_cpu.cpp"
+#include "../kernels/vort_cpu.cpp"
+#include "trajectory.cu"
+#include "sparsebud.cpp"
+#include "tilemask.cu"
+#ifndef INTEGRATE_CPU
+#define INTEGRATE_CPU
+/*
+ * Copyright (C) 2017-2020 Kelton Halbert, Space Science and Engineering Center (SSEC), University of Wisconsin - Madison
+ * Written by Kelton Halbert at the University of Wisconsin - Madison,
+ * Cooperative Institute for Meteorological Satellite Studies (CIMSS),
+ * Space Science and Engineering Center (SSEC). Provided under the Apache 2.0 License.
+ * Email: kthalbert@wisc.edu
+*/
+using namespace std;
+
+/* CPU version of doCalcVort. Compute the 3 components of vorticity
+   on their native staggered points and average them to the scalar grid. */
+void doCalcVortCPU(datagrid *grid, model_data *data, int tStart, int tEnd) {
+    cpuCalcVort(grid, data->ustag, data->vstag, data->wstag, data->xvort, data->yvort, data->zvort, tStart, tEnd);
+}
+
+/* CPU version of doMomentumBud */
+void doMomentumBudCPU(datagrid *grid, model_data *data, int tStart, int tEnd) {
+    // The scalars need to be computed first
+    cpuCalcPipert(grid, data->prespert, data->pipert, tStart, tEnd);
+    cpuCalcRf(grid, data->rhopert, data->rhof, tStart, tEnd);
+
+    // and then every term of the budget in one pass
+    cpuCalcMomentumBud(grid, data, tStart, tEnd);
+}
+
+/* CPU version of doSparseMomentumPrep */
+void doSparseMomentumPrepCPU(datagrid *grid, model_data *data, int tStart, int tEnd) {
+    cpuCalcPipert(grid, data->prespert, data->pipert, tStart, tEnd);
+    cpuCalcRf(grid, data->rhopert, data->rhof, tStart, tEnd);
+}
+
+/* CPU version of doCalcVortTend */
+void doCalcVortTendCPU(datagrid *grid, model_data *data, int tStart, int tEnd) {
+    // get the io config from the user namelist
+    iocfg *io = data->io;
+
+    // The scalars need to be computed first
+    cpuCalcPipert(grid, data->prespert, data->pipert, tStart, tEnd);
+    cpuCalcRf(grid, data->rhopert, data->rhof, tStart, tEnd);
+
+    // Compute the budget terms for tilting of vorticity. First, we have to
+    // preprocess some derivatives on the staggered mesh into the temporary
+    // arrays we have available, and then compute the tilting rate. Nothing
+    // before this uses the temporary arrays, so clean them out first.
+    zeroTemArraysCPU(grid, data, tStart, tEnd);
+    cpuPreXvortTilt(grid, data->ustag, data->tem1, data->tem2, tStart, tEnd);
+    cpuPreYvortTilt(grid, data->vstag, data->tem3, data->tem4, tStart, tEnd);
+    cpuPreZvortTilt(grid, data->wstag, data->tem5, data->tem6, tStart, tEnd);
+
+    cpuCalcXvortTilt(grid, data->yvort, data->zvort, data->tem1, data->tem2, data->xvtilt, tStart, tEnd);
+    cpuCalcYvortTilt(grid, data->xvort, data->zvort, data->tem3, data->tem4, data->yvtilt, tStart, tEnd);
+    cpuCalcZvortTilt(grid, data->xvort, data->yvort, data->tem5, data->tem6, data->zvtilt, tStart, tEnd);
+    zeroTemArraysCPU(grid, data, tStart, tEnd);
+
+    // Now do the budget terms that do not depend
+    // on temp arrays or each other
+    cpuCalcXvortStretch(grid, data->vstag, data->wstag, data->xvort, data->xvstretch, tStart, tEnd);
+    cpuCalcYvortStretch(grid, data->ustag, data->wstag, data->yvort, data->yvstretch, tStart, tEnd);
+    cpuCalcZvortStretch(grid, data->ustag, data->vstag, data->zvort, data->zvstretch, tStart, tEnd);
+
+    cpuCalcXvortBaro(grid, data->thrhopert, data->xvort_baro, tStart, tEnd);
+    cpuCalcYvortBaro(grid, data->thrhopert, data->yvort_baro, tStart, tEnd);
+
+    cpuCalcXvortSolenoid(grid, data->pipert, data->thrhopert, data->xvort_solenoid, tStart, tEnd);
+    cpuCalcYvortSolenoid(grid, data->pipert, data->thrhopert, data->yvort_solenoid, tStart, tEnd);
+    cpuCalcZvortSolenoid(grid, data->pipert, data->thrhopert, data->zvort_solenoid, tStart, tEnd);
+
+    // Have we already computed the momentum budgets?
+    // If not, calculate them for our diffusion and turbulence terms.
+    if (!io->output_momentum_budget) {
+        doMomentumBudCPU(grid, data, tStart, tEnd);
+    }
+
+    // compute vorticity due to momentum diffusion and turbulence
+    cpuCalcVort(grid, data->diffu, data->diffv, data->diffw, data->diffxvort, data->diffyvort, data->diffzvort, tStart, tEnd);
+    cpuCalcVort(grid, data->turbu, data->turbv, data->turbw, data->turbxvort, data->turbyvort, data->turbzvort, tStart, tEnd);
+}
+
+/* Compute the fields derived from the ones read in (the momentum budget,
+   vorticity, and the vorticity budget) for time levels tStart to tEnd */
+void _cpuDeriveFields(datagrid *grid, model_data *data, int tStart, int tEnd) {
+    iocfg *io = data->io;
+    if (io->output_momentum_budget) {
+        if (io->sparse_budget) doSparseMomentumPrepCPU(grid, data, tStart, tEnd);
+        else doMomentumBudCPU(grid, data, tStart, tEnd);
+    }
+    // Calculate the three compionents of vorticity
+    // and do the necessary averaging.
+    if (io->output_xvort || io->output_yvort || io->output_zvort || io->output_vorticity_budget) {
+        doCalcVortCPU(grid, data, tStart, tEnd);
+    }
+    // Calculate the vorticity forcing terms for each of the 3 components.
+    if (io->output_vorticity_budget) doCalcVortTendCPU(grid, data, tStart, tEnd);
+}
+
+/* Bring the derived fields up to date through time level tEnd. Every
+   level is done on its own, so the driver can call this on the levels
+   that have come in so far while the rest are still being read. */
+void cpuDeriveFields(datagrid *grid, model_data *data, int tEnd) {
+    if (data->nDerived >= tEnd) return;
+    _cpuDeriveFields(grid, data, data->nDerived, tEnd);
+    data->nDerived = tEnd;
+}
+
+/* This is the CPU counterpart to cudaIntegrateParcels for machines that
+   don't have a GPU. Each parcel is completely independent of the others,
+   so we just hand out chunks of parcels to OpenMP threads and have each
+   thread call the same per-parcel routine the GPU kernel uses. Parcels
+   that leave the domain early finish quickly, so use a dynamic schedule
+   to keep the threads load balanced. */
+void cpuIntegrateParcels(datagrid *grid, model_data *data, parcel_pos *parcels, int nT, int totTime, int direct) {
+
+    int tStart, tEnd;
+    tStart = 0;
+    tEnd = nT;
+    iocfg *io = parcels->io;
+
+    // only do the gridded fields where the parcels can get to
+    if (io->tile_mask) grid->mask = build_tile_mask(grid, data, parcels, tStart, tEnd, totTime);
+
+    // Levels kept over from the last chunk or done while the rest were
+    // being read already have their derived fields, unless the tile mask
+    // might have skipped parts of them.
+    if (io->tile_mask) {
+        _cpuDeriveFields(grid, data, tStart, tEnd);
+        data->nDerived = 0;
+    }
+    else cpuDeriveFields(grid, data, tEnd);
+
+    // only the parcels that are still in the domain get integrated
+    int nActive = parcels->nActive;
+    cout << "Integrating " << nActive << " of " << parcels->nParcels << " parcels with " << omp_get_max_threads() << " OpenMP threads" << endl;
+
+    // integrate the parcels forward in time and interpolate
+    // calculations to trajectories in a single pass.
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (int active_id = 0; active_id < nActive; ++active_id) {
+        integrate_parcel(grid, parcels, data, parcels->active[active_id], tStart, tEnd, totTime, direct);
+    }
+
+    // the sparse budget needs to know where the parcels went first
+    if (io->output_momentum_budget && io->sparse_budget) {
+        sparse_momentum_budget(grid, data, parcels, tStart, tEnd, totTime);
+    }
+    deallocate_tile_mask(grid->mask);
+    grid->mask = NULL;
+}
+#endif
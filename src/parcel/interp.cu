@@ -4,6 +4,7 @@
 #include "math.h"
 #include "../include/datastructs.h"
 #include "../include/macros.h"
+#include "gridlookup.cu"
 using namespace std;
 
 #ifndef INTERP_CU
@@ -18,8 +19,9 @@ using namespace std;
 
 // find the nearest grid index i, j, and k for a point contained inside of a cube.
 // i, j, and k are set to -1 if the point requested is out of the domain bounds
-// of the cube provided.
-__device__ __host__ void _nearest_grid_idx(float *point, datagrid *grid, int *idx_4D) {
+// of the cube provided. If hint_4D is given, it should be the cell the point
+// was in last time, and the search starts there. 
+__device__ __host__ void _nearest_grid_idx(float *point, datagrid *grid, int *idx_4D, int *hint_4D) {
 
 	int near_i = -1;
 	int near_j = -1;
@@ -29,25 +31,20 @@ __device__ __host__ void _nearest_grid_idx(float *point, datagrid *grid, int *id
     float pt_y = point[1];
     float pt_z = point[2];
 
-
-	// loop over the X grid
-	for ( int i = 0; i < grid->NX; i++ ) {
-		// find the nearest grid point index at X
-		if ( ( pt_x >= xf(i) ) && ( pt_x <= xf(i+1) ) ) { near_i = i; } 
-	}
-
-	// loop over the Y grid
-	for ( int j = 0; j < grid->NY; j++ ) {
-		// find the nearest grid point index in the Y
-		if ( ( pt_y >= yf(j) ) && ( pt_y <= yf(j+1) ) ) { near_j = j; } 
-	}
-
-	// loop over the Z grid
-    int k = 0;
-    while (pt_z >= zf(k+1)) {
-        k = k + 1;
+    int hint_i = -1;
+    int hint_j = -1;
+    int hint_k = -1;
+    if (hint_4D != NULL) {
+        hint_i = hint_4D[0]; hint_j = hint_4D[1]; hint_k = hint_4D[2];
     }
-    near_k = k;
+
+    // find the nearest grid point index in X, Y, and Z
+    near_i = _find_cell(&(xf(0)), grid->NX, pt_x, grid->xuniform, grid->rdx, hint_i);
+    near_j = _find_cell(&(yf(0)), grid->NY, pt_y, grid->yuniform, grid->rdy, hint_j);
+    // anything below the lowest ghost point
+    // still goes in the lowest cell
+    if (pt_z < zf(0)) near_k = 0;
+    else near_k = _find_cell(&(zf(0)), grid->NZ, pt_z, grid->zuniform, grid->rdz, hint_k);
 
 	// if a nearest index was not found, set all indices to -1 to flag
 	// that the point is not in the domain
@@ -59,6 +56,10 @@ __device__ __host__ void _nearest_grid_idx(float *point, datagrid *grid, int *id
 	return;
 }
 
+__device__ __host__ void _nearest_grid_idx(float *point, datagrid *grid, int *idx_4D) {
+    _nearest_grid_idx(point, grid, idx_4D, NULL);
+}
+
 // calculate the 8 interpolation weights for a trilinear interpolation of a point inside of a cube.
 // Returns an array full of -1 if the requested poit is out of the domain bounds
 __host__ __device__ void _calc_weights(datagrid *grid, float *weights, float *point, \
@@ -184,7 +185,7 @@ __host__ __device__ void _calc_weights(datagrid *grid, float *weights, float *po
 // weights is a 1D array of interpolation weights returned by _calc_weights
 // idx_3D containing the i, j, and k are the respective indices of the nearest grid point we are
 // interpolating to, returned by _nearest_grid_idx 
-__host__ __device__ float _tri_interp(float *data_arr, float* weights, bool ugrd, bool vgrd, bool wgrd,\
+__host__ __device__ float _tri_interp(field_t *data_arr, float* weights, bool ugrd, bool vgrd, bool wgrd,\
                                         int *idx_4D, int NX, int NY, int NZ) {
 	float out = -999.0;
 
@@ -210,7 +211,7 @@ __host__ __device__ float _tri_interp(float *data_arr, float* weights, bool ugrd
 
     if (ugrd) {
         //printf("I'm a U staggered interpolation!\n");
-        float *ustag = data_arr;
+        field_t *ustag = data_arr;
         out = (UA4D(i ,  j, k  , t) * weights[0]) + \
               (UA4D(i+1, j, k  , t) * weights[1]) + \
               (UA4D(i ,j+1, k  , t) * weights[2]) + \
@@ -222,7 +223,7 @@ __host__ __device__ float _tri_interp(float *data_arr, float* weights, bool ugrd
     }
     else if (vgrd) {
         //printf("I'm a V staggered interpolation!\n");
-        float *vstag = data_arr;
+        field_t *vstag = data_arr;
         out = (VA4D(i ,  j, k  , t) * weights[0]) + \
               (VA4D(i+1, j, k  , t) * weights[1]) + \
               (VA4D(i ,j+1, k  , t) * weights[2]) + \
@@ -234,7 +235,7 @@ __host__ __device__ float _tri_interp(float *data_arr, float* weights, bool ugrd
         }
     else if (wgrd) {
         //printf("I'm a W staggered interpolation!\n");
-        float *wstag = data_arr;
+        field_t *wstag = data_arr;
         // i = 100 j = 66 k = 5
         out = (WA4D(i ,  j, k  , t) * weights[0]) + \
               (WA4D(i+1, j, k  , t) * weights[1]) + \
@@ -246,7 +247,7 @@ __host__ __device__ float _tri_interp(float *data_arr, float* weights, bool ugrd
               (WA4D(i+1,j+1, k+1,t) * weights[7]);
     }
     else {
-        float *buf0 = data_arr;
+        field_t *buf0 = data_arr;
         //printf("I'm a scalar interpolation!\n");
         out = (BUF4D(i ,  j, k  , t) * weights[0]) + \
               (BUF4D(i+1, j, k  , t) * weights[1]) + \
@@ -266,7 +267,7 @@ __host__ __device__ float _tri_interp(float *data_arr, float* weights, bool ugrd
 // the nearest grid point, calculates the interpolation weights depending on whether or not the grid is staggered,
 // and then calls the trilinear interpolator. Returns -999.0 if the data is not inside the grid or the weights
 // are invalid.
-__host__ __device__ float interp3D(datagrid *grid, float *data_grd, float *point, \
+__host__ __device__ float interp3D(datagrid *grid, field_t *data_grd, float *point, \
                                     bool ugrd, bool vgrd, bool wgrd, int tstep) {
     int idx_4D[4];
     float weights[8];
@@ -291,6 +292,161 @@ __host__ __device__ float interp3D(datagrid *grid, float *data_grd, float *point
     return output_val;
 }
 
+/* The cell index and trilinear weights only depend on the point and which
+   of the 4 meshes (U, V, W, or scalar) the data lives on, not on the field
+   itself. When a bunch of fields get sampled at the same point, compute
+   the weights once per stagger with calc_interp_wts and then reuse them
+   for every field with apply_interp_wts. */
+struct interp_wts {
+    int idx_4D[4];
+    float weights[8];
+};
+
+// Compute the interpolation weights for a given stagger. base_idx is the
+// unadjusted cell from _nearest_grid_idx, which is copied so that it can be
+// shared between the different staggers.
+__host__ __device__ void calc_interp_wts(datagrid *grid, float *point, int *base_idx, \
+                                         bool ugrd, bool vgrd, bool wgrd, int tstep, interp_wts *wts) {
+    wts->idx_4D[0] = base_idx[0];
+    wts->idx_4D[1] = base_idx[1];
+    wts->idx_4D[2] = base_idx[2];
+    wts->idx_4D[3] = tstep;
+    _calc_weights(grid, wts->weights, point, wts->idx_4D, ugrd, vgrd, wgrd);
+}
+
+// Interpolate a field using precomputed weights. The stagger adjustment
+// is already baked into the index, and all 4 meshes share the same array
+// layout, so this is just the weighted sum. Returns -999.0 if the weights
+// are invalid, same as interp3D.
+__host__ __device__ float apply_interp_wts(field_t *data_grd, interp_wts *wts, int NX, int NY, int NZ) {
+    return _tri_interp(data_grd, wts->weights, false, false, false, wts->idx_4D, NX, NY, NZ);
+}
+
+// Same as apply_interp_wts, but linearly interpolates between time
+// levels t and t+1 of the field, with tfrac being how far along
+// we are towards t+1.
+__host__ __device__ float apply_interp_wts_time(field_t *data_grd, interp_wts *wts, float tfrac, int NX, int NY, int NZ) {
+    float val0 = apply_interp_wts(data_grd, wts, NX, NY, NZ);
+    if ((tfrac == 0.0) || (val0 == -999.0)) return val0;
+
+    wts->idx_4D[3] += 1;
+    float val1 = apply_interp_wts(data_grd, wts, NX, NY, NZ);
+    wts->idx_4D[3] -= 1;
+    if (val1 == -999.0) return val1;
+    if (tfrac >= 1.0) return val1;
+    return (1.0 - tfrac) * val0 + tfrac * val1;
+}
+
+// number of points interp3D_batch works on at a time. The indices
+// and weights for a block are small enough to stay in L1 while the
+// field values get gathered.
+#define INTERP_BATCH 64
+
+/* Find the cell along one axis and how far across it each of a block of
+   nb coordinates is, for interp3D_batch. f are the N+1 face values and h
+   the half levels. stag means the data is on the faces along this axis,
+   and zaxis turns on the special cases _nearest_grid_idx and _calc_weights
+   have for the vertical. This gives the same cells as those two, just a
+   whole block at a time: on an evenly spaced axis the cell is done with
+   vectorized arithmetic, and then a scalar pass hands anything roundoff
+   put in the wrong cell to _find_cell, which is also what does the search
+   on a stretched axis. Cells that are out of bounds are set to -1. */
+inline void _batch_axis(float *f, float *h, int N, int uniform, float rd, bool stag, bool zaxis, \
+                        float *pos, int nb, int *idx, float *r) {
+    if (uniform) {
+        float f0 = f[0];
+        #pragma omp simd
+        for (int p = 0; p < nb; ++p) {
+            int i = (int) ((pos[p] - f0) * rd);
+            if (i < 0) i = 0;
+            if (i > N-1) i = N-1;
+            idx[p] = i;
+        }
+    }
+    for (int p = 0; p < nb; ++p) {
+        float x = pos[p];
+        int i = idx[p];
+        if (zaxis && (x < f[0])) idx[p] = 0;
+        else if ((x < f[0]) || (x > f[N])) idx[p] = -1;
+        else if (!uniform || (x < f[i]) || ((x >= f[i+1]) && (i < N-1))) {
+            idx[p] = _find_cell(f, N, x, uniform, rd, -1);
+        }
+    }
+
+    // shift to the mesh the data is on, same as _calc_weights
+    float *a = stag ? f : h;
+    #pragma omp simd
+    for (int p = 0; p < nb; ++p) {
+        float x = pos[p];
+        int i = idx[p];
+        int ii = (i < 0) ? 0 : i;
+        if (!stag && (x < h[ii]) && !(zaxis && (ii == 0))) ii = ii - 1;
+        r[p] = (x - a[ii]) / (a[ii+1] - a[ii]);
+        idx[p] = (i < 0) ? -1 : ii;
+    }
+}
+
+/* Interpolate one field to n points at once. This is for host side code
+   that has a lot of points to sample, like checking seed locations or
+   testing. The points come in as separate x, y, and z arrays, and get
+   done in blocks. For each block the cells and the distances across them
+   are found one axis at a time, and then the weights and weighted sums
+   for the whole block happen in one loop. All 4 meshes have the same
+   strides, so the sums are just 8 gathers at fixed offsets from each
+   point's base index, and everything vectorizes nicely. The answers are
+   the same as calling interp3D on each point, give or take roundoff since
+   the compiler is free to use FMAs in the vector loops. Points outside
+   of the grid get -999.0 like interp3D, just without all the printing. */
+void interp3D_batch(datagrid *grid, field_t *data_grd, bool ugrd, bool vgrd, bool wgrd, \
+                    float *xs, float *ys, float *zs, int tstep, float *out, int n) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    // offsets to the neighboring points in j, k, and t
+    const long sj = NX+2;
+    const long sk = (long)(NX+2)*(NY+2);
+    const long st = sk*(NZ+1);
+
+    int ix[INTERP_BATCH], iy[INTERP_BATCH], iz[INTERP_BATCH];
+    float rx[INTERP_BATCH], ry[INTERP_BATCH], rz[INTERP_BATCH];
+
+    for (int b = 0; b < n; b += INTERP_BATCH) {
+        int nb = n - b;
+        if (nb > INTERP_BATCH) nb = INTERP_BATCH;
+
+        _batch_axis(&(xf(0)), &(xh(0)), NX, grid->xuniform, grid->rdx, ugrd, false, &(xs[b]), nb, ix, rx);
+        _batch_axis(&(yf(0)), &(yh(0)), NY, grid->yuniform, grid->rdy, vgrd, false, &(ys[b]), nb, iy, ry);
+        _batch_axis(&(zf(0)), &(zh(0)), NZ, grid->zuniform, grid->rdz, wgrd, true, &(zs[b]), nb, iz, rz);
+
+        // the weights are the same as _calc_weights, and
+        // the sum is the same order of operations as _tri_interp
+        #pragma omp simd
+        for (int p = 0; p < nb; ++p) {
+            bool valid = (ix[p] >= 0) && (iy[p] >= 0) && (iz[p] >= 0);
+            long base = valid ? (tstep*st + iz[p]*sk + (iy[p]+1)*sj + ix[p]+1) : 0;
+            field_t *d = &(data_grd[base]);
+            float x = rx[p]; float y = ry[p]; float z = rz[p];
+            float w1 = (1.0 - x) * (1.0 - y) * (1.0 - z);
+            float w2 = x * (1.0 - y) * (1.0 - z);
+            float w3 = (1.0 - x) * y * (1.0 - z);
+            float w4 = (1.0 - x) * (1.0 - y) * z;
+            float w5 = x * (1.0 - y) * z;
+            float w6 = (1.0 - x) * y * z;
+            float w7 = x * y * (1.0 - z);
+            float w8 = x * y * z;
+            float val = (d[0]       * w1) + \
+                        (d[1]       * w2) + \
+                        (d[sj]      * w3) + \
+                        (d[sk]      * w4) + \
+                        (d[1+sk]    * w5) + \
+                        (d[sj+sk]   * w6) + \
+                        (d[1+sj]    * w7) + \
+                        (d[1+sj+sk] * w8);
+            out[b+p] = valid ? val : -999.0;
+        }
+    }
+}
+
 /* Do a 1D interpolation */
 __host__ __device__ float interp1D(datagrid *grid, float *data_grd, float zpt, bool wgrid, int tstep) {
     float z0, z1;
@@ -0,0 +1,232 @@
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include <string.h>
+#include "../include/datastructs.h"
+#include "../include/macros.h"
+#include "../include/integrate.h"
+#ifndef REORDER_CPP
+#define REORDER_CPP
+/*
+ * Copyright (C) 2017-2020 Kelton Halbert, Space Science and Engineering Center (SSEC), University of Wisconsin - Madison
+ * Written by Kelton Halbert at the University of Wisconsin - Madison,
+ * Cooperative Institute for Meteorological Satellite Studies (CIMSS),
+ * Space Science and Engineering Center (SSEC). Provided under the Apache 2.0 License.
+ * Email: kthalbert@wisc.edu
+*/
+using namespace std;
+
+/* Parcels are seeded in order, so at first neighboring parcel ids are
+   neighbors in space and the threads working on them read the same
+   parts of the 4D arrays. After a while in turbulent flow that falls
+   apart, and every parcel is reading from somewhere different. These
+   routines sort the parcels in memory by the Morton (Z-order) key of
+   the grid cell they are in, so that parcels close together in space
+   are close together in memory again. The pclid array keeps track of
+   which parcel is where, so the output can be put back in order.
+
+   This is also where parcels that have left the domain get dropped
+   from the active list, so that they stop costing us anything. */
+
+// the most parcel arrays that can be allocated at once
+#define MAX_PCL_ARRAYS 64
+
+// Spread the lower 21 bits of v out so that
+// there are two zero bits between each of them
+inline unsigned long long _spread_bits(unsigned long long v) {
+    v &= 0x1fffff;
+    v = (v | v << 32) & 0x1f00000000ffffULL;
+    v = (v | v << 16) & 0x1f0000ff0000ffULL;
+    v = (v | v << 8)  & 0x100f00f00f00f00fULL;
+    v = (v | v << 4)  & 0x10c30c30c30c30c3ULL;
+    v = (v | v << 2)  & 0x1249249249249249ULL;
+    return v;
+}
+
+// Interleave the bits of the i, j, and k grid
+// indices into a single 63 bit Morton key
+inline unsigned long long morton_key(int i, int j, int k) {
+    return _spread_bits(i) | (_spread_bits(j) << 1) | (_spread_bits(k) << 2);
+}
+
+/* Collect pointers to every parcel array that has been allocated
+   into arrs, and return how many there are. This has to stay in
+   sync with the gating in allocate_parcels_cpu/managed. */
+int _parcel_arrays(parcel_pos *parcels, float **arrs) {
+    iocfg *io = parcels->io;
+    int n = 0;
+    arrs[n++] = parcels->xpos;
+    arrs[n++] = parcels->ypos;
+    arrs[n++] = parcels->zpos;
+    arrs[n++] = parcels->pclu;
+    arrs[n++] = parcels->pclv;
+    arrs[n++] = parcels->pclw;
+    if (io->output_kmh) arrs[n++] = parcels->pclkmh;
+    if (io->output_momentum_budget) {
+        arrs[n++] = parcels->pclbuoy;
+        arrs[n++] = parcels->pclupgrad;
+        arrs[n++] = parcels->pclvpgrad;
+        arrs[n++] = parcels->pclwpgrad;
+        arrs[n++] = parcels->pcluturb;
+        arrs[n++] = parcels->pclvturb;
+        arrs[n++] = parcels->pclwturb;
+        arrs[n++] = parcels->pcludiff;
+        arrs[n++] = parcels->pclvdiff;
+        arrs[n++] = parcels->pclwdiff;
+    }
+    if (io->output_vorticity_budget || io->output_xvort) arrs[n++] = parcels->pclxvort;
+    if (io->output_vorticity_budget || io->output_yvort) arrs[n++] = parcels->pclyvort;
+    if (io->output_vorticity_budget || io->output_zvort) arrs[n++] = parcels->pclzvort;
+    if (io->output_vorticity_budget) {
+        arrs[n++] = parcels->pclxvorttilt;
+        arrs[n++] = parcels->pclyvorttilt;
+        arrs[n++] = parcels->pclzvorttilt;
+        arrs[n++] = parcels->pclxvortstretch;
+        arrs[n++] = parcels->pclyvortstretch;
+        arrs[n++] = parcels->pclzvortstretch;
+        arrs[n++] = parcels->pclxvortturb;
+        arrs[n++] = parcels->pclyvortturb;
+        arrs[n++] = parcels->pclzvortturb;
+        arrs[n++] = parcels->pclxvortdiff;
+        arrs[n++] = parcels->pclyvortdiff;
+        arrs[n++] = parcels->pclzvortdiff;
+        arrs[n++] = parcels->pclxvortbaro;
+        arrs[n++] = parcels->pclyvortbaro;
+        arrs[n++] = parcels->pclxvortsolenoid;
+        arrs[n++] = parcels->pclyvortsolenoid;
+        arrs[n++] = parcels->pclzvortsolenoid;
+    }
+
+    if (io->output_ppert) arrs[n++] = parcels->pclppert;
+    if (io->output_qvpert) arrs[n++] = parcels->pclqvpert;
+    if (io->output_rhopert) arrs[n++] = parcels->pclrhopert;
+    if (io->output_thetapert) arrs[n++] = parcels->pclthetapert;
+    if (io->output_thrhopert) arrs[n++] = parcels->pclthrhopert;
+
+    if (io->output_pbar) arrs[n++] = parcels->pclpbar;
+    if (io->output_qvbar) arrs[n++] = parcels->pclqvbar;
+    if (io->output_rhobar) arrs[n++] = parcels->pclrhobar;
+    if (io->output_thetabar) arrs[n++] = parcels->pclthetabar;
+    if (io->output_thrhobar) arrs[n++] = parcels->pclthrhobar;
+
+    if (io->output_qc) arrs[n++] = parcels->pclqc;
+    if (io->output_qi) arrs[n++] = parcels->pclqi;
+    if (io->output_qs) arrs[n++] = parcels->pclqs;
+    if (io->output_qg) arrs[n++] = parcels->pclqg;
+    return n;
+}
+
+// Move each parcel's row of nTimes values in arr from
+// slot order[p] to slot p, using buf as scratch space
+void _permute_rows(float *arr, int *order, int nParcels, int nTimes, float *buf) {
+    #pragma omp parallel for
+    for (int pcl = 0; pcl < nParcels; ++pcl) {
+        memcpy(&(buf[(long)pcl*nTimes]), &(arr[(long)order[pcl]*nTimes]), nTimes*sizeof(float));
+    }
+    memcpy(arr, buf, (long)nParcels*nTimes*sizeof(float));
+}
+
+/* Drop the parcels that have left the domain from the active list.
+   This should be called between time chunks, after the final positions
+   have been moved to the start of the arrays, so a parcel is done if
+   its starting position is missing. The list is compacted in place and
+   stays in the same order. The rows of the parcels that get dropped are
+   filled with missing values once here, and after that nothing touches
+   them again. */
+void compact_parcels(parcel_pos *parcels) {
+    int nTimes = parcels->nTimes;
+    float *arrs[MAX_PCL_ARRAYS];
+    int nArrs = _parcel_arrays(parcels, arrs);
+
+    int nActive = 0;
+    for (int a = 0; a < parcels->nActive; ++a) {
+        int pcl = parcels->active[a];
+        if (parcels->xpos[PCL(0, pcl, nTimes)] != PCL_MISSING) {
+            parcels->active[nActive] = pcl;
+            nActive += 1;
+            continue;
+        }
+        for (int n = 0; n < nArrs; ++n) {
+            for (int t = 0; t < nTimes; ++t) arrs[n][PCL(t, pcl, nTimes)] = PCL_MISSING;
+        }
+    }
+    if (nActive < parcels->nActive) {
+        cout << "Dropped " << parcels->nActive - nActive << " parcels that left the domain, ";
+        cout << nActive << " of " << parcels->nParcels << " still active" << endl;
+    }
+    parcels->nActive = nActive;
+}
+
+/* Sort the parcels in memory by the Morton key of the grid cell they are
+   in at the first time in the arrays. This should be called between time
+   chunks, after the final positions have been moved to the start of the
+   arrays. Parcels that have left the domain get moved to the end. Every
+   allocated parcel array gets permuted along with the positions, and
+   pclid and the active list are updated to match. */
+void reorder_parcels(datagrid *grid, parcel_pos *parcels) {
+    int nParcels = parcels->nParcels;
+    int nTimes = parcels->nTimes;
+
+    // compute the key for each parcel. The previous parcel's cell
+    // is a good guess for the next since they are mostly sorted.
+    vector< pair<unsigned long long, int> > keys(nParcels);
+    float point[3];
+    int idx_4D[4];
+    int hint_4D[4] = {-1, -1, -1, -1};
+    for (int pcl = 0; pcl < nParcels; ++pcl) {
+        point[0] = parcels->xpos[PCL(0, pcl, nTimes)];
+        point[1] = parcels->ypos[PCL(0, pcl, nTimes)];
+        point[2] = parcels->zpos[PCL(0, pcl, nTimes)];
+        unsigned long long key = ~0ULL;
+        if ((point[0] != PCL_MISSING) && (point[1] != PCL_MISSING) && (point[2] != PCL_MISSING)) {
+            _nearest_grid_idx(point, grid, idx_4D, hint_4D);
+            if (idx_4D[0] != -1) {
+                hint_4D[0] = idx_4D[0]; hint_4D[1] = idx_4D[1]; hint_4D[2] = idx_4D[2];
+                key = morton_key(idx_4D[0], idx_4D[1], idx_4D[2]);
+            }
+        }
+        keys[pcl] = make_pair(key, pcl);
+    }
+    // sorting on the pair also uses the current slot to
+    // break ties, which keeps the result deterministic
+    sort(keys.begin(), keys.end());
+
+    int *order = new int[nParcels];
+    bool changed = false;
+    for (int pcl = 0; pcl < nParcels; ++pcl) {
+        order[pcl] = keys[pcl].second;
+        if (order[pcl] != pcl) changed = true;
+    }
+    if (!changed) {
+        delete[] order;
+        return;
+    }
+    cout << "Reordering " << nParcels << " parcels by location" << endl;
+
+    // the parcel ids
+    int *newid = new int[nParcels];
+    for (int pcl = 0; pcl < nParcels; ++pcl) newid[pcl] = parcels->pclid[order[pcl]];
+    memcpy(parcels->pclid, newid, nParcels*sizeof(int));
+    delete[] newid;
+
+    // and every array that's been allocated
+    float *arrs[MAX_PCL_ARRAYS];
+    int nArrs = _parcel_arrays(parcels, arrs);
+    float *buf = new float[(long)nParcels*nTimes];
+    for (int n = 0; n < nArrs; ++n) _permute_rows(arrs[n], order, nParcels, nTimes, buf);
+    delete[] buf;
+    delete[] order;
+
+    // the active parcels all moved, so rebuild the list
+    // from the ones that still have a starting position
+    int nActive = 0;
+    for (int pcl = 0; pcl < nParcels; ++pcl) {
+        if (parcels->xpos[PCL(0, pcl, nTimes)] != PCL_MISSING) {
+            parcels->active[nActive] = pcl;
+            nActive += 1;
+        }
+    }
+    parcels->nActive = nActive;
+}
+
+#endif
@@ -0,0 +1,196 @@
+#include <iostream>
+#include <algorithm>
+#include <vector>
+#include "../include/datastructs.h"
+#include "../include/macros.h"
+#include "../calc/calcsparse.cu"
+#include "interp.cu"
+#ifndef SPARSEBUD_CPP
+#define SPARSEBUD_CPP
+/*
+ * Copyright (C) 2017-2020 Kelton Halbert, Space Science and Engineering Center (SSEC), University of Wisconsin - Madison
+ * Written by Kelton Halbert at the University of Wisconsin - Madison,
+ * Cooperative Institute for Meteorological Satellite Studies (CIMSS),
+ * Space Science and Engineering Center (SSEC). Provided under the Apache 2.0 License.
+ * Email: kthalbert@wisc.edu
+*/
+using namespace std;
+
+/* The gridded momentum budget runs every stencil over the whole domain
+   for every time level, and then each parcel reads 8 points out of each
+   of those arrays. When the parcels only cover a small part of the domain
+   almost all of that work gets thrown away. With io->sparse_budget on,
+   the budget terms instead only get evaluated at the grid points that are
+   a corner of some parcel's interpolation cell, using the pointwise
+   stencils in calcsparse.cu. Corners shared between parcels get evaluated
+   once. The parcels get sampled at the same positions with the same
+   weights as the gridded version, so the answers are the same up to
+   roundoff, and the 10 full-grid budget arrays are never touched. */
+
+// which staggered mesh a set of budget terms is on
+#define SPARSE_UMESH 0
+#define SPARSE_VMESH 1
+#define SPARSE_WMESH 2
+// the most budget terms on any one mesh
+#define SPARSE_MAXTERMS 4
+
+// Evaluate budget term number term of the given mesh at (i, j, k). The
+// order of the terms matches the output arrays in sparse_momentum_budget.
+inline float _sparse_term(datagrid *grid, model_data *data, int mesh, int term, int tidx, int i, int j, int k) {
+    if (mesh == SPARSE_UMESH) {
+        if (term == 0) return pt_pgradu(grid, data, tidx, i, j, k);
+        if (term == 1) return pt_turbu(grid, data, tidx, i, j, k);
+        return pt_diff(grid, data->ustag, grid->u0, tidx, i, j, k);
+    }
+    if (mesh == SPARSE_VMESH) {
+        if (term == 0) return pt_pgradv(grid, data, tidx, i, j, k);
+        if (term == 1) return pt_turbv(grid, data, tidx, i, j, k);
+        return pt_diff(grid, data->vstag, grid->v0, tidx, i, j, k);
+    }
+    if (term == 0) return pt_pgradw(grid, data, tidx, i, j, k);
+    if (term == 1) return pt_turbw(grid, data, tidx, i, j, k);
+    if (term == 2) return pt_diff(grid, data->wstag, NULL, tidx, i, j, k);
+    return pt_buoy(grid, data, tidx, i, j, k);
+}
+
+// Same checks _tri_interp does before it uses the weights
+inline bool _sparse_valid(interp_wts *wts) {
+    if ((wts->idx_4D[0] == -1) || (wts->idx_4D[1] == -1) || (wts->idx_4D[2] == -1)) return false;
+    for (int c = 0; c < 8; ++c) {
+        if (wts->weights[c] == -999) return false;
+    }
+    return true;
+}
+
+/* Compute the momentum budget terms along the trajectories for time levels
+   tStart to tEnd, after the parcels have been integrated. This fills the
+   same arrays that sample_parcel_fields does for the gridded budget, at
+   every time a parcel got sampled, and leaves the rest of them alone.
+   pipert and rhof need to have been computed for these time levels. */
+void sparse_momentum_budget(datagrid *grid, model_data *data, parcel_pos *parcels, int tStart, int tEnd, int totTime) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int nActive = parcels->nActive;
+    if (nActive == 0) return;
+
+    float *pclterms[3][SPARSE_MAXTERMS] = {
+        {parcels->pclupgrad, parcels->pcluturb, parcels->pcludiff, NULL},
+        {parcels->pclvpgrad, parcels->pclvturb, parcels->pclvdiff, NULL},
+        {parcels->pclwpgrad, parcels->pclwturb, parcels->pclwdiff, parcels->pclbuoy}
+    };
+    int nTerms[3] = {3, 3, 4};
+
+    interp_wts *wts = new interp_wts[3*nActive];
+    bool *sampled = new bool[nActive];
+    int *cell = new int[8*nActive];
+    vector< pair<long, int> > corners;
+    vector<long> cells;
+    vector<float> vals;
+    corners.reserve(8*nActive);
+
+    long nEval = 0;
+    long nCorners = 0;
+    for (int tidx = tStart; tidx < tEnd; ++tidx) {
+        // Get the cell and weights for each parcel on each mesh, the same
+        // way integrate_parcel does. Parcels that left the domain before
+        // this time didn't get sampled, and don't get a budget either.
+        #pragma omp parallel for
+        for (int a = 0; a < nActive; ++a) {
+            int pcl = parcels->active[a];
+            float point[3];
+            int idx_4D[4];
+            point[0] = parcels->xpos[PCL(tidx, pcl, totTime)];
+            point[1] = parcels->ypos[PCL(tidx, pcl, totTime)];
+            point[2] = parcels->zpos[PCL(tidx, pcl, totTime)];
+            sampled[a] = (point[0] != PCL_MISSING);
+            if (!sampled[a]) continue;
+
+            _nearest_grid_idx(point, grid, idx_4D);
+            calc_interp_wts(grid, point, idx_4D, true, false, false, tidx, &(wts[3*a+SPARSE_UMESH]));
+            calc_interp_wts(grid, point, idx_4D, false, true, false, tidx, &(wts[3*a+SPARSE_VMESH]));
+            calc_interp_wts(grid, point, idx_4D, false, false, true, tidx, &(wts[3*a+SPARSE_WMESH]));
+        }
+
+        for (int mesh = 0; mesh < 3; ++mesh) {
+            // The 8 corners of each parcel's cell, in the same order
+            // as the weights, keyed by where they are in the 3D arrays
+            corners.clear();
+            for (int a = 0; a < nActive; ++a) {
+                interp_wts *w = &(wts[3*a+mesh]);
+                if (!sampled[a] || !_sparse_valid(w)) continue;
+                int i = w->idx_4D[0]; int j = w->idx_4D[1]; int k = w->idx_4D[2];
+                corners.push_back(make_pair((long) P3(i+1, j+1, k  , NX+2, NY+2), 8*a+0));
+                corners.push_back(make_pair((long) P3(i+2, j+1, k  , NX+2, NY+2), 8*a+1));
+                corners.push_back(make_pair((long) P3(i+1, j+2, k  , NX+2, NY+2), 8*a+2));
+                corners.push_back(make_pair((long) P3(i+1, j+1, k+1, NX+2, NY+2), 8*a+3));
+                corners.push_back(make_pair((long) P3(i+2, j+1, k+1, NX+2, NY+2), 8*a+4));
+                corners.push_back(make_pair((long) P3(i+1, j+2, k+1, NX+2, NY+2), 8*a+5));
+                corners.push_back(make_pair((long) P3(i+2, j+2, k  , NX+2, NY+2), 8*a+6));
+                corners.push_back(make_pair((long) P3(i+2, j+2, k+1, NX+2, NY+2), 8*a+7));
+            }
+
+            // sort them so that parcels sharing a corner
+            // end up next to each other, and number the
+            // distinct ones
+            sort(corners.begin(), corners.end());
+            cells.clear();
+            for (size_t c = 0; c < corners.size(); ++c) {
+                if ((c == 0) || (corners[c].first != corners[c-1].first)) cells.push_back(corners[c].first);
+                cell[corners[c].second] = cells.size() - 1;
+            }
+            nCorners += corners.size();
+            nEval += cells.size();
+
+            // evaluate the budget terms at each distinct corner
+            int nT = nTerms[mesh];
+            long nCells = cells.size();
+            vals.resize(nCells*nT);
+            #pragma omp parallel for schedule(dynamic, 64)
+            for (long c = 0; c < nCells; ++c) {
+                int k = cells[c] / ((NX+2)*(NY+2));
+                int rem = cells[c] % ((NX+2)*(NY+2));
+                int j = rem / (NX+2) - 1;
+                int i = rem % (NX+2) - 1;
+                for (int term = 0; term < nT; ++term) {
+                    vals[c*nT+term] = _sparse_term(grid, data, mesh, term, tidx, i, j, k);
+                }
+            }
+
+            // and apply the weights. The sum is in the
+            // same order of operations as _tri_interp.
+            #pragma omp parallel for
+            for (int a = 0; a < nActive; ++a) {
+                if (!sampled[a]) continue;
+                int pcl = parcels->active[a];
+                interp_wts *w = &(wts[3*a+mesh]);
+                bool valid = _sparse_valid(w);
+                for (int term = 0; term < nT; ++term) {
+                    float out = -999.0;
+                    if (valid) {
+                        float *v = &(vals[term]);
+                        int *cl = &(cell[8*a]);
+                        float *wt = w->weights;
+                        out = (v[cl[0]*nT] * wt[0]) + \
+                              (v[cl[1]*nT] * wt[1]) + \
+                              (v[cl[2]*nT] * wt[2]) + \
+                              (v[cl[3]*nT] * wt[3]) + \
+                              (v[cl[4]*nT] * wt[4]) + \
+                              (v[cl[5]*nT] * wt[5]) + \
+                              (v[cl[6]*nT] * wt[6]) + \
+                              (v[cl[7]*nT] * wt[7]);
+                    }
+                    pclterms[mesh][term][PCL(tidx, pcl, totTime)] = out;
+                }
+            }
+        }
+    }
+    if (nCorners > 0) {
+        cout << "Sparse momentum budget evaluated at " << nEval << " of " << nCorners << " parcel cell corners" << endl;
+    }
+
+    delete[] wts;
+    delete[] sampled;
+    delete[] cell;
+}
+
+#endif
@@ -0,0 +1,292 @@
+#include <iostream>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <climits>
+#include "../include/datastructs.h"
+#include "../include/macros.h"
+#include "gridlookup.cu"
+#ifndef TILEMASK_CU
+#define TILEMASK_CU
+/*
+ * Copyright (C) 2017-2020 Kelton Halbert, Space Science and Engineering Center (SSEC), University of Wisconsin - Madison
+ * Written by Kelton Halbert at the University of Wisconsin - Madison,
+ * Cooperative Institute for Meteorological Satellite Studies (CIMSS),
+ * Space Science and Engineering Center (SSEC). Provided under the Apache 2.0 License.
+ * Email: kthalbert@wisc.edu
+*/
+
+/* The grid subset is the bounding box of all of the parcels plus a
+   halo, so when the parcels are in a couple of separate clusters most
+   of it never gets sampled by anything. With io->tile_mask on, the
+   driver marks the tiles of the subset that a parcel could possibly
+   read from during the time chunk, and the gridded stencils skip the
+   rest. Unlike the sparse budget, the fields are still computed on the
+   grid as usual, so they're good everywhere a parcel might look. They
+   just aren't computed anywhere else. */
+
+// How far outside of the path of a parcel the gridded fields have to be
+// good. The interpolation cell reaches 2 points past the parcel's nearest
+// index on the staggered meshes, and the vorticity budget stacks a couple
+// of stencils on top of the momentum budget and the vorticity.
+#define TILE_MASK_HALO 4
+
+// Whether the tile containing (i, j, k) is active. Points outside
+// of the mask get clamped to the closest tile.
+__host__ __device__ inline bool tile_active(datagrid *grid, int i, int j, int k) {
+    tile_mask *mask = grid->mask;
+    if (mask == NULL) return true;
+    int ti = i / MASK_TILE_I;
+    int tj = j / MASK_TILE_J;
+    int tk = k / MASK_TILE_K;
+    ti = (ti < 0) ? 0 : ((ti < mask->nI) ? ti : mask->nI-1);
+    tj = (tj < 0) ? 0 : ((tj < mask->nJ) ? tj : mask->nJ-1);
+    tk = (tk < 0) ? 0 : ((tk < mask->nK) ? tk : mask->nK-1);
+    return mask->active[P3(ti, tj, tk, mask->nI, mask->nJ)];
+}
+
+/* Shrink the box [i0, i1) x [j0, j1) x [k0, k1) down to the bounding box
+   of the active tiles inside of it. Returns false if none of them are
+   active, and leaves the box alone if there isn't a mask. The edges of
+   the box that are in the first or last tile of a dimension stay where
+   they were, so ghost points past the end of the mask stay in. */
+inline bool tile_bounds(datagrid *grid, int *i0, int *i1, int *j0, int *j1, int *k0, int *k1) {
+    tile_mask *mask = grid->mask;
+    if ((*i0 >= *i1) || (*j0 >= *j1) || (*k0 >= *k1)) return false;
+    if (mask == NULL) return true;
+
+    int lo[3] = {*i0, *j0, *k0};
+    int hi[3] = {*i1, *j1, *k1};
+    int size[3] = {MASK_TILE_I, MASK_TILE_J, MASK_TILE_K};
+    int nt[3] = {mask->nI, mask->nJ, mask->nK};
+    int t0[3], t1[3];
+    for (int d = 0; d < 3; ++d) {
+        t0[d] = std::min(std::max(lo[d] / size[d], 0), nt[d]-1);
+        t1[d] = std::min(std::max((hi[d]-1) / size[d], 0), nt[d]-1);
+    }
+
+    int amin[3] = {nt[0], nt[1], nt[2]};
+    int amax[3] = {-1, -1, -1};
+    for (int tk = t0[2]; tk <= t1[2]; ++tk) {
+        for (int tj = t0[1]; tj <= t1[1]; ++tj) {
+            for (int ti = t0[0]; ti <= t1[0]; ++ti) {
+                if (!mask->active[P3(ti, tj, tk, mask->nI, mask->nJ)]) continue;
+                amin[0] = std::min(amin[0], ti); amax[0] = std::max(amax[0], ti);
+                amin[1] = std::min(amin[1], tj); amax[1] = std::max(amax[1], tj);
+                amin[2] = std::min(amin[2], tk); amax[2] = std::max(amax[2], tk);
+            }
+        }
+    }
+    if (amax[0] < 0) return false;
+
+    for (int d = 0; d < 3; ++d) {
+        if (amin[d] > 0) lo[d] = std::max(lo[d], amin[d]*size[d]);
+        if (amax[d] < nt[d]-1) hi[d] = std::min(hi[d], (amax[d]+1)*size[d]);
+    }
+    *i0 = lo[0]; *i1 = hi[0];
+    *j0 = lo[1]; *j1 = hi[1];
+    *k0 = lo[2]; *k1 = hi[2];
+    return true;
+}
+
+// the smallest spacing between the N+1 face values in arr
+inline float _min_spacing(float *arr, int N) {
+    float dmin = arr[1] - arr[0];
+    for (int i = 1; i < N; ++i) dmin = std::min(dmin, arr[i+1] - arr[i]);
+    return dmin;
+}
+
+// Grow the active tiles of the mask by r tiles along one dimension
+inline void _dilate_tiles(tile_mask *mask, int dim, int r) {
+    int nt[3] = {mask->nI, mask->nJ, mask->nK};
+    long stride[3] = {1, mask->nI, (long)mask->nI*mask->nJ};
+    long N = (long)mask->nI*mask->nJ*mask->nK;
+    unsigned char *src = new unsigned char[N];
+    memcpy(src, mask->active, N);
+    for (long idx = 0; idx < N; ++idx) {
+        if (!src[idx]) continue;
+        int t = (idx / stride[dim]) % nt[dim];
+        for (int n = std::max(t-r, 0); n <= std::min(t+r, nt[dim]-1); ++n) {
+            mask->active[idx + (n-t)*stride[dim]] = 1;
+        }
+    }
+    delete[] src;
+}
+
+/* How many grid points a parcel could possibly move toward each face
+   of the subset (west, east, south, north, bottom, top) while being
+   integrated from time level tStart to tEnd. A parcel can't get further
+   from where it started than the fastest wind it runs into over that
+   time times how long it is. That's the fastest wind in box (i0, i1,
+   j0, j1, k0, k1 in the subset's indices) if the parcels are known to
+   stay inside of it, or anywhere in the subset if box is NULL, which
+   is very conservative but means it's safe to plan around. The winds
+   get read on the host, so with managed memory this needs to happen
+   before the kernels touch them. */
+void parcel_reach_faces(datagrid *grid, model_data *data, int *box, int tStart, int tEnd, int *faces) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+
+    // the arrays go from -1 to NX and NY, and 0 to NZ
+    int b[6] = {-1, NX, -1, NY, 0, NZ};
+    if (box != NULL) {
+        b[0] = std::max(box[0], -1); b[1] = std::min(box[1], NX);
+        b[2] = std::max(box[2], -1); b[3] = std::min(box[3], NY);
+        b[4] = std::max(box[4], 0);  b[5] = std::min(box[5], NZ);
+    }
+
+    // The fastest each wind component gets in each direction over the
+    // chunk. With time interpolation there's one more level of winds
+    // after it.
+    int tLast = tEnd;
+    if (data->io->time_interp) tLast += 1;
+    float umin = 0.0, vmin = 0.0, wmin = 0.0;
+    float umax = 0.0, vmax = 0.0, wmax = 0.0;
+    #pragma omp parallel for collapse(3) reduction(min:umin,vmin,wmin) reduction(max:umax,vmax,wmax)
+    for (int t = tStart; t < tLast; ++t) {
+    for (int k = b[4]; k <= b[5]; ++k) {
+    for (int j = b[2]; j <= b[3]; ++j) {
+        for (int i = b[0]; i <= b[1]; ++i) {
+            long idx = P4(i+1, j+1, k, t, NX+2, NY+2, NZ+1);
+            // the fields can be 16 bit, so widen them first
+            float u = data->ustag[idx], v = data->vstag[idx], w = data->wstag[idx];
+            umin = std::min(umin, u);
+            vmin = std::min(vmin, v);
+            wmin = std::min(wmin, w);
+            umax = std::max(umax, u);
+            vmax = std::max(vmax, v);
+            wmax = std::max(wmax, w);
+        }
+    }
+    }
+    }
+
+    // and how many grid points that could take a parcel
+    float T = (tEnd - tStart) * grid->dt;
+    float dx = _min_spacing(&(xf(0)), NX);
+    float dy = _min_spacing(&(yf(0)), NY);
+    float dz = _min_spacing(&(zf(0)), NZ);
+    faces[0] = (int) ceil(-umin * T / dx);
+    faces[1] = (int) ceil(umax * T / dx);
+    faces[2] = (int) ceil(-vmin * T / dy);
+    faces[3] = (int) ceil(vmax * T / dy);
+    faces[4] = (int) ceil(-wmin * T / dz);
+    faces[5] = (int) ceil(wmax * T / dz);
+}
+
+// The same over the whole subset, but the same distance both ways along each dimension
+void parcel_reach(datagrid *grid, model_data *data, int tStart, int tEnd, int *reach) {
+    int faces[6];
+    parcel_reach_faces(grid, data, NULL, tStart, tEnd, faces);
+    for (int d = 0; d < 3; ++d) reach[d] = std::max(faces[2*d], faces[2*d+1]);
+}
+
+// The grid cell an active parcel is in at time level t, or false if
+// it's missing or outside of the subset. The same lookup as _nearest_grid_idx.
+inline bool _parcel_cell(datagrid *grid, parcel_pos *parcels, int pcl, int t, int totTime, int *i, int *j, int *k) {
+    float px = parcels->xpos[PCL(t, pcl, totTime)];
+    float py = parcels->ypos[PCL(t, pcl, totTime)];
+    float pz = parcels->zpos[PCL(t, pcl, totTime)];
+    if ((px == PCL_MISSING) || (py == PCL_MISSING) || (pz == PCL_MISSING)) return false;
+    *i = _find_cell(&(xf(0)), grid->NX, px, grid->xuniform, grid->rdx, -1);
+    *j = _find_cell(&(yf(0)), grid->NY, py, grid->yuniform, grid->rdy, -1);
+    *k = (pz < zf(0)) ? 0 : _find_cell(&(zf(0)), grid->NZ, pz, grid->zuniform, grid->rdz, -1);
+    return (*i != -1) && (*j != -1) && (*k != -1);
+}
+
+/* The room to leave on each face of the next grid subset with
+   io->adaptive_halo, going by how far the winds of the window over
+   time levels tStart to tEnd could take a parcel toward it. Only the
+   winds around the parcels count: the box their starting cells cover,
+   grown by the room pad already gave them, which is as far as they
+   could have gotten without getting out of the subset. Going backward
+   in time (direct = -1) the parcels move against the wind. The stencils
+   need SUBSET_STENCIL points past that, and it's capped at
+   ADAPT_HALO_MAX so one wild time can't blow up the subset. */
+void adaptive_halo(datagrid *grid, model_data *data, parcel_pos *parcels, int tStart, int tEnd, int direct, int *pad) {
+    int box[6] = {INT_MAX, INT_MIN, INT_MAX, INT_MIN, INT_MAX, INT_MIN};
+    for (int a = 0; a < parcels->nActive; ++a) {
+        int i, j, k;
+        if (!_parcel_cell(grid, parcels, parcels->active[a], tStart, parcels->nTimes, &i, &j, &k)) continue;
+        box[0] = std::min(box[0], i); box[1] = std::max(box[1], i);
+        box[2] = std::min(box[2], j); box[3] = std::max(box[3], j);
+        box[4] = std::min(box[4], k); box[5] = std::max(box[5], k);
+    }
+    // without any parcels to go by, fall back on the whole subset
+    int *near = NULL;
+    if (box[0] <= box[1]) {
+        for (int f = 0; f < 6; ++f) box[f] += (f % 2 == 0) ? -pad[f] : pad[f];
+        near = box;
+    }
+    parcel_reach_faces(grid, data, near, tStart, tEnd, pad);
+    for (int f = 0; f < 6; ++f) {
+        if (direct < 0 && f % 2 == 0) std::swap(pad[f], pad[f+1]);
+        pad[f] = std::min(pad[f] + SUBSET_STENCIL, ADAPT_HALO_MAX);
+    }
+}
+
+/* Build the tile mask for integrating the parcels over time levels tStart
+   to tEnd. Every tile within reach of an active parcel's starting position
+   is turned on, so nothing a parcel samples ever comes from a tile that
+   got skipped. */
+tile_mask* build_tile_mask(datagrid *grid, model_data *data, parcel_pos *parcels, int tStart, int tEnd, int totTime) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+
+    tile_mask *mask;
+    // the stencils go from -1 to NX+1, so make sure
+    // the last tile includes NX and NZ
+    int nI = NX / MASK_TILE_I + 1;
+    int nJ = NY / MASK_TILE_J + 1;
+    int nK = NZ / MASK_TILE_K + 1;
+    long nTiles = (long)nI*nJ*nK;
+#ifdef CPU_ONLY
+    mask = new tile_mask();
+    mask->active = new unsigned char[nTiles];
+#else
+    cudaMallocManaged(&mask, sizeof(tile_mask));
+    cudaMallocManaged(&(mask->active), nTiles*sizeof(unsigned char));
+#endif
+    mask->nI = nI; mask->nJ = nJ; mask->nK = nK;
+    memset(mask->active, 0, nTiles*sizeof(unsigned char));
+
+    // how far the parcels can get, plus the halo around their paths
+    int reach[3];
+    parcel_reach(grid, data, tStart, tEnd, reach);
+    for (int d = 0; d < 3; ++d) reach[d] += TILE_MASK_HALO;
+
+    // the tiles the parcels start out in
+    for (int a = 0; a < parcels->nActive; ++a) {
+        int i, j, k;
+        if (!_parcel_cell(grid, parcels, parcels->active[a], tStart, totTime, &i, &j, &k)) continue;
+        mask->active[P3(i / MASK_TILE_I, j / MASK_TILE_J, k / MASK_TILE_K, nI, nJ)] = 1;
+    }
+
+    // A point within reach r of a point in tile t is at most
+    // ceil(r/tile) tiles away, so grow the mask by that much
+    _dilate_tiles(mask, 0, (reach[0] + MASK_TILE_I - 1) / MASK_TILE_I);
+    _dilate_tiles(mask, 1, (reach[1] + MASK_TILE_J - 1) / MASK_TILE_J);
+    _dilate_tiles(mask, 2, (reach[2] + MASK_TILE_K - 1) / MASK_TILE_K);
+
+    mask->nActive = 0;
+    for (long idx = 0; idx < nTiles; ++idx) mask->nActive += mask->active[idx];
+    std::cout << "Tile mask: " << mask->nActive << " of " << nTiles << " tiles active, parcels can move ";
+    std::cout << reach[0] << " " << reach[1] << " " << reach[2] << " points with the halo" << std::endl;
+    return mask;
+}
+
+void deallocate_tile_mask(tile_mask *mask) {
+    if (mask == NULL) return;
+#ifdef CPU_ONLY
+    delete[] mask->active;
+    delete mask;
+#else
+    cudaFree(mask->active);
+    cudaFree(mask);
+#endif
+}
+
+#endif
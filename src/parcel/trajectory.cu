@@ -0,0 +1,474 @@
+#include <iostream>
+#include <stdio.h>
+#include "../include/datastructs.h"
+#include "../include/macros.h"
+#include "interp.cu"
+#ifndef TRAJECTORY_CU
+#define TRAJECTORY_CU
+/*
+ * Copyright (C) 2017-2020 Kelton Halbert, Space Science and Engineering Center (SSEC), University of Wisconsin - Madison
+ * Written by Kelton Halbert at the University of Wisconsin - Madison,
+ * Cooperative Institute for Meteorological Satellite Studies (CIMSS),
+ * Space Science and Engineering Center (SSEC). Provided under the Apache 2.0 License.
+ * Email: kthalbert@wisc.edu
+*/
+
+/* These are the per-parcel pieces of the trajectory code. They get
+   called from one GPU thread per parcel in integrate.cu, and from the
+   OpenMP parcel loop in integrate_cpu.cpp, so that both backends are
+   running the exact same math. */
+
+// Interpolate the requested output fields to a parcel at time tidx,
+// using weights that have already been computed at the parcel position
+// for each of the U, V, W, and scalar meshes.
+__host__ __device__ void sample_parcel_fields(datagrid *grid, parcel_pos *parcels, model_data *data, int parcel_id, \
+                                              int tidx, int totTime, float *point, interp_wts *wts_u, \
+                                              interp_wts *wts_v, interp_wts *wts_w, interp_wts *wts_s) {
+    // get the io config from the user namelist
+    iocfg *io = parcels->io;
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+
+    if (io->output_kmh) {
+        float pclkmh = apply_interp_wts(data->kmh, wts_w, NX, NY, NZ);
+        parcels->pclkmh[PCL(tidx, parcel_id, totTime)] = pclkmh;
+    }
+
+    // the sparse budget gets done after integrating, in sparsebud.cpp
+    if (io->output_momentum_budget && !io->sparse_budget) {
+        float pclupgrad = apply_interp_wts(data->pgradu, wts_u, NX, NY, NZ);
+        float pcluturb = apply_interp_wts(data->turbu, wts_u, NX, NY, NZ);
+        float pcludiff = apply_interp_wts(data->diffu, wts_u, NX, NY, NZ);
+        float pclvpgrad = apply_interp_wts(data->pgradv, wts_v, NX, NY, NZ);
+        float pclvturb = apply_interp_wts(data->turbv, wts_v, NX, NY, NZ);
+        float pclvdiff = apply_interp_wts(data->diffv, wts_v, NX, NY, NZ);
+        float pclwpgrad = apply_interp_wts(data->pgradw, wts_w, NX, NY, NZ);
+        float pclwturb = apply_interp_wts(data->turbw, wts_w, NX, NY, NZ);
+        float pclwdiff = apply_interp_wts(data->diffw, wts_w, NX, NY, NZ);
+        float pclbuoy = apply_interp_wts(data->buoy, wts_w, NX, NY, NZ);
+        parcels->pclupgrad[PCL(tidx,   parcel_id, totTime)] = pclupgrad;
+        parcels->pclvpgrad[PCL(tidx,   parcel_id, totTime)] = pclvpgrad;
+        parcels->pclwpgrad[PCL(tidx,   parcel_id, totTime)] = pclwpgrad;
+        parcels->pcluturb[PCL(tidx,   parcel_id, totTime)] = pcluturb;
+        parcels->pclvturb[PCL(tidx,   parcel_id, totTime)] = pclvturb;
+        parcels->pclwturb[PCL(tidx,   parcel_id, totTime)] = pclwturb;
+        parcels->pcludiff[PCL(tidx,   parcel_id, totTime)] = pcludiff;
+        parcels->pclvdiff[PCL(tidx,   parcel_id, totTime)] = pclvdiff;
+        parcels->pclwdiff[PCL(tidx,   parcel_id, totTime)] = pclwdiff;
+        parcels->pclbuoy[PCL(tidx,   parcel_id, totTime)] = pclbuoy;
+    }
+
+
+    // interpolate scalar values to the parcel point
+    if (io->output_vorticity_budget || io->output_xvort) {
+        float pclxvort = apply_interp_wts(data->xvort, wts_s, NX, NY, NZ);
+        parcels->pclxvort[PCL(tidx, parcel_id, totTime)] = pclxvort;
+    }
+    if (io->output_vorticity_budget || io->output_yvort) {
+        float pclyvort = apply_interp_wts(data->yvort, wts_s, NX, NY, NZ);
+        parcels->pclyvort[PCL(tidx, parcel_id, totTime)] = pclyvort;
+    }
+    if (io->output_vorticity_budget || io->output_zvort) {
+        float pclzvort = apply_interp_wts(data->zvort, wts_s, NX, NY, NZ);
+        parcels->pclzvort[PCL(tidx, parcel_id, totTime)] = pclzvort;
+    }
+    if (io->output_vorticity_budget) {
+        float pclxvorttilt = apply_interp_wts(data->xvtilt, wts_s, NX, NY, NZ);
+        float pclyvorttilt = apply_interp_wts(data->yvtilt, wts_s, NX, NY, NZ);
+        float pclzvorttilt = apply_interp_wts(data->zvtilt, wts_s, NX, NY, NZ);
+        float pclxvortstretch = apply_interp_wts(data->xvstretch, wts_s, NX, NY, NZ);
+        float pclyvortstretch = apply_interp_wts(data->yvstretch, wts_s, NX, NY, NZ);
+        float pclzvortstretch = apply_interp_wts(data->zvstretch, wts_s, NX, NY, NZ);
+        float pclxvortturb = apply_interp_wts(data->turbxvort, wts_s, NX, NY, NZ);
+        float pclyvortturb = apply_interp_wts(data->turbyvort, wts_s, NX, NY, NZ);
+        float pclzvortturb = apply_interp_wts(data->turbzvort, wts_s, NX, NY, NZ);
+        float pclxvortdiff = apply_interp_wts(data->diffxvort, wts_s, NX, NY, NZ);
+        float pclyvortdiff = apply_interp_wts(data->diffyvort, wts_s, NX, NY, NZ);
+        float pclzvortdiff = apply_interp_wts(data->diffzvort, wts_s, NX, NY, NZ);
+        float pclxvortbaro = apply_interp_wts(data->xvort_baro, wts_s, NX, NY, NZ);
+        float pclyvortbaro = apply_interp_wts(data->yvort_baro, wts_s, NX, NY, NZ);
+        float pclxvortsolenoid = apply_interp_wts(data->xvort_solenoid, wts_s, NX, NY, NZ);
+        float pclyvortsolenoid = apply_interp_wts(data->yvort_solenoid, wts_s, NX, NY, NZ);
+        float pclzvortsolenoid = apply_interp_wts(data->zvort_solenoid, wts_s, NX, NY, NZ);
+        // Store the vorticity in the parcel
+        parcels->pclxvorttilt[PCL(tidx, parcel_id, totTime)] = pclxvorttilt;
+        parcels->pclyvorttilt[PCL(tidx, parcel_id, totTime)] = pclyvorttilt;
+        parcels->pclzvorttilt[PCL(tidx, parcel_id, totTime)] = pclzvorttilt;
+        parcels->pclxvortstretch[PCL(tidx, parcel_id, totTime)] = pclxvortstretch;
+        parcels->pclyvortstretch[PCL(tidx, parcel_id, totTime)] = pclyvortstretch;
+        parcels->pclzvortstretch[PCL(tidx, parcel_id, totTime)] = pclzvortstretch;
+        parcels->pclxvortturb[PCL(tidx, parcel_id, totTime)] = pclxvortturb;
+        parcels->pclyvortturb[PCL(tidx, parcel_id, totTime)] = pclyvortturb;
+        parcels->pclzvortturb[PCL(tidx, parcel_id, totTime)] = pclzvortturb;
+        parcels->pclxvortdiff[PCL(tidx, parcel_id, totTime)] = pclxvortdiff;
+        parcels->pclyvortdiff[PCL(tidx, parcel_id, totTime)] = pclyvortdiff;
+        parcels->pclzvortdiff[PCL(tidx, parcel_id, totTime)] = pclzvortdiff;
+        parcels->pclxvortbaro[PCL(tidx, parcel_id, totTime)] = pclxvortbaro;
+        parcels->pclyvortbaro[PCL(tidx, parcel_id, totTime)] = pclyvortbaro;
+        parcels->pclxvortsolenoid[PCL(tidx, parcel_id, totTime)] = pclxvortsolenoid;
+        parcels->pclyvortsolenoid[PCL(tidx, parcel_id, totTime)] = pclyvortsolenoid;
+        parcels->pclzvortsolenoid[PCL(tidx, parcel_id, totTime)] = pclzvortsolenoid;
+    }
+
+    // Now do the scalars
+    if (io->output_ppert) {
+        float pclppert = apply_interp_wts(data->prespert, wts_s, NX, NY, NZ);
+        parcels->pclppert[PCL(tidx, parcel_id, totTime)] = pclppert;
+    }
+    if (io->output_qvpert) {
+        float pclqvpert = apply_interp_wts(data->qvpert, wts_s, NX, NY, NZ);
+        parcels->pclqvpert[PCL(tidx, parcel_id, totTime)] = pclqvpert;
+    }
+    if (io->output_rhopert) {
+        float pclrhopert = apply_interp_wts(data->rhopert, wts_s, NX, NY, NZ);
+        parcels->pclrhopert[PCL(tidx, parcel_id, totTime)] = pclrhopert;
+    }
+    if (io->output_thetapert) {
+        float pclthetapert = apply_interp_wts(data->thetapert, wts_s, NX, NY, NZ);
+        parcels->pclthetapert[PCL(tidx, parcel_id, totTime)] = pclthetapert;
+    }
+    if (io->output_thrhopert) {
+        float pclthrhopert = apply_interp_wts(data->thrhopert, wts_s, NX, NY, NZ);
+        parcels->pclthrhopert[PCL(tidx, parcel_id, totTime)] = pclthrhopert;
+    }
+
+    if (io->output_pbar) {
+        float pclpbar = interp1D(grid, grid->p0, point[2], false, tidx);
+        parcels->pclpbar[PCL(tidx, parcel_id, totTime)] = pclpbar;
+    }
+    if (io->output_qvbar) {
+        float pclqvbar = interp1D(grid, grid->qv0, point[2], false, tidx);
+        parcels->pclqvbar[PCL(tidx, parcel_id, totTime)] = pclqvbar;
+    }
+    if (io->output_rhobar) {
+        float pclrhobar = interp1D(grid, grid->rho0, point[2], false, tidx);
+        parcels->pclrhobar[PCL(tidx, parcel_id, totTime)] = pclrhobar;
+    }
+    if (io->output_thetabar) {
+        float pclthetabar = interp1D(grid, grid->th0, point[2], false, tidx);
+        parcels->pclthetabar[PCL(tidx, parcel_id, totTime)] = pclthetabar;
+    }
+    if (io->output_thrhobar) {
+        float pclthrhobar = interp1D(grid, grid->th0, point[2], false, tidx);
+        parcels->pclthrhobar[PCL(tidx, parcel_id, totTime)] = pclthrhobar;
+    }
+
+    if (io->output_qc) {
+        float pclqc = apply_interp_wts(data->qc, wts_s, NX, NY, NZ);
+        parcels->pclqc[PCL(tidx, parcel_id, totTime)] = pclqc;
+    }
+    if (io->output_qi) {
+        float pclqi = apply_interp_wts(data->qi, wts_s, NX, NY, NZ);
+        parcels->pclqi[PCL(tidx, parcel_id, totTime)] = pclqi;
+    }
+    if (io->output_qs) {
+        float pclqs = apply_interp_wts(data->qs, wts_s, NX, NY, NZ);
+        parcels->pclqs[PCL(tidx, parcel_id, totTime)] = pclqs;
+    }
+    if (io->output_qg) {
+        float pclqg = apply_interp_wts(data->qg, wts_s, NX, NY, NZ);
+        parcels->pclqg[PCL(tidx, parcel_id, totTime)] = pclqg;
+    }
+}
+
+// smallest step the adaptive RK45 scheme is allowed to take,
+// as a fraction of the history interval. Steps this small get
+// accepted no matter what the error estimate says.
+#define RK45_HMIN_FRAC 1.0e-3
+
+// Hook that gets called once for every wind interpolation, which is
+// how tests/integrator_benchmark.cpp counts the work each scheme does.
+// Does nothing unless it's defined before this file is included.
+#ifndef COUNT_WIND_INTERP
+#define COUNT_WIND_INTERP()
+#endif
+
+// Interpolate the three wind components to a point at the time
+// tidx + tfrac, where tfrac is the fraction of the way to the next
+// time level. This does a single grid lookup shared by u, v, and w.
+// Returns false if any of the components are missing.
+__host__ __device__ bool _interp_wind(datagrid *grid, model_data *data, float *point, int tidx, \
+                                      float tfrac, int *hint_4D, float *uvw) {
+    int idx_4D[4];
+    interp_wts wts_u, wts_v, wts_w;
+
+    COUNT_WIND_INTERP();
+    _nearest_grid_idx(point, grid, idx_4D, hint_4D);
+    calc_interp_wts(grid, point, idx_4D, true, false, false, tidx, &wts_u);
+    calc_interp_wts(grid, point, idx_4D, false, true, false, tidx, &wts_v);
+    calc_interp_wts(grid, point, idx_4D, false, false, true, tidx, &wts_w);
+    uvw[0] = apply_interp_wts_time(data->ustag, &wts_u, tfrac, grid->NX, grid->NY, grid->NZ);
+    uvw[1] = apply_interp_wts_time(data->vstag, &wts_v, tfrac, grid->NX, grid->NY, grid->NZ);
+    uvw[2] = apply_interp_wts_time(data->wstag, &wts_w, tfrac, grid->NX, grid->NY, grid->NZ);
+    return !((uvw[0] == -999.0) || (uvw[1] == -999.0) || (uvw[2] == -999.0));
+}
+
+__host__ __device__ void _missing_wind_warning(datagrid *grid, float *point) {
+    printf("Warning: missing values detected at x: %f y:%f z:%f with ground bounds X0: %f Y0: %f Z0: %f X1: %f Y1: %f Z1: %f\n", \
+        point[0], point[1], point[2], xh(0), yh(0), zh(0), xh(grid->NX-1), yh(grid->NY-1), zh(grid->NZ-1));
+}
+
+/* The integrators below each take a single step of h seconds from point,
+   where k1 is the wind already interpolated at point. tfrac is how far
+   into the history interval the step starts and hfrac is how much of the
+   interval the step covers, both only used when interpolating in time.
+   On return point holds the new position. They return false (and leave
+   the last position they tried in point) if they run into missing data. */
+
+// Two stage Runge-Kutta (Heun's method)
+__host__ __device__ bool _rk2_step(datagrid *grid, model_data *data, int tidx, float tfrac, float hfrac, \
+                                   float h, int direct, int time_interp, int *hint_4D, float *point, float *k1) {
+    float k2[3];
+    float pcl_x = point[0];
+    float pcl_y = point[1];
+    float pcl_z = point[2];
+    float h2 = h / 2.;
+
+    // First the predictor step using the wind at the current
+    // position...
+    point[0] = pcl_x + k1[0] * h * direct;
+    point[1] = pcl_y + k1[1] * h * direct;
+    point[2] = pcl_z + k1[2] * h * direct;
+    if ((k1[0] == -999.0) || (k1[1] == -999.0) || (k1[2] == -999.0)) return false;
+
+    // ...and then the corrector using the average of that
+    // and the wind at the predicted position
+    bool valid = _interp_wind(grid, data, point, tidx, time_interp ? tfrac + hfrac : 0.0, hint_4D, k2);
+    point[0] = pcl_x + (k2[0] + k1[0]) * h2 * direct;
+    point[1] = pcl_y + (k2[1] + k1[1]) * h2 * direct;
+    point[2] = pcl_z + (k2[2] + k1[2]) * h2 * direct;
+    return valid;
+}
+
+// Classic four stage Runge-Kutta
+__host__ __device__ bool _rk4_step(datagrid *grid, model_data *data, int tidx, float tfrac, float hfrac, \
+                                   float h, int direct, int time_interp, int *hint_4D, float *point, float *k1) {
+    float k2[3], k3[3], k4[3];
+    float pcl[3] = {point[0], point[1], point[2]};
+    float h2 = h / 2.;
+    float tmid = time_interp ? tfrac + 0.5*hfrac : 0.0;
+    float tend = time_interp ? tfrac + hfrac : 0.0;
+    if ((k1[0] == -999.0) || (k1[1] == -999.0) || (k1[2] == -999.0)) return false;
+
+    for (int d = 0; d < 3; ++d) point[d] = pcl[d] + k1[d] * h2 * direct;
+    if (!_interp_wind(grid, data, point, tidx, tmid, hint_4D, k2)) return false;
+    for (int d = 0; d < 3; ++d) point[d] = pcl[d] + k2[d] * h2 * direct;
+    if (!_interp_wind(grid, data, point, tidx, tmid, hint_4D, k3)) return false;
+    for (int d = 0; d < 3; ++d) point[d] = pcl[d] + k3[d] * h * direct;
+    if (!_interp_wind(grid, data, point, tidx, tend, hint_4D, k4)) return false;
+
+    for (int d = 0; d < 3; ++d) {
+        point[d] = pcl[d] + (k1[d] + 2.*k2[d] + 2.*k3[d] + k4[d]) * (h / 6.) * direct;
+    }
+    return true;
+}
+
+/* Embedded 5(4) Runge-Kutta step using the Dormand-Prince coefficients.
+   k holds the 7 stages, with k[0] being the wind at point on input. The
+   last stage is the wind at the new position, so it can be used as k[0]
+   for the next step. err is set to the largest difference between the
+   4th and 5th order positions in meters, which is what the step size
+   control uses. point is only updated if this returns true. */
+__host__ __device__ bool _rk45_step(datagrid *grid, model_data *data, int tidx, float tfrac, float hfrac, \
+                                    float h, int direct, int time_interp, int *hint_4D, float *point, \
+                                    float k[7][3], float *err) {
+    const float c[7] = {0.0, 1.0/5.0, 3.0/10.0, 4.0/5.0, 8.0/9.0, 1.0, 1.0};
+    const float a[7][6] = {
+        {0.0, 0.0, 0.0, 0.0, 0.0, 0.0},
+        {1.0/5.0, 0.0, 0.0, 0.0, 0.0, 0.0},
+        {3.0/40.0, 9.0/40.0, 0.0, 0.0, 0.0, 0.0},
+        {44.0/45.0, -56.0/15.0, 32.0/9.0, 0.0, 0.0, 0.0},
+        {19372.0/6561.0, -25360.0/2187.0, 64448.0/6561.0, -212.0/729.0, 0.0, 0.0},
+        {9017.0/3168.0, -355.0/33.0, 46732.0/5247.0, 49.0/176.0, -5103.0/18656.0, 0.0},
+        // the last row is the 5th order solution
+        {35.0/384.0, 0.0, 500.0/1113.0, 125.0/192.0, -2187.0/6784.0, 11.0/84.0}
+    };
+    // difference between the 5th and 4th order weights
+    const float e[7] = {71.0/57600.0, 0.0, -71.0/16695.0, 71.0/1920.0, -17253.0/339200.0, 22.0/525.0, -1.0/40.0};
+    float pt[3];
+    float hd = h * direct;
+
+    if ((k[0][0] == -999.0) || (k[0][1] == -999.0) || (k[0][2] == -999.0)) return false;
+    for (int s = 1; s < 7; ++s) {
+        for (int d = 0; d < 3; ++d) {
+            float dx = 0.0;
+            for (int j = 0; j < s; ++j) dx += a[s][j] * k[j][d];
+            pt[d] = point[d] + dx * hd;
+        }
+        if (!_interp_wind(grid, data, pt, tidx, time_interp ? tfrac + c[s]*hfrac : 0.0, hint_4D, k[s])) {
+            for (int d = 0; d < 3; ++d) point[d] = pt[d];
+            return false;
+        }
+    }
+
+    *err = 0.0;
+    for (int d = 0; d < 3; ++d) {
+        float de = 0.0;
+        for (int j = 0; j < 7; ++j) de += e[j] * k[j][d];
+        de = fabs(de * h);
+        if (de > *err) *err = de;
+    }
+    // pt is the 5th order position from the last stage
+    for (int d = 0; d < 3; ++d) point[d] = pt[d];
+    return true;
+}
+
+/* Integrate a single parcel forward (or backward) in time from tStart
+   to tEnd, and sample all of the requested fields along the way. The
+   cell lookup and interpolation weights at the parcel position are done
+   once per stagger each time step and shared between the wind components
+   and every output field, and the cell from the last lookup is handed to
+   the next one as a starting guess.
+
+   io->integrator picks the scheme. RK2 and RK4 split each history interval
+   into io->nsubsteps equal steps. RK45 adapts the step size per parcel to
+   keep the estimated position error of each step under io->rk_tol meters,
+   starting from a step of 1/nsubsteps of the interval, and always lands
+   exactly on the history times.
+
+   By default the wind is held at time level tidx for the whole interval,
+   but with io->time_interp it gets linearly interpolated in time between
+   tidx and tidx+1, which means the data needs one more time level past
+   tEnd-1. The fields written out along the trajectory are still only
+   sampled at the history times. */
+__host__ __device__ void integrate_parcel(datagrid *grid, parcel_pos *parcels, model_data *data, int parcel_id, \
+                                          int tStart, int tEnd, int totTime, int direct) {
+    iocfg *io = parcels->io;
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+
+    float pcl_x, pcl_y, pcl_z;
+    float k[7][3];
+    float point[3];
+    int idx_4D[4];
+    int hint_4D[4] = {-1, -1, -1, -1};
+    interp_wts wts_u, wts_v, wts_w, wts_s;
+    bool in_domain, valid;
+
+    int nsteps = io->nsubsteps;
+    if (nsteps < 1) nsteps = 1;
+
+    // loop over the number of time steps we are
+    // integrating over
+    float DT = grid->dt;
+    float dt = DT / nsteps; 
+    // the adaptive step size carries over between history intervals
+    float h = dt;
+    float hmin = RK45_HMIN_FRAC * DT;
+    for (int tidx = tStart; tidx < tEnd; ++tidx) {
+
+        // get the current values of various fields interpolated
+        // to the parcel before we integrate forward
+        point[0] = parcels->xpos[PCL(tidx, parcel_id, totTime)];
+        point[1] = parcels->ypos[PCL(tidx, parcel_id, totTime)];
+        point[2] = parcels->zpos[PCL(tidx, parcel_id, totTime)];
+
+        _nearest_grid_idx(point, grid, idx_4D, hint_4D);
+        if (idx_4D[0] != -1) {
+            hint_4D[0] = idx_4D[0]; hint_4D[1] = idx_4D[1]; hint_4D[2] = idx_4D[2];
+        }
+        calc_interp_wts(grid, point, idx_4D, true, false, false, tidx, &wts_u);
+        calc_interp_wts(grid, point, idx_4D, false, true, false, tidx, &wts_v);
+        calc_interp_wts(grid, point, idx_4D, false, false, true, tidx, &wts_w);
+        calc_interp_wts(grid, point, idx_4D, false, false, false, tidx, &wts_s);
+
+        // the output fields get sampled at the current position even
+        // if the parcel is about to leave the domain
+        sample_parcel_fields(grid, parcels, data, parcel_id, tidx, totTime, point, &wts_u, &wts_v, &wts_w, &wts_s);
+
+        // the wind at the start of the interval is the first
+        // stage of the first step for every scheme
+        COUNT_WIND_INTERP();
+        k[0][0] = apply_interp_wts(data->ustag, &wts_u, NX, NY, NZ);
+        k[0][1] = apply_interp_wts(data->vstag, &wts_v, NX, NY, NZ);
+        k[0][2] = apply_interp_wts(data->wstag, &wts_w, NX, NY, NZ);
+
+        in_domain = true;
+        valid = true;
+        float t = 0.0;
+        int step = 0;
+        bool last = false;
+        while (!last) {
+            pcl_x = point[0];
+            pcl_y = point[1];
+            pcl_z = point[2];
+            if (( pcl_x > xf(grid->NX-4) ) || ( pcl_y > yf(grid->NY-4) ) || ( pcl_z > zf(grid->NZ-4) ) \
+             || ( pcl_x < xf(0) )        || ( pcl_y < yf(0) )        || ( pcl_z < 0. ) ) {
+                in_domain = false;
+                break;
+            }
+
+            if (step == 0) {
+                parcels->pclu[PCL(tidx,   parcel_id, totTime)] = k[0][0];
+                parcels->pclv[PCL(tidx,   parcel_id, totTime)] = k[0][1];
+                parcels->pclw[PCL(tidx,   parcel_id, totTime)] = k[0][2];
+            }
+
+            if (io->integrator == INTEG_RK45) {
+                float err;
+                if (h >= DT - t) {
+                    h = DT - t;
+                    last = true;
+                }
+                valid = _rk45_step(grid, data, tidx, t / DT, h / DT, h, direct, io->time_interp, hint_4D, point, k, &err);
+                if (!valid) break;
+
+                // accept the step if it's accurate enough, and pick
+                // the next step size from the error estimate
+                if ((err <= io->rk_tol) || (h <= hmin)) {
+                    t += h;
+                    for (int d = 0; d < 3; ++d) k[0][d] = k[6][d];
+                }
+                else {
+                    point[0] = pcl_x; point[1] = pcl_y; point[2] = pcl_z;
+                    last = false;
+                }
+                float fac = 5.0;
+                if (err > 0.0) fac = 0.9 * pow(io->rk_tol / err, 0.2);
+                if (fac < 0.2) fac = 0.2;
+                if (fac > 5.0) fac = 5.0;
+                h = h * fac;
+                if (h < hmin) h = hmin;
+            }
+            else {
+                // the winds at the start of the first sub-step
+                // were already interpolated above
+                if (step > 0) {
+                    _interp_wind(grid, data, point, tidx, io->time_interp ? (float) step / nsteps : 0.0, hint_4D, k[0]);
+                }
+                if (io->integrator == INTEG_RK4) {
+                    valid = _rk4_step(grid, data, tidx, (float) step / nsteps, 1.0 / nsteps, dt, direct, \
+                                      io->time_interp, hint_4D, point, k[0]);
+                }
+                else {
+                    valid = _rk2_step(grid, data, tidx, (float) step / nsteps, 1.0 / nsteps, dt, direct, \
+                                      io->time_interp, hint_4D, point, k[0]);
+                }
+                if (!valid) break;
+                if (step == nsteps-1) last = true;
+            }
+            step += 1;
+        } // end sub-step loop
+
+        if (!valid) _missing_wind_warning(grid, point);
+        if (!valid || !in_domain) {
+            // this parcel is done. Mark the rest of the trajectory
+            // as missing so that it doesn't have leftover positions
+            // from the last time chunk, and so compact_parcels knows
+            // to drop it from the active list.
+            for (int tr = tidx+1; tr <= tEnd; ++tr) {
+                parcels->xpos[PCL(tr, parcel_id, totTime)] = PCL_MISSING;
+                parcels->ypos[PCL(tr, parcel_id, totTime)] = PCL_MISSING;
+                parcels->zpos[PCL(tr, parcel_id, totTime)] = PCL_MISSING;
+            }
+            return;
+        }
+
+        parcels->xpos[PCL(tidx+1, parcel_id, totTime)] = point[0]; 
+        parcels->ypos[PCL(tidx+1, parcel_id, totTime)] = point[1];
+        parcels->zpos[PCL(tidx+1, parcel_id, totTime)] = point[2];
+    } // end time loop
+}
+#endif
@@ -0,0 +1,321 @@
+#ifndef INTEGRATOR_BENCHMARK
+#define INTEGRATOR_BENCHMARK
+#include <iostream>
+#include <string>
+#include <math.h>
+#include <omp.h>
+#include "../src/include/datastructs.h"
+#include "../src/include/macros.h"
+
+// count every wind interpolation the integrators do, per thread
+// so that the counting doesn't slow the parcel loop down
+static long n_wind_interp = 0;
+#pragma omp threadprivate(n_wind_interp)
+#define COUNT_WIND_INTERP() (++n_wind_interp)
+
+#include "../src/io/datastructs.cu"
+#include "../src/parcel/integrate_cpu.cpp"
+using namespace std;
+/* This code compares the different trajectory integration
+ * schemes (RK2, RK4, and adaptive RK45) against known solutions
+ * for the same flows as the solid_body_vortex and unidirectional_shear
+ * tests. An artificial CM1 grid with no terrain is constructed and a
+ * steady-state flow field imposed upon it. Parcels are integrated
+ * with each scheme using the CPU backend, and the position error
+ * relative to the analytic solution is reported along with how many
+ * wind interpolations each parcel needed and how long the integration
+ * took, so the schemes can be compared on accuracy per unit of work.
+ * The first two flows are linear in space, which the trilinear
+ * interpolation gets exactly right, so there's also an updraft core
+ * surrounded by calm air where the winds vary the way they do in a
+ * storm. Building it with -DFIELD_FP16 or -DFIELD_BF16
+ * (make integrator_benchmark_fp16/_bf16) runs the same thing with the
+ * winds stored in 16 bits, so the errors can be compared to the
+ * float version. */
+
+// history output interval of the fake dataset, in seconds
+#define HIST_DT 10.0
+// number of history times in memory at once,
+// like the number of MPI ranks in run_cm1
+#define CHUNK_TIMES 4
+// total number of chunks to integrate through
+#define NCHUNKS 15
+// RK4 sub-steps per history interval for the reference
+// solution when there isn't an exact one
+#define REF_SUBSTEPS 32
+
+/* Create a staggered C-grid based on the provided number
+ * of grid points in each dimension and spacing between them,
+ * with the same ghost points that lofs_get_grid sets up. The
+ * horizontal domain is centered on zero. */
+void create_grid(datagrid *grid, float dx, float dy, float dz) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+
+    for (int i = -1; i < NX+1; ++i) {
+        xf(i) = dx*i - 0.5*dx*NX;
+        xh(i) = xf(i) + 0.5*dx;
+    }
+    for (int j = -1; j < NY+1; ++j) {
+        yf(j) = dy*j - 0.5*dy*NY;
+        yh(j) = yf(j) + 0.5*dy;
+    }
+    for (int k = 0; k < NZ+2; ++k) {
+        zf(k) = dz*(k-1);
+        zh(k) = zf(k) + 0.5*dz;
+    }
+    grid->dx = dx;
+    grid->dy = dy;
+    grid->dz = dz;
+    grid->dt = HIST_DT;
+    set_grid_lookup(grid);
+}
+
+/* Fill every time level with a solid body vortex centered
+ * on the origin, plus a constant vertical velocity. */
+void create_vortex(datagrid *grid, model_data *data, int nT, float omega, float w0) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    field_t *ustag = data->ustag;
+    field_t *vstag = data->vstag;
+    field_t *wstag = data->wstag;
+
+    for (int t = 0; t < nT; ++t) {
+        for (int k = 0; k < NZ+1; ++k) {
+            for (int j = -1; j < NY+1; ++j) {
+                for (int i = -1; i < NX+1; ++i) {
+                    UA4D(i, j, k, t) = -omega * yh(j);
+                    VA4D(i, j, k, t) =  omega * xh(i);
+                    WA4D(i, j, k, t) = w0;
+                }
+            }
+        }
+    }
+}
+
+/* Fill every time level with unidirectional constant
+ * shear in the vertical, and no vertical velocity. */
+void create_shear(datagrid *grid, model_data *data, int nT, float u0, float v0, float shear) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    field_t *ustag = data->ustag;
+    field_t *vstag = data->vstag;
+    field_t *wstag = data->wstag;
+
+    for (int t = 0; t < nT; ++t) {
+        for (int k = 0; k < NZ+1; ++k) {
+            for (int j = -1; j < NY+1; ++j) {
+                for (int i = -1; i < NX+1; ++i) {
+                    UA4D(i, j, k, t) = u0 + shear*zh(k);
+                    VA4D(i, j, k, t) = v0 + shear*zh(k);
+                    WA4D(i, j, k, t) = 0.0;
+                }
+            }
+        }
+    }
+}
+
+/* Fill every time level with a swirling updraft core centered on the
+ * origin. The rotation rate and vertical velocity both fall off like a
+ * Gaussian of radius R, so the air is calm far from the core. Parcels
+ * stay at a constant radius, turning at omega(r) and rising at w(r). */
+void create_updraft_core(datagrid *grid, model_data *data, int nT, float omega0, float w0, float R) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    field_t *ustag = data->ustag;
+    field_t *vstag = data->vstag;
+    field_t *wstag = data->wstag;
+
+    for (int t = 0; t < nT; ++t) {
+        for (int k = 0; k < NZ+1; ++k) {
+            for (int j = -1; j < NY+1; ++j) {
+                for (int i = -1; i < NX+1; ++i) {
+                    // u, v, and w each live on their own staggered point
+                    float ru = exp(-(xf(i)*xf(i) + yh(j)*yh(j)) / (R*R));
+                    float rv = exp(-(xh(i)*xh(i) + yf(j)*yf(j)) / (R*R));
+                    float rw = exp(-(xh(i)*xh(i) + yh(j)*yh(j)) / (R*R));
+                    UA4D(i, j, k, t) = -omega0 * ru * yh(j);
+                    VA4D(i, j, k, t) =  omega0 * rv * xh(i);
+                    WA4D(i, j, k, t) = w0 * rw;
+                }
+            }
+        }
+    }
+}
+
+/* Integrate the parcels through all of the chunks, starting from
+ * the positions in x0/y0/z0, and leave the final positions there. */
+double integrate_chunks(datagrid *grid, model_data *data, parcel_pos *parcels, float *x0, float *y0, float *z0) {
+    int nTotTimes = parcels->nTimes;
+    for (int pcl = 0; pcl < parcels->nParcels; ++pcl) {
+        parcels->xpos[PCL(0, pcl, nTotTimes)] = x0[pcl];
+        parcels->ypos[PCL(0, pcl, nTotTimes)] = y0[pcl];
+        parcels->zpos[PCL(0, pcl, nTotTimes)] = z0[pcl];
+    }
+
+    double start = omp_get_wtime();
+    for (int tChunk = 0; tChunk < NCHUNKS; ++tChunk) {
+        cpuIntegrateParcels(grid, data, parcels, CHUNK_TIMES, nTotTimes, 1);
+        for (int pcl = 0; pcl < parcels->nParcels; ++pcl) {
+            parcels->xpos[PCL(0, pcl, nTotTimes)] = parcels->xpos[PCL(CHUNK_TIMES, pcl, nTotTimes)];
+            parcels->ypos[PCL(0, pcl, nTotTimes)] = parcels->ypos[PCL(CHUNK_TIMES, pcl, nTotTimes)];
+            parcels->zpos[PCL(0, pcl, nTotTimes)] = parcels->zpos[PCL(CHUNK_TIMES, pcl, nTotTimes)];
+        }
+    }
+    double elapsed = omp_get_wtime() - start;
+
+    for (int pcl = 0; pcl < parcels->nParcels; ++pcl) {
+        x0[pcl] = parcels->xpos[PCL(0, pcl, nTotTimes)];
+        y0[pcl] = parcels->ypos[PCL(0, pcl, nTotTimes)];
+        z0[pcl] = parcels->zpos[PCL(0, pcl, nTotTimes)];
+    }
+    return elapsed;
+}
+
+/* Run each of the integration schemes over the flow currently in data,
+ * and print the mean and max error against the exact final positions
+ * next to the number of wind interpolations per parcel. */
+void run_schemes(string flow, datagrid *grid, model_data *data, iocfg *io, parcel_pos *parcels, \
+                 float *xs, float *ys, float *zs, float *xe, float *ye, float *ze) {
+    const int nCfgs = 8;
+    int schemes[nCfgs] =    {INTEG_RK2, INTEG_RK2, INTEG_RK2, INTEG_RK4, INTEG_RK4, INTEG_RK45, INTEG_RK45, INTEG_RK45};
+    int substeps[nCfgs] =   {1,         4,         16,        1,         4,         1,          1,          1};
+    // rk_tol is the position error allowed per step in meters. The linear
+    // flows only need one step per history interval at any of these, and
+    // at 1e-5 the extra steps there just add float roundoff, since the
+    // positions are only good to a few 1e-4 m a few km from the origin.
+    float tols[nCfgs] =     {0.0,       0.0,       0.0,       0.0,       0.0,       1.0e-3,     1.0e-4,     1.0e-5};
+    string names[3] = {"rk2", "rk4", "rk45"};
+
+    int nParcels = parcels->nParcels;
+    float *x = new float[nParcels];
+    float *y = new float[nParcels];
+    float *z = new float[nParcels];
+
+    cout << endl << flow << endl;
+    printf("%-6s %9s %9s %12s %12s %12s %10s\n", "scheme", "nsubstep", "rk_tol", "mean err (m)", "max err (m)", "interp/pcl", "time (s)");
+    for (int c = 0; c < nCfgs; ++c) {
+        io->integrator = schemes[c];
+        io->nsubsteps = substeps[c];
+        io->rk_tol = tols[c];
+        for (int pcl = 0; pcl < nParcels; ++pcl) {
+            x[pcl] = xs[pcl]; y[pcl] = ys[pcl]; z[pcl] = zs[pcl];
+        }
+        #pragma omp parallel
+        n_wind_interp = 0;
+        double elapsed = integrate_chunks(grid, data, parcels, x, y, z);
+        long ninterp = 0;
+        #pragma omp parallel reduction(+:ninterp)
+        ninterp += n_wind_interp;
+
+        double meanerr = 0.0;
+        double maxerr = 0.0;
+        for (int pcl = 0; pcl < nParcels; ++pcl) {
+            double err = sqrt( (x[pcl]-xe[pcl])*(x[pcl]-xe[pcl]) + (y[pcl]-ye[pcl])*(y[pcl]-ye[pcl]) \
+                             + (z[pcl]-ze[pcl])*(z[pcl]-ze[pcl]) );
+            meanerr += err / nParcels;
+            if (err > maxerr) maxerr = err;
+        }
+        printf("%-6s %9d %9.0e %12.4f %12.4f %12.1f %10.4f\n", names[schemes[c]].c_str(), substeps[c], tols[c], \
+               meanerr, maxerr, (double) ninterp / nParcels, elapsed);
+    }
+    delete[] x;
+    delete[] y;
+    delete[] z;
+}
+
+int main(int argc, char **argv ) {
+    /* Creates an artificial CM1 grid that has dimentions
+     * 10km x 10km x 2km (x, y, z) with an isotropic resolution
+     * of 50 meters. */
+    float domain_extent = 10000.;
+    float domain_depth = 2000.;
+    float dx = 50.; float dy = 50.; float dz = 50.;
+    int NX = (int) (domain_extent / dx);
+    int NY = (int) (domain_extent / dy);
+    int NZ = (int) (domain_depth / dz);
+    long N = (NX+2)*(NY+2)*(NZ+1);
+    cout << "NX: " << NX << " NY: " << NY << " NZ: " << NZ << endl;
+    cout << "FIELD STORAGE: " << FIELD_TYPE_NAME << endl;
+
+    iocfg *io = new iocfg();
+    datagrid *grid = allocate_grid_cpu(0, NX-1, 0, NY-1, 0, NZ-1);
+    create_grid(grid, dx, dy, dz);
+    model_data *data = allocate_model_cpu(io, N*CHUNK_TIMES);
+
+    // seed a 100 x 100 plane of parcels. For the vortex this
+    // is a vertical plane through the vortex center, and for
+    // the shear it is a vertical plane along the Y axis, so
+    // that the parcels don't all move the same way.
+    int pNX = 100;
+    int pNZ = 100;
+    int nParcels = pNX*pNZ;
+    parcel_pos *parcels = allocate_parcels_cpu(io, pNX, 1, pNZ, CHUNK_TIMES+1);
+    float *xs = new float[nParcels]; float *ys = new float[nParcels]; float *zs = new float[nParcels];
+    float *xe = new float[nParcels]; float *ye = new float[nParcels]; float *ze = new float[nParcels];
+    double tTot = NCHUNKS*CHUNK_TIMES*HIST_DT;
+
+    // solid body vortex
+    float omega = 0.01;
+    float w0 = 1.0;
+    create_vortex(grid, data, CHUNK_TIMES, omega, w0);
+    for (int pcl = 0; pcl < nParcels; ++pcl) {
+        xs[pcl] = 300. + 40.*(pcl % pNX); ys[pcl] = 0.0; zs[pcl] = 100. + 5.*(pcl / pNX);
+        xe[pcl] = xs[pcl]*cos(omega*tTot);
+        ye[pcl] = xs[pcl]*sin(omega*tTot);
+        ze[pcl] = zs[pcl] + w0*tTot;
+    }
+    run_schemes("Solid body vortex", grid, data, io, parcels, xs, ys, zs, xe, ye, ze);
+
+    // The winds above all land on multiples of 1/4 m/s, which fp16 and
+    // bf16 store exactly, so do the vortex again with a rotation rate
+    // and updraft that get rounded, to see what the 16 bit fields cost.
+    omega = 0.0137;
+    w0 = 1.3;
+    create_vortex(grid, data, CHUNK_TIMES, omega, w0);
+    for (int pcl = 0; pcl < nParcels; ++pcl) {
+        xs[pcl] = 300. + 40.*(pcl % pNX); ys[pcl] = 0.0; zs[pcl] = 100. + 5.*(pcl / pNX);
+        xe[pcl] = xs[pcl]*cos(omega*tTot);
+        ye[pcl] = xs[pcl]*sin(omega*tTot);
+        ze[pcl] = zs[pcl] + w0*tTot;
+    }
+    run_schemes("Solid body vortex, inexact winds", grid, data, io, parcels, xs, ys, zs, xe, ye, ze);
+
+    // unidirectional shear
+    float u0 = 5.0; float v0 = 5.0; float shear = 0.0025;
+    create_shear(grid, data, CHUNK_TIMES, u0, v0, shear);
+    for (int pcl = 0; pcl < nParcels; ++pcl) {
+        xs[pcl] = -4500.; ys[pcl] = -4500. + 20.*(pcl % pNX); zs[pcl] = 100. + 15.*(pcl / pNX);
+        xe[pcl] = xs[pcl] + (u0 + shear*zs[pcl])*tTot;
+        ye[pcl] = ys[pcl] + (v0 + shear*zs[pcl])*tTot;
+        ze[pcl] = zs[pcl];
+    }
+    run_schemes("Unidirectional shear", grid, data, io, parcels, xs, ys, zs, xe, ye, ze);
+
+    // swirling updraft core in calm air. The plane of parcels runs out
+    // from the core center, so the inner ones spin and rise fast while
+    // the outer ones barely move.
+    float omega0 = 0.03; float wcore = 1.5; float R = 1500.;
+    create_updraft_core(grid, data, CHUNK_TIMES, omega0, wcore, R);
+    for (int pcl = 0; pcl < nParcels; ++pcl) {
+        xs[pcl] = 20. + 40.*(pcl % pNX); ys[pcl] = 0.0; zs[pcl] = 100. + 5.*(pcl / pNX);
+        xe[pcl] = xs[pcl]; ye[pcl] = ys[pcl]; ze[pcl] = zs[pcl];
+    }
+    // The trilinear interpolation of this flow is off by a couple of
+    // meters over the run no matter how small the time step is, which
+    // would hide the differences between the schemes. So the reference
+    // here is RK4 with tiny steps through the same gridded winds.
+    io->integrator = INTEG_RK4;
+    io->nsubsteps = REF_SUBSTEPS;
+    integrate_chunks(grid, data, parcels, xe, ye, ze);
+    run_schemes("Updraft core in calm air", grid, data, io, parcels, xs, ys, zs, xe, ye, ze);
+
+    deallocate_model_cpu(io, data);
+    deallocate_grid_cpu(grid);
+}
+
+#endif
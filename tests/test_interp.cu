@@ -1,286 +1,225 @@
-#include "../interp.cu"
+#include <iostream>
 #include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <omp.h>
+#include "../src/include/datastructs.h"
+#include "../src/include/macros.h"
+#include "../src/io/datastructs.cu"
+#include "../src/parcel/interp.cu"
 using namespace std;
 
-
-// This function tests the _nearest_grid_idx method in order 
-// to determine that things are working as intended.
-// It creates a small 30m isotropic grid and calls the GPU code
-// to find the nearest grid point index, and then returns the
-// grid point information for that index. This is a GPU method.
-void _testNearestIndex(float *point, float *nearest_point) {
-	printf("INPUT PARAMATERS\n");
-	printf("%0.6f %0.6f %0.6f\n", point[0], point[1], point[2]);
-	printf("%0.6f %0.6f %0.6f\n\n", nearest_point[0], nearest_point[1], nearest_point[2]);
-
-	int idx[3];
-	float *x_grd, *y_grd, *z_grd;
-	float near_x, near_y, near_z;
-	int pi, pj, pk;
-	int nX = 10;
-	int nY = 10;
-	int nZ = 10;
-
-	// initialize our fake 3D grid with a 30m grid spacing
-	// out 10 grid points in each direction
-	x_grd = new float[nX];
-	for (int i = 0; i < nX; i++) {
-		x_grd[i] = i*30.;
-	}
-
-	y_grd = new float[nY];
-	for(int j = 0; j < nY; j++) {
-		y_grd[j] = j*30.;
-	}
-
-	z_grd = new float[nZ];
-	for (int k = 0; k < nZ; k++) {
-		z_grd[k] = k*30.;
-	}
-
-
-	// get the nearest point index
-	_nearest_grid_idx(point, x_grd, y_grd, z_grd, idx, nX, nY, nZ);
-	// use the index to get the nearest grid point values
-	pi= idx[0];
-	pj = idx[1];
-	pk = idx[2];
-
-	if ((pi == -1) | (pj == -1) | (pk == -1)) {
-		near_x = -999.99;
-		near_y = -999.99;
-		near_z = -999.99;
-	}
-
-	else {
-		near_x = x_grd[pi];
-		near_y = y_grd[pj];
-		near_z = z_grd[pk];
-	}
-
-	nearest_point[0] = near_x;
-	nearest_point[1] = near_y;
-	nearest_point[2] = near_z;
-	// print the output
-	//cout << "X input: " << pt_x << " | Nearest X Point: " << near_x << endl; 
-
+/* Tests for the interpolation routines in interp.cu. These build a small
+ * 30 meter isotropic grid with the same ghost points that lofs_get_grid
+ * sets up, so they only need the CPU side of things. */
+
+// number of grid points in each direction of the test grid
+#define TEST_N 10
+#define TEST_DX 30.0
+
+// Create the 30 meter isotropic test grid
+datagrid* _testGrid() {
+    datagrid *grid = allocate_grid_cpu(0, TEST_N-1, 0, TEST_N-1, 0, TEST_N-1);
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    for (int i = -1; i < NX+1; ++i) {
+        xf(i) = i*TEST_DX;
+        xh(i) = xf(i) + 0.5*TEST_DX;
+    }
+    for (int j = -1; j < NY+1; ++j) {
+        yf(j) = j*TEST_DX;
+        yh(j) = yf(j) + 0.5*TEST_DX;
+    }
+    for (int k = 0; k < NZ+2; ++k) {
+        zf(k) = (k-1)*TEST_DX;
+        zh(k) = zf(k) + 0.5*TEST_DX;
+    }
+    grid->dx = TEST_DX;
+    grid->dy = TEST_DX;
+    grid->dz = TEST_DX;
+    set_grid_lookup(grid);
+    return grid;
 }
 
-// Test whether or not the _calc_weights function works as intended.
-// Creates a small 30m isotropic grid to test the weigting function.
-// _calc_weights calls _nearest_grid_idx. This is a GPU method. 
-void _testCalcWeights(float *point, float *weights_out) {
-
-	float *x_grd, *y_grd, *z_grd;
-	float weights[8];
-    int idx_3D[3];
-	int nX = 10;
-	int nY = 10;
-	int nZ = 10;
-
-	// initialize our fake 3D grid with a 30m grid spacing
-	// out 10 grid points in each direction
-	x_grd = new float[nX];
-	for (int i = 0; i < nX; i++) {
-		x_grd[i] = i*30.;
-	}
-
-	y_grd = new float[nY];
-	for(int j = 0; j < nY; j++) {
-		y_grd[j] = j*30.;
-	}
-
-	z_grd = new float[nZ];
-	for (int k = 0; k < nZ; k++) {
-		z_grd[k] = k*30.;
-	}
-
-
-	// right now we just care about testing it on the unstaggered grid
-	// since we have a regular grid. Probably should test grid staggering
-	// at some point, but nah.
-
-	// get the nearest point index
-	_nearest_grid_idx(point, x_grd, y_grd, z_grd, idx_3D, nX, nY, nZ);
-    _calc_weights(x_grd, y_grd, z_grd, weights, point, idx_3D,  false, false, false, nX, nY, nZ);
-	for (int i = 0; i < 8; i++) {
-		weights_out[i] = weights[i];
-	}
-
-}
-
-void _testTriInterp(float *point, float *interp_val) {
-
-    float *x_grd, *y_grd, *z_grd;
-    int nX = 10;
-    int nY = 10;
-    int nZ = 10;
-    int N = nX*nY*nZ;
-
-    float *data_arr = new float[N];
-
-	// initialize our fake 3D grid with a 30m grid spacing
-	// out 10 grid points in each direction
-	x_grd = new float[nX];
-	for (int i = 0; i < nX; i++) {
-		x_grd[i] = i*30.;
-	}
-
-	y_grd = new float[nY];
-	for(int j = 0; j < nY; j++) {
-		y_grd[j] = j*30.;
-	}
-
-	z_grd = new float[nZ];
-	for (int k = 0; k < nZ; k++) {
-		z_grd[k] = k*30.;
-	}
-
-    //initialize our fake data grid with ones in all dimensions
-    for ( int i = 0; i < nX; ++i) {
-        for (int j = 0; j < nY; ++j) {
-            for (int k = 0; k < nZ; ++k) {
-            data_arr[arrayIndex(i, j, k, nX, nY)] = k;
+// Fill nT time levels of a 4D array with a linear function of the
+// position on the given mesh, which trilinear interpolation should
+// reproduce exactly.
+field_t* _testField(datagrid *grid, bool ugrd, bool vgrd, bool wgrd, int nT) {
+    int NX = grid->NX;
+    int NY = grid->NY;
+    int NZ = grid->NZ;
+    field_t *buf0 = new field_t[(NX+2)*(NY+2)*(NZ+1)*nT];
+    for (int t = 0; t < nT; ++t) {
+        for (int k = 0; k < NZ+1; ++k) {
+            for (int j = -1; j < NY+1; ++j) {
+                for (int i = -1; i < NX+1; ++i) {
+                    float x = xh(i); float y = yh(j); float z = zh(k);
+                    if (ugrd) x = xf(i);
+                    if (vgrd) y = yf(j);
+                    if (wgrd) z = zf(k);
+                    BUF4D(i, j, k, t) = 2.0*x - 0.5*y + z + 100.0*t;
+                }
             }
         }
-    } 
-
-    float result = interp3D(x_grd, y_grd, z_grd, data_arr, point, false, false, false, nX, nY, nZ);
-
-    interp_val[0] = result; 
-
-    return;
-
+    }
+    return buf0;
 }
-//__host__ __device__ float _tri_interp(float* data_arr, int NX, int NY, float* weights, int i, int j, int k) {
 
-
-// The CPU method for testing the GPU method that returns the nearest grid index
+// Test that _nearest_grid_idx returns the
+// cell that contains the requested point
 void testNearestIndex() {
-	float *nearest_point = new float[3];
-	float *point = new float[3];
-
-
-	cout << endl << "TESTING THE NEAREST GRIDPOINT FINDER USING 30 METER ISOTROPIC" << endl;
-	cout << "CASE WHERE DATA IS EXACTLY ON GRID" << endl;
-	point[0] = 30.; point[1] = 30.; point[2] = 30.;
-	nearest_point[0] = -1.; nearest_point[1] = -1.; nearest_point[2] = -1.;
-	_testNearestIndex(point, nearest_point);
-	cout << "OUTPUT" << endl;
-	cout << "X input: " << point[0] << " | Nearest X Point: " << nearest_point[0] << endl;
-	cout << "Y input: " << point[1] << " | Nearest Y Point: " << nearest_point[1] << endl;
-	cout << "Z input: " << point[2] << " | Nearest Z Point: " << nearest_point[2] << endl << endl;
-
-	cout << "CASE WHERE DATA IS NOT ON GRID BUT IN GRID" << endl;
-	point[0] = 121.; point[1] = 65.; point[2] = 252.3337;
-	nearest_point[0] = -1.; nearest_point[1] = -1.; nearest_point[2] = -1.;
-	_testNearestIndex(point, nearest_point);
-	cout << "OUTPUT" << endl;
-	cout << "X input: " << point[0] << " | Nearest X Point: " << nearest_point[0] << endl;
-	cout << "Y input: " << point[1] << " | Nearest Y Point: " << nearest_point[1] << endl;
-	cout << "Z input: " << point[2] << " | Nearest Z Point: " << nearest_point[2] << endl << endl;
-
-	cout << "CASE WHERE DATA IS OUTSIDE OF THE DOMAIN" << endl;
-	point[0] = -100.; point[1] = 10000.; point[2] = 5000.;
-	nearest_point[0] = -1.; nearest_point[1] = -1.; nearest_point[2] = -1.;
-	_testNearestIndex(point, nearest_point);
-	cout << "OUTPUT" << endl;
-	cout << "X input: " << point[0] << " | Nearest X Point: " << nearest_point[0] << endl;
-	cout << "Y input: " << point[1] << " | Nearest Y Point: " << nearest_point[1] << endl;
-	cout << "Z input: " << point[2] << " | Nearest Z Point: " << nearest_point[2] << endl << endl;
-	cout << "END NEAREST GRIDPOINT TEST" << endl << endl << endl << endl;
+    datagrid *grid = _testGrid();
+    float point[3];
+    int idx_4D[4];
+
+    cout << endl << "TESTING THE NEAREST GRIDPOINT FINDER USING 30 METER ISOTROPIC" << endl;
+    cout << "CASE WHERE DATA IS EXACTLY ON GRID" << endl;
+    point[0] = 30.; point[1] = 30.; point[2] = 30.;
+    _nearest_grid_idx(point, grid, idx_4D);
+    cout << "I: " << idx_4D[0] << " J: " << idx_4D[1] << " K: " << idx_4D[2] << " (expected 1 1 2)" << endl << endl;
+
+    cout << "CASE WHERE DATA IS NOT ON GRID BUT IN GRID" << endl;
+    point[0] = 121.; point[1] = 65.; point[2] = 252.3337;
+    _nearest_grid_idx(point, grid, idx_4D);
+    cout << "I: " << idx_4D[0] << " J: " << idx_4D[1] << " K: " << idx_4D[2] << " (expected 4 2 9)" << endl << endl;
+
+    cout << "CASE WHERE DATA IS OUTSIDE OF THE DOMAIN" << endl;
+    point[0] = -100.; point[1] = 10000.; point[2] = 5000.;
+    _nearest_grid_idx(point, grid, idx_4D);
+    cout << "I: " << idx_4D[0] << " J: " << idx_4D[1] << " K: " << idx_4D[2] << " (expected -1 -1 -1)" << endl << endl;
+    cout << "END NEAREST GRIDPOINT TEST" << endl << endl << endl << endl;
+    deallocate_grid_cpu(grid);
 }
 
-// the CPU method for testing the GPU method that returns the trilinear interpolation
-// weights for a regular 3D isotropic grid. 
+// Test the trilinear interpolation weights on the scalar mesh
 void testCalcWeights() {
-	float *point = new float[3];
-	float *weights_out = new float[8];
-
-	// sett all weights to -999.99 to make 
-	// certain they're being copied over from
-	// the GPU
-	for (int i = 0; i < 8; i++) {
-		weights_out[i] = -999.99;
-	}
-
-	// in this case, w1 should equal 1 and the other weights equal 0.
-	cout << endl << "TESTING THE INTERPOLATION WEIGHTS CALCULATOR USING 30 METER ISOTROPIC" << endl;
-	cout << "CASE WHERE DATA IS EXACTLY ON GRID" << endl;
-	point[0] = 30.; point[1] = 30.; point[2] = 30.;
-	_testCalcWeights(point, weights_out);
-	cout << "OUTPUT" << endl;
-	for (int i = 0; i < 8; i++) {
-		cout << "W" << i+1 << "=" << weights_out[i] << " ";
-	}
-	cout << endl << endl;
-
-	// in this case, we should have 8 distinct weights with values < 1
-	cout << "CASE WHERE DATA IS NOT ON GRID BUT IN GRID" << endl;
-	point[0] = 121.; point[1] = 65.; point[2] = 252.3337;
-	_testCalcWeights(point, weights_out);
-	cout << "OUTPUT" << endl;
-	for (int i = 0; i < 8; i++) {
-		cout << "W" << i+1 << "=" << weights_out[i] << " ";
-	}
-	cout << endl << endl;
-
-	// in this case, all weights should return as -1 because 
-	// the requested point was outside of our specified domain
-	cout << "CASE WHERE DATA IS OUTSIDE OF THE DOMAIN" << endl;
-	point[0] = -100.; point[1] = 10000.; point[2] = 5000.;
-	_testCalcWeights(point, weights_out);
-	cout << "OUTPUT" << endl;
-	for (int i = 0; i < 8; i++) {
-		cout << "W" << i+1 << "=" << weights_out[i] << " ";
-	}
-	cout << endl << endl;
-	cout << "END CALC WEIGHTS TEST" << endl << endl << endl << endl;
-
-
-
+    datagrid *grid = _testGrid();
+    float point[3];
+    float weights[8];
+    int idx_4D[4];
+
+    // in this case, w1 should equal 1 and the other weights equal 0.
+    cout << endl << "TESTING THE INTERPOLATION WEIGHTS CALCULATOR USING 30 METER ISOTROPIC" << endl;
+    cout << "CASE WHERE DATA IS EXACTLY ON GRID" << endl;
+    point[0] = 45.; point[1] = 45.; point[2] = 45.;
+    _nearest_grid_idx(point, grid, idx_4D);
+    _calc_weights(grid, weights, point, idx_4D, false, false, false);
+    for (int i = 0; i < 8; i++) cout << "W" << i+1 << "=" << weights[i] << " ";
+    cout << endl << endl;
+
+    // in this case, we should have 8 distinct weights with values < 1
+    cout << "CASE WHERE DATA IS NOT ON GRID BUT IN GRID" << endl;
+    point[0] = 121.; point[1] = 65.; point[2] = 252.3337;
+    _nearest_grid_idx(point, grid, idx_4D);
+    _calc_weights(grid, weights, point, idx_4D, false, false, false);
+    for (int i = 0; i < 8; i++) cout << "W" << i+1 << "=" << weights[i] << " ";
+    cout << endl << endl;
+
+    // in this case, all weights should return as -999 because
+    // the requested point was outside of our specified domain
+    cout << "CASE WHERE DATA IS OUTSIDE OF THE DOMAIN" << endl;
+    point[0] = -100.; point[1] = 10000.; point[2] = 5000.;
+    _nearest_grid_idx(point, grid, idx_4D);
+    _calc_weights(grid, weights, point, idx_4D, false, false, false);
+    for (int i = 0; i < 8; i++) cout << "W" << i+1 << "=" << weights[i] << " ";
+    cout << endl << endl;
+    cout << "END CALC WEIGHTS TEST" << endl << endl << endl << endl;
+    deallocate_grid_cpu(grid);
 }
 
-// the CPU method for testing the GPU method that returns the trilinear interpolation
-// weights for a regular 3D isotropic grid. 
+// Test interp3D on each of the 4 meshes with a linear
+// field, where the interpolation should be exact
 void testTriInterp() {
-	float *point = new float[3];
-	float *interp_val = new float[1];
-
-	// in this case, w1 should equal 1 and the other weights equal 0.
-	cout << endl << "TESTING THE INTERPOLATION CALCULATOR USING 30 METER ISOTROPIC" << endl;
-	cout << "CASE WHERE DATA IS EXACTLY ON GRID" << endl;
-	point[0] = 30.; point[1] = 30.; point[2] = 60.;
-	_testTriInterp(point, interp_val);
-	cout << "OUTPUT" << endl;
-	cout << "INTERP = " << interp_val[0];;
-	cout << endl << endl;
-
-	// in this case, we should have 8 distinct weights with values < 1
-	cout << "CASE WHERE DATA IS NOT ON GRID BUT IN GRID" << endl;
-	point[0] = 121.; point[1] = 65.; point[2] = 252.3337;
-	_testTriInterp(point, interp_val);
-	cout << "OUTPUT" << endl;
-	cout << "INTERP = " << interp_val[0];;
-	cout << endl << endl;
-
-	// in this case, all weights should return as -1 because 
-	// the requested point was outside of our specified domain
-	cout << "CASE WHERE DATA IS OUTSIDE OF THE DOMAIN" << endl;
-	point[0] = -100.; point[1] = 10000.; point[2] = 5000.;
-	_testTriInterp(point, interp_val);
-	cout << "OUTPUT" << endl;
-	cout << "INTERP = " << interp_val[0];;
-	cout << endl << endl;
-	cout << "END CALC WEIGHTS TEST" << endl << endl << endl << endl;
+    datagrid *grid = _testGrid();
+    const char *names[4] = {"U", "V", "W", "SCALAR"};
+    bool ugrd[4] = {true, false, false, false};
+    bool vgrd[4] = {false, true, false, false};
+    bool wgrd[4] = {false, false, true, false};
+    float point[3] = {121., 65., 152.3337};
+    float expected = 2.0*point[0] - 0.5*point[1] + point[2] + 100.0;
+
+    cout << endl << "TESTING THE INTERPOLATION CALCULATOR USING 30 METER ISOTROPIC" << endl;
+    cout << "POINT X " << point[0] << " Y " << point[1] << " Z " << point[2] << " EXPECTED " << expected << endl;
+    for (int s = 0; s < 4; ++s) {
+        field_t *field = _testField(grid, ugrd[s], vgrd[s], wgrd[s], 2);
+        float val = interp3D(grid, field, point, ugrd[s], vgrd[s], wgrd[s], 1);
+        cout << names[s] << " INTERP = " << val;
+        if (fabs(val - expected) < 1.0e-2) cout << " PASS" << endl;
+        else cout << " FAIL" << endl;
+        delete[] field;
+    }
+    cout << "END TRI INTERP TEST" << endl << endl << endl << endl;
+    deallocate_grid_cpu(grid);
+}
 
+// Test that interp3D_batch gives the same answers as calling
+// interp3D one point at a time (to within roundoff), on every mesh,
+// including for points outside of the domain, and compare how long
+// they take.
+void testInterpBatch() {
+    datagrid *grid = _testGrid();
+    const char *names[4] = {"U", "V", "W", "SCALAR"};
+    bool ugrd[4] = {true, false, false, false};
+    bool vgrd[4] = {false, true, false, false};
+    bool wgrd[4] = {false, false, true, false};
+
+    // mostly points inside the domain, with every tenth one
+    // outside of it. The inside points stay half a grid point
+    // away from the edges so every mesh has data around them.
+    int n = 100000;
+    float *xs = new float[n]; float *ys = new float[n]; float *zs = new float[n];
+    float *out = new float[n];
+    float *ref = new float[n];
+    srand(1234);
+    for (int p = 0; p < n; ++p) {
+        xs[p] = 15. + 270. * (rand() / (float) RAND_MAX);
+        ys[p] = 15. + 270. * (rand() / (float) RAND_MAX);
+        zs[p] = 15. + 255. * (rand() / (float) RAND_MAX);
+        if (p % 10 == 0) xs[p] = -50.;
+    }
+
+    cout << endl << "TESTING THE BATCHED INTERPOLATION AGAINST INTERP3D" << endl;
+    for (int s = 0; s < 4; ++s) {
+        field_t *field = _testField(grid, ugrd[s], vgrd[s], wgrd[s], 2);
+
+        double start = omp_get_wtime();
+        interp3D_batch(grid, field, ugrd[s], vgrd[s], wgrd[s], xs, ys, zs, 1, out, n);
+        double tbatch = omp_get_wtime() - start;
+
+        // the single point version complains loudly about
+        // points outside of the domain, so skip those
+        float point[3];
+        start = omp_get_wtime();
+        for (int p = 0; p < n; ++p) {
+            point[0] = xs[p]; point[1] = ys[p]; point[2] = zs[p];
+            ref[p] = -999.0;
+            if (p % 10 != 0) ref[p] = interp3D(grid, field, point, ugrd[s], vgrd[s], wgrd[s], 1);
+        }
+        double tsingle = omp_get_wtime() - start;
 
+        int nDiff = 0;
+        int nMissing = 0;
+        for (int p = 0; p < n; ++p) {
+            if (fabs(ref[p] - out[p]) > 1.0e-6*fabs(ref[p])) nDiff += 1;
+            if (out[p] == -999.0) nMissing += 1;
+        }
+        cout << names[s] << " MISMATCHES: " << nDiff << " MISSING: " << nMissing;
+        cout << " BATCH TIME: " << tbatch << " SINGLE TIME: " << tsingle;
+        if (nDiff == 0) cout << " PASS" << endl;
+        else cout << " FAIL" << endl;
+        delete[] field;
+    }
+    cout << "END BATCH INTERP TEST" << endl << endl << endl << endl;
+    delete[] xs; delete[] ys; delete[] zs; delete[] out; delete[] ref;
+    deallocate_grid_cpu(grid);
 }
 
 int main() {
 
-	testNearestIndex();
-	testCalcWeights();
+    testNearestIndex();
+    testCalcWeights();
     testTriInterp();
-	return 0;
+    testInterpBatch();
+    return 0;
 }